@@ -0,0 +1,202 @@
+/*************************************************************
+ * Schemas and data generator of the benchmarks. Files are   *
+ * created on first use in $FASTPLY_BENCHMARK_DATA (default: *
+ * /tmp/fastply_benchmark) and reused by later runs.         *
+ ************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fastply/fastply_macros.h"
+#include "fastply/fastply_writer.h"
+
+FASTPLY_ELEMENT(Point,
+  float x;
+  float y;
+  float z;
+
+  FASTPLY_GENERATE_OPERATORS(Point, x, y, z)
+)
+
+FASTPLY_ELEMENT(Vertex,
+  float x;
+  float y;
+  float z;
+  float nx;
+  float ny;
+  float nz;
+  uint8_t red;
+  uint8_t green;
+  uint8_t blue;
+
+  FASTPLY_GENERATE_OPERATORS(Vertex, x, y, z, nx, ny, nz, red, green, blue)
+)
+
+FASTPLY_LIST_ELEMENT(Face, uint8_t, int32_t)
+
+namespace bench {
+
+/// Deterministic pseudo random numbers (splitmix64)
+class Random {
+ public:
+  explicit Random(std::uint64_t seed) : state_(seed) {}
+
+  std::uint64_t next() {
+    std::uint64_t z = (state_ += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+  }
+
+  /// Uniform in [0, 1000)
+  float coordinate() { return float(next() >> 40) * (1000.0f / (1 << 24)); }
+
+ private:
+  std::uint64_t state_;
+};
+
+/// xyz points, 12 bytes per record
+struct Points {
+  using Ply = fastply::FastPly<Point>;
+  static const char* name() { return "points"; }
+
+  static void write(const std::string& path, std::size_t n) {
+    fastply::FastPlyWriter<Point> writer;
+    writer.setCount<Point>(n);
+    writer.open(path);
+    Random random(1);
+    for (auto& p : writer.get<Point>()) {
+      p.x = random.coordinate();
+      p.y = random.coordinate();
+      p.z = random.coordinate();
+    }
+    writer.close();
+  }
+};
+
+/// Points with normals and colors, 27 bytes per record (unaligned floats)
+struct Colored {
+  using Ply = fastply::FastPly<Vertex>;
+  static const char* name() { return "colored"; }
+
+  static void write(const std::string& path, std::size_t n) {
+    fastply::FastPlyWriter<Vertex> writer;
+    writer.setCount<Vertex>(n);
+    writer.open(path);
+    Random random(2);
+    for (auto& v : writer.get<Vertex>()) {
+      v.x = random.coordinate();
+      v.y = random.coordinate();
+      v.z = random.coordinate();
+      v.nx = v.ny = 0;
+      v.nz = 1;
+      const std::uint64_t color = random.next();
+      v.red = static_cast<uint8_t>(color);
+      v.green = static_cast<uint8_t>(color >> 8);
+      v.blue = static_cast<uint8_t>(color >> 16);
+    }
+    writer.close();
+  }
+};
+
+/// Colored vertices and twice as many triangles (a list element)
+struct Mesh {
+  using Ply = fastply::FastPly<Vertex, Face>;
+  static const char* name() { return "mesh"; }
+
+  static void write(const std::string& path, std::size_t n) {
+    fastply::FastPlyWriter<Vertex, Face> writer;
+    writer.setCount<Vertex>(n);
+    writer.setCount<Face>(2 * n, 6 * n);
+    writer.open(path);
+    Random random(3);
+    for (auto& v : writer.get<Vertex>()) {
+      v.x = random.coordinate();
+      v.y = random.coordinate();
+      v.z = random.coordinate();
+      v.nx = v.ny = 0;
+      v.nz = 1;
+      v.red = v.green = v.blue = 255;
+    }
+    for (std::size_t f = 0; f < 2 * n; ++f) {
+      const std::int32_t a = static_cast<std::int32_t>(f / 2);
+      const std::int32_t face[3] = {
+          a, static_cast<std::int32_t>((a + 1) % n),
+          static_cast<std::int32_t>(random.next() % n)};
+      writer.get<Face>().append(face, 3);
+    }
+    writer.close();
+  }
+};
+
+inline std::string dataDirectory() {
+  const char* dir = std::getenv("FASTPLY_BENCHMARK_DATA");
+  const std::string path = dir && *dir ? dir : "/tmp/fastply_benchmark";
+  mkdir(path.c_str(), 0755);
+  return path;
+}
+
+/// Flushes a file to disk, so its pages can be dropped from the page cache
+inline void syncFile(const std::string& path) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  fdatasync(fd);
+  ::close(fd);
+}
+
+/**
+ * @brief Drops the cached pages of a file (which must not be mapped), so the
+ * next access reads from disk. Best effort: the kernel may keep pages.
+ */
+inline void dropPageCache(const std::string& path) {
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  ::close(fd);
+}
+
+/// Writes the file of schema S with n records to path, unless it exists
+template <typename S>
+void ensureFile(const std::string& path, std::size_t n) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    const std::string tmp = path + ".tmp";
+    S::write(tmp, n);
+    syncFile(tmp);
+    std::rename(tmp.c_str(), path.c_str());
+  }
+}
+
+/// Path of the file of schema S with n records, generated if missing
+template <typename S>
+std::string dataFile(std::size_t n) {
+  const std::string path = dataDirectory() + "/" + S::name() + "_" +
+                           std::to_string(n) + ".ply";
+  ensureFile<S>(path, n);
+  return path;
+}
+
+/// Paths of count small files (tiles) of schema S with n records each
+template <typename S>
+std::vector<std::string> tileFiles(std::size_t count, std::size_t n) {
+  std::vector<std::string> paths;
+  for (std::size_t t = 0; t < count; ++t) {
+    paths.push_back(dataDirectory() + "/" + S::name() + "_" +
+                    std::to_string(n) + "_tile_" + std::to_string(t) +
+                    ".ply");
+    ensureFile<S>(paths.back(), n);
+  }
+  return paths;
+}
+
+}  // namespace bench
@@ -0,0 +1,223 @@
+/*************************************************************
+ * Benchmarks of the access paths of fastply, see README.md. *
+ * Sizes are given in records of the first element; cold    *
+ * variants drop the file from the page cache (untimed)     *
+ * before every iteration.                                   *
+ ************************************************************/
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "BenchmarkData.h"
+#include "benchmark/benchmark.h"
+#include "fastply/fastply.h"
+
+using namespace bench;
+
+namespace {
+
+/// Random indices in [0, n), the same for all runs
+std::vector<std::size_t> randomIndices(std::size_t n, std::size_t count) {
+  Random random(42);
+  std::vector<std::size_t> indices(count);
+  for (auto& i : indices)
+    i = static_cast<std::size_t>(random.next() % n);
+  return indices;
+}
+
+/**
+ * @brief Opens the file of schema S for a benchmark. In cold mode (second
+ * argument) the file is closed, dropped from the page cache and opened again
+ * by restart(), with the timer paused; otherwise a first pass warms the cache.
+ */
+template <typename S>
+class Fixture {
+ public:
+  explicit Fixture(benchmark::State& state)
+      : state_(state),
+        path_(dataFile<S>(static_cast<std::size_t>(state.range(0)))),
+        cold_(state.range(1) != 0) {
+    if (!ply_.open(path_))
+      state.SkipWithError("Could not open the benchmark file");
+  }
+
+  typename S::Ply& ply() { return ply_; }
+
+  bool cold() const { return cold_; }
+
+  /// Called at the start of every iteration
+  void restart() {
+    if (!cold_)
+      return;
+    state_.PauseTiming();
+    ply_.close();
+    dropPageCache(path_);
+    ply_.open(path_);
+    state_.ResumeTiming();
+  }
+
+ private:
+  benchmark::State& state_;
+  std::string path_;
+  bool cold_;
+  typename S::Ply ply_;
+};
+
+template <typename Container>
+float sumX(const Container& elements) {
+  float sum = 0;
+  for (const auto& e : elements)
+    sum += e.x;
+  return sum;
+}
+
+void sizes(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"records", "cold"});
+  for (std::int64_t cold : {0, 1})
+    for (std::int64_t n : {1 << 10, 1 << 16, 1 << 22})
+      b->Args({n, cold});
+}
+
+}  // namespace
+
+template <typename S>
+void BM_ParseHeader(benchmark::State& state) {
+  std::ifstream is(dataFile<S>(1 << 10), std::ios::binary);
+  const std::string text(std::istreambuf_iterator<char>(is), {});
+  fastply::detail::PlyHeader<2> header;
+  for (auto _ : state) {
+    header.parse(text.data(), text.size());
+    benchmark::DoNotOptimize(header.length);
+  }
+  state.SetBytesProcessed(state.iterations() * header.length);
+}
+BENCHMARK_TEMPLATE(BM_ParseHeader, Points);
+BENCHMARK_TEMPLATE(BM_ParseHeader, Mesh);
+
+template <typename S>
+void BM_OpenClose(benchmark::State& state) {
+  const std::string path =
+      dataFile<S>(static_cast<std::size_t>(state.range(0)));
+  typename S::Ply ply;
+  for (auto _ : state) {
+    if (!ply.open(path))
+      state.SkipWithError("Could not open the benchmark file");
+    ply.close();
+  }
+}
+BENCHMARK_TEMPLATE(BM_OpenClose, Colored)
+    ->ArgName("records")
+    ->Arg(1 << 10)
+    ->Arg(1 << 22);
+BENCHMARK_TEMPLATE(BM_OpenClose, Mesh)->ArgName("records")->Arg(1 << 16);
+
+// Opens many small files in turn, e.g. the tiles of a streamed scene
+template <typename S>
+void BM_OpenCloseTiles(benchmark::State& state) {
+  const std::vector<std::string> paths =
+      tileFiles<S>(static_cast<std::size_t>(state.range(0)), 64);
+  typename S::Ply ply;
+  std::size_t t = 0;
+  for (auto _ : state) {
+    if (!ply.open(paths[t]))
+      state.SkipWithError("Could not open the benchmark file");
+    ply.close();
+    t = t + 1 == paths.size() ? 0 : t + 1;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_OpenCloseTiles, Mesh)->ArgName("tiles")->Arg(1000);
+
+template <typename S>
+void BM_Iterate(benchmark::State& state) {
+  Fixture<S> fixture(state);
+  const auto& elements = fixture.ply().template get<0>();
+  if (!fixture.cold())
+    benchmark::DoNotOptimize(sumX(elements));
+  for (auto _ : state) {
+    fixture.restart();
+    benchmark::DoNotOptimize(sumX(fixture.ply().template get<0>()));
+  }
+  state.SetItemsProcessed(state.iterations() * elements.size());
+  state.SetBytesProcessed(state.iterations() * elements.size() *
+                          sizeof(*elements.data()));
+}
+BENCHMARK_TEMPLATE(BM_Iterate, Points)->Apply(sizes);
+BENCHMARK_TEMPLATE(BM_Iterate, Colored)->Apply(sizes);
+
+/// operator[] in a counted loop, to compare with at() (bounds checked)
+void BM_IndexOperator(benchmark::State& state) {
+  Fixture<Colored> fixture(state);
+  for (auto _ : state) {
+    fixture.restart();
+    const auto& vertices = fixture.ply().get<Vertex>();
+    float sum = 0;
+    for (std::size_t i = 0; i < vertices.size(); ++i)
+      sum += vertices[i].x;
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_IndexOperator)->Args({1 << 22, 0});
+
+void BM_At(benchmark::State& state) {
+  Fixture<Colored> fixture(state);
+  for (auto _ : state) {
+    fixture.restart();
+    const auto& vertices = fixture.ply().get<Vertex>();
+    float sum = 0;
+    for (std::size_t i = 0; i < vertices.size(); ++i)
+      sum += vertices.at(i).x;
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_At)->Args({1 << 22, 0});
+
+/// 65536 reads at random indices per iteration
+template <typename S>
+void BM_RandomAccess(benchmark::State& state) {
+  Fixture<S> fixture(state);
+  const auto indices =
+      randomIndices(static_cast<std::size_t>(state.range(0)), 1 << 16);
+  if (!fixture.cold())
+    benchmark::DoNotOptimize(sumX(fixture.ply().template get<0>()));
+  for (auto _ : state) {
+    fixture.restart();
+    const auto& elements = fixture.ply().template get<0>();
+    float sum = 0;
+    for (const std::size_t i : indices)
+      sum += elements[i].x;
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * indices.size());
+}
+BENCHMARK_TEMPLATE(BM_RandomAccess, Colored)->Apply(sizes);
+
+/// Vertices and faces of one file, faces through the list container
+void BM_MultiElement(benchmark::State& state) {
+  Fixture<Mesh> fixture(state);
+  std::size_t bytes = 0;
+  for (auto _ : state) {
+    fixture.restart();
+    const auto& vertices = fixture.ply().get<Vertex>();
+    const auto& faces = fixture.ply().get<Face>();
+    float sum = sumX(vertices);
+    std::int64_t indices = 0;
+    for (const auto& face : faces)
+      for (const std::int32_t v : face)
+        indices += v;
+    benchmark::DoNotOptimize(sum);
+    benchmark::DoNotOptimize(indices);
+    bytes = vertices.size() * sizeof(Vertex) +
+            faces.size() * (1 + 3 * sizeof(std::int32_t));
+  }
+  state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_MultiElement)
+    ->ArgNames({"records", "cold"})
+    ->Args({1 << 16, 0})
+    ->Args({1 << 20, 0})
+    ->Args({1 << 20, 1});
@@ -0,0 +1,285 @@
+# Writes the header of fastply_generate_schema() (see FastplySchema.cmake):
+#   cmake -DINPUT=<ply or json> -DOUTPUT=<header> -DNAMESPACE=<namespace>
+#         -DALIAS=<name> -P FastplyGenerateSchema.cmake
+cmake_minimum_required(VERSION 3.8)
+
+# Canonical PLY name, C++ type and size of a PLY type name
+function(_fastply_type type out_name out_ctype out_size)
+  string(TOLOWER "${type}" type)
+  if(type STREQUAL "char" OR type STREQUAL "int8")
+    set(result char std::int8_t 1)
+  elseif(type STREQUAL "uchar" OR type STREQUAL "uint8")
+    set(result uchar std::uint8_t 1)
+  elseif(type STREQUAL "short" OR type STREQUAL "int16")
+    set(result short std::int16_t 2)
+  elseif(type STREQUAL "ushort" OR type STREQUAL "uint16")
+    set(result ushort std::uint16_t 2)
+  elseif(type STREQUAL "int" OR type STREQUAL "int32")
+    set(result int std::int32_t 4)
+  elseif(type STREQUAL "uint" OR type STREQUAL "uint32")
+    set(result uint std::uint32_t 4)
+  elseif(type STREQUAL "float" OR type STREQUAL "float32")
+    set(result float float 4)
+  elseif(type STREQUAL "double" OR type STREQUAL "float64")
+    set(result double double 8)
+  else()
+    message(FATAL_ERROR "${INPUT}: unknown property type '${type}'")
+  endif()
+  list(GET result 0 name)
+  list(GET result 1 ctype)
+  list(GET result 2 size)
+  set(${out_name} ${name} PARENT_SCOPE)
+  set(${out_ctype} ${ctype} PARENT_SCOPE)
+  set(${out_size} ${size} PARENT_SCOPE)
+endfunction()
+
+# Elements are collected in _elements, the properties of element i in
+# _properties_<i> as "<type>|<name>" or "list|<count type>|<type>|<name>"
+macro(_fastply_add_element name)
+  list(LENGTH _elements _index)
+  list(APPEND _elements "${name}")
+  set(_properties_${_index} "")
+endmacro()
+
+macro(_fastply_add_property definition)
+  list(LENGTH _elements _count)
+  if(_count EQUAL 0)
+    message(FATAL_ERROR "${INPUT}: property declared before any element")
+  endif()
+  math(EXPR _index "${_count} - 1")
+  list(APPEND _properties_${_index} "${definition}")
+endmacro()
+
+function(_fastply_read_ply)
+  file(STRINGS "${INPUT}" lines LENGTH_MINIMUM 1 LIMIT_INPUT 1048576)
+  set(_elements "")
+  foreach(line IN LISTS lines)
+    string(STRIP "${line}" line)
+    string(REGEX REPLACE "[ \t]+" ";" tokens "${line}")
+    list(LENGTH tokens num_tokens)
+    if(num_tokens EQUAL 0)
+      continue()
+    endif()
+    list(GET tokens 0 keyword)
+    string(TOLOWER "${keyword}" keyword)
+    if(keyword STREQUAL "end_header")
+      set(_found_end TRUE)
+      break()
+    elseif(keyword STREQUAL "element" AND num_tokens GREATER 1)
+      list(GET tokens 1 name)
+      _fastply_add_element("${name}")
+    elseif(keyword STREQUAL "property" AND num_tokens GREATER 2)
+      list(REMOVE_AT tokens 0)
+      string(REPLACE ";" "|" definition "${tokens}")
+      _fastply_add_property("${definition}")
+    endif()
+  endforeach()
+  if(NOT _found_end)
+    message(FATAL_ERROR "${INPUT}: PLY header is not terminated by end_header")
+  endif()
+  set(_elements "${_elements}" PARENT_SCOPE)
+  list(LENGTH _elements count)
+  if(count GREATER 0)
+    math(EXPR last "${count} - 1")
+    foreach(i RANGE ${last})
+      set(_properties_${i} "${_properties_${i}}" PARENT_SCOPE)
+    endforeach()
+  endif()
+endfunction()
+
+function(_fastply_read_json)
+  if(CMAKE_VERSION VERSION_LESS 3.19)
+    message(FATAL_ERROR "Generating schemas from JSON needs CMake 3.19")
+  endif()
+  file(READ "${INPUT}" json)
+
+  # Members are not returned in the order of the file, hence the elements
+  # are sorted by the position of their key
+  string(JSON count LENGTH "${json}")
+  set(keys "")
+  math(EXPR last "${count} - 1")
+  foreach(i RANGE ${last})
+    string(JSON key MEMBER "${json}" ${i})
+    string(LENGTH "\"${key}\"" key_length)
+    set(tail "${json}")
+    set(position 0)
+    while(TRUE)
+      string(FIND "${tail}" "\"${key}\"" found)
+      if(found EQUAL -1)
+        message(FATAL_ERROR "${INPUT}: element '${key}' not found")
+      endif()
+      math(EXPR next "${found} + ${key_length}")
+      string(SUBSTRING "${tail}" ${next} -1 tail)
+      math(EXPR position "${position} + ${next}")
+      if(tail MATCHES "^[ \t\r\n]*:")
+        break()
+      endif()
+    endwhile()
+    string(LENGTH "0000000000${position}" digits)
+    math(EXPR digits "${digits} - 10")
+    string(SUBSTRING "0000000000${position}" ${digits} 10 position)
+    list(APPEND keys "${position}|${key}")
+  endforeach()
+  list(SORT keys)
+
+  set(_elements "")
+  foreach(entry IN LISTS keys)
+    string(REGEX REPLACE "^[0-9]+\\|" "" name "${entry}")
+    _fastply_add_element("${name}")
+    string(JSON num_properties LENGTH "${json}" "${name}" properties)
+    if(num_properties EQUAL 0)
+      continue()
+    endif()
+    math(EXPR last "${num_properties} - 1")
+    foreach(j RANGE ${last})
+      string(JSON first GET "${json}" "${name}" properties ${j} 0)
+      if(first STREQUAL "list")
+        string(JSON count_type GET "${json}" "${name}" properties ${j} 1)
+        string(JSON type GET "${json}" "${name}" properties ${j} 2)
+        string(JSON property GET "${json}" "${name}" properties ${j} 3)
+        _fastply_add_property("list|${count_type}|${type}|${property}")
+      else()
+        string(JSON property GET "${json}" "${name}" properties ${j} 1)
+        _fastply_add_property("${first}|${property}")
+      endif()
+    endforeach()
+  endforeach()
+  set(_elements "${_elements}" PARENT_SCOPE)
+  list(LENGTH _elements count)
+  math(EXPR last "${count} - 1")
+  foreach(i RANGE ${last})
+    set(_properties_${i} "${_properties_${i}}" PARENT_SCOPE)
+  endforeach()
+endfunction()
+
+foreach(var INPUT OUTPUT NAMESPACE ALIAS)
+  if(NOT ${var})
+    message(FATAL_ERROR "${var} is not set")
+  endif()
+endforeach()
+
+if(INPUT MATCHES "\\.[jJ][sS][oO][nN]$")
+  _fastply_read_json()
+else()
+  _fastply_read_ply()
+endif()
+list(LENGTH _elements num_elements)
+if(num_elements EQUAL 0)
+  message(FATAL_ERROR "${INPUT}: no elements declared")
+endif()
+
+get_filename_component(input_name "${INPUT}" NAME)
+set(elements_code "")
+set(asserts_code "")
+set(schema_code "")
+set(types "")
+set(qualified_types "")
+math(EXPR last "${num_elements} - 1")
+foreach(i RANGE ${last})
+  list(GET _elements ${i} element)
+  string(SUBSTRING "${element}" 0 1 first)
+  string(SUBSTRING "${element}" 1 -1 rest)
+  string(TOUPPER "${first}" first)
+  string(MAKE_C_IDENTIFIER "${first}${rest}" type)
+  list(APPEND types ${type})
+  list(APPEND qualified_types ${NAMESPACE}::${type})
+  string(APPEND schema_code "\n    \"element ${element}\\n\"")
+
+  set(members "")
+  set(names "")
+  set(size 0)
+  set(lists 0)
+  foreach(definition IN LISTS _properties_${i})
+    string(REPLACE "|" ";" tokens "${definition}")
+    list(GET tokens 0 first)
+    string(TOLOWER "${first}" first)
+    if(first STREQUAL "list")
+      list(GET tokens 1 count_type)
+      list(GET tokens 2 value_type)
+      list(GET tokens 3 name)
+      _fastply_type("${count_type}" count_name count_ctype count_size)
+      _fastply_type("${value_type}" value_name value_ctype value_size)
+      string(APPEND schema_code
+             "\n    \"property list ${count_name} ${value_name} ${name}\\n\"")
+      math(EXPR lists "${lists} + 1")
+    else()
+      list(GET tokens 1 name)
+      _fastply_type("${first}" type_name ctype type_size)
+      string(APPEND schema_code "\n    \"property ${type_name} ${name}\\n\"")
+      string(MAKE_C_IDENTIFIER "${name}" member)
+      string(APPEND members "  const ${ctype} ${member};\n")
+      list(APPEND names ${member})
+      math(EXPR size "${size} + ${type_size}")
+    endif()
+  endforeach()
+
+  list(LENGTH _properties_${i} num_properties)
+  if(num_properties EQUAL 0)
+    message(FATAL_ERROR "${INPUT}: element '${element}' has no properties")
+  elseif(lists GREATER 0)
+    if(NOT num_properties EQUAL 1)
+      message(FATAL_ERROR "${INPUT}: element '${element}' mixes lists and "
+                          "other properties, which is not supported")
+    endif()
+    string(APPEND elements_code
+           "FASTPLY_LIST_ELEMENT(${type}, ${count_ctype}, ${value_ctype})\n\n")
+  else()
+    # Wrap the member list of FASTPLY_GENERATE_OPERATORS at 80 columns
+    set(operators "  FASTPLY_GENERATE_OPERATORS(${type}")
+    set(line "${operators}")
+    set(operators "")
+    foreach(member IN LISTS names)
+      string(LENGTH "${line}, ${member})" length)
+      if(length GREATER 80)
+        string(APPEND operators "${line},\n")
+        set(line "      ${member}")
+      else()
+        set(line "${line}, ${member}")
+      endif()
+    endforeach()
+    string(APPEND operators "${line})")
+    string(APPEND elements_code
+           "FASTPLY_ELEMENT(${type},\n${members}\n${operators}\n)\n\n")
+    string(APPEND asserts_code
+           "static_assert(sizeof(${type}) == ${size}, \"${type} is not packed\");\n"
+           "static_assert(fastply::ElementLayout<${type}>::isComplete(),\n"
+           "              \"${type} does not match its properties\");\n")
+  endif()
+endforeach()
+string(REPLACE ";" ", " types "${types}")
+string(REPLACE ";" ",\n                         " qualified_types
+       "${qualified_types}")
+
+file(WRITE "${OUTPUT}.tmp"
+"// Generated by fastply_generate_schema() from ${input_name}, do not edit.
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+#include \"fastply/fastply.h\"
+#include \"fastply/fastply_macros.h\"
+
+namespace ${NAMESPACE} {
+
+${elements_code}${asserts_code}
+/// Reads files with the schema of ${input_name}
+using ${ALIAS} = fastply::FastPly<${types}>;
+
+/// Fingerprint of the schema (see fastply::detail::schemaFingerprint())
+constexpr std::uint64_t kFingerprint = fastply::detail::schemaFingerprint(${schema_code});
+
+}  // namespace ${NAMESPACE}
+
+namespace fastply {
+
+template <>
+struct SchemaFingerprint<${qualified_types}>
+    : std::integral_constant<std::uint64_t, ${NAMESPACE}::kFingerprint> {};
+
+}  // namespace fastply
+")
+# Unchanged headers are not touched, so their dependents are not rebuilt
+execute_process(COMMAND "${CMAKE_COMMAND}" -E copy_if_different
+                        "${OUTPUT}.tmp" "${OUTPUT}")
+file(REMOVE "${OUTPUT}.tmp")
@@ -0,0 +1,52 @@
+# fastply_generate_schema(<target> <input>
+#                         [NAMESPACE <namespace>] [ALIAS <name>]
+#                         [OUTPUT <header>])
+#
+# Generates a header from the header of a sample PLY file or a JSON
+# description of its elements (as in example/header_*.json, needs CMake 3.19)
+# at build time and adds it to <target>. In <namespace> (default: the base
+# name of <input>), the header defines
+#   - a FASTPLY_ELEMENT (or FASTPLY_LIST_ELEMENT) per element, named after
+#     the element with a capital first letter,
+#   - static_asserts checking their size and layout,
+#   - <ALIAS> (default: Ply), the FastPly<...> reading all elements,
+#   - kFingerprint, the constexpr fingerprint of the schema.
+# fastply::SchemaFingerprint is specialized for the elements, so files with
+# the same schema are opened without matching each element at runtime.
+#
+# The header is written to <OUTPUT> (default:
+# ${CMAKE_CURRENT_BINARY_DIR}/fastply_schema/<base name>.h), whose directory
+# is added to the include directories of <target>.
+
+set(FASTPLY_SCHEMA_GENERATOR "${CMAKE_CURRENT_LIST_DIR}/FastplyGenerateSchema.cmake"
+    CACHE INTERNAL "Script generating fastply schema headers")
+
+function(fastply_generate_schema target input)
+  cmake_parse_arguments(ARG "" "NAMESPACE;ALIAS;OUTPUT" "" ${ARGN})
+  get_filename_component(input "${input}" ABSOLUTE)
+  get_filename_component(base "${input}" NAME_WE)
+  string(MAKE_C_IDENTIFIER "${base}" base)
+  if(NOT ARG_NAMESPACE)
+    set(ARG_NAMESPACE ${base})
+  endif()
+  if(NOT ARG_ALIAS)
+    set(ARG_ALIAS Ply)
+  endif()
+  if(NOT ARG_OUTPUT)
+    set(ARG_OUTPUT "${CMAKE_CURRENT_BINARY_DIR}/fastply_schema/${base}.h")
+  endif()
+  get_filename_component(output "${ARG_OUTPUT}" ABSOLUTE
+                         BASE_DIR "${CMAKE_CURRENT_BINARY_DIR}")
+  get_filename_component(output_dir "${output}" DIRECTORY)
+
+  add_custom_command(OUTPUT "${output}"
+    COMMAND "${CMAKE_COMMAND}"
+            "-DINPUT=${input}" "-DOUTPUT=${output}"
+            "-DNAMESPACE=${ARG_NAMESPACE}" "-DALIAS=${ARG_ALIAS}"
+            -P "${FASTPLY_SCHEMA_GENERATOR}"
+    DEPENDS "${input}" "${FASTPLY_SCHEMA_GENERATOR}"
+    COMMENT "Generating fastply schema ${ARG_NAMESPACE}"
+    VERBATIM)
+  target_sources(${target} PRIVATE "${output}")
+  target_include_directories(${target} PRIVATE "${output_dir}")
+endfunction()
@@ -6,8 +6,6 @@ import argparse
 from collections import OrderedDict
 import json
 
-BIG_ENDIAN=False
-
 # Maps the ply-supported string type identifies
 # to the special characters used by struct and the equivalent C name
 # (although the later could be system dependent)
@@ -22,7 +20,7 @@ STR2TYPEC = {
     # "uint": ("I", "unsigned int"),
     # "float": ("f", "float"),
     # "double": ("d", "double"),
-    "char": ("c", "int8_t"),
+    "char": ("b", "int8_t"),
     "uchar": ("B", "uint8_t"),
     "short": ("h", "int16_t"),
     "ushort": ("H", "uint16_t"),
@@ -32,9 +30,10 @@ STR2TYPEC = {
     "double": ("d", "double"),
 }
 
-def generate_header(elements):
+def generate_header(elements, big_endian=False, ascii=False):
+    encoding = "ascii" if ascii else ("binary_big_endian" if big_endian else "binary_little_endian")
     header = ["ply",
-    "format " + ("binary_big_endian 1.0" if BIG_ENDIAN else "binary_little_endian 1.0"),
+    "format " + encoding + " 1.0",
     ]
 
     for name, spec in elements.items():
@@ -44,17 +43,42 @@ def generate_header(elements):
     header += ["end_header\n"]
     return "\n".join(header)
 
+def ascii_value(type_name, value):
+    return repr(float(value)) if type_name in ("float", "double") else str(value)
+
+def write_ply_ascii(path, elements):
+    count = 0
+    with open(path + ".ply", "w") as f:
+        f.write(generate_header(elements, ascii=True))
+        for name, el in elements.items():
+            for i in range(el["n"]):
+                values = []
+                for p in el["properties"]:
+                    if p[0] == "list":
+                        n = p[-1][i % len(p[-1])] if isinstance(p[-1], list) else p[-1]
+                        values.append(str(n))
+                        for j in range(n):
+                            values.append(ascii_value(p[2], count%128))
+                            count += 1
+                    else:
+                        values.append(ascii_value(p[0], count%128))
+                        count += 1
+                f.write(" ".join(values) + "\n")
+
 def write_ply(path, elements, big_endian=False):
     count = 0
     encoding = '>' if big_endian else '<'
     with open(path + ".ply", "wb") as f:
-        f.write(generate_header(elements).encode('ascii'))
+        f.write(generate_header(elements, big_endian).encode('ascii'))
         for name, el in elements.items():
             for i in range(el["n"]):
                 for p in el["properties"]:
                     if p[0] == "list":
-                        f.write(struct.pack(encoding + STR2TYPEC[p[1]][0], p[-1]))
-                        for j in range(p[-1]):
+                        # A list of lengths is cycled through to produce
+                        # variable-length lists (e.g. mixed triangles/quads)
+                        n = p[-1][i % len(p[-1])] if isinstance(p[-1], list) else p[-1]
+                        f.write(struct.pack(encoding + STR2TYPEC[p[1]][0], n))
+                        for j in range(n):
                             f.write(struct.pack(encoding + STR2TYPEC[p[2]][0], count%128))
                             count += 1
                     else:
@@ -108,6 +132,7 @@ def main():
     parser.add_argument('--code', '-c', dest='gen_code', action='store_true', help="Generate struct definitions for usage in C++")
     parser.add_argument('--verbose', '-v', dest='verbose', action='store_true', help="Additional outputs")
     parser.add_argument('--big_endian', dest='big_endian', action='store_true', help="Encode big endian instead of little endian")
+    parser.add_argument('--ascii', dest='ascii', action='store_true', help="Encode as ASCII instead of binary")
     args = parser.parse_args()
 
     with open(args.header) as f:
@@ -116,11 +141,14 @@ def main():
     if args.verbose:
         print("Generated header:")
         print(">>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>")
-        print(generate_header(elements))
+        print(generate_header(elements, args.big_endian, args.ascii))
         print("<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<")
 
     if args.gen_ply:
-        ply = write_ply(args.out, elements, args.big_endian)
+        if args.ascii:
+            write_ply_ascii(args.out, elements)
+        else:
+            write_ply(args.out, elements, args.big_endian)
 
     if args.gen_code:
         code = write_code(args.out, elements)
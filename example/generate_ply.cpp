@@ -1,10 +1,15 @@
 #include <cstdint>
 #include <cstdlib>
-#include <fstream>
+#include <functional>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <vector>
 
-struct __attribute__((packed)) VertexLayout {
+#include "fastply/fastply_macros.h"
+#include "fastply/fastply_writer.h"
+
+FASTPLY_ELEMENT(Vertex,
   float x;
   float y;
   float z;
@@ -14,31 +19,17 @@ struct __attribute__((packed)) VertexLayout {
   uint8_t red;
   uint8_t green;
   uint8_t blue;
-};
 
-void writeHeader(char* path, int nvert) {
-  std::ofstream out(path);
-  out << "ply" << std::endl;
-  out << "format binary_little_endian 1.0" << std::endl;
-  out << "element vertex " + std::to_string(nvert) << std::endl;
-  out << "property float x" << std::endl;
-  out << "property float y" << std::endl;
-  out << "property float z" << std::endl;
-  out << "property float nx" << std::endl;
-  out << "property float ny" << std::endl;
-  out << "property float nz" << std::endl;
-  out << "property uchar red" << std::endl;
-  out << "property uchar green" << std::endl;
-  out << "property uchar blue" << std::endl;
-  out << "end_header" << std::endl;
-  out.close();
-}
+  FASTPLY_GENERATE_OPERATORS(Vertex, x, y, z, nx, ny, nz, red, green, blue)
+)
 
-void writeData(char* path, int nvert) {
-  VertexLayout vert;
-  uint64_t count = 0;
-  std::ofstream ofs(path, std::ios::binary | std::ios::app);
-  for (int i = 0; i < nvert; ++i) {
+// Every thread fills its own range of the mapped file
+void writeData(fastply::PlyWritableElementContainer<Vertex>& vertices,
+               std::size_t first,
+               std::size_t last) {
+  for (std::size_t i = first; i < last; ++i) {
+    uint64_t count = i * 9;
+    Vertex& vert = vertices[i];
     vert.x = float(count++ % 128);
     vert.y = float(count++ % 128);
     vert.z = float(count++ % 128);
@@ -46,13 +37,8 @@ void writeData(char* path, int nvert) {
     vert.ny = float(count++ % 128);
     vert.nz = float(count++ % 128);
     vert.red = static_cast<uint8_t>(count++ % 128);
-    vert.green = (count++ % 128);
-    vert.blue = (count++ % 128);
-
-    ofs.write((char*)&vert, sizeof(VertexLayout));
-
-    if (i % 10000000 == 0)
-      std::cout << i << "/" << nvert << std::endl;
+    vert.green = static_cast<uint8_t>(count++ % 128);
+    vert.blue = static_cast<uint8_t>(count++ % 128);
   }
 }
 
@@ -60,12 +46,24 @@ int main(int argc, char** argv) {
   if (argc != 3)
     return 0;
 
-  int nvert = int(std::atof(argv[2]) * 1073741824 / sizeof(VertexLayout));
+  std::size_t nvert =
+      std::size_t(std::atof(argv[2]) * 1073741824 / sizeof(Vertex));
 
   std::cout << "Generating " << nvert << " vertices" << std::endl;
 
-  writeHeader(argv[1], nvert);
-  writeData(argv[1], nvert);
+  fastply::FastPlyWriter<Vertex> writer;
+  writer.setCount<Vertex>(nvert);
+  writer.open(argv[1]);
+
+  auto& vertices = writer.get<Vertex>();
+  const std::size_t threads = fastply::defaultConcurrency();
+  std::vector<std::thread> workers;
+  for (std::size_t t = 0; t < threads; ++t)
+    workers.emplace_back(writeData, std::ref(vertices), nvert * t / threads,
+                         nvert * (t + 1) / threads);
+  for (auto& worker : workers)
+    worker.join();
 
+  writer.close();
   return 0;
 }
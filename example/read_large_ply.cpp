@@ -14,6 +14,7 @@
 #include <string>
 
 #include <fastply.h>
+#include <fastply_algorithm.h>
 
 struct __attribute__((packed)) Vertex {
   float x;
@@ -37,8 +38,12 @@ int main(int argc, char** argv) {
   if (argc != 2)
     return 0;
 
+  // Random queries: disable readahead of pages which are never touched
+  fastply::OpenOptions options;
+  options.access = fastply::AccessPattern::Random;
+
   fastply::FastPly<Vertex> fp;
-  fp.open(std::string(argv[1]));
+  fp.open(std::string(argv[1]), options);
 
   auto& vertices = fp.get<Vertex>();
   std::cout << ":: Opening PLY with " << vertices.size() << " vertices!"
@@ -51,40 +56,41 @@ int main(int argc, char** argv) {
   std::random_device rd;
   std::mt19937_64 gen(rd());
   std::uniform_int_distribution<unsigned int> dist{
-      0, static_cast<unsigned int>(vertices.size())};
+      0, static_cast<unsigned int>(vertices.size() - 1)};
   auto generator = [&dist, &gen]() { return dist(gen); };
   std::generate(std::begin(rnd_indices), std::end(rnd_indices), generator);
 
   std::cout << "    :: Reading ..." << std::endl;
   auto start = std::chrono::high_resolution_clock::now();
   for (std::size_t ridx = 0; ridx < rnd_indices.size(); ridx++) {
-    if (vertices.at(ridx).x != (ridx * 9) % 128) {
-      std::cout << "ERR " << (ridx * 9) % 128 << " != " << vertices.at(ridx).x
+    const std::size_t idx = rnd_indices[ridx];
+    if (vertices.at(idx).x != (idx * 9) % 128) {
+      std::cout << "ERR " << (idx * 9) % 128 << " != " << vertices.at(idx).x
                 << std::endl;
-    } else if (vertices.at(ridx).y != (ridx * 9 + 1) % 128) {
-      std::cout << "ERR " << (ridx * 9) % 128 << " != " << vertices.at(ridx).y
+    } else if (vertices.at(idx).y != (idx * 9 + 1) % 128) {
+      std::cout << "ERR " << (idx * 9) % 128 << " != " << vertices.at(idx).y
                 << std::endl;
-    } else if (vertices.at(ridx).z != (ridx * 9 + 2) % 128) {
-      std::cout << "ERR " << (ridx * 9) % 128 << " != " << vertices.at(ridx).z
+    } else if (vertices.at(idx).z != (idx * 9 + 2) % 128) {
+      std::cout << "ERR " << (idx * 9) % 128 << " != " << vertices.at(idx).z
                 << std::endl;
-    } else if (vertices.at(ridx).nx != (ridx * 9 + 3) % 128) {
-      std::cout << "ERR " << (ridx * 9) % 128 << " != " << vertices.at(ridx).nx
+    } else if (vertices.at(idx).nx != (idx * 9 + 3) % 128) {
+      std::cout << "ERR " << (idx * 9) % 128 << " != " << vertices.at(idx).nx
                 << std::endl;
-    } else if (vertices.at(ridx).ny != (ridx * 9 + 4) % 128) {
-      std::cout << "ERR " << (ridx * 9) % 128 << " != " << vertices.at(ridx).ny
+    } else if (vertices.at(idx).ny != (idx * 9 + 4) % 128) {
+      std::cout << "ERR " << (idx * 9) % 128 << " != " << vertices.at(idx).ny
                 << std::endl;
-    } else if (vertices.at(ridx).nz != (ridx * 9 + 5) % 128) {
-      std::cout << "ERR " << (ridx * 9) % 128 << " != " << vertices.at(ridx).nz
+    } else if (vertices.at(idx).nz != (idx * 9 + 5) % 128) {
+      std::cout << "ERR " << (idx * 9) % 128 << " != " << vertices.at(idx).nz
                 << std::endl;
-    } else if (vertices.at(ridx).red != (ridx * 9 + 6) % 128) {
-      std::cout << "ERR " << (ridx * 9) % 128 << " != " << vertices.at(ridx).red
+    } else if (vertices.at(idx).red != (idx * 9 + 6) % 128) {
+      std::cout << "ERR " << (idx * 9) % 128 << " != " << vertices.at(idx).red
                 << std::endl;
-    } else if (vertices.at(ridx).green != (ridx * 9 + 7) % 128) {
-      std::cout << "ERR " << (ridx * 9) % 128
-                << " != " << vertices.at(ridx).green << std::endl;
-    } else if (vertices.at(ridx).blue != (ridx * 9 + 8) % 128) {
-      std::cout << "ERR " << (ridx * 9) % 128
-                << " != " << vertices.at(ridx).blue << std::endl;
+    } else if (vertices.at(idx).green != (idx * 9 + 7) % 128) {
+      std::cout << "ERR " << (idx * 9) % 128
+                << " != " << vertices.at(idx).green << std::endl;
+    } else if (vertices.at(idx).blue != (idx * 9 + 8) % 128) {
+      std::cout << "ERR " << (idx * 9) % 128
+                << " != " << vertices.at(idx).blue << std::endl;
     }
   }
   auto end = std::chrono::high_resolution_clock::now();
@@ -92,7 +98,17 @@ int main(int argc, char** argv) {
       std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
   std::cout << "    :: Done in " << elapsed.count() << "ms" << std::endl;
 
+  std::cout << ":: Batched Random Read Test (gather)" << std::endl;
+  std::vector<unsigned char> gathered(rnd_indices.size() * sizeof(Vertex));
+  start = std::chrono::high_resolution_clock::now();
+  vertices.gather(rnd_indices.data(), rnd_indices.size(),
+                  reinterpret_cast<Vertex*>(&gathered[0]));
+  end = std::chrono::high_resolution_clock::now();
+  elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+  std::cout << "    :: Done in " << elapsed.count() << "ms" << std::endl;
+
   std::cout << ":: Count all matching vertices (std::count)" << std::endl;
+  fp.advise(fastply::AccessPattern::Sequential);
   Vertex target1{0, 1, 2, 3, 4, 5, 6, 7, 8};
   start = std::chrono::high_resolution_clock::now();
   int num_items1 = std::count(vertices.begin(), vertices.end(), target1);
@@ -100,5 +116,16 @@ int main(int argc, char** argv) {
   elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
   std::cout << "    :: Done in " << elapsed.count() << "ms" << std::endl;
 
+  std::cout << ":: Count all matching vertices (parallel_count_if)"
+            << std::endl;
+  start = std::chrono::high_resolution_clock::now();
+  std::size_t num_items2 = fastply::parallel_count_if(
+      vertices, [&](const Vertex& v) { return v == target1; });
+  end = std::chrono::high_resolution_clock::now();
+  elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+  std::cout << "    :: Done in " << elapsed.count() << "ms ("
+            << (num_items2 == std::size_t(num_items1) ? "match" : "MISMATCH")
+            << ")" << std::endl;
+
   return 0;
 }
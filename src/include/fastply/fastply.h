@@ -22,88 +22,1557 @@
 #define FASTPLY_H
 
 #include <algorithm>
+#include <array>
+#include <cctype>
+#include <cerrno>
 #include <cstddef>
 #include <cstdint>
-#include <fstream>
+#include <cstring>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
 #include <memory>
-#include <sstream>
+#include <mutex>
 #include <stdexcept>
 #include <string>
 #include <system_error>
 #include <tuple>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "fastply/fastply_ascii.h"
+#include "fastply/fastply_byteswap.h"
+#include "fastply/fastply_header.h"
+#include "fastply/fastply_instrument.h"
+#include "fastply/fastply_mapping_cache.h"
+#include "fastply/fastply_options.h"
+#include "fastply/fastply_schema.h"
+#include "fastply/fastply_types.h"
+
 namespace fastply {
 
-/**
- * @brief Returns size (bytes) of a file.
- *
- * @param filename Path to file
- * @return Size in bytes, or -1 upon failure
- */
-inline std::size_t getFileSize(const std::string& filename) noexcept {
-  struct ::stat st;
-  int rc = stat(filename.c_str(), &st);
-  return rc == 0 ? st.st_size : 0;
+/**
+ * @brief Returns size (bytes) of a file.
+ *
+ * @param filename Path to file
+ * @return Size in bytes, or -1 upon failure
+ */
+inline std::size_t getFileSize(const std::string& filename) noexcept {
+  struct ::stat st;
+  int rc = stat(filename.c_str(), &st);
+  return rc == 0 ? st.st_size : 0;
+}
+
+namespace detail {
+
+template <typename...>
+struct voider {
+  using type = void;
+};
+
+template <typename... Ts>
+using void_t = typename voider<Ts...>::type;
+
+template <bool...>
+struct bool_pack;
+
+template <bool... Bs>
+using all_of = std::is_same<bool_pack<Bs..., true>, bool_pack<true, Bs...>>;
+
+/// Position of T in Ts...
+template <typename T, typename... Ts>
+struct IndexOf;
+
+template <typename T, typename... Ts>
+struct IndexOf<T, T, Ts...> : std::integral_constant<std::size_t, 0> {};
+
+template <typename T, typename U, typename... Ts>
+struct IndexOf<T, U, Ts...>
+    : std::integral_constant<std::size_t, 1 + IndexOf<T, Ts...>::value> {};
+
+template <typename V>
+inline V loadUnaligned(const unsigned char* p) noexcept {
+  V v;
+  std::memcpy(&v, p, sizeof(V));
+  return v;
+}
+
+template <typename V>
+inline V loadUnaligned(const unsigned char* p, bool byte_swap) noexcept {
+  V v = loadUnaligned<V>(p);
+  return byte_swap ? byteSwap(v) : v;
+}
+
+/// Copy of the record at p (elements may have const members)
+template <typename T>
+T loadRecord(const unsigned char* p) noexcept {
+  typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  std::memcpy(&storage, p, sizeof(T));
+  return *reinterpret_cast<const T*>(&storage);
+}
+
+/// pwrite() of all size bytes at offset at
+inline void writeAll(int fd, const void* data, std::size_t size, off_t at) {
+  const unsigned char* p = static_cast<const unsigned char*>(data);
+  while (size) {
+    const ssize_t n = ::pwrite(fd, p, size, at);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      throw std::system_error(errno, std::generic_category());
+    p += n;
+    size -= static_cast<std::size_t>(n);
+    at += n;
+  }
+}
+
+/// pread() of exactly size bytes at offset at
+inline void readAll(int fd, void* data, std::size_t size, off_t at) {
+  unsigned char* p = static_cast<unsigned char*>(data);
+  while (size) {
+    const ssize_t n = ::pread(fd, p, size, at);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n == -1)
+      throw std::system_error(errno, std::generic_category());
+    if (n == 0)
+      throw std::runtime_error("Unexpected end of file");
+    p += n;
+    size -= static_cast<std::size_t>(n);
+    at += n;
+  }
+}
+
+/**
+ * @brief Random access iterator over values of type V which are placed at a
+ * fixed byte stride in memory, without any alignment guarantees.
+ *
+ * Values are loaded by copy (memcpy), hence dereferencing yields a value and
+ * not a reference. This is sufficient for all non-modifying std algorithms.
+ */
+template <typename V>
+class StridedIterator {
+ public:
+  using iterator_category = std::random_access_iterator_tag;
+  using value_type = V;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const V*;
+  using reference = V;
+
+  StridedIterator() = default;
+
+  StridedIterator(const unsigned char* ptr,
+                  difference_type stride,
+                  bool byte_swap = false) noexcept
+      : ptr_(ptr), stride_(stride), swap_(byte_swap) {}
+
+  reference operator*() const noexcept {
+    return loadUnaligned<V>(ptr_, swap_);
+  }
+
+  reference operator[](difference_type n) const noexcept {
+    return loadUnaligned<V>(ptr_ + n * stride_, swap_);
+  }
+
+  StridedIterator& operator++() noexcept {
+    ptr_ += stride_;
+    return *this;
+  }
+
+  StridedIterator operator++(int) noexcept {
+    auto tmp = *this;
+    ptr_ += stride_;
+    return tmp;
+  }
+
+  StridedIterator& operator--() noexcept {
+    ptr_ -= stride_;
+    return *this;
+  }
+
+  StridedIterator operator--(int) noexcept {
+    auto tmp = *this;
+    ptr_ -= stride_;
+    return tmp;
+  }
+
+  StridedIterator& operator+=(difference_type n) noexcept {
+    ptr_ += n * stride_;
+    return *this;
+  }
+
+  StridedIterator& operator-=(difference_type n) noexcept {
+    ptr_ -= n * stride_;
+    return *this;
+  }
+
+  friend StridedIterator operator+(StridedIterator it,
+                                   difference_type n) noexcept {
+    return it += n;
+  }
+
+  friend StridedIterator operator+(difference_type n,
+                                   StridedIterator it) noexcept {
+    return it += n;
+  }
+
+  friend StridedIterator operator-(StridedIterator it,
+                                   difference_type n) noexcept {
+    return it -= n;
+  }
+
+  friend difference_type operator-(const StridedIterator& lhs,
+                                   const StridedIterator& rhs) noexcept {
+    return (lhs.ptr_ - rhs.ptr_) / lhs.stride_;
+  }
+
+  friend bool operator==(const StridedIterator& lhs,
+                         const StridedIterator& rhs) noexcept {
+    return lhs.ptr_ == rhs.ptr_;
+  }
+
+  friend bool operator!=(const StridedIterator& lhs,
+                         const StridedIterator& rhs) noexcept {
+    return lhs.ptr_ != rhs.ptr_;
+  }
+
+  friend bool operator<(const StridedIterator& lhs,
+                        const StridedIterator& rhs) noexcept {
+    return lhs.ptr_ < rhs.ptr_;
+  }
+
+  friend bool operator>(const StridedIterator& lhs,
+                        const StridedIterator& rhs) noexcept {
+    return lhs.ptr_ > rhs.ptr_;
+  }
+
+  friend bool operator<=(const StridedIterator& lhs,
+                         const StridedIterator& rhs) noexcept {
+    return lhs.ptr_ <= rhs.ptr_;
+  }
+
+  friend bool operator>=(const StridedIterator& lhs,
+                         const StridedIterator& rhs) noexcept {
+    return lhs.ptr_ >= rhs.ptr_;
+  }
+
+ private:
+  const unsigned char* ptr_ = nullptr;
+  difference_type stride_ = static_cast<difference_type>(sizeof(V));
+  bool swap_ = false;
+};
+
+/**
+ * @brief Random access iterator yielding container[idx] by value, used by
+ * containers which cannot hand out references into the mapped file.
+ */
+template <typename C, typename V>
+class IndexIterator {
+ public:
+  using iterator_category = std::random_access_iterator_tag;
+  using value_type = V;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const V*;
+  using reference = V;
+
+  IndexIterator() = default;
+
+  IndexIterator(const C* container, std::size_t idx) noexcept
+      : container_(container), idx_(idx) {}
+
+  reference operator*() const { return (*container_)[idx_]; }
+
+  reference operator[](difference_type n) const {
+    return (*container_)[idx_ + n];
+  }
+
+  IndexIterator& operator++() noexcept {
+    ++idx_;
+    return *this;
+  }
+
+  IndexIterator operator++(int) noexcept {
+    auto tmp = *this;
+    ++idx_;
+    return tmp;
+  }
+
+  IndexIterator& operator--() noexcept {
+    --idx_;
+    return *this;
+  }
+
+  IndexIterator operator--(int) noexcept {
+    auto tmp = *this;
+    --idx_;
+    return tmp;
+  }
+
+  IndexIterator& operator+=(difference_type n) noexcept {
+    idx_ += n;
+    return *this;
+  }
+
+  IndexIterator& operator-=(difference_type n) noexcept {
+    idx_ -= n;
+    return *this;
+  }
+
+  friend IndexIterator operator+(IndexIterator it, difference_type n) noexcept {
+    return it += n;
+  }
+
+  friend IndexIterator operator+(difference_type n, IndexIterator it) noexcept {
+    return it += n;
+  }
+
+  friend IndexIterator operator-(IndexIterator it, difference_type n) noexcept {
+    return it -= n;
+  }
+
+  friend difference_type operator-(const IndexIterator& lhs,
+                                   const IndexIterator& rhs) noexcept {
+    return static_cast<difference_type>(lhs.idx_) -
+           static_cast<difference_type>(rhs.idx_);
+  }
+
+  friend bool operator==(const IndexIterator& lhs,
+                         const IndexIterator& rhs) noexcept {
+    return lhs.idx_ == rhs.idx_;
+  }
+
+  friend bool operator!=(const IndexIterator& lhs,
+                         const IndexIterator& rhs) noexcept {
+    return lhs.idx_ != rhs.idx_;
+  }
+
+  friend bool operator<(const IndexIterator& lhs,
+                        const IndexIterator& rhs) noexcept {
+    return lhs.idx_ < rhs.idx_;
+  }
+
+  friend bool operator>(const IndexIterator& lhs,
+                        const IndexIterator& rhs) noexcept {
+    return lhs.idx_ > rhs.idx_;
+  }
+
+  friend bool operator<=(const IndexIterator& lhs,
+                         const IndexIterator& rhs) noexcept {
+    return lhs.idx_ <= rhs.idx_;
+  }
+
+  friend bool operator>=(const IndexIterator& lhs,
+                         const IndexIterator& rhs) noexcept {
+    return lhs.idx_ >= rhs.idx_;
+  }
+
+ private:
+  const C* container_ = nullptr;
+  std::size_t idx_ = 0;
+};
+
+}  // namespace detail
+
+/**
+ * @brief Compile-time description of the fields of an element T.
+ *
+ * The layout is derived from the members listed in FASTPLY_GENERATE_OPERATORS,
+ * which may be listed in any order; fields keep the listed order and carry
+ * the offsets of the members in T. It is complete if these members cover all
+ * bytes of T, which is required for byte swapping.
+ */
+template <typename T, typename = void>
+struct ElementLayout {
+  /// Placeholder; field indices require FASTPLY_GENERATE_OPERATORS
+  template <std::size_t I>
+  using field_type = void;
+
+  static constexpr std::size_t numFields() noexcept { return 0; }
+
+  static constexpr bool isComplete() noexcept { return false; }
+
+  static constexpr std::array<PlyFieldInfo, 0> fields() noexcept {
+    return {};
+  }
+
+  static std::vector<std::string> fieldNames() { return {}; }
+};
+
+template <typename T>
+struct ElementLayout<
+    T,
+    detail::void_t<decltype(std::declval<const T&>().tie_internals_())>> {
+ private:
+  using tie_type = decltype(std::declval<const T&>().tie_internals_());
+  static constexpr std::size_t N = std::tuple_size<tie_type>::value;
+
+  template <std::size_t... I>
+  static constexpr std::size_t sizeSum(std::index_sequence<I...>) noexcept {
+    const std::size_t sizes[] = {sizeof(field_type<I>)..., 0};
+    std::size_t sum = 0;
+    for (std::size_t i = 0; i < N; ++i)
+      sum += sizes[i];
+    return sum;
+  }
+
+  // No two fields share a byte (e.g. a member listed twice)
+  template <std::size_t... I>
+  static constexpr bool disjoint(std::index_sequence<I...>) noexcept {
+    const std::size_t sizes[] = {sizeof(field_type<I>)..., 0};
+    for (std::size_t i = 0; i < N; ++i)
+      for (std::size_t j = i + 1; j < N; ++j) {
+        const std::size_t a = T::fastply_field_offset_(i);
+        const std::size_t b = T::fastply_field_offset_(j);
+        if (a < b + sizes[j] && b < a + sizes[i])
+          return false;
+      }
+    return true;
+  }
+
+  template <std::size_t... I>
+  static constexpr bool allValid(std::index_sequence<I...>) noexcept {
+    const bool valid[] = {(plyTypeOf<field_type<I>>() != PlyType::Invalid)...,
+                          true};
+    for (std::size_t i = 0; i < N; ++i)
+      if (!valid[i])
+        return false;
+    return true;
+  }
+
+  template <std::size_t... I>
+  static constexpr std::array<PlyFieldInfo, N> makeFields(
+      std::index_sequence<I...> seq) noexcept {
+    (void)seq;
+    return {{PlyFieldInfo{plyTypeOf<field_type<I>>(),
+                          T::fastply_field_offset_(I),
+                          sizeof(field_type<I>)}...}};
+  }
+
+ public:
+  /// Type of the I-th field
+  template <std::size_t I>
+  using field_type =
+      typename std::decay<typename std::tuple_element<I, tie_type>::type>::type;
+
+  static constexpr std::size_t numFields() noexcept { return N; }
+
+  static constexpr bool isComplete() noexcept {
+    return sizeSum(std::make_index_sequence<N>{}) == sizeof(T) &&
+           disjoint(std::make_index_sequence<N>{}) &&
+           allValid(std::make_index_sequence<N>{});
+  }
+
+  static constexpr std::array<PlyFieldInfo, N> fields() noexcept {
+    return makeFields(std::make_index_sequence<N>{});
+  }
+
+  /// Byte offset of the field with index idx
+  static constexpr std::size_t fieldOffset(std::size_t idx) noexcept {
+    return T::fastply_field_offset_(idx);
+  }
+
+  /// Names of the fields as listed in FASTPLY_GENERATE_OPERATORS
+  static std::vector<std::string> fieldNames() {
+    std::vector<std::string> names;
+    std::string name;
+    for (const char* p = T::fastply_field_names_();; ++p) {
+      if (*p == ',' || *p == '\0') {
+        names.push_back(name);
+        name.clear();
+        if (*p == '\0')
+          break;
+      } else if (!std::isspace(static_cast<unsigned char>(*p))) {
+        name += *p;
+      }
+    }
+    return names;
+  }
+};
+
+namespace detail {
+
+template <typename T, typename = void>
+struct HasElementName : std::false_type {};
+
+template <typename T>
+struct HasElementName<T, void_t<decltype(T::fastply_name_())>>
+    : std::true_type {};
+
+template <typename T>
+std::string elementName(std::true_type) {
+  std::string name = T::fastply_name_();
+  std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+  return name;
+}
+
+template <typename T>
+std::string elementName(std::false_type) {
+  return "";
+}
+
+}  // namespace detail
+
+/// Element name (lower case name of T) as used in PLY headers, if known
+template <typename T>
+std::string elementName() {
+  return detail::elementName<T>(detail::HasElementName<T>{});
+}
+
+namespace detail {
+
+/// Byte swapping kernel for element T (built once per type)
+template <typename T>
+const ByteSwapKernel& byteSwapKernel() {
+  static const ByteSwapKernel kernel = [] {
+    std::vector<ByteSwapKernel::Field> fields;
+    for (const auto& f : ElementLayout<T>::fields())
+      fields.emplace_back(f.offset, f.size);
+    return ByteSwapKernel(sizeof(T), fields);
+  }();
+  return kernel;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Elements consisting of a single variable-length list property
+ * (e.g. "property list uchar int vertex_indices") are declared via
+ * FASTPLY_LIST_ELEMENT, which exposes the count and value type of the list.
+ */
+template <typename T, typename = void>
+struct is_list_element : std::false_type {};
+
+template <typename T>
+struct is_list_element<T,
+                       detail::void_t<typename T::fastply_count_type,
+                                      typename T::fastply_value_type>>
+    : std::true_type {};
+
+namespace detail {
+
+/// Plans the records of element T from the properties declared for it
+template <typename T>
+RecordPlan planElement(const std::string& name,
+                       const std::vector<PlyProperty>& properties) {
+  const auto fields = ElementLayout<T>::fields();
+  const bool complete = ElementLayout<T>::isComplete();
+  return planRecords(
+      name, properties, complete ? fields.data() : nullptr,
+      complete ? ElementLayout<T>::fieldNames() : std::vector<std::string>(),
+      sizeof(T));
+}
+
+template <typename... Args, std::size_t N, std::size_t... I>
+void requireInPlace(const char* reader,
+                    const PlyHeader<N>& header,
+                    std::index_sequence<I...>) {
+  const bool in_place[] = {
+      (is_list_element<Args>::value ||
+       planElement<Args>(header.names[I], header.properties[I]).in_place)...,
+      true};
+  for (std::size_t i = 0; i < sizeof...(Args); ++i)
+    if (!in_place[i])
+      throw std::runtime_error(
+          std::string(reader) + " reads records as stored, but element '" +
+          header.names[i] + "' is not stored like its struct (members are "
+          "shuffled by FastPly only)");
+}
+
+/**
+ * @brief Throws unless the records of all elements Args... are stored
+ * exactly like their structs, for readers stepping by sizeof(T).
+ */
+template <typename... Args, std::size_t N>
+void requireInPlace(const char* reader, const PlyHeader<N>& header) {
+  requireInPlace<Args...>(reader, header, std::index_sequence_for<Args...>{});
+}
+
+/// Byte offset of a member inside T (offsetof for member pointers)
+template <typename T, typename M>
+std::size_t memberOffset(M T::*member) noexcept {
+  unsigned char storage[sizeof(T)];
+  const T* object = reinterpret_cast<const T*>(storage);
+  return static_cast<std::size_t>(
+      &reinterpret_cast<const unsigned char&>(object->*member) - storage);
+}
+
+}  // namespace detail
+
+/**
+ * @brief Random access view onto one field of all elements of a container,
+ * i.e. a column of the packed records.
+ *
+ * Values are loaded unaligned (and byte swapped if required) and accessed by
+ * value, without touching the remaining bytes of the records.
+ */
+template <typename V>
+class PlyColumnView {
+ public:
+  using value_type = V;
+  using size_type = std::size_t;
+  using const_iterator = detail::StridedIterator<V>;
+  using iterator = const_iterator;
+
+  PlyColumnView() = default;
+
+  PlyColumnView(const unsigned char* begin,
+                std::size_t stride,
+                std::size_t size,
+                bool byte_swap = false) noexcept
+      : begin_(begin), stride_(stride), size_(size), swap_(byte_swap) {}
+
+  value_type operator[](std::size_t i) const noexcept {
+    return detail::loadUnaligned<V>(begin_ + i * stride_, swap_);
+  }
+
+  value_type at(std::size_t i) const noexcept(false) {
+    if (i < size_) {
+      return (*this)[i];
+    } else {
+      throw std::out_of_range("Accessed position is out of range");
+    }
+  }
+
+  value_type front() const noexcept { return (*this)[0]; }
+
+  value_type back() const noexcept { return (*this)[size_ - 1]; }
+
+  const_iterator begin() const noexcept {
+    return const_iterator(begin_, stride_, swap_);
+  }
+
+  const_iterator cbegin() const noexcept { return begin(); }
+
+  const_iterator end() const noexcept {
+    return const_iterator(begin_ + size_ * stride_, stride_, swap_);
+  }
+
+  const_iterator cend() const noexcept { return end(); }
+
+  std::size_t size() const noexcept { return size_; }
+
+  bool empty() const noexcept { return size_ == 0; }
+
+  /// Distance between consecutive values in bytes
+  std::size_t stride() const noexcept { return stride_; }
+
+ private:
+  const unsigned char* begin_ = nullptr;
+  std::size_t stride_ = sizeof(V);
+  std::size_t size_ = 0;
+  bool swap_ = false;
+};
+
+/**
+ * @brief Random access view onto a subset of the fields of all elements,
+ * yielding a std::tuple of the selected fields per element.
+ */
+template <typename... Vs>
+class PlyProjectionView {
+ public:
+  using value_type = std::tuple<Vs...>;
+  using size_type = std::size_t;
+  using const_iterator = detail::IndexIterator<PlyProjectionView, value_type>;
+  using iterator = const_iterator;
+  using offsets_type = std::array<std::size_t, sizeof...(Vs)>;
+
+  PlyProjectionView() = default;
+
+  PlyProjectionView(const unsigned char* begin,
+                    std::size_t stride,
+                    std::size_t size,
+                    const offsets_type& offsets,
+                    bool byte_swap = false) noexcept
+      : begin_(begin),
+        stride_(stride),
+        size_(size),
+        offsets_(offsets),
+        swap_(byte_swap) {}
+
+  value_type operator[](std::size_t i) const noexcept {
+    return load(begin_ + i * stride_, std::index_sequence_for<Vs...>{});
+  }
+
+  value_type at(std::size_t i) const noexcept(false) {
+    if (i < size_) {
+      return (*this)[i];
+    } else {
+      throw std::out_of_range("Accessed position is out of range");
+    }
+  }
+
+  value_type front() const noexcept { return (*this)[0]; }
+
+  value_type back() const noexcept { return (*this)[size_ - 1]; }
+
+  const_iterator begin() const noexcept { return const_iterator(this, 0); }
+
+  const_iterator cbegin() const noexcept { return begin(); }
+
+  const_iterator end() const noexcept { return const_iterator(this, size_); }
+
+  const_iterator cend() const noexcept { return end(); }
+
+  std::size_t size() const noexcept { return size_; }
+
+  bool empty() const noexcept { return size_ == 0; }
+
+  /// Column of the I-th selected field
+  template <std::size_t I>
+  PlyColumnView<typename std::tuple_element<I, value_type>::type> column()
+      const noexcept {
+    return {begin_ + offsets_[I], stride_, size_, swap_};
+  }
+
+ private:
+  template <std::size_t... I>
+  value_type load(const unsigned char* p, std::index_sequence<I...>) const
+      noexcept {
+    return value_type(detail::loadUnaligned<Vs>(p + offsets_[I], swap_)...);
+  }
+
+  const unsigned char* begin_ = nullptr;
+  std::size_t stride_ = 0;
+  std::size_t size_ = 0;
+  offsets_type offsets_ = {};
+  bool swap_ = false;
+};
+
+namespace detail {
+
+/**
+ * @brief Thread safe store for results derived from the elements of an open
+ * file (e.g. reductions), keyed by a description of the computation.
+ */
+class ResultCache {
+ public:
+  template <typename R>
+  std::shared_ptr<const R> find(const std::string& key) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = results_.find(key);
+    if (it == results_.end())
+      return nullptr;
+    return std::static_pointer_cast<const R>(it->second);
+  }
+
+  template <typename R>
+  void insert(const std::string& key, R value) {
+    auto result = std::make_shared<const R>(std::move(value));
+    std::lock_guard<std::mutex> lock(mutex_);
+    results_[key] = std::move(result);
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::map<std::string, std::shared_ptr<const void>> results_;
+};
+
+}  // namespace detail
+
+template <typename T>
+class PlyNativeView;
+
+template <typename T>
+class PlyElementContainer {
+ public:
+  using value_type = T;
+  using difference_type = std::ptrdiff_t;
+  using pointer = T*;
+  using const_pointer = const T*;
+  using reference = T&;
+  using const_reference = const T&;
+  using iterator = T*;
+  using const_iterator = const T*;
+
+  const_reference operator[](std::size_t i) const { return elements()[i]; }
+
+  const_reference at(std::size_t i) const noexcept(false) {
+    if (i < size_) {
+      return elements()[i];
+    } else {
+      throw std::out_of_range("Accessed position is out of range");
+    }
+  }
+
+  const_reference front() const { return *elements(); }
+
+  const_reference back() const { return elements()[size_ - 1]; }
+
+  const_pointer data() const { return elements(); }
+
+  const_iterator begin() const { return elements(); }
+
+  const_iterator cbegin() const { return elements(); }
+
+  const_iterator end() const { return elements() + size_; }
+
+  const_iterator cend() const { return elements() + size_; }
+
+  constexpr std::size_t size() const noexcept { return size_; }
+
+  constexpr bool empty() const noexcept { return size_ == 0; }
+
+  /// True if the elements are stored in non-native byte order
+  constexpr bool needsByteSwap() const noexcept { return swap_; }
+
+  /**
+   * @brief True if the elements are used as stored in the file. False if
+   * the file declares the fields in another order or declares additional
+   * properties: native(), column(), project(), gather() and prefetch() then
+   * assemble the fields from the file records on access, while the
+   * accessors returning references (operator[], data(), begin(), ...)
+   * shuffle all elements into memory on their first call (see
+   * materialize()).
+   */
+  bool inPlace() const noexcept { return !planned_; }
+
+  /**
+   * @brief Shuffles the elements into memory now instead of on the first
+   * call of an accessor returning references. Reads every record of the
+   * element and allocates size() * sizeof(T) bytes; no-op if inPlace().
+   */
+  void materialize() const noexcept(false) { elements(); }
+
+  /// Asynchronously reads elements [first, first + count) into memory
+  void prefetch(std::size_t first = 0,
+                std::size_t count = std::numeric_limits<std::size_t>::max())
+      const noexcept(false) {
+    advise(first, count, MADV_WILLNEED);
+  }
+
+  /**
+   * @brief Releases the pages of elements [first, first + count) from the
+   * mapping; they are read again from the file on the next access. No-op for
+   * files converted from ASCII, which are not backed by the file.
+   *
+   * The mapping is private, so MADV_DONTNEED only drops the page table
+   * entries of this process: the pages stay in the page cache (and in other
+   * mappings of the file) until the kernel reclaims them, and the next access
+   * is a minor fault. To release the cached file data as well, call
+   * posix_fadvise(POSIX_FADV_DONTNEED) on the file after evicting.
+   */
+  void evict(std::size_t first = 0,
+             std::size_t count = std::numeric_limits<std::size_t>::max())
+      const noexcept(false) {
+    if (file_backed_)
+      advise(first, count, MADV_DONTNEED);
+  }
+
+  /**
+   * @brief By-value view converting elements to native byte order.
+   *
+   * The elements returned by operator[] etc. of the container itself are the
+   * raw bytes of the file. For files not in host byte order (see
+   * needsByteSwap()), this view swaps each field according to
+   * ElementLayout<T>, either lazily per element or in bulk via copyTo().
+   */
+  PlyNativeView<T> native() const noexcept(false);
+
+  /**
+   * @brief Copies the elements at the given indices into out, in the order
+   * of the indices (duplicates allowed).
+   *
+   * Meant for large batches of random indices: unless a sample of the
+   * pages is already resident, the records are visited in file order and
+   * their pages are requested from the kernel up front, so page faults
+   * overlap instead of being taken one at a time. Records are prefetched
+   * ahead of the copy. Elements are copied as stored (see needsByteSwap()).
+   *
+   * @param out Caller provided storage for at least count elements
+   * @throws std::out_of_range if any index is out of range (out is
+   * untouched)
+   */
+  template <typename Index>
+  void gather(const Index* indices,
+              std::size_t count,
+              T* out,
+              const GatherOptions& options = GatherOptions()) const
+      noexcept(false);
+
+  /// Cache of derived results, valid until the file is closed (or nullptr)
+  detail::ResultCache* cache() const noexcept { return cache_.get(); }
+
+  /// Column of the I-th field listed in FASTPLY_GENERATE_OPERATORS
+  template <std::size_t I>
+  PlyColumnView<typename ElementLayout<T>::template field_type<I>> column()
+      const noexcept {
+    static_assert(ElementLayout<T>::isComplete(),
+                  "Field indices require all members of the element to be "
+                  "listed in FASTPLY_GENERATE_OPERATORS");
+    return {records() + sourceOffset(ElementLayout<T>::fieldOffset(I)),
+            stride(), size_, swap_};
+  }
+
+  /// Column of a (scalar) member, e.g. column(&Vertex::x)
+  template <typename M>
+  PlyColumnView<typename std::remove_cv<M>::type> column(M T::*member) const
+      noexcept {
+    static_assert(std::is_arithmetic<M>::value,
+                  "Columns require scalar members");
+    return {records() + sourceOffset(detail::memberOffset(member)), stride(),
+            size_, swap_};
+  }
+
+  /// Tuples of the fields with the given indices (see column<I>())
+  template <std::size_t... I>
+  PlyProjectionView<typename ElementLayout<T>::template field_type<I>...>
+  project() const noexcept {
+    static_assert(ElementLayout<T>::isComplete(),
+                  "Field indices require all members of the element to be "
+                  "listed in FASTPLY_GENERATE_OPERATORS");
+    return {records(), stride(), size_,
+            {{sourceOffset(ElementLayout<T>::fieldOffset(I))...}}, swap_};
+  }
+
+  /// Tuples of the given members, e.g. project(&Vertex::x, &Vertex::y)
+  template <typename... Ms>
+  PlyProjectionView<typename std::remove_cv<Ms>::type...> project(
+      Ms T::*... members) const noexcept {
+    static_assert(detail::all_of<std::is_arithmetic<Ms>::value...>::value,
+                  "Projections require scalar members");
+    return {records(), stride(), size_,
+            {{sourceOffset(detail::memberOffset(members))...}}, swap_};
+  }
+
+ private:
+  /// Elements as structs, shuffled into memory first if not in place
+  const_pointer elements() const {
+    if (planned_)
+      return reinterpret_cast<const_pointer>(planned_->structs());
+    return begin_;
+  }
+
+  /// First record in the file (or buffer)
+  const unsigned char* records() const noexcept {
+    return planned_ ? planned_->records()
+                    : reinterpret_cast<const unsigned char*>(begin_);
+  }
+
+  /// Bytes per record in the file
+  std::size_t stride() const noexcept {
+    return planned_ ? planned_->stride() : sizeof(T);
+  }
+
+  /// Offset inside the file record of the member at offset inside T
+  std::size_t sourceOffset(std::size_t offset) const noexcept {
+    return planned_ ? planned_->sourceOffset(offset) : offset;
+  }
+
+  const unsigned char* setupBlock(const unsigned char* start,
+                                  const unsigned char* limit,
+                                  std::size_t count,
+                                  bool byte_swap,
+                                  bool file_backed,
+                                  const std::string& name,
+                                  const std::vector<PlyProperty>& properties);
+
+  void resetBlock() noexcept {
+    size_ = 0;
+    begin_ = nullptr;
+    block_end_ = nullptr;
+    swap_ = false;
+    file_backed_ = false;
+    cache_.reset();
+    planned_.reset();
+  }
+
+  void advise(std::size_t first, std::size_t count, int advice) const {
+    if (first > size_)
+      throw std::out_of_range("Accessed range is out of range");
+    count = std::min(count, size_ - first);
+    detail::adviseRange(records() + first * stride(),
+                        records() + (first + count) * stride(), advice);
+  }
+
+  const unsigned char* blockEnd() const noexcept { return block_end_; }
+
+  std::size_t size_ = 0;
+  const_pointer begin_ = nullptr;  //!< Elements if in place
+  const unsigned char* block_end_ = nullptr;  //!< End of the block in file
+  bool swap_ = false;  //!< Elements are stored in non-native byte order
+  bool file_backed_ = false;  //!< Mapping is backed by the file (evictable)
+  std::shared_ptr<detail::ResultCache> cache_;  //!< Derived results
+  std::shared_ptr<const detail::PlannedRecords> planned_;  //!< Not in place
+
+  template <typename... Args>
+  friend class FastPly;
+};
+
+template <typename T>
+const unsigned char* PlyElementContainer<T>::setupBlock(
+    const unsigned char* start,
+    const unsigned char* limit,
+    std::size_t count,
+    bool byte_swap,
+    bool file_backed,
+    const std::string& name,
+    const std::vector<PlyProperty>& properties) {
+  resetBlock();
+  detail::RecordPlan plan = detail::planElement<T>(name, properties);
+
+  size_ = count;
+  swap_ = byte_swap;
+  file_backed_ = file_backed;
+  if (start > limit)
+    throw std::runtime_error("Element exceeds the size of the file");
+  if (plan.in_place) {
+    if (count > static_cast<std::size_t>(limit - start) / sizeof(T))
+      throw std::runtime_error("Element exceeds the size of the file");
+    begin_ = reinterpret_cast<const_pointer>(start);
+    block_end_ = start + count * sizeof(T);
+  } else {
+    if (count > static_cast<std::size_t>(limit - start) / plan.stride)
+      throw std::runtime_error("Element exceeds the size of the file");
+    block_end_ = start + count * plan.stride;
+    planned_ = std::make_shared<const detail::PlannedRecords>(
+        start, count, std::move(plan), sizeof(T));
+  }
+  cache_ = std::make_shared<detail::ResultCache>();
+  return blockEnd();
 }
 
 template <typename T>
-class PlyElementContainer {
+class PlyNativeView {
  public:
   using value_type = T;
   using difference_type = std::ptrdiff_t;
-  using pointer = T*;
-  using const_pointer = const T*;
-  using reference = T&;
-  using const_reference = const T&;
-  using iterator = T*;
-  using const_iterator = const T*;
+  using reference = T;
+  using const_reference = T;
+  using const_iterator = detail::IndexIterator<PlyNativeView, T>;
+  using iterator = const_iterator;
+
+  const_reference operator[](std::size_t i) const noexcept {
+    alignas(T) unsigned char buffer[sizeof(T)];
+    const unsigned char* src = begin_ + i * sizeof(T);
+    if (planned_) {
+      planned_->assemble(i, buffer);
+      src = buffer;
+    }
+    if (!swap_)
+      return *reinterpret_cast<const T*>(src);
+    detail::byteSwapKernel<T>().swapRecord(src, buffer);
+    return *reinterpret_cast<const T*>(buffer);
+  }
+
+  const_reference at(std::size_t i) const noexcept(false) {
+    if (i < size_) {
+      return (*this)[i];
+    } else {
+      throw std::out_of_range("Accessed position is out of range");
+    }
+  }
+
+  const_reference front() const noexcept { return (*this)[0]; }
+
+  const_reference back() const noexcept { return (*this)[size_ - 1]; }
+
+  const_iterator begin() const noexcept { return const_iterator(this, 0); }
+
+  const_iterator cbegin() const noexcept { return begin(); }
+
+  const_iterator end() const noexcept { return const_iterator(this, size_); }
+
+  const_iterator cend() const noexcept { return end(); }
+
+  std::size_t size() const noexcept { return size_; }
+
+  bool empty() const noexcept { return size_ == 0; }
+
+  bool needsByteSwap() const noexcept { return swap_; }
+
+  /**
+   * @brief Converts count elements starting at first into out (vectorized).
+   *
+   * @param out Caller provided storage for at least count elements
+   */
+  void copyTo(std::size_t first, std::size_t count, T* out) const
+      noexcept(false) {
+    if (first > size_ || count > size_ - first)
+      throw std::out_of_range("Accessed range is out of range");
+    const unsigned char* src = begin_ + first * sizeof(T);
+    if (planned_) {
+      unsigned char* dst = reinterpret_cast<unsigned char*>(out);
+      for (std::size_t i = 0; i < count; ++i)
+        planned_->assemble(first + i, dst + i * sizeof(T));
+      src = dst;
+    }
+    if (swap_)
+      detail::byteSwapKernel<T>()(src, reinterpret_cast<unsigned char*>(out),
+                                  count);
+    else if (!planned_)
+      std::memcpy(static_cast<void*>(out), src, count * sizeof(T));
+  }
+
+ private:
+  PlyNativeView(const unsigned char* begin,
+                std::size_t size,
+                bool byte_swap,
+                const detail::PlannedRecords* planned)
+      : begin_(begin), size_(size), swap_(byte_swap), planned_(planned) {}
+
+  const unsigned char* begin_ = nullptr;  //!< Elements if in place
+  std::size_t size_ = 0;
+  bool swap_ = false;
+  const detail::PlannedRecords* planned_ = nullptr;  //!< Not in place
+
+  friend class PlyElementContainer<T>;
+};
+
+template <typename T>
+PlyNativeView<T> PlyElementContainer<T>::native() const noexcept(false) {
+  if (swap_ && !ElementLayout<T>::isComplete())
+    throw std::runtime_error(
+        "Byte swapping requires all members of the element to be listed "
+        "in FASTPLY_GENERATE_OPERATORS");
+  return PlyNativeView<T>(reinterpret_cast<const unsigned char*>(begin_),
+                          size_, swap_, planned_.get());
+}
+
+namespace detail {
+
+/**
+ * @brief Positions into indices, ordered by the page of the record (i.e. in
+ * file order for records not sharing a page). Counting sort by page when
+ * there are few pages compared to indices, otherwise a comparison sort.
+ */
+template <typename Index>
+std::vector<std::size_t> pageOrder(const Index* indices,
+                                   std::size_t count,
+                                   std::size_t record_size,
+                                   std::size_t num_records) {
+  std::vector<std::size_t> order(count);
+  const std::size_t page = pageSize();
+  const std::size_t num_pages = (num_records * record_size) / page + 1;
+  if (num_pages > 2 * count + 1024) {
+    for (std::size_t k = 0; k < count; ++k)
+      order[k] = k;
+    std::sort(order.begin(), order.end(),
+              [indices](std::size_t a, std::size_t b) {
+                return indices[a] < indices[b];
+              });
+    return order;
+  }
+
+  std::vector<std::size_t> offsets(num_pages + 1, 0);
+  for (std::size_t k = 0; k < count; ++k)
+    ++offsets[static_cast<std::size_t>(indices[k]) * record_size / page + 1];
+  for (std::size_t p = 1; p <= num_pages; ++p)
+    offsets[p] += offsets[p - 1];
+  for (std::size_t k = 0; k < count; ++k)
+    order[offsets[static_cast<std::size_t>(indices[k]) * record_size /
+                  page]++] = k;
+  return order;
+}
+
+/**
+ * @brief True if the pages of (up to 64 evenly spaced) sampled records are
+ * all resident in memory.
+ */
+template <typename Index>
+bool sampleResident(const Index* indices,
+                    std::size_t count,
+                    const unsigned char* base,
+                    std::size_t record_size) noexcept {
+  const std::size_t page = pageSize();
+  const std::size_t samples = std::min<std::size_t>(count, 64);
+  for (std::size_t s = 0; s < samples; ++s) {
+    const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(
+        base + static_cast<std::size_t>(indices[s * count / samples]) *
+                   record_size);
+    unsigned char resident = 0;
+    if (mincore(reinterpret_cast<void*>(address & ~(page - 1)), 1,
+                &resident) != 0 ||
+        !(resident & 1))
+      return false;
+  }
+  return true;
+}
+
+}  // namespace detail
+
+template <typename T>
+template <typename Index>
+void PlyElementContainer<T>::gather(const Index* indices,
+                                    std::size_t count,
+                                    T* out,
+                                    const GatherOptions& options) const
+    noexcept(false) {
+  static_assert(std::is_integral<Index>::value,
+                "Indices must be of integral type");
+  for (std::size_t k = 0; k < count; ++k)
+    if (static_cast<std::size_t>(indices[k]) >= size_)
+      throw std::out_of_range("Accessed position is out of range");
+
+  // Sorting only pays off if pages have to be read from the file
+  const bool sort = options.sort && file_backed_ &&
+                    !detail::sampleResident(indices, count, records(),
+                                            stride());
+  std::vector<std::size_t> order;
+  if (sort)
+    order = detail::pageOrder(indices, count, stride(), size_);
+  const bool advise = sort && options.advise;
+  const std::size_t distance = options.prefetch_distance;
+  const std::size_t page = detail::pageSize();
+  const unsigned char* base = records();
+  const std::size_t record_stride = stride();
+  const detail::PlannedRecords* planned = planned_.get();
+  unsigned char* dst = reinterpret_cast<unsigned char*>(out);
+
+  // Contiguous ranges of the (sorted) requests per task
+  const std::size_t num_tasks = std::min<std::size_t>(count / 4096 + 1, 256);
+  detail::runTasks(num_tasks, options.threads, [&](std::size_t task) {
+    const std::size_t first = count * task / num_tasks;
+    const std::size_t last = count * (task + 1) / num_tasks;
+    auto position = [&](std::size_t k) { return sort ? order[k] : k; };
+    auto record = [&](std::size_t k) {
+      return base +
+             static_cast<std::size_t>(indices[position(k)]) * record_stride;
+    };
+
+    if (advise) {
+      // One request per run of adjacent pages
+      std::uintptr_t run_begin = 0, run_end = 0;
+      for (std::size_t k = first; k < last; ++k) {
+        const std::uintptr_t begin =
+            reinterpret_cast<std::uintptr_t>(record(k)) / page;
+        const std::uintptr_t end =
+            (reinterpret_cast<std::uintptr_t>(record(k)) + record_stride - 1) /
+                page + 1;
+        if (run_end != 0 && begin <= run_end) {
+          run_end = std::max(run_end, end);
+          continue;
+        }
+        if (run_end != 0)
+          detail::adviseRange(reinterpret_cast<const void*>(run_begin * page),
+                              reinterpret_cast<const void*>(run_end * page),
+                              MADV_WILLNEED);
+        run_begin = begin;
+        run_end = end;
+      }
+      if (run_end != 0)
+        detail::adviseRange(reinterpret_cast<const void*>(run_begin * page),
+                            reinterpret_cast<const void*>(run_end * page),
+                            MADV_WILLNEED);
+    }
+
+    for (std::size_t k = first; k < last; ++k) {
+      if (distance && k + distance < last)
+        __builtin_prefetch(record(k + distance));
+      if (planned)
+        detail::assembleRecord(record(k), dst + position(k) * sizeof(T),
+                               planned->plan().copies);
+      else
+        std::memcpy(dst + position(k) * sizeof(T), record(k), sizeof(T));
+    }
+  });
+}
+
+/**
+ * @brief Zero-copy view onto a single list instance (e.g. the vertex indices
+ * of one face) inside the memory mapped file.
+ *
+ * List values are not guaranteed to be aligned, hence they are returned by
+ * value.
+ */
+template <typename V>
+class PlyListView {
+ public:
+  using value_type = V;
+  using size_type = std::size_t;
+  using const_iterator = detail::StridedIterator<V>;
+  using iterator = const_iterator;
+
+  PlyListView() = default;
 
-  constexpr const_reference operator[](std::size_t i) const {
-    return begin_[i];
+  PlyListView(const unsigned char* begin,
+              std::size_t size,
+              bool byte_swap = false) noexcept
+      : begin_(begin), size_(size), swap_(byte_swap) {}
+
+  value_type operator[](std::size_t i) const noexcept {
+    return detail::loadUnaligned<V>(begin_ + i * sizeof(V), swap_);
   }
 
-  constexpr const_reference at(std::size_t i) const noexcept(false) {
+  value_type at(std::size_t i) const noexcept(false) {
     if (i < size_) {
-      return begin_[i];
+      return (*this)[i];
     } else {
       throw std::out_of_range("Accessed position is out of range");
     }
   }
 
-  constexpr const_reference front() const noexcept { return *begin_; }
+  value_type front() const noexcept { return (*this)[0]; }
 
-  constexpr const_reference back() const noexcept { return *(end_ - 1); }
+  value_type back() const noexcept { return (*this)[size_ - 1]; }
 
-  constexpr const_pointer data() const noexcept { return begin_; }
+  const void* data() const noexcept { return begin_; }
 
-  constexpr const_iterator begin() const noexcept { return begin_; }
+  const_iterator begin() const noexcept {
+    return const_iterator(begin_, sizeof(V), swap_);
+  }
 
-  constexpr const_iterator cbegin() const noexcept { return begin_; }
+  const_iterator cbegin() const noexcept { return begin(); }
 
-  constexpr const_iterator end() const noexcept { return end_; }
+  const_iterator end() const noexcept {
+    return const_iterator(begin_ + size_ * sizeof(V), sizeof(V), swap_);
+  }
 
-  constexpr const_iterator cend() const noexcept { return end_; }
+  const_iterator cend() const noexcept { return end(); }
 
-  constexpr std::size_t size() const noexcept { return size_; }
+  std::size_t size() const noexcept { return size_; }
 
-  constexpr bool empty() const noexcept { return size_ == 0; }
+  bool empty() const noexcept { return size_ == 0; }
+
+ private:
+  const unsigned char* begin_ = nullptr;
+  std::size_t size_ = 0;
+  bool swap_ = false;
+};
+
+/**
+ * @brief Random access container for elements made of a single variable-length
+ * list property.
+ *
+ * Since list instances have different sizes, an offset index is built once
+ * when the file is opened. The index is stored compactly: One absolute byte
+ * offset for every block of kBlockSize lists, plus a narrow per-list count of
+ * values preceding it inside its block. If all lists have the same length
+ * (e.g. pure triangle meshes), no index is stored at all.
+ */
+template <typename T>
+class PlyListElementContainer {
+ public:
+  using count_type = typename T::fastply_count_type;
+  using list_value_type = typename T::fastply_value_type;
+  using value_type = PlyListView<list_value_type>;
+  using difference_type = std::ptrdiff_t;
+  using reference = value_type;
+  using const_reference = value_type;
+
+  static_assert(std::is_integral<count_type>::value,
+                "List count type must be an integral type.");
+
+  using const_iterator =
+      detail::IndexIterator<PlyListElementContainer, value_type>;
+  using iterator = const_iterator;
+
+  const_reference operator[](std::size_t i) const noexcept {
+    const unsigned char* p = begin_ + offsetOf(i);
+    return value_type(
+        p + sizeof(count_type),
+        static_cast<std::size_t>(detail::loadUnaligned<count_type>(p, swap_)),
+        swap_);
+  }
+
+  const_reference at(std::size_t i) const noexcept(false) {
+    if (i < size_) {
+      return (*this)[i];
+    } else {
+      throw std::out_of_range("Accessed position is out of range");
+    }
+  }
+
+  const_reference front() const noexcept { return (*this)[0]; }
+
+  const_reference back() const noexcept { return (*this)[size_ - 1]; }
+
+  const unsigned char* data() const noexcept { return begin_; }
+
+  const_iterator begin() const noexcept { return const_iterator(this, 0); }
+
+  const_iterator cbegin() const noexcept { return begin(); }
+
+  const_iterator end() const noexcept { return const_iterator(this, size_); }
+
+  const_iterator cend() const noexcept { return end(); }
+
+  std::size_t size() const noexcept { return size_; }
+
+  bool empty() const noexcept { return size_ == 0; }
+
+  /// Size of the element block in the file (bytes)
+  std::size_t sizeBytes() const noexcept {
+    return static_cast<std::size_t>(end_ - begin_);
+  }
+
+  /// True if all lists have the same length (no offset index required)
+  bool isUniform() const noexcept { return uniform_stride_ != 0 || size_ == 0; }
+
+  /// True if the lists are stored in non-native byte order (swapped on access)
+  bool needsByteSwap() const noexcept { return swap_; }
+
+  /// Asynchronously reads lists [first, first + count) into memory
+  void prefetch(std::size_t first = 0,
+                std::size_t count = std::numeric_limits<std::size_t>::max())
+      const noexcept(false) {
+    advise(first, count, MADV_WILLNEED);
+  }
+
+  /// Releases the pages of lists [first, first + count) from this process's
+  /// mapping (not from the page cache), see PlyElementContainer::evict()
+  void evict(std::size_t first = 0,
+             std::size_t count = std::numeric_limits<std::size_t>::max())
+      const noexcept(false) {
+    if (file_backed_)
+      advise(first, count, MADV_DONTNEED);
+  }
 
  private:
+  static constexpr std::size_t kBlockShift = 6;
+  static constexpr std::size_t kBlockSize = std::size_t(1) << kBlockShift;
+
+  // Values preceding a list inside its block; 16 bit suffice for uchar counts
+  using block_rel_type = typename std::conditional<sizeof(count_type) == 1,
+                                                   std::uint16_t,
+                                                   std::uint32_t>::type;
+
+  std::size_t offsetOf(std::size_t i) const noexcept {
+    if (uniform_stride_)
+      return i * uniform_stride_;
+    return block_offsets_[i >> kBlockShift] +
+           (i & (kBlockSize - 1)) * sizeof(count_type) +
+           static_cast<std::size_t>(block_rel_[i]) * sizeof(list_value_type);
+  }
+
+  const unsigned char* setupBlock(const unsigned char* start,
+                                  const unsigned char* limit,
+                                  std::size_t count,
+                                  bool byte_swap,
+                                  bool file_backed,
+                                  const std::string& name,
+                                  const std::vector<PlyProperty>& properties);
+
+  void resetBlock() noexcept {
+    size_ = 0;
+    swap_ = false;
+    file_backed_ = false;
+    begin_ = nullptr;
+    end_ = nullptr;
+    uniform_stride_ = 0;
+    std::vector<std::size_t>().swap(block_offsets_);
+    std::vector<block_rel_type>().swap(block_rel_);
+  }
+
+  const unsigned char* blockEnd() const noexcept { return end_; }
+
+  void advise(std::size_t first, std::size_t count, int advice) const {
+    if (first > size_)
+      throw std::out_of_range("Accessed range is out of range");
+    count = std::min(count, size_ - first);
+    const unsigned char* last =
+        first + count == size_ ? end_ : begin_ + offsetOf(first + count);
+    detail::adviseRange(begin_ + offsetOf(first), last, advice);
+  }
+
   std::size_t size_ = 0;
-  const_pointer begin_ = nullptr;
-  const_pointer end_ = nullptr;
+  const unsigned char* begin_ = nullptr;
+  const unsigned char* end_ = nullptr;
+  std::size_t uniform_stride_ = 0;  //!< Bytes per list, if all are alike
+  bool swap_ = false;  //!< Lists are stored in non-native byte order
+  bool file_backed_ = false;  //!< Mapping is backed by the file (evictable)
+  std::vector<std::size_t> block_offsets_;  //!< Byte offset per block
+  std::vector<block_rel_type> block_rel_;   //!< Values before list in block
 
   template <typename... Args>
   friend class FastPly;
 };
 
+template <typename T>
+const unsigned char* PlyListElementContainer<T>::setupBlock(
+    const unsigned char* start,
+    const unsigned char* limit,
+    std::size_t count,
+    bool byte_swap,
+    bool file_backed,
+    const std::string&,
+    const std::vector<PlyProperty>&) {
+  resetBlock();
+  size_ = count;
+  begin_ = start;
+  swap_ = byte_swap;
+  file_backed_ = file_backed;
+  if (count == 0) {
+    end_ = start;
+    return end_;
+  }
+
+  // The position of a list depends on the length of all preceding lists, so
+  // the counts can only be discovered by a single walk over the block. Only
+  // the count field of each list is touched.
+  if (start > limit)
+    throw std::runtime_error("List element exceeds the size of the file");
+  const std::size_t available = static_cast<std::size_t>(limit - start);
+  std::size_t offset = 0;
+  std::size_t first_length = 0;
+  std::size_t block_values = 0;
+  bool uniform = true;
+
+  for (std::size_t i = 0; i < count; ++i) {
+    if (offset + sizeof(count_type) > available)
+      throw std::runtime_error("List element exceeds the size of the file");
+
+    const count_type raw =
+        detail::loadUnaligned<count_type>(start + offset, swap_);
+    if (raw < 0)
+      throw std::runtime_error("Negative list length found");
+    const std::size_t length = static_cast<std::size_t>(raw);
+
+    if (i == 0)
+      first_length = length;
+
+    if (uniform && length != first_length) {
+      // First irregular list: Materialize the index for all lists so far
+      uniform = false;
+      block_offsets_.reserve((count >> kBlockShift) + 1);
+      block_rel_.reserve(count);
+      const std::size_t stride =
+          sizeof(count_type) + first_length * sizeof(list_value_type);
+      for (std::size_t j = 0; j < i; ++j) {
+        if ((j & (kBlockSize - 1)) == 0)
+          block_offsets_.push_back(j * stride);
+        block_rel_.push_back(static_cast<block_rel_type>(
+            (j & (kBlockSize - 1)) * first_length));
+      }
+      block_values = (i & (kBlockSize - 1)) * first_length;
+    }
+
+    if (!uniform) {
+      if ((i & (kBlockSize - 1)) == 0) {
+        block_offsets_.push_back(offset);
+        block_values = 0;
+      }
+      if (block_values > std::numeric_limits<block_rel_type>::max())
+        throw std::runtime_error("List lengths too large for offset index");
+      block_rel_.push_back(static_cast<block_rel_type>(block_values));
+      block_values += length;
+    }
+
+    offset += sizeof(count_type) + length * sizeof(list_value_type);
+    if (offset > available)
+      throw std::runtime_error("List element exceeds the size of the file");
+  }
+
+  if (uniform)
+    uniform_stride_ =
+        sizeof(count_type) + first_length * sizeof(list_value_type);
+
+  end_ = start + offset;
+  return end_;
+}
+
+template <typename T>
+using element_container_t =
+    typename std::conditional<is_list_element<T>::value,
+                              PlyListElementContainer<T>,
+                              PlyElementContainer<T>>::type;
+
 template <typename... Args>
 class FastPly {
   static_assert(
@@ -118,25 +1587,79 @@ class FastPly {
   FastPly(const FastPly&) = delete;
   FastPly& operator=(const FastPly&) = delete;
 
-  bool open(const std::string& path);
+  /**
+   * @brief Maps the PLY file at path and sets up its elements.
+   *
+   * Elements are paged in on access. Elements whose struct skips or
+   * reorders declared properties are served from their records as well,
+   * and only shuffled into packed structs by the first accessor returning
+   * references (see PlyElementContainer::inPlace() and materialize()).
+   */
+  bool open(const std::string& path,
+            const OpenOptions& options = OpenOptions());
+
+  /**
+   * @brief Maps length bytes of fd starting at offset (0: up to the end of
+   * the file). fd is not closed and may be closed right after open returns.
+   * Throws std::system_error if the range exceeds the file.
+   */
+  bool open(int fd,
+            std::size_t offset,
+            std::size_t length = 0,
+            const OpenOptions& options = OpenOptions());
+
+  /**
+   * @brief Reads the PLY file from the caller's buffer, without copying.
+   *
+   * The buffer must outlive the FastPly object or stay valid until close().
+   * Binary data is used in place; ASCII data is converted into a new
+   * mapping. Mapping related options and advise() do not apply to buffers.
+   */
+  bool open(const void* data,
+            std::size_t length,
+            const OpenOptions& options = OpenOptions());
 
   void close();
 
+  /// Changes the access pattern hint for the whole mapping
+  void advise(AccessPattern access) const noexcept;
+
   std::string getInputPath() const noexcept { return path_; }
 
-  int getHeaderOffset() const noexcept { return header_length_; }
+  int getHeaderOffset() const noexcept {
+    return header_parsed_ ? static_cast<int>(header_.length) : -1;
+  }
+
+  bool isBigEndian() const noexcept { return header_.is_big_endian; }
 
-  bool isBigEndian() const noexcept { return is_big_endian_; }
+  /// True for ASCII files (converted to binary in host byte order on open)
+  bool isAscii() const noexcept { return header_.is_ascii; }
+
+  /// True if the file's byte order differs from the host's (see native())
+  bool needsByteSwap() const noexcept {
+    return !header_.is_ascii &&
+           header_.is_big_endian != detail::isHostBigEndian();
+  }
 
   bool isHeaderParsed() const noexcept { return header_parsed_; }
 
+  /// Properties of element i as declared in the header
+  const std::vector<PlyProperty>& properties(std::size_t i) const noexcept {
+    return header_.properties[i];
+  }
+
+  /// Fingerprint of the element and property declarations of the header
+  std::uint64_t schemaFingerprint() const noexcept {
+    return header_.schema_fingerprint;
+  }
+
   std::size_t numberElements() const noexcept { return num_element_definitions; }
 
   const auto& getElements() const noexcept { return elements_; }
 
   template <typename T>
   const auto& get() const noexcept {
-    return std::get<PlyElementContainer<T>>(elements_);
+    return std::get<element_container_t<T>>(elements_);
   }
 
   template <std::size_t I>
@@ -144,12 +1667,47 @@ class FastPly {
     return std::get<I>(elements_);
   }
 
+  /// Start of the binary element data (ASCII files: converted data)
+  const unsigned char* body() const noexcept {
+    return static_cast<const unsigned char*>(ptr_mapped_file_) + data_offset_;
+  }
+
+  /**
+   * @brief Offsets of the element blocks relative to body(): element i
+   * occupies [offsets[i], offsets[i + 1]).
+   */
+  std::array<std::size_t, sizeof...(Args) + 1> elementOffsets() const noexcept {
+    return elementOffsets(std::index_sequence_for<Args...>{});
+  }
+
+  /// Phases of the last open() (FASTPLY_INSTRUMENTATION only, else zero)
+  const OpenTimings& timings() const noexcept { return timings_; }
+
+  /**
+   * @brief Open timings and the page cache residency (mincore) of every
+   * element block. Pages shared by adjacent blocks count for both.
+   */
+  FileReport report() const;
+
  private:
-  bool parseHeader();
+  template <std::size_t... I>
+  std::array<std::size_t, sizeof...(Args) + 1> elementOffsets(
+      std::index_sequence<I...>) const noexcept {
+    return {{0, static_cast<std::size_t>(std::get<I>(elements_).blockEnd() -
+                                         body())...}};
+  }
+
+  bool setupMapping(const OpenOptions& options, int fd, off_t map_offset);
+
+  /// Opens path from the MappingCache, false if it is not cached
+  bool openShared(const std::string& path);
+
+  /// Hands the mapping of the file opened through fd to the MappingCache
+  void shareMapping(int fd);
 
-  bool readEncoding(std::istream& is);
+  bool parseHeader(const char* text, std::size_t length);
 
-  bool readElementDefinition(std::istream& is);
+  void convertAscii();
 
 #if defined(__cplusplus) && (__cplusplus == 201402L)
   template <std::size_t idx>
@@ -172,166 +1730,375 @@ class FastPly {
   template <typename T, typename... Ts>
   void resetElements();
 
+  /// Properties element i is checked against, none for known schemas
+  const std::vector<PlyProperty>& checkedProperties(std::size_t i) const
+      noexcept {
+    static const std::vector<PlyProperty> none;
+    const std::uint64_t known = SchemaFingerprint<Args...>::value;
+    return known != 0 && header_.schema_fingerprint == known
+               ? none
+               : header_.properties[i];
+  }
+
+  /// Pages can be dropped and read back from the file (see evict())
+  bool fileBacked() const noexcept {
+    return mapping_ != nullptr && !header_.is_ascii;
+  }
+
+  const unsigned char* dataEnd() const noexcept {
+    return static_cast<const unsigned char*>(ptr_mapped_file_) + file_length_;
+  }
+
   std::string path_ = "";                //!< Path to input ply file
-  bool is_big_endian_ = false;           //!< Encoding of ply file
-  std::size_t num_parsed_elements_ = 0;  //!< Elements parsed from ply header
-  int header_length_ = -1;               //!< Length of header in bytes
+  detail::PlyHeader<sizeof...(Args)> header_;  //!< Parsed ply header
   bool header_parsed_ = false;           //!< Indicates valid header
 
-  std::tuple<PlyElementContainer<Args>...>
+  std::tuple<element_container_t<Args>...>
       elements_;  //!< Element layouts in order as given as template params
   const unsigned int num_element_definitions =
       sizeof...(Args);  //!< Number of template params (known at compile time)
-  std::size_t element_count_[sizeof...(Args)] =
-      {};  //!< Num. elements per element definition
 
-  std::size_t file_length_;
-  void* ptr_mapped_file_ = nullptr;  //!< Ptr to start of mmap'ed file
+  std::size_t file_length_ = 0;       //!< Length of PLY data in bytes
+  void* ptr_mapped_file_ = nullptr;  //!< Ptr to start of PLY data
+  void* mapping_ = nullptr;  //!< Owned mapping (null for caller buffers)
+  std::size_t mapping_length_ = 0;  //!< Length of owned mapping in bytes
+  std::size_t data_offset_ = 0;  //!< Offset of first element in mapping
+  OpenTimings timings_;  //!< Phases of the last open()
+  std::shared_ptr<const detail::SharedMapping>
+      shared_;  //!< Owner of mapping_ if opened with OpenOptions::shared
 };
 
 template <typename... Args>
-bool FastPly<Args...>::open(const std::string& path) {
+bool FastPly<Args...>::open(const std::string& path,
+                            const OpenOptions& options) {
   if (!num_element_definitions)
     return false;
 
   if (ptr_mapped_file_ != nullptr)  // already opened
     return true;
 
-  path_ = path;
+  timings_ = OpenTimings();
+  detail::ScopedTimer timer(timings_.open_ns);  // outlives open(fd)
 
-  // Parse Header: This will only query the basic information
-  // such as little/big endian encoding, how many elements etc.
-  if (!parseHeader())
-    return false;
+  if (options.shared && openShared(path))
+    return true;
 
-  // Open file descriptor required by mmap
-  int fd = ::open(path_.c_str(), O_RDONLY, 0);
+  // One descriptor and one fstat: the header is parsed from the mapping
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
   if (fd == -1)
-    throw std::system_error(EFAULT, std::generic_category());
+    throw std::system_error(errno, std::generic_category());
+
+  bool opened = false;
+  try {
+    opened = open(fd, 0, 0, options);
+    if (opened && options.shared)
+      shareMapping(fd);
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  ::close(fd);  // can be closed
+  if (opened)
+    path_ = path;
+  return opened;
+}
+
+template <typename... Args>
+bool FastPly<Args...>::open(int fd,
+                            std::size_t offset,
+                            std::size_t length,
+                            const OpenOptions& options) {
+  if (!num_element_definitions)
+    return false;
+
+  if (ptr_mapped_file_ != nullptr)  // already opened
+    return true;
+
+  timings_ = OpenTimings();
+  detail::ScopedTimer timer(timings_.open_ns);
 
-  // Get filesize (required by mmap)
-  file_length_ = getFileSize(path_.c_str());
-  if (file_length_ <= 0)
+  // Pages mapped beyond the end of the file would raise SIGBUS on access
+  struct ::stat st;
+  if (fstat(fd, &st) == -1)
+    throw std::system_error(errno, std::generic_category());
+  const std::size_t size = static_cast<std::size_t>(st.st_size);
+  if (size <= offset || length > size - offset)
     throw std::system_error(EFAULT, std::generic_category());
+  if (length == 0)
+    length = size - offset;
+
+  // mmap needs a page aligned file offset
+  const std::size_t page_offset = offset % detail::pageSize();
+  const off_t map_offset = static_cast<off_t>(offset - page_offset);
+  mapping_length_ = page_offset + length;
+  mapping_ =
+      mmap(0, mapping_length_, PROT_READ, MAP_PRIVATE, fd, map_offset);
+  if (mapping_ == MAP_FAILED) {
+    mapping_ = nullptr;
+    mapping_length_ = 0;
+    throw std::runtime_error("Failed to memory map file descriptor");
+  }
+  ptr_mapped_file_ = static_cast<unsigned char*>(mapping_) + page_offset;
+  file_length_ = length;
+  return setupMapping(options, fd, map_offset);
+}
+
+template <typename... Args>
+bool FastPly<Args...>::open(const void* data,
+                            std::size_t length,
+                            const OpenOptions& options) {
+  if (!num_element_definitions)
+    return false;
+
+  if (ptr_mapped_file_ != nullptr)  // already opened
+    return true;
+
+  if (data == nullptr || length == 0)
+    throw std::invalid_argument("Cannot open an empty buffer");
+
+  timings_ = OpenTimings();
+  detail::ScopedTimer timer(timings_.open_ns);
+
+  ptr_mapped_file_ = const_cast<void*>(data);  // never written to
+  file_length_ = length;
+  return setupMapping(options, -1, 0);
+}
+
+template <typename... Args>
+bool FastPly<Args...>::setupMapping(const OpenOptions& options,
+                                    int fd,
+                                    off_t map_offset) {
+  // Parse Header: This will only query the basic information
+  // such as little/big endian encoding, how many elements etc.
+  bool parsed = false;
+  try {
+    detail::ScopedTimer timer(timings_.parse_header_ns);
+    parsed = parseHeader(static_cast<const char*>(ptr_mapped_file_),
+                         file_length_);
+  } catch (...) {
+    close();
+    throw;
+  }
+  if (!parsed) {
+    close();
+    return false;
+  }
+  if (header_.is_block_compressed) {
+    close();
+    throw std::runtime_error(
+        "Block compressed PLY files are read with FastPlyCompressed");
+  }
+  data_offset_ = header_.length;
+
+#ifdef MAP_POPULATE
+  // Prefaulting only pays off for binary files (ASCII files are read once),
+  // which is known only now: map again, populated
+  if (options.populate && !header_.is_ascii && mapping_ != nullptr) {
+    void* ptr = mmap(0, mapping_length_, PROT_READ,
+                     MAP_PRIVATE | MAP_POPULATE, fd, map_offset);
+    if (ptr != MAP_FAILED) {
+      const std::size_t page_offset = static_cast<std::size_t>(
+          static_cast<unsigned char*>(ptr_mapped_file_) -
+          static_cast<unsigned char*>(mapping_));
+      munmap(mapping_, mapping_length_);
+      mapping_ = ptr;
+      ptr_mapped_file_ = static_cast<unsigned char*>(ptr) + page_offset;
+    }
+  }
+#else
+  (void)fd;
+  (void)map_offset;
+#endif
 
-  // memory map the file descriptor
-  ptr_mapped_file_ = mmap(0, file_length_, PROT_READ, MAP_PRIVATE, fd, 0);
-  ::close(fd); // can be closed
-  if (ptr_mapped_file_ == MAP_FAILED) {
-    throw std::runtime_error("Failed to memory map " + path_);
+  // ASCII files are replaced by their binary representation
+  if (header_.is_ascii) {
+    try {
+      detail::ScopedTimer timer(timings_.convert_ascii_ns);
+      convertAscii();
+    } catch (...) {
+      close();
+      throw;
+    }
   }
 
+#ifdef MADV_HUGEPAGE
+  if (options.huge_pages && mapping_ != nullptr)
+    madvise(mapping_, mapping_length_, MADV_HUGEPAGE);
+#endif
+  if (options.access != AccessPattern::Normal)
+    advise(options.access);
+
   // Fill PlyElementContainers with information (num_elements, ptr offsets etc.)
-  setupElements<Args...>();
+  // and check them against the properties of the header
+  try {
+    detail::ScopedTimer timer(timings_.setup_elements_ns);
+    setupElements<Args...>();
+  } catch (...) {
+    close();
+    throw;
+  }
 
   return true;
 }
 
 template <typename... Args>
 void FastPly<Args...>::close() {
-  // Freeind mmaped memory
-  if (ptr_mapped_file_ != nullptr) {
-    if (munmap(ptr_mapped_file_, file_length_) == -1) {
+  // Freeind mmaped memory (shared mappings are released below)
+  if (mapping_ != nullptr && !shared_) {
+    if (munmap(mapping_, mapping_length_) == -1) {
       throw std::runtime_error("Failed to unmap memory!");
     }
-    ptr_mapped_file_ = nullptr;
   }
+  mapping_ = nullptr;
+  ptr_mapped_file_ = nullptr;
+  mapping_length_ = 0;
 
   file_length_ = 0;
+  data_offset_ = 0;
   path_ = "";
-  is_big_endian_ = false;
-  num_parsed_elements_ = 0;
-  header_length_ = -1;
+  header_.clear();
   header_parsed_ = false;
 
-  std::fill(element_count_, element_count_ + num_element_definitions, 0);
-
   resetElements<Args...>();
+
+  if (shared_) {
+    shared_.reset();
+    MappingCache::global().trim();
+  }
 }
 
 template <typename... Args>
-bool FastPly<Args...>::parseHeader() {
-  std::ifstream is(path_, std::ios::binary);
-  if (is.fail())
-    throw std::system_error(EFAULT, std::generic_category());
-
-  std::string line;
-  while (std::getline(is, line)) {
-    std::istringstream ls(line);
-    std::string keyword;
-    ls >> keyword;
-
-    // This transformation to all lower chars only handles ASCII.
-    // Ply files should only be ASCII (+binary), so it should be alright.
-    // Note: This allows slightly non-standard formats to be successfully
-    // parsed. aka PlY plY cOmMent, will be fine.
-    std::transform(keyword.begin(), keyword.end(), keyword.begin(), ::tolower);
+bool FastPly<Args...>::openShared(const std::string& path) {
+  struct ::stat st;
+  if (::stat(path.c_str(), &st) != 0)
+    return false;
+  shared_ = MappingCache::global().find(st);
+  if (!shared_)
+    return false;
 
-    if (keyword == "ply" || keyword == "")
-      continue;
-    else if (keyword == "comment")
-      continue;
-    else if (keyword == "format") {
-      if (!readEncoding(ls))
-        return false;
-    } else if (keyword == "element") {
-      if (!this->readElementDefinition(ls))
-        return false;
-    } else if (keyword == "property")
-      continue;
-    else if (keyword == "obj_info")
-      continue;
-    else if (keyword == "end_header")
-      break;
-    else {
-      throw std::runtime_error("Unknown keyword '" + keyword + "' found");
-      return false;  // exception or bool unexpected header field
+  try {
+    std::shared_ptr<const detail::PlyHeader<sizeof...(Args)>> header;
+    {
+      detail::ScopedTimer timer(timings_.parse_header_ns);
+      header = shared_->header<sizeof...(Args)>();
     }
+    if (!header) {
+      close();
+      return false;
+    }
+    header_ = *header;
+    header_parsed_ = true;
+    mapping_ = shared_->mapping;
+    mapping_length_ = shared_->mapping_length;
+    ptr_mapped_file_ = shared_->data;
+    file_length_ = shared_->length;
+    data_offset_ = shared_->data_offset;
+    {
+      // Set up once per mapping and element list, copied by later opens
+      detail::ScopedTimer timer(timings_.setup_elements_ns);
+      elements_ = *shared_->elements<decltype(elements_)>([this]() {
+        setupElements<Args...>();
+        return elements_;
+      });
+    }
+  } catch (...) {
+    close();
+    throw;
   }
+  path_ = path;
+  return true;
+}
 
-  header_length_ = is.tellg();
-  if (header_length_ <= 0) {
-    if (!is.eof())
-      throw std::runtime_error(
-          "Could not determine length of header. Empty file?");
+template <typename... Args>
+void FastPly<Args...>::shareMapping(int fd) {
+  struct ::stat st;
+  if (mapping_ == nullptr || fstat(fd, &st) != 0)
+    return;  // stays private
+
+  // Sharing is an optimization: on failure the file stays opened privately
+  try {
+    // ASCII files are converted, so their header is read from the file
+    std::string header(header_.length, '\0');
+    if (header_.is_ascii)
+      detail::readAll(fd, &header[0], header.size(), 0);
+    else
+      header.assign(static_cast<const char*>(ptr_mapped_file_),
+                    header_.length);
+
+    auto mapping = std::make_shared<detail::SharedMapping>(
+        mapping_, mapping_length_, ptr_mapped_file_, file_length_,
+        data_offset_, std::move(header));
+    shared_ = mapping;  // owns mapping_ from here on
+    mapping->setHeader(header_);
+    mapping->elements<decltype(elements_)>([this]() { return elements_; });
+    shared_ = MappingCache::global().insert(st, shared_);
+  } catch (...) {
   }
-
-  is.close();
-  header_parsed_ = true;
-  return true;
 }
 
 template <typename... Args>
-bool FastPly<Args...>::readEncoding(std::istream& is) {
-  std::string s;
-  (is >> s);
-  if (s == "binary_little_endian")
-    is_big_endian_ = false;
-  else if (s == "binary_big_endian")
-    is_big_endian_ = true;
-  else
-    return false;  // No support for ascii or typos ;).
-  return true;
+bool FastPly<Args...>::parseHeader(const char* text, std::size_t length) {
+  switch (header_.parse(text, length)) {
+    case detail::HeaderStatus::Complete:
+      header_parsed_ = true;
+      return true;
+    case detail::HeaderStatus::Invalid:
+      return false;
+    default:
+      throw std::runtime_error("PLY header is not terminated by end_header");
+  }
 }
 
 template <typename... Args>
-bool FastPly<Args...>::readElementDefinition(std::istream& is) {
-  // If we read more element definition keywords than defined
-  if (num_parsed_elements_ >= num_element_definitions) {
-    throw std::runtime_error(
-        "Definition of PLY file does not match the loaded file. More "
-        "element definitions found than number of template parameters!");
+FileReport FastPly<Args...>::report() const {
+  FileReport result;
+  result.path = path_;
+  result.timings = timings_;
+  if (ptr_mapped_file_ == nullptr)
+    return result;
+
+  const std::string names[] = {elementName<Args>()...};
+  const auto offsets = elementOffsets();
+  for (std::size_t i = 0; i < sizeof...(Args); ++i) {
+    ElementReport element;
+    element.name = names[i];
+    element.count = header_.counts[i];
+    element.residency =
+        detail::residency(body() + offsets[i], body() + offsets[i + 1]);
+    result.elements.push_back(std::move(element));
   }
+  return result;
+}
+
+template <typename... Args>
+void FastPly<Args...>::advise(AccessPattern access) const noexcept {
+  if (mapping_ != nullptr)
+    madvise(mapping_, mapping_length_, detail::adviceFor(access));
+}
 
-  std::string s;
-  (is >> s);  // s contains element name, not being used atm
+template <typename... Args>
+void FastPly<Args...>::convertAscii() {
+  detail::AsciiElement elements[sizeof...(Args)];
+  for (std::size_t i = 0; i < header_.num_elements; ++i) {
+    for (const auto& property : header_.properties[i])
+      if (plyTypeSize(property.type) == 0 ||
+          (property.is_list && plyTypeSize(property.count_type) == 0))
+        throw std::runtime_error("Unknown property type in ASCII file");
+    elements[i].count = header_.counts[i];
+    elements[i].properties = header_.properties[i].data();
+    elements[i].num_properties = header_.properties[i].size();
+  }
 
-  // Store number of instances of this element type
-  (is >> s);  // s contains element count as string
-  element_count_[num_parsed_elements_] = std::stoi(s);  // convert to number
+  const char* text = static_cast<const char*>(ptr_mapped_file_);
+  const detail::AsciiMapping binary = detail::convertAscii(
+      text + data_offset_, text + file_length_, elements,
+      header_.num_elements);
 
-  ++num_parsed_elements_;  // update the count of read elements
-  return true;
+  if (mapping_ != nullptr)
+    munmap(mapping_, mapping_length_);
+  mapping_ = ptr_mapped_file_ = binary.data;
+  mapping_length_ = file_length_ = std::max<std::size_t>(binary.length, 1);
+  data_offset_ = 0;
 }
 
 #if defined(__cplusplus) && (__cplusplus == 201402L)
@@ -339,20 +2106,15 @@ template <typename... Args>
 template <std::size_t idx>
 void FastPly<Args...>::setupInnerElementImpl() {
   auto& el = std::get<idx + 1>(elements_);
-  el.size_ = element_count_[idx + 1];
-  unsigned char const* start =
-      reinterpret_cast<unsigned char const*>(std::get<(idx)>(elements_).end_);
-  el.begin_ = reinterpret_cast<decltype(el.begin_)>(start);
-  el.end_ = el.begin_ + el.size_;
+  el.setupBlock(std::get<(idx)>(elements_).blockEnd(), dataEnd(),
+                header_.counts[idx + 1], needsByteSwap(), fileBacked(),
+                header_.names[idx + 1], checkedProperties(idx + 1));
 }
 
 template <typename... Args>
 template <std::size_t idx>
 void FastPly<Args...>::resetInnerElementImpl() {
-  auto& el = std::get<idx>(elements_);
-  el.size_ = 0;
-  el.begin_ = nullptr;
-  el.end_ = nullptr;
+  std::get<idx>(elements_).resetBlock();
 }
 
 template <typename... Args>
@@ -374,11 +2136,10 @@ template <typename T, typename... Ts>
 void FastPly<Args...>::setupElements() {
   // Setup first element (special case)
   auto& el = std::get<0>(elements_);
-  el.size_ = element_count_[0];
   unsigned char const* start =
-      static_cast<unsigned char const*>(ptr_mapped_file_) + header_length_;
-  el.begin_ = reinterpret_cast<decltype(el.begin_)>(start);
-  el.end_ = el.begin_ + el.size_;
+      static_cast<unsigned char const*>(ptr_mapped_file_) + data_offset_;
+  el.setupBlock(start, dataEnd(), header_.counts[0], needsByteSwap(),
+                fileBacked(), header_.names[0], checkedProperties(0));
 
   // Setup remaining elements
   auto remaining_indices =
@@ -403,19 +2164,17 @@ void FastPly<Args...>::setupElements() {
 
   // Get element and fill in the size
   auto& el = std::get<idx>(elements_);
-  el.size_ = element_count_[idx];
 
   unsigned char const* start;
   if constexpr (idx == 0) {
     start =
-        static_cast<unsigned char const*>(ptr_mapped_file_) + header_length_;
+        static_cast<unsigned char const*>(ptr_mapped_file_) + data_offset_;
   } else {
-    start = reinterpret_cast<unsigned char const*>(
-        std::get<(idx - 1)>(elements_).end_);
+    start = std::get<(idx - 1)>(elements_).blockEnd();
   }
 
-  el.begin_ = reinterpret_cast<decltype(el.begin_)>(start);
-  el.end_ = el.begin_ + el.size_;
+  el.setupBlock(start, dataEnd(), header_.counts[idx], needsByteSwap(),
+                fileBacked(), header_.names[idx], checkedProperties(idx));
 
   if constexpr (sizeof...(Ts) > 0) {
     setupElements<Ts...>();
@@ -428,11 +2187,7 @@ void FastPly<Args...>::resetElements() {
   // Index of current element to setup
   constexpr int idx = sizeof...(Args) - sizeof...(Ts) - 1;
 
-  // Get element and fill in the size
-  auto& el = std::get<idx>(elements_);
-  el.size_ = 0;
-  el.begin_ = nullptr;
-  el.end_ = nullptr;
+  std::get<idx>(elements_).resetBlock();
 
   if constexpr (sizeof...(Ts) > 0) {
     resetElements<Ts...>();
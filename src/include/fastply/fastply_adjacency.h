@@ -0,0 +1,567 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "fastply/fastply.h"
+#include "fastply/fastply_index.h"
+#include "fastply/fastply_parallel.h"
+#include "fastply/fastply_sidecar.h"
+
+namespace fastply {
+
+/// Options for MeshAdjacency::build()
+struct AdjacencyOptions {
+  bool edges = false;    //!< Also build the edge tables
+  unsigned threads = 0;  //!< Number of threads (0: global pool)
+};
+
+/// Default location of the adjacency sidecar of a PLY file
+inline std::string adjacencyPath(const std::string& ply_path) {
+  return ply_path + ".adj";
+}
+
+namespace detail {
+
+/// Header of the adjacency sidecar, stored in host byte order
+struct AdjacencyHeader {
+  char magic[8];              //!< "FPLYADJ" followed by '\0'
+  std::uint32_t version;      //!< Format version
+  std::uint32_t byte_order;   //!< 0x01020304 as written by the host
+  std::uint64_t num_vertices;  //!< Number of vertices
+  std::uint64_t num_faces;    //!< Number of faces (lists)
+  std::uint64_t num_corners;  //!< Sum of the list lengths
+  std::uint64_t fingerprint;  //!< Hash of the size and sampled lists
+  std::uint64_t has_edges;    //!< Edge tables are stored
+  std::uint64_t num_edges;    //!< Number of undirected edges
+  MappingKey source;          //!< PLY file the adjacency was built from
+};
+
+constexpr std::uint32_t kAdjacencyVersion() noexcept { return 2; }
+
+/// Offset of the first table in the sidecar
+constexpr std::size_t kAdjacencyDataOffset() noexcept { return 128; }
+
+static_assert(sizeof(AdjacencyHeader) <= kAdjacencyDataOffset(),
+              "Sidecar header does not fit in front of the tables");
+
+/// Faces per task of the parallel passes
+constexpr std::size_t kAdjacencyFacesPerTask = std::size_t(1) << 16;
+
+/**
+ * @brief Positions (in 64 bit words after the header) of the tables of the
+ * sidecar. Edge targets come last, so the file can be cut to the number of
+ * edges found.
+ */
+struct AdjacencyLayout {
+  std::size_t vertex_offsets;  //!< num_vertices + 1 row offsets
+  std::size_t vertex_faces;    //!< num_corners face indices
+  std::size_t face_offsets;    //!< num_faces + 1 corner offsets (edges)
+  std::size_t face_edges;      //!< num_corners edge indices (edges)
+  std::size_t edge_offsets;    //!< num_vertices + 1 row offsets (edges)
+  std::size_t edge_targets;    //!< num_edges higher end points (edges)
+  std::size_t length;          //!< File length in bytes
+
+  AdjacencyLayout(std::size_t num_vertices,
+                  std::size_t num_faces,
+                  std::size_t num_corners,
+                  bool edges,
+                  std::size_t num_edges) noexcept {
+    vertex_offsets = 0;
+    vertex_faces = vertex_offsets + num_vertices + 1;
+    face_offsets = vertex_faces + num_corners;
+    face_edges = face_offsets + (edges ? num_faces + 1 : 0);
+    edge_offsets = face_edges + (edges ? num_corners : 0);
+    edge_targets = edge_offsets + (edges ? num_vertices + 1 : 0);
+    length = kAdjacencyDataOffset() +
+             (edge_targets + num_edges) * sizeof(std::uint64_t);
+  }
+};
+
+/// Vertex referenced by a list value, throws if it is out of range
+template <typename V>
+std::uint64_t vertexIndex(V value, std::size_t num_vertices) {
+  // Negative values wrap around to huge indices
+  const std::uint64_t index = static_cast<std::uint64_t>(value);
+  if (index >= num_vertices)
+    throw std::out_of_range("Face refers to a vertex out of range");
+  return index;
+}
+
+/// Calls fn(f, faces[f]) for all faces, in parallel
+template <typename F, typename Fn>
+void forEachFace(const PlyListElementContainer<F>& faces,
+                 unsigned threads,
+                 Fn&& fn) {
+  const std::size_t count = faces.size();
+  const std::size_t tasks =
+      (count + kAdjacencyFacesPerTask - 1) / kAdjacencyFacesPerTask;
+  runTasks(tasks, threads, [&](std::size_t t) {
+    const std::size_t last =
+        std::min(count, (t + 1) * kAdjacencyFacesPerTask);
+    for (std::size_t f = t * kAdjacencyFacesPerTask; f < last; ++f)
+      fn(f, faces[f]);
+  });
+}
+
+/// Replaces counts[0, n) by their exclusive prefix sums, counts[n] = total
+inline void exclusiveScan(std::uint64_t* counts,
+                          std::size_t n,
+                          unsigned threads) {
+  const std::size_t tasks =
+      std::max<std::size_t>(1, std::min<std::size_t>(n >> 16, 256));
+  std::vector<std::uint64_t> sums(tasks + 1, 0);
+  runTasks(tasks, threads, [&](std::size_t t) {
+    std::uint64_t sum = 0;
+    for (std::size_t i = n * t / tasks; i < n * (t + 1) / tasks; ++i)
+      sum += counts[i];
+    sums[t + 1] = sum;
+  });
+  for (std::size_t t = 0; t < tasks; ++t)
+    sums[t + 1] += sums[t];
+  runTasks(tasks, threads, [&](std::size_t t) {
+    std::uint64_t sum = sums[t];
+    for (std::size_t i = n * t / tasks; i < n * (t + 1) / tasks; ++i) {
+      const std::uint64_t count = counts[i];
+      counts[i] = sum;
+      sum += count;
+    }
+  });
+  counts[n] = sums[tasks];
+}
+
+/**
+ * @brief Second pass of a count/scatter: appends value to the row of key.
+ * offsets holds the row starts and afterwards the row ends, see
+ * finishScatter().
+ */
+inline void scatter(std::uint64_t* offsets,
+                    std::uint64_t* values,
+                    std::uint64_t key,
+                    std::uint64_t value) noexcept {
+  values[__atomic_fetch_add(&offsets[key], 1, __ATOMIC_RELAXED)] = value;
+}
+
+/// Restores the row starts of n rows after scatter() and sorts every row
+inline void finishScatter(std::uint64_t* offsets,
+                          std::uint64_t* values,
+                          std::size_t n,
+                          unsigned threads) {
+  std::memmove(offsets + 1, offsets, n * sizeof(std::uint64_t));
+  offsets[0] = 0;
+  const std::size_t tasks =
+      std::max<std::size_t>(1, std::min<std::size_t>(n >> 12, 1024));
+  runTasks(tasks, threads, [&](std::size_t t) {
+    for (std::size_t i = n * t / tasks; i < n * (t + 1) / tasks; ++i)
+      std::sort(values + offsets[i], values + offsets[i + 1]);
+  });
+}
+
+template <typename F>
+std::uint64_t faceFingerprint(const PlyListElementContainer<F>& faces) {
+  const std::uint64_t sizes[2] = {faces.size(), faces.sizeBytes()};
+  std::uint64_t hash = fnv1a(sizes, sizeof(sizes));
+  using V = typename PlyListElementContainer<F>::list_value_type;
+  for (std::size_t k = 0; faces.size() && k <= 64; ++k) {
+    const auto list = faces[k * (faces.size() - 1) / 64];
+    hash = fnv1a(list.data(), list.size() * sizeof(V), hash);
+  }
+  return hash;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Vertex to face adjacency of a mesh in compressed sparse row (CSR)
+ * form, optionally with edge tables, stored in a memory mapped sidecar file.
+ *
+ * build() streams the lists of the face element from the mapped PLY file
+ * in two parallel passes (count, then scatter) straight into the mapped
+ * sidecar, so neither the faces nor the adjacency need to fit into memory.
+ * It is reopened without any work with open() (openOrBuild() combines
+ * both), as long as the PLY file it was built from (see SidecarSource) is
+ * unchanged.
+ *
+ * The edge tables number the undirected edges by their lower end point,
+ * then by their higher end point, and map every half-edge (corner k of a
+ * face, joining its vertices k and k + 1) to its edge.
+ */
+class MeshAdjacency {
+ public:
+  MeshAdjacency() = default;
+
+  ~MeshAdjacency() { close(); }
+
+  MeshAdjacency(const MeshAdjacency&) = delete;
+  MeshAdjacency& operator=(const MeshAdjacency&) = delete;
+
+  /**
+   * @brief Maps the sidecar at path.
+   *
+   * @return False if it does not exist or was not built from this version
+   * of source, or for these faces (compared by their size and a hash of
+   * sampled lists)
+   */
+  template <typename F>
+  bool open(const std::string& path,
+            const SidecarSource& source,
+            const PlyListElementContainer<F>& faces,
+            std::size_t num_vertices);
+
+  /**
+   * @brief Builds the adjacency of the faces and writes it to path.
+   *
+   * The file is written to a unique temporary file next to path and renamed
+   * once complete.
+   *
+   * @throws std::out_of_range if a face refers to a vertex >= num_vertices
+   */
+  template <typename F>
+  void build(const std::string& path,
+             const SidecarSource& source,
+             const PlyListElementContainer<F>& faces,
+             std::size_t num_vertices,
+             const AdjacencyOptions& options = AdjacencyOptions());
+
+  /// Opens the sidecar at path, rebuilding it if missing, stale or if it
+  /// lacks requested edge tables
+  template <typename F>
+  void openOrBuild(const std::string& path,
+                   const SidecarSource& source,
+                   const PlyListElementContainer<F>& faces,
+                   std::size_t num_vertices,
+                   const AdjacencyOptions& options = AdjacencyOptions()) {
+    if (!open(path, source, faces, num_vertices) ||
+        (options.edges && !hasEdges()))
+      build(path, source, faces, num_vertices, options);
+  }
+
+  void close();
+
+  bool isOpen() const noexcept { return ptr_mapped_file_ != nullptr; }
+
+  std::size_t numVertices() const noexcept { return num_vertices_; }
+
+  std::size_t numFaces() const noexcept { return num_faces_; }
+
+  /// True if the edge tables were built (see AdjacencyOptions::edges)
+  bool hasEdges() const noexcept { return edge_offsets_ != nullptr; }
+
+  /// Number of undirected edges (0 without edge tables)
+  std::size_t numEdges() const noexcept { return num_edges_; }
+
+  /// Faces using vertex v in ascending order (repeated if used repeatedly)
+  IndexSpan faces(std::size_t v) const noexcept {
+    return {vertex_faces_ + vertex_offsets_[v],
+            vertex_faces_ + vertex_offsets_[v + 1]};
+  }
+
+  /// Index of the first edge whose lower end point is v
+  std::size_t firstEdge(std::size_t v) const noexcept {
+    return static_cast<std::size_t>(edge_offsets_[v]);
+  }
+
+  /**
+   * @brief Higher end points of the edges whose lower end point is v, in
+   * ascending order; entry i belongs to edge firstEdge(v) + i.
+   */
+  IndexSpan neighbors(std::size_t v) const noexcept {
+    return {edge_targets_ + edge_offsets_[v],
+            edge_targets_ + edge_offsets_[v + 1]};
+  }
+
+  /// End points of edge e, lower first
+  std::array<std::uint64_t, 2> edge(std::size_t e) const noexcept {
+    const std::uint64_t* row =
+        std::upper_bound(edge_offsets_, edge_offsets_ + num_vertices_ + 1,
+                         static_cast<std::uint64_t>(e)) -
+        1;
+    return {{static_cast<std::uint64_t>(row - edge_offsets_),
+             edge_targets_[e]}};
+  }
+
+  /// Index of the edge joining vertices a and b, numEdges() if none
+  std::size_t findEdge(std::size_t a, std::size_t b) const noexcept {
+    const std::size_t lo = std::min(a, b);
+    const IndexSpan row = neighbors(lo);
+    const auto it = std::lower_bound(row.begin(), row.end(),
+                                     std::uint64_t(std::max(a, b)));
+    if (it == row.end() || *it != std::max(a, b))
+      return num_edges_;
+    return firstEdge(lo) + static_cast<std::size_t>(it - row.begin());
+  }
+
+  /// Edges of face f; entry k joins its vertices k and k + 1 (cyclic)
+  IndexSpan faceEdges(std::size_t f) const noexcept {
+    return {face_edges_ + face_offsets_[f], face_edges_ + face_offsets_[f + 1]};
+  }
+
+ private:
+  template <typename F>
+  static detail::AdjacencyHeader describe(
+      const SidecarSource& source,
+      const PlyListElementContainer<F>& faces,
+      std::size_t num_vertices);
+
+  template <typename F>
+  static void buildEdges(const PlyListElementContainer<F>& faces,
+                         std::size_t num_vertices,
+                         const detail::AdjacencyLayout& layout,
+                         std::uint64_t* tables,
+                         unsigned threads);
+
+  void map(void* ptr, std::size_t length, const detail::AdjacencyHeader& h);
+
+  std::size_t num_vertices_ = 0;  //!< Number of vertices
+  std::size_t num_faces_ = 0;     //!< Number of faces
+  std::size_t num_edges_ = 0;     //!< Number of undirected edges
+  const std::uint64_t* vertex_offsets_ = nullptr;  //!< Rows of faces()
+  const std::uint64_t* vertex_faces_ = nullptr;    //!< Faces by vertex
+  const std::uint64_t* face_offsets_ = nullptr;    //!< Rows of faceEdges()
+  const std::uint64_t* face_edges_ = nullptr;      //!< Edges by face corner
+  const std::uint64_t* edge_offsets_ = nullptr;    //!< Rows of neighbors()
+  const std::uint64_t* edge_targets_ = nullptr;    //!< Higher end points
+  std::size_t file_length_ = 0;      //!< Length of mapped sidecar in bytes
+  void* ptr_mapped_file_ = nullptr;  //!< Ptr to start of mmap'ed sidecar
+};
+
+template <typename F>
+detail::AdjacencyHeader MeshAdjacency::describe(
+    const SidecarSource& source,
+    const PlyListElementContainer<F>& faces,
+    std::size_t num_vertices) {
+  using count_type = typename PlyListElementContainer<F>::count_type;
+  using V = typename PlyListElementContainer<F>::list_value_type;
+  static_assert(std::is_integral<V>::value,
+                "Vertex indices must be of integral type");
+  detail::AdjacencyHeader header = {};
+  std::memcpy(header.magic, "FPLYADJ", 8);
+  header.version = detail::kAdjacencyVersion();
+  header.byte_order = detail::kIndexByteOrder();
+  header.num_vertices = num_vertices;
+  header.num_faces = faces.size();
+  header.num_corners =
+      (faces.sizeBytes() - faces.size() * sizeof(count_type)) / sizeof(V);
+  header.fingerprint = detail::faceFingerprint(faces);
+  header.source = source.key();
+  return header;
+}
+
+template <typename F>
+bool MeshAdjacency::open(const std::string& path,
+                         const SidecarSource& source,
+                         const PlyListElementContainer<F>& faces,
+                         std::size_t num_vertices) {
+  close();
+  std::size_t length = 0;
+  void* ptr =
+      detail::mapSidecar(path, detail::kAdjacencyDataOffset(), length);
+  if (ptr == nullptr)
+    return false;
+
+  detail::AdjacencyHeader stored;
+  std::memcpy(&stored, ptr, sizeof(stored));
+  const detail::AdjacencyHeader expected =
+      describe(source, faces, num_vertices);
+  const detail::AdjacencyLayout layout(
+      num_vertices, faces.size(),
+      static_cast<std::size_t>(expected.num_corners), stored.has_edges != 0,
+      static_cast<std::size_t>(stored.num_edges));
+  const std::uint64_t* tables = reinterpret_cast<const std::uint64_t*>(
+      static_cast<const unsigned char*>(ptr) + detail::kAdjacencyDataOffset());
+  if (std::memcmp(&stored, &expected,
+                  offsetof(detail::AdjacencyHeader, has_edges)) ||
+      !(stored.source == expected.source) || length != layout.length ||
+      // Rows span exactly the stored tables
+      tables[layout.vertex_offsets] != 0 ||
+      tables[layout.vertex_offsets + num_vertices] != expected.num_corners ||
+      (stored.has_edges &&
+       (tables[layout.face_offsets + faces.size()] != expected.num_corners ||
+        tables[layout.edge_offsets + num_vertices] != stored.num_edges))) {
+    munmap(ptr, length);
+    return false;
+  }
+  map(ptr, length, stored);
+  return true;
+}
+
+inline void MeshAdjacency::map(void* ptr,
+                               std::size_t length,
+                               const detail::AdjacencyHeader& header) {
+  ptr_mapped_file_ = ptr;
+  file_length_ = length;
+  num_vertices_ = static_cast<std::size_t>(header.num_vertices);
+  num_faces_ = static_cast<std::size_t>(header.num_faces);
+  num_edges_ = static_cast<std::size_t>(header.num_edges);
+  const detail::AdjacencyLayout layout(
+      num_vertices_, num_faces_, static_cast<std::size_t>(header.num_corners),
+      header.has_edges != 0, num_edges_);
+  const std::uint64_t* tables = reinterpret_cast<const std::uint64_t*>(
+      static_cast<const unsigned char*>(ptr) + detail::kAdjacencyDataOffset());
+  vertex_offsets_ = tables + layout.vertex_offsets;
+  vertex_faces_ = tables + layout.vertex_faces;
+  if (header.has_edges) {
+    face_offsets_ = tables + layout.face_offsets;
+    face_edges_ = tables + layout.face_edges;
+    edge_offsets_ = tables + layout.edge_offsets;
+    edge_targets_ = tables + layout.edge_targets;
+  }
+}
+
+template <typename F>
+void MeshAdjacency::build(const std::string& path,
+                          const SidecarSource& source,
+                          const PlyListElementContainer<F>& faces,
+                          std::size_t num_vertices,
+                          const AdjacencyOptions& options) {
+  close();
+  detail::AdjacencyHeader header = describe(source, faces, num_vertices);
+  const std::size_t num_corners =
+      static_cast<std::size_t>(header.num_corners);
+  // There are at most as many edges as corners; the file is cut afterwards
+  const detail::AdjacencyLayout upper(num_vertices, faces.size(), num_corners,
+                                      options.edges,
+                                      options.edges ? num_corners : 0);
+  detail::SidecarWriter writer(path, upper.length);
+
+  // The tables start out zeroed (ftruncate)
+  std::uint64_t* tables = reinterpret_cast<std::uint64_t*>(
+      writer.data() + detail::kAdjacencyDataOffset());
+  std::uint64_t* vertex_offsets = tables + upper.vertex_offsets;
+  std::uint64_t* vertex_faces = tables + upper.vertex_faces;
+  const unsigned threads = options.threads;
+  detail::forEachFace(faces, threads, [&](std::size_t, const auto& list) {
+    for (const auto v : list) {
+      const std::uint64_t i = detail::vertexIndex(v, num_vertices);
+      __atomic_fetch_add(&vertex_offsets[i], 1, __ATOMIC_RELAXED);
+    }
+  });
+  detail::exclusiveScan(vertex_offsets, num_vertices, threads);
+  detail::forEachFace(faces, threads, [&](std::size_t f, const auto& list) {
+    for (const auto v : list)
+      detail::scatter(vertex_offsets, vertex_faces,
+                      static_cast<std::uint64_t>(v), f);
+  });
+  detail::finishScatter(vertex_offsets, vertex_faces, num_vertices, threads);
+
+  if (options.edges) {
+    buildEdges(faces, num_vertices, upper, tables, threads);
+    header.has_edges = 1;
+    header.num_edges = tables[upper.edge_offsets + num_vertices];
+  }
+
+  std::memcpy(writer.data(), &header, sizeof(header));
+  const detail::AdjacencyLayout layout(
+      num_vertices, faces.size(), num_corners, options.edges,
+      static_cast<std::size_t>(header.num_edges));
+  writer.commit(layout.length);
+
+  if (!open(path, source, faces, num_vertices))
+    throw std::runtime_error("Failed to open mesh adjacency " + path);
+}
+
+template <typename F>
+void MeshAdjacency::buildEdges(const PlyListElementContainer<F>& faces,
+                               std::size_t num_vertices,
+                               const detail::AdjacencyLayout& layout,
+                               std::uint64_t* tables,
+                               unsigned threads) {
+  std::uint64_t* face_offsets = tables + layout.face_offsets;
+  std::uint64_t* face_edges = tables + layout.face_edges;
+  std::uint64_t* edge_offsets = tables + layout.edge_offsets;
+  std::uint64_t* targets = tables + layout.edge_targets;
+  auto corner = [](const auto& list, std::size_t k) {
+    const std::uint64_t a = static_cast<std::uint64_t>(list[k]);
+    const std::uint64_t b =
+        static_cast<std::uint64_t>(list[k + 1 == list.size() ? 0 : k + 1]);
+    return std::make_pair(std::min(a, b), std::max(a, b));
+  };
+
+  // Half-edges by lower end point (vertices were checked before)
+  detail::forEachFace(faces, threads, [&](std::size_t f, const auto& list) {
+    face_offsets[f] = list.size();
+    for (std::size_t k = 0; k < list.size(); ++k)
+      __atomic_fetch_add(&edge_offsets[corner(list, k).first], 1,
+                         __ATOMIC_RELAXED);
+  });
+  detail::exclusiveScan(face_offsets, faces.size(), threads);
+  detail::exclusiveScan(edge_offsets, num_vertices, threads);
+  detail::forEachFace(faces, threads, [&](std::size_t, const auto& list) {
+    for (std::size_t k = 0; k < list.size(); ++k) {
+      const auto edge = corner(list, k);
+      detail::scatter(edge_offsets, targets, edge.first, edge.second);
+    }
+  });
+  detail::finishScatter(edge_offsets, targets, num_vertices, threads);
+
+  // Duplicates (edges shared by faces) are dropped by one sequential pass,
+  // moving every row to the front; rows never move past unread entries
+  std::uint64_t write = 0, begin = 0;
+  for (std::size_t v = 0; v < num_vertices; ++v) {
+    const std::uint64_t end = edge_offsets[v + 1];
+    edge_offsets[v] = write;
+    for (std::uint64_t i = begin; i < end; ++i)
+      if (write == edge_offsets[v] || targets[write - 1] != targets[i])
+        targets[write++] = targets[i];
+    begin = end;
+  }
+  edge_offsets[num_vertices] = write;
+
+  detail::forEachFace(faces, threads, [&](std::size_t f, const auto& list) {
+    for (std::size_t k = 0; k < list.size(); ++k) {
+      const auto edge = corner(list, k);
+      const std::uint64_t* row = targets + edge_offsets[edge.first];
+      const std::uint64_t* row_end = targets + edge_offsets[edge.first + 1];
+      face_edges[face_offsets[f] + k] = static_cast<std::uint64_t>(
+          std::lower_bound(row, row_end, edge.second) - targets);
+    }
+  });
+}
+
+inline void MeshAdjacency::close() {
+  if (ptr_mapped_file_ != nullptr) {
+    if (munmap(ptr_mapped_file_, file_length_) == -1)
+      throw std::runtime_error("Failed to unmap memory!");
+    ptr_mapped_file_ = nullptr;
+  }
+  vertex_offsets_ = nullptr;
+  vertex_faces_ = nullptr;
+  face_offsets_ = nullptr;
+  face_edges_ = nullptr;
+  edge_offsets_ = nullptr;
+  edge_targets_ = nullptr;
+  file_length_ = 0;
+  num_vertices_ = 0;
+  num_faces_ = 0;
+  num_edges_ = 0;
+}
+
+}  // namespace fastply
@@ -0,0 +1,193 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "fastply/fastply.h"
+#include "fastply/fastply_options.h"
+#include "fastply/fastply_parallel.h"
+
+namespace fastply {
+namespace detail {
+
+/**
+ * @brief Splits a block of count records of size bytes into chunks whose
+ * boundaries lie on multiples of chunkBytes() in the address space.
+ *
+ * chunkBytes() is a power of two between the page size and 2MB, so chunk
+ * edges coincide with page (and huge page) boundaries and no two chunks fault
+ * in the same page, except for the one record straddling each edge. A record
+ * belongs to the chunk containing its first byte.
+ */
+class PageChunks {
+ public:
+  PageChunks(const void* data,
+             std::size_t count,
+             std::size_t size,
+             unsigned participants) noexcept
+      : base_(reinterpret_cast<std::uintptr_t>(data)),
+        count_(count),
+        size_(size) {
+    // Several chunks per participant, so stealing can balance the load
+    const std::size_t target = std::max<std::size_t>(1, participants) * 8;
+    const std::size_t bytes = count * size;
+    chunk_bytes_ = pageSize();
+    while (chunk_bytes_ < kMaxChunkBytes() && chunk_bytes_ * target < bytes)
+      chunk_bytes_ *= 2;
+    first_chunk_ = base_ / chunk_bytes_;
+    if (count_)
+      num_chunks_ =
+          (base_ + bytes + chunk_bytes_ - 1) / chunk_bytes_ - first_chunk_;
+  }
+
+  static constexpr std::size_t kMaxChunkBytes() noexcept {
+    return std::size_t(2) << 20;
+  }
+
+  std::size_t chunkBytes() const noexcept { return chunk_bytes_; }
+
+  std::size_t size() const noexcept { return num_chunks_; }
+
+  /// Records [first, last) of chunk k
+  std::pair<std::size_t, std::size_t> operator[](std::size_t k) const
+      noexcept {
+    return {recordAt((first_chunk_ + k) * chunk_bytes_),
+            recordAt((first_chunk_ + k + 1) * chunk_bytes_)};
+  }
+
+ private:
+  /// Index of the first record starting at or after address
+  std::size_t recordAt(std::uintptr_t address) const noexcept {
+    if (address <= base_)
+      return 0;
+    return std::min(count_, (address - base_ + size_ - 1) / size_);
+  }
+
+  std::uintptr_t base_;
+  std::size_t count_;
+  std::size_t size_;
+  std::size_t chunk_bytes_ = 0;
+  std::size_t first_chunk_ = 0;
+  std::size_t num_chunks_ = 0;
+};
+
+/// Runs fn(first, last) for all page aligned chunks of the container
+template <typename T, typename F>
+void forEachChunk(const PlyElementContainer<T>& container,
+                  unsigned threads,
+                  F&& fn) {
+  const unsigned participants =
+      threads ? threads : WorkStealingPool::global().size();
+  const PageChunks chunks(container.data(), container.size(), sizeof(T),
+                          participants);
+  runTasks(chunks.size(), threads, [&](std::size_t k) {
+    const auto range = chunks[k];
+    if (range.first < range.second)
+      fn(range.first, range.second);
+  });
+}
+
+/**
+ * @brief Computes fn(first, last) for all non-empty page aligned chunks and
+ * combines the partial results with init in chunk order.
+ */
+template <typename T, typename R, typename ChunkFn, typename Combine>
+R reduceChunks(const PlyElementContainer<T>& container,
+               unsigned threads,
+               R init,
+               ChunkFn fn,
+               Combine combine) {
+  const unsigned participants =
+      threads ? threads : WorkStealingPool::global().size();
+  const PageChunks chunks(container.data(), container.size(), sizeof(T),
+                          participants);
+  std::vector<R> partial(chunks.size(), init);
+  std::vector<char> valid(chunks.size(), 0);
+  runTasks(chunks.size(), threads, [&](std::size_t k) {
+    const auto range = chunks[k];
+    if (range.first >= range.second)
+      return;
+    partial[k] = fn(range.first, range.second);
+    valid[k] = 1;
+  });
+
+  for (std::size_t k = 0; k < chunks.size(); ++k)
+    if (valid[k])
+      init = combine(std::move(init), std::move(partial[k]));
+  return init;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Calls fn(element) for all elements of the container in parallel
+ * (threads: 0 uses the global pool). The order of the calls is unspecified.
+ */
+template <typename T, typename F>
+void parallel_for_each(const PlyElementContainer<T>& container,
+                       F fn,
+                       unsigned threads = 0) {
+  detail::forEachChunk(container, threads,
+                       [&](std::size_t first, std::size_t last) {
+                         for (std::size_t i = first; i < last; ++i)
+                           fn(container[i]);
+                       });
+}
+
+/**
+ * @brief Reduces transform(element) over all elements with reduce, starting
+ * from init. Partial results of the chunks are combined in element order, so
+ * the result does not depend on the scheduling (reduce must be associative).
+ */
+template <typename T, typename R, typename Reduce, typename Transform>
+R parallel_transform_reduce(const PlyElementContainer<T>& container,
+                            R init,
+                            Reduce reduce,
+                            Transform transform,
+                            unsigned threads = 0) {
+  return detail::reduceChunks(
+      container, threads, std::move(init),
+      [&](std::size_t first, std::size_t last) {
+        R value = transform(container[first]);
+        for (std::size_t i = first + 1; i < last; ++i)
+          value = reduce(std::move(value), transform(container[i]));
+        return value;
+      },
+      reduce);
+}
+
+/// Number of elements for which pred(element) is true
+template <typename T, typename Pred>
+std::size_t parallel_count_if(const PlyElementContainer<T>& container,
+                              Pred pred,
+                              unsigned threads = 0) {
+  return parallel_transform_reduce(
+      container, std::size_t(0), std::plus<std::size_t>(),
+      [&](const T& element) -> std::size_t { return pred(element) ? 1 : 0; },
+      threads);
+}
+
+}  // namespace fastply
@@ -0,0 +1,560 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <locale.h>
+#include <sys/mman.h>
+#if defined(__APPLE__)
+#include <xlocale.h>
+#endif
+
+#include "fastply/fastply_parallel.h"
+#include "fastply/fastply_simd.h"
+#include "fastply/fastply_types.h"
+
+namespace fastply {
+namespace detail {
+
+/// Body bytes per parallel ASCII parsing task
+constexpr std::size_t kAsciiChunkBytes = std::size_t(4) << 20;
+
+inline std::size_t countNewlinesScalar(const char* begin,
+                                       const char* end) noexcept {
+  return static_cast<std::size_t>(std::count(begin, end, '\n'));
+}
+
+#if FASTPLY_X86_DISPATCH
+// Matches are accumulated in 8 bit lanes and folded with psadbw before the
+// lanes can overflow.
+FASTPLY_TARGET_AVX2 inline std::size_t countNewlinesAvx2(
+    const char* begin,
+    const char* end) noexcept {
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i total = _mm256_setzero_si256();
+  while (end - begin >= 32) {
+    __m256i acc = _mm256_setzero_si256();
+    for (int i = 0; i < 255 && end - begin >= 32; ++i, begin += 32) {
+      const __m256i v =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+      acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(v, newline));
+    }
+    total = _mm256_add_epi64(total, _mm256_sad_epu8(acc, zero));
+  }
+  alignas(32) std::uint64_t lanes[4];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), total);
+  return static_cast<std::size_t>(lanes[0] + lanes[1] + lanes[2] + lanes[3]) +
+         countNewlinesScalar(begin, end);
+}
+#endif
+
+/// Counts the line feeds in [begin, end)
+inline std::size_t countNewlines(const char* begin, const char* end) noexcept {
+#if FASTPLY_X86_DISPATCH
+  if (cpuHasAvx2())
+    return countNewlinesAvx2(begin, end);
+#endif
+  return countNewlinesScalar(begin, end);
+}
+
+/// Whitespace separating values of a record (records are separated by '\n')
+inline bool isAsciiBlank(char c) noexcept {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline bool isBlankLine(const char* begin, const char* end) noexcept {
+  return std::all_of(begin, end, isAsciiBlank);
+}
+
+/// Splits a record into tokens
+class AsciiTokenizer {
+ public:
+  AsciiTokenizer(const char* begin, const char* end) noexcept
+      : ptr_(begin), end_(end) {}
+
+  bool next(const char*& token_begin, const char*& token_end) noexcept {
+    while (ptr_ != end_ && isAsciiBlank(*ptr_))
+      ++ptr_;
+    if (ptr_ == end_)
+      return false;
+    token_begin = ptr_;
+    while (ptr_ != end_ && !isAsciiBlank(*ptr_))
+      ++ptr_;
+    token_end = ptr_;
+    return true;
+  }
+
+  bool atEnd() noexcept {
+    while (ptr_ != end_ && isAsciiBlank(*ptr_))
+      ++ptr_;
+    return ptr_ == end_;
+  }
+
+ private:
+  const char* ptr_;
+  const char* end_;
+};
+
+/// Parses a decimal integer; false on malformed input or overflow of I
+template <typename I>
+bool parseInteger(const char* begin, const char* end, I& out) noexcept {
+  bool negative = false;
+  if (begin != end && (*begin == '-' || *begin == '+'))
+    negative = *begin++ == '-';
+  if (begin == end)
+    return false;
+
+  std::uint64_t value = 0;
+  for (; begin != end; ++begin) {
+    const unsigned digit = static_cast<unsigned char>(*begin) - '0';
+    if (digit > 9 || value > (std::numeric_limits<std::uint64_t>::max() -
+                              digit) / 10)
+      return false;
+    value = value * 10 + digit;
+  }
+
+  if (negative) {
+    const std::uint64_t limit =
+        std::is_signed<I>::value
+            ? static_cast<std::uint64_t>(std::numeric_limits<I>::max()) + 1
+            : 0;
+    if (value > limit)
+      return false;
+    out = static_cast<I>(0 - value);
+  } else {
+    if (value > static_cast<std::uint64_t>(std::numeric_limits<I>::max()))
+      return false;
+    out = static_cast<I>(value);
+  }
+  return true;
+}
+
+/**
+ * @brief Locale independent fallback for values the fast path cannot convert
+ * exactly (long mantissas, large exponents, nan, inf).
+ */
+template <typename F>
+bool parseFloatSlow(const char* begin, const char* end, F& out) {
+  static const locale_t c_locale = newlocale(LC_ALL_MASK, "C", locale_t(0));
+  char buffer[128];
+  const std::size_t length = static_cast<std::size_t>(end - begin);
+  if (length >= sizeof(buffer))
+    return false;
+  std::memcpy(buffer, begin, length);
+  buffer[length] = '\0';
+  char* parsed_end = nullptr;
+  if (sizeof(F) == sizeof(float))
+    out = static_cast<F>(strtof_l(buffer, &parsed_end, c_locale));
+  else
+    out = static_cast<F>(strtod_l(buffer, &parsed_end, c_locale));
+  return parsed_end == buffer + length;
+}
+
+/**
+ * @brief Parses a floating point value without locale (correctly rounded).
+ *
+ * Decimal values with at most 19 significant digits and a mantissa below
+ * 2^53 are converted exactly via a single multiplication or division by an
+ * exact power of ten (Clinger's fast path). Floats are rounded from that
+ * double, unless it lies exactly halfway between two floats.
+ */
+template <typename F>
+bool parseFloat(const char* begin, const char* end, F& out) {
+  static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                  1e18, 1e19, 1e20, 1e21, 1e22};
+  const char* p = begin;
+  bool negative = false;
+  if (p != end && (*p == '-' || *p == '+'))
+    negative = *p++ == '-';
+
+  std::uint64_t mantissa = 0;
+  int digits = 0;      // significant digits consumed
+  int exponent = 0;    // decimal exponent
+  bool any = false;    // any digit found
+  bool exact = true;   // mantissa holds all significant digits
+  for (; p != end && *p >= '0' && *p <= '9'; ++p) {
+    any = true;
+    if (digits < 19) {
+      mantissa = mantissa * 10 + static_cast<unsigned>(*p - '0');
+      digits += mantissa != 0;
+    } else {
+      exact &= *p == '0';
+      ++exponent;
+    }
+  }
+  if (p != end && *p == '.') {
+    for (++p; p != end && *p >= '0' && *p <= '9'; ++p) {
+      any = true;
+      if (digits < 19) {
+        mantissa = mantissa * 10 + static_cast<unsigned>(*p - '0');
+        digits += mantissa != 0;
+        --exponent;
+      } else {
+        exact &= *p == '0';
+      }
+    }
+  }
+  if (!any)
+    return parseFloatSlow(begin, end, out);  // nan, inf, ...
+
+  if (p != end && (*p == 'e' || *p == 'E')) {
+    int exp_value = 0;
+    if (!parseInteger(p + 1, end, exp_value))
+      return false;
+    if (exp_value > 10000 || exp_value < -10000)
+      return parseFloatSlow(begin, end, out);
+    exponent += exp_value;
+    p = end;
+  }
+  if (p != end)
+    return false;
+
+  if (mantissa == 0) {
+    out = negative ? -F(0) : F(0);
+    return true;
+  }
+
+  if (!exact || mantissa > (std::uint64_t(1) << 53) || exponent < -22 ||
+      exponent > 22)
+    return parseFloatSlow(begin, end, out);
+
+  double value = static_cast<double>(mantissa);
+  value = exponent < 0 ? value / powers[-exponent] : value * powers[exponent];
+  if (negative)
+    value = -value;
+
+  if (sizeof(F) == sizeof(float)) {
+    // Rounding the double to float is exact unless the double is a float
+    // midpoint: the 29 mantissa bits below float precision are 100..0. Floats
+    // with reduced (subnormal) precision always take the slow path.
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const std::uint64_t low = bits & ((std::uint64_t(1) << 29) - 1);
+    if (low == (std::uint64_t(1) << 28) ||
+        std::fabs(value) < static_cast<double>(
+                               std::numeric_limits<float>::min()))
+      return parseFloatSlow(begin, end, out);
+    out = static_cast<F>(static_cast<float>(value));
+  } else {
+    out = static_cast<F>(value);
+  }
+  return true;
+}
+
+/// Parses one token as the given type into out (native byte order)
+inline bool parseAsciiValue(PlyType type,
+                            const char* begin,
+                            const char* end,
+                            unsigned char* out) {
+  switch (type) {
+#define FASTPLY_PARSE_CASE_(ply_type, c_type, parser) \
+  case PlyType::ply_type: {                           \
+    c_type v;                                         \
+    if (!parser(begin, end, v))                       \
+      return false;                                   \
+    std::memcpy(out, &v, sizeof(v));                  \
+    return true;                                      \
+  }
+    FASTPLY_PARSE_CASE_(Int8, std::int8_t, parseInteger)
+    FASTPLY_PARSE_CASE_(UInt8, std::uint8_t, parseInteger)
+    FASTPLY_PARSE_CASE_(Int16, std::int16_t, parseInteger)
+    FASTPLY_PARSE_CASE_(UInt16, std::uint16_t, parseInteger)
+    FASTPLY_PARSE_CASE_(Int32, std::int32_t, parseInteger)
+    FASTPLY_PARSE_CASE_(UInt32, std::uint32_t, parseInteger)
+    FASTPLY_PARSE_CASE_(Float32, float, parseFloat)
+    FASTPLY_PARSE_CASE_(Float64, double, parseFloat)
+#undef FASTPLY_PARSE_CASE_
+    default:
+      return false;
+  }
+}
+
+/// Element declaration as required for converting its ASCII records
+struct AsciiElement {
+  std::size_t count = 0;
+  const PlyProperty* properties = nullptr;
+  std::size_t num_properties = 0;
+
+  bool hasList() const noexcept {
+    for (std::size_t i = 0; i < num_properties; ++i)
+      if (properties[i].is_list)
+        return true;
+    return false;
+  }
+
+  /// Binary size of a record without list properties
+  std::size_t fixedSize() const noexcept {
+    std::size_t size = 0;
+    for (std::size_t i = 0; i < num_properties; ++i)
+      size += plyTypeSize(properties[i].type);
+    return size;
+  }
+};
+
+[[noreturn]] inline void throwAsciiError(std::size_t line,
+                                         const char* what) {
+  throw std::runtime_error(std::string(what) + " in line " +
+                           std::to_string(line + 1) + " of the ASCII body");
+}
+
+/// Binary size of a record containing list properties
+inline std::size_t asciiRecordSize(const char* begin,
+                                   const char* end,
+                                   const AsciiElement& el,
+                                   std::size_t line) {
+  AsciiTokenizer tokens(begin, end);
+  const char* tb;
+  const char* te;
+  std::size_t size = 0;
+  for (std::size_t i = 0; i < el.num_properties; ++i) {
+    const PlyProperty& prop = el.properties[i];
+    if (!tokens.next(tb, te))
+      throwAsciiError(line, "Missing value");
+    if (!prop.is_list) {
+      size += plyTypeSize(prop.type);
+      continue;
+    }
+    std::uint32_t length;
+    if (!parseInteger(tb, te, length))
+      throwAsciiError(line, "Malformed list length");
+    for (std::uint32_t j = 0; j < length; ++j)
+      if (!tokens.next(tb, te))
+        throwAsciiError(line, "Missing list value");
+    size += plyTypeSize(prop.count_type) + length * plyTypeSize(prop.type);
+  }
+  return size;
+}
+
+/// Converts a record into its binary representation, returns bytes written
+inline std::size_t parseAsciiRecord(const char* begin,
+                                    const char* end,
+                                    const AsciiElement& el,
+                                    unsigned char* out,
+                                    std::size_t line) {
+  AsciiTokenizer tokens(begin, end);
+  const char* tb;
+  const char* te;
+  unsigned char* const start = out;
+  for (std::size_t i = 0; i < el.num_properties; ++i) {
+    const PlyProperty& prop = el.properties[i];
+    if (!tokens.next(tb, te))
+      throwAsciiError(line, "Missing value");
+    if (!prop.is_list) {
+      if (!parseAsciiValue(prop.type, tb, te, out))
+        throwAsciiError(line, "Malformed value");
+      out += plyTypeSize(prop.type);
+      continue;
+    }
+    std::uint32_t length;
+    if (!parseInteger(tb, te, length) ||
+        !parseAsciiValue(prop.count_type, tb, te, out))
+      throwAsciiError(line, "Malformed list length");
+    out += plyTypeSize(prop.count_type);
+    for (std::uint32_t j = 0; j < length; ++j) {
+      if (!tokens.next(tb, te))
+        throwAsciiError(line, "Missing list value");
+      if (!parseAsciiValue(prop.type, tb, te, out))
+        throwAsciiError(line, "Malformed list value");
+      out += plyTypeSize(prop.type);
+    }
+  }
+  if (!tokens.atEnd())
+    throwAsciiError(line, "Unexpected value");
+  return static_cast<std::size_t>(out - start);
+}
+
+/// Anonymous memory holding the converted (binary, native) elements
+struct AsciiMapping {
+  void* data = nullptr;
+  std::size_t length = 0;
+};
+
+/**
+ * @brief Converts the ASCII body [begin, end) of a PLY file into the binary
+ * representation in host byte order, stored in an anonymous mapping.
+ *
+ * Every record is expected on its own line. The body is split into line
+ * aligned chunks which are processed in parallel: First the lines of every
+ * chunk are counted (vectorized), which assigns each line to its element and
+ * record. For elements with list properties, a second pass determines the
+ * binary size of the records of each chunk. The final pass parses all records
+ * directly into their place in the output.
+ *
+ * @param threads Number of threads (0: one per core)
+ * @param chunk_bytes Minimal size of a chunk
+ */
+inline AsciiMapping convertAscii(const char* begin,
+                                 const char* end,
+                                 const AsciiElement* elements,
+                                 std::size_t num_elements,
+                                 unsigned threads = 0,
+                                 std::size_t chunk_bytes = kAsciiChunkBytes) {
+  if (threads == 0)
+    threads = defaultConcurrency();
+  const std::size_t size = static_cast<std::size_t>(end - begin);
+
+  // Line aligned chunks
+  std::size_t num_chunks =
+      std::min<std::size_t>(size / std::max<std::size_t>(chunk_bytes, 1) + 1,
+                            std::size_t(threads) * 4);
+  std::vector<const char*> bounds{begin};
+  for (std::size_t c = 1; c < num_chunks; ++c) {
+    const char* p = begin + c * (size / num_chunks);
+    if (p <= bounds.back())
+      continue;
+    const void* nl =
+        std::memchr(p - 1, '\n', static_cast<std::size_t>(end - p + 1));
+    if (!nl)
+      break;
+    const char* next = static_cast<const char*>(nl) + 1;
+    if (next > bounds.back() && next < end)
+      bounds.push_back(next);
+  }
+  bounds.push_back(end);
+  num_chunks = bounds.size() - 1;
+
+  // Pass 1: Lines per chunk
+  std::vector<std::size_t> chunk_line(num_chunks + 1, 0);
+  runTasks(num_chunks, threads, [&](std::size_t c) {
+    const char* cb = bounds[c];
+    const char* ce = bounds[c + 1];
+    std::size_t lines = countNewlines(cb, ce);
+    if (ce == end && ce != cb && ce[-1] != '\n')
+      ++lines;  // last line without line feed
+    chunk_line[c + 1] = lines;
+  });
+  for (std::size_t c = 0; c < num_chunks; ++c)
+    chunk_line[c + 1] += chunk_line[c];
+
+  std::vector<std::size_t> element_line(num_elements + 1, 0);
+  for (std::size_t k = 0; k < num_elements; ++k)
+    element_line[k + 1] = element_line[k] + elements[k].count;
+  const std::size_t num_records = element_line[num_elements];
+  if (chunk_line[num_chunks] < num_records)
+    throw std::runtime_error(
+        "ASCII body ends before all declared elements were read");
+
+  // Calls fn(line index, element index, line begin, line end) for all lines
+  auto forEachLine = [&](std::size_t c, auto&& fn) {
+    std::size_t line = chunk_line[c];
+    std::size_t k = 0;
+    while (k < num_elements && element_line[k + 1] <= line)
+      ++k;
+    const char* p = bounds[c];
+    const char* ce = bounds[c + 1];
+    while (p < ce) {
+      const void* nl = std::memchr(p, '\n', static_cast<std::size_t>(ce - p));
+      const char* line_end = nl ? static_cast<const char*>(nl) : ce;
+      while (k < num_elements && element_line[k + 1] <= line)
+        ++k;
+      fn(line, k, p, line_end);
+      p = line_end + 1;
+      ++line;
+    }
+  };
+
+  // Pass 2: Binary size of list records per chunk and element
+  bool any_list = false;
+  std::vector<char> has_list(num_elements);
+  for (std::size_t k = 0; k < num_elements; ++k)
+    any_list |= (has_list[k] = elements[k].hasList()) != 0;
+
+  std::vector<std::size_t> chunk_bytes_of(num_chunks * num_elements, 0);
+  if (any_list) {
+    runTasks(num_chunks, threads, [&](std::size_t c) {
+      std::size_t* bytes = &chunk_bytes_of[c * num_elements];
+      forEachLine(c, [&](std::size_t line, std::size_t k, const char* lb,
+                         const char* le) {
+        if (k < num_elements && has_list[k])
+          bytes[k] += asciiRecordSize(lb, le, elements[k], line);
+      });
+    });
+  }
+
+  // Placement of elements and of the list records of every chunk
+  std::vector<std::size_t> element_base(num_elements + 1, 0);
+  std::vector<std::size_t> chunk_offset(num_chunks * num_elements, 0);
+  for (std::size_t k = 0; k < num_elements; ++k) {
+    std::size_t bytes = 0;
+    if (has_list[k]) {
+      for (std::size_t c = 0; c < num_chunks; ++c) {
+        chunk_offset[c * num_elements + k] = element_base[k] + bytes;
+        bytes += chunk_bytes_of[c * num_elements + k];
+      }
+    } else {
+      bytes = elements[k].count * elements[k].fixedSize();
+    }
+    element_base[k + 1] = element_base[k] + bytes;
+  }
+
+  AsciiMapping mapping;
+  mapping.length = element_base[num_elements];
+  void* ptr = mmap(nullptr, std::max<std::size_t>(mapping.length, 1),
+                   PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED)
+    throw std::runtime_error("Failed to allocate memory for ASCII elements");
+  mapping.data = ptr;
+  unsigned char* const out = static_cast<unsigned char*>(ptr);
+
+  // Pass 3: Parse records into place
+  try {
+    runTasks(num_chunks, threads, [&](std::size_t c) {
+      std::size_t* offsets = &chunk_offset[c * num_elements];
+      forEachLine(c, [&](std::size_t line, std::size_t k, const char* lb,
+                         const char* le) {
+        if (k >= num_elements) {
+          if (!isBlankLine(lb, le))
+            throwAsciiError(line, "Data beyond the declared elements");
+          return;
+        }
+        const AsciiElement& el = elements[k];
+        if (has_list[k]) {
+          offsets[k] += parseAsciiRecord(lb, le, el, out + offsets[k], line);
+        } else {
+          const std::size_t record = line - element_line[k];
+          parseAsciiRecord(lb, le, el,
+                           out + element_base[k] + record * el.fixedSize(),
+                           line);
+        }
+      });
+    });
+  } catch (...) {
+    munmap(ptr, std::max<std::size_t>(mapping.length, 1));
+    throw;
+  }
+
+  return mapping;
+}
+
+}  // namespace detail
+}  // namespace fastply
@@ -0,0 +1,791 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && !defined(FASTPLY_NO_IO_URING)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup)
+#define FASTPLY_HAS_IO_URING 1
+#endif
+#endif
+
+#include "fastply/fastply.h"
+#include "fastply/fastply_header.h"
+#include "fastply/fastply_options.h"
+#include "fastply/fastply_parallel.h"
+
+namespace fastply {
+
+/// I/O backend of FastPlyAsync
+enum class AsyncBackend {
+  Auto,     //!< io_uring if the kernel supports it, otherwise Pread
+  IoUring,  //!< io_uring (Linux 5.1+), throws if unavailable
+  Pread     //!< Pool of threads issuing blocking pread()
+};
+
+/// Options for FastPlyAsync::open()
+struct AsyncOptions {
+  AsyncBackend backend = AsyncBackend::Auto;
+  unsigned queue_depth = 64;  //!< Reads in flight (one buffer each)
+  std::size_t buffer_size = 256 << 10;  //!< Bytes per buffer
+  unsigned threads = 4;  //!< Threads of the pread backend
+};
+
+/**
+ * @brief A finished read of FastPlyAsync.
+ *
+ * The records are stored in one of the buffers of the reader and stay valid
+ * until the completion is released (FastPlyAsync::release()).
+ */
+struct AsyncCompletion {
+  std::uint64_t id = 0;       //!< Returned by FastPlyAsync::read()
+  std::size_t element = 0;    //!< Index of the element type
+  std::size_t first = 0;      //!< Index of the first record
+  std::size_t count = 0;      //!< Number of records
+  const unsigned char* data = nullptr;  //!< Records as stored in the file
+  int error = 0;               //!< errno of a failed read (data invalid)
+  std::size_t buffer = 0;      //!< Buffer holding the records
+
+  template <typename T>
+  const T* records() const noexcept {
+    return reinterpret_cast<const T*>(data);
+  }
+};
+
+namespace detail {
+
+#if defined(FASTPLY_HAS_IO_URING)
+/**
+ * @brief Minimal io_uring (submission and completion ring) on top of the raw
+ * system calls, reading into registered buffers if possible.
+ *
+ * Single threaded: submit() and reap() must not be called concurrently.
+ */
+class IoUring {
+ public:
+  /// Ring with entries slots, nullptr if io_uring is not available
+  static std::unique_ptr<IoUring> create(unsigned entries,
+                                         const std::vector<iovec>& buffers) {
+    std::unique_ptr<IoUring> ring(new IoUring());
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ring->fd_ = static_cast<int>(
+        syscall(__NR_io_uring_setup, entries, &params));
+    if (ring->fd_ < 0)
+      return nullptr;
+    if (!ring->map(params))
+      return nullptr;
+    // Fixed buffers save the page pinning per read, but count against
+    // RLIMIT_MEMLOCK on older kernels; plain reads work regardless
+    ring->fixed_buffers_ =
+        syscall(__NR_io_uring_register, ring->fd_, IORING_REGISTER_BUFFERS,
+                buffers.data(), static_cast<unsigned>(buffers.size())) == 0;
+    return ring;
+  }
+
+  ~IoUring() {
+    if (sqes_ != nullptr)
+      munmap(sqes_, sqes_size_);
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_)
+      munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_ != nullptr)
+      munmap(sq_ring_, sq_ring_size_);
+    if (fd_ >= 0)
+      ::close(fd_);
+  }
+
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  bool fixedBuffers() const noexcept { return fixed_buffers_; }
+
+  /// Queues a read; at most entries reads may be in flight
+  void submit(int fd,
+              std::uint64_t offset,
+              void* data,
+              std::size_t length,
+              unsigned buffer,
+              std::uint64_t user_data) noexcept {
+    const unsigned tail = *sq_tail_;
+    const unsigned index = tail & *sq_mask_;
+    io_uring_sqe& sqe = sqes_[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = fixed_buffers_ ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe.fd = fd;
+    sqe.off = offset;
+    sqe.addr = reinterpret_cast<std::uint64_t>(data);
+    sqe.len = static_cast<std::uint32_t>(length);
+    sqe.buf_index = static_cast<std::uint16_t>(buffer);
+    sqe.user_data = user_data;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    ++unsubmitted_;
+  }
+
+  /**
+   * @brief Submits queued reads, waits for at least min_complete completions
+   * and calls fn(user_data, result) for each; result is the number of bytes
+   * read or -errno.
+   */
+  template <typename F>
+  std::size_t reap(std::size_t min_complete, F&& fn) {
+    std::size_t reaped = drain(fn);
+    while (unsubmitted_ || reaped < min_complete) {
+      const unsigned wait =
+          reaped < min_complete ? IORING_ENTER_GETEVENTS : 0u;
+      const long submitted =
+          syscall(__NR_io_uring_enter, fd_, unsubmitted_,
+                  wait ? static_cast<unsigned>(min_complete - reaped) : 0u,
+                  wait, nullptr, 0);
+      if (submitted < 0) {
+        if (errno == EINTR)
+          continue;
+        if (errno != EAGAIN && errno != EBUSY)
+          throw std::system_error(errno, std::generic_category());
+      } else {
+        unsubmitted_ -= static_cast<unsigned>(submitted);
+      }
+      reaped += drain(fn);
+    }
+    return reaped;
+  }
+
+ private:
+  IoUring() = default;
+
+  bool map(const io_uring_params& params) {
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single)
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+      sq_ring_ = nullptr;
+      return false;
+    }
+    cq_ring_ = single ? sq_ring_
+                      : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, fd_,
+                             IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      cq_ring_ = nullptr;
+      return false;
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+      return false;
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    unsigned char* sq = static_cast<unsigned char*>(sq_ring_);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    unsigned char* cq = static_cast<unsigned char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  template <typename F>
+  std::size_t drain(F& fn) {
+    std::size_t reaped = 0;
+    unsigned head = *cq_head_;
+    while (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+      const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+      const std::uint64_t user_data = cqe.user_data;
+      const int result = cqe.res;
+      __atomic_store_n(cq_head_, ++head, __ATOMIC_RELEASE);
+      fn(user_data, result);  // may submit() again
+      ++reaped;
+    }
+    return reaped;
+  }
+
+  int fd_ = -1;
+  bool fixed_buffers_ = false;  //!< Buffers are registered with the ring
+  unsigned unsubmitted_ = 0;    //!< Queued but not yet submitted reads
+  void* sq_ring_ = nullptr;     //!< Submission ring mapping
+  void* cq_ring_ = nullptr;     //!< Completion ring mapping (may be shared)
+  std::size_t sq_ring_size_ = 0;
+  std::size_t cq_ring_size_ = 0;
+  io_uring_sqe* sqes_ = nullptr;  //!< Submission queue entries
+  std::size_t sqes_size_ = 0;
+  unsigned* sq_tail_ = nullptr;
+  unsigned* sq_mask_ = nullptr;
+  unsigned* sq_array_ = nullptr;
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned* cq_mask_ = nullptr;
+  io_uring_cqe* cqes_ = nullptr;
+};
+#endif
+
+/// Threads issuing blocking pread() for queued reads (io_uring fallback)
+class PreadPool {
+ public:
+  explicit PreadPool(unsigned threads) {
+    for (unsigned t = 0; t < std::max(threads, 1u); ++t)
+      workers_.emplace_back([this] { work(); });
+  }
+
+  ~PreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    queued_.notify_all();
+    for (auto& worker : workers_)
+      worker.join();
+  }
+
+  PreadPool(const PreadPool&) = delete;
+  PreadPool& operator=(const PreadPool&) = delete;
+
+  void submit(int fd,
+              std::uint64_t offset,
+              void* data,
+              std::size_t length,
+              unsigned /* buffer */,
+              std::uint64_t user_data) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      requests_.push_back({fd, offset, data, length, user_data});
+    }
+    queued_.notify_one();
+  }
+
+  /// See IoUring::reap()
+  template <typename F>
+  std::size_t reap(std::size_t min_complete, F&& fn) {
+    std::size_t reaped = 0;
+    std::vector<std::pair<std::uint64_t, int>> done;
+    while (reaped < min_complete) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        completed_.wait(lock, [this] { return !completions_.empty(); });
+        done.swap(completions_);
+      }
+      for (const auto& completion : done)
+        fn(completion.first, completion.second);  // may submit() again
+      reaped += done.size();
+      done.clear();
+    }
+    return reaped;
+  }
+
+ private:
+  struct Request {
+    int fd;
+    std::uint64_t offset;
+    void* data;
+    std::size_t length;
+    std::uint64_t user_data;
+  };
+
+  void work() {
+    for (;;) {
+      Request request;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        queued_.wait(lock, [this] { return stop_ || !requests_.empty(); });
+        if (stop_)
+          return;
+        request = requests_.front();
+        requests_.pop_front();
+      }
+      ssize_t n;
+      do {
+        n = ::pread(request.fd, request.data, request.length,
+                    static_cast<off_t>(request.offset));
+      } while (n == -1 && errno == EINTR);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        completions_.emplace_back(request.user_data,
+                                  n == -1 ? -errno : static_cast<int>(n));
+      }
+      completed_.notify_one();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable queued_;     //!< Signals new requests
+  std::condition_variable completed_;  //!< Signals new completions
+  std::deque<Request> requests_;
+  std::vector<std::pair<std::uint64_t, int>> completions_;
+  bool stop_ = false;
+  std::vector<std::thread> workers_;
+};
+
+/**
+ * @brief End of the list element block starting at offset, found by
+ * reading the record lengths (buffered pread()).
+ */
+template <typename T>
+std::uint64_t scanListBlock(int fd,
+                            std::uint64_t offset,
+                            std::size_t count,
+                            bool byte_swap) {
+  using count_type = typename T::fastply_count_type;
+  using value_type = typename T::fastply_value_type;
+  std::vector<unsigned char> buffer(1 << 20);
+  std::uint64_t buffer_offset = offset;
+  std::size_t buffered = 0;
+  for (std::size_t i = 0; i < count; ++i) {
+    if (offset + sizeof(count_type) > buffer_offset + buffered) {
+      buffer_offset = offset;
+      buffered = 0;
+      while (buffered < sizeof(count_type)) {
+        const ssize_t n = ::pread(fd, buffer.data() + buffered,
+                                  buffer.size() - buffered,
+                                  static_cast<off_t>(offset + buffered));
+        if (n == -1 && errno == EINTR)
+          continue;
+        if (n == -1)
+          throw std::system_error(errno, std::generic_category());
+        if (n == 0)
+          throw std::runtime_error("PLY file is truncated");
+        buffered += static_cast<std::size_t>(n);
+      }
+    }
+    const count_type length = loadUnaligned<count_type>(
+        buffer.data() + (offset - buffer_offset), byte_swap);
+    if (static_cast<long long>(length) < 0)
+      throw std::runtime_error("Negative list length found");
+    offset += sizeof(count_type) +
+              static_cast<std::uint64_t>(length) * sizeof(value_type);
+  }
+  return offset;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Reads records of a binary PLY file with explicit, asynchronous
+ * reads instead of a memory mapping.
+ *
+ * Reads go into a fixed pool of buffers (registered with io_uring, or
+ * filled by a pool of pread() threads), so one thread can keep many reads
+ * in flight without taking page faults. Only fixed size elements can be
+ * read; list elements are scanned once on open to locate the elements
+ * following them. Records are read as stored: open() throws if an element
+ * is not stored like its struct.
+ *
+ * Not thread-safe: reads are issued and completed by one thread.
+ */
+template <typename... Args>
+class FastPlyAsync {
+  static_assert(sizeof...(Args),
+                "FastPlyAsync expects at least one element definition as "
+                "template parameter.");
+
+ public:
+  FastPlyAsync() = default;
+
+  ~FastPlyAsync() { close(); }
+
+  FastPlyAsync(const FastPlyAsync&) = delete;
+  FastPlyAsync& operator=(const FastPlyAsync&) = delete;
+
+  bool open(const std::string& path,
+            const AsyncOptions& options = AsyncOptions());
+
+  /// Waits for reads in flight, then releases all resources
+  void close();
+
+  bool isOpen() const noexcept { return fd_ != -1; }
+
+  bool isBigEndian() const noexcept { return header_.is_big_endian; }
+
+  bool needsByteSwap() const noexcept {
+    return header_.is_big_endian != detail::isHostBigEndian();
+  }
+
+  /// Backend in use (IoUring or Pread)
+  AsyncBackend backend() const noexcept {
+#if defined(FASTPLY_HAS_IO_URING)
+    if (ring_)
+      return AsyncBackend::IoUring;
+#endif
+    return AsyncBackend::Pread;
+  }
+
+  template <typename T>
+  std::size_t size() const noexcept {
+    return header_.counts[detail::IndexOf<T, Args...>::value];
+  }
+
+  /// Largest number of records of type T a single read can return
+  template <typename T>
+  std::size_t maxRecords() const noexcept {
+    return buffer_size_ / sizeof(T);
+  }
+
+  std::size_t inFlight() const noexcept { return in_flight_; }
+
+  /**
+   * @brief Starts reading records [first, first + count) of element T.
+   *
+   * @return Id of the read (see AsyncCompletion), or 0 if all buffers are in
+   * use (wait for and release completions first)
+   * @throws std::out_of_range if the range is out of range or larger than
+   * maxRecords<T>()
+   */
+  template <typename T>
+  std::uint64_t read(std::size_t first, std::size_t count);
+
+  /**
+   * @brief Waits for at least min_complete reads (no more than are in
+   * flight) and appends the finished ones to out.
+   *
+   * @return Number of completions appended
+   */
+  std::size_t wait(std::vector<AsyncCompletion>& out,
+                   std::size_t min_complete = 1);
+
+  /// Hands the buffer of a completion back for further reads
+  void release(const AsyncCompletion& completion) noexcept {
+    free_.push_back(completion.buffer);
+  }
+
+  /**
+   * @brief Reads records [first, first + count) of element T with all
+   * buffers in flight and calls fn(const T* records, std::size_t n) for the
+   * chunks in order.
+   *
+   * @throws std::runtime_error if reads started with read() are pending
+   */
+  template <typename T, typename F>
+  void forEachChunk(std::size_t first, std::size_t count, F&& fn);
+
+ private:
+  /// Bookkeeping of one buffer
+  struct Slot {
+    AsyncCompletion completion;
+    std::uint64_t offset = 0;  //!< File offset of the read
+    std::size_t length = 0;    //!< Bytes to read
+    std::size_t done = 0;      //!< Bytes read so far
+  };
+
+  void submit(std::size_t buffer);
+
+  std::size_t reap(std::size_t min_complete);
+
+  template <std::size_t... I>
+  void setupElements(std::index_sequence<I...>);
+
+  template <std::size_t I>
+  std::uint64_t elementEnd(std::uint64_t offset, std::false_type) const {
+    using T = typename std::tuple_element<I, std::tuple<Args...>>::type;
+    return offset + static_cast<std::uint64_t>(header_.counts[I]) * sizeof(T);
+  }
+
+  template <std::size_t I>
+  std::uint64_t elementEnd(std::uint64_t offset, std::true_type) const {
+    using T = typename std::tuple_element<I, std::tuple<Args...>>::type;
+    return detail::scanListBlock<T>(fd_, offset, header_.counts[I],
+                                    needsByteSwap());
+  }
+
+  int fd_ = -1;
+  detail::PlyHeader<sizeof...(Args)> header_;  //!< Parsed ply header
+  std::uint64_t offsets_[sizeof...(Args)];     //!< File offsets of elements
+  unsigned char* buffers_ = nullptr;  //!< All buffers, one mapping
+  std::size_t buffer_size_ = 0;       //!< Bytes per buffer
+  std::vector<Slot> slots_;           //!< One per buffer
+  std::vector<std::size_t> free_;     //!< Unused buffers
+  std::vector<AsyncCompletion> done_;  //!< Finished, not yet returned
+  std::size_t in_flight_ = 0;          //!< Reads not yet finished
+  std::uint64_t next_id_ = 1;
+#if defined(FASTPLY_HAS_IO_URING)
+  std::unique_ptr<detail::IoUring> ring_;
+#endif
+  std::unique_ptr<detail::PreadPool> pool_;
+};
+
+template <typename... Args>
+bool FastPlyAsync<Args...>::open(const std::string& path,
+                                 const AsyncOptions& options) {
+  if (fd_ != -1)  // already opened
+    return true;
+
+  fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ == -1)
+    throw std::system_error(errno, std::generic_category());
+  try {
+    detail::HeaderStatus status;
+    detail::readHeader(fd_, header_, status);
+    if (status == detail::HeaderStatus::Invalid) {
+      close();
+      return false;
+    }
+    if (header_.is_ascii || header_.is_block_compressed)
+      throw std::runtime_error("ASCII and block compressed PLY files cannot "
+                               "be read asynchronously");
+    detail::requireInPlace<Args...>("FastPlyAsync", header_);
+    setupElements(std::index_sequence_for<Args...>{});
+
+    // Buffers are page aligned, as required for O_DIRECT like reads
+    const std::size_t page = detail::pageSize();
+    const unsigned depth = std::min(std::max(options.queue_depth, 1u), 1024u);
+    buffer_size_ = (std::max<std::size_t>(options.buffer_size, 1) + page - 1) /
+                   page * page;
+    void* buffers = mmap(nullptr, depth * buffer_size_, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers == MAP_FAILED)
+      throw std::system_error(errno, std::generic_category());
+    buffers_ = static_cast<unsigned char*>(buffers);
+    slots_.resize(depth);
+    std::vector<iovec> iovecs(depth);
+    for (unsigned b = 0; b < depth; ++b) {
+      free_.push_back(depth - 1 - b);
+      iovecs[b].iov_base = buffers_ + b * buffer_size_;
+      iovecs[b].iov_len = buffer_size_;
+    }
+
+#if defined(FASTPLY_HAS_IO_URING)
+    if (options.backend != AsyncBackend::Pread)
+      ring_ = detail::IoUring::create(depth, iovecs);
+    if (!ring_ && options.backend == AsyncBackend::IoUring)
+      throw std::runtime_error("io_uring is not available");
+#else
+    if (options.backend == AsyncBackend::IoUring)
+      throw std::runtime_error("io_uring is not available");
+#endif
+    if (backend() == AsyncBackend::Pread)
+      pool_.reset(new detail::PreadPool(options.threads));
+  } catch (...) {
+    close();
+    throw;
+  }
+  return true;
+}
+
+template <typename... Args>
+template <std::size_t... I>
+void FastPlyAsync<Args...>::setupElements(std::index_sequence<I...>) {
+  struct ::stat st;
+  if (fstat(fd_, &st) == -1)
+    throw std::system_error(errno, std::generic_category());
+  std::uint64_t offset = header_.length;
+  const int expand[] = {
+      (offsets_[I] = offset,
+       offset = elementEnd<I>(offset, is_list_element<Args>()), 0)...};
+  (void)expand;
+  if (offset > static_cast<std::uint64_t>(st.st_size))
+    throw std::runtime_error("PLY file is truncated");
+}
+
+template <typename... Args>
+void FastPlyAsync<Args...>::close() {
+  if (in_flight_)
+    reap(in_flight_);  // the kernel or the pool may still write to buffers
+#if defined(FASTPLY_HAS_IO_URING)
+  ring_.reset();
+#endif
+  pool_.reset();
+  if (buffers_ != nullptr)
+    munmap(buffers_, slots_.size() * buffer_size_);
+  buffers_ = nullptr;
+  buffer_size_ = 0;
+  slots_.clear();
+  free_.clear();
+  done_.clear();
+  in_flight_ = 0;
+  if (fd_ != -1)
+    ::close(fd_);
+  fd_ = -1;
+  header_.clear();
+}
+
+template <typename... Args>
+template <typename T>
+std::uint64_t FastPlyAsync<Args...>::read(std::size_t first,
+                                          std::size_t count) {
+  static_assert(!is_list_element<T>::value,
+                "List elements cannot be read asynchronously");
+  constexpr std::size_t element = detail::IndexOf<T, Args...>::value;
+  if (first > header_.counts[element] ||
+      count > header_.counts[element] - first || count > maxRecords<T>())
+    throw std::out_of_range("Accessed range is out of range");
+  if (free_.empty())
+    return 0;
+
+  const std::size_t buffer = free_.back();
+  free_.pop_back();
+  Slot& slot = slots_[buffer];
+  slot.completion.id = next_id_++;
+  slot.completion.element = element;
+  slot.completion.first = first;
+  slot.completion.count = count;
+  slot.completion.data = buffers_ + buffer * buffer_size_;
+  slot.completion.error = 0;
+  slot.completion.buffer = buffer;
+  slot.offset = offsets_[element] + first * sizeof(T);
+  slot.length = count * sizeof(T);
+  slot.done = 0;
+  ++in_flight_;
+  submit(buffer);
+  return slot.completion.id;
+}
+
+template <typename... Args>
+void FastPlyAsync<Args...>::submit(std::size_t buffer) {
+  Slot& slot = slots_[buffer];
+  if (slot.done == slot.length) {  // nothing (left) to read
+    --in_flight_;
+    done_.push_back(slot.completion);
+    return;
+  }
+  unsigned char* data = buffers_ + buffer * buffer_size_ + slot.done;
+#if defined(FASTPLY_HAS_IO_URING)
+  if (ring_) {
+    ring_->submit(fd_, slot.offset + slot.done, data, slot.length - slot.done,
+                  static_cast<unsigned>(buffer), buffer);
+    return;
+  }
+#endif
+  pool_->submit(fd_, slot.offset + slot.done, data, slot.length - slot.done,
+                static_cast<unsigned>(buffer), buffer);
+}
+
+template <typename... Args>
+std::size_t FastPlyAsync<Args...>::reap(std::size_t min_complete) {
+  auto complete = [this](std::uint64_t buffer, int result) {
+    Slot& slot = slots_[static_cast<std::size_t>(buffer)];
+    if (result <= 0) {  // error, or end of file (truncated since opened)
+      slot.completion.error = result < 0 ? -result : EIO;
+      slot.done = slot.length;
+    } else {
+      slot.done += static_cast<std::size_t>(result);  // short reads resume
+    }
+    submit(static_cast<std::size_t>(buffer));
+  };
+  const std::size_t before = done_.size();
+  while (done_.size() - before < min_complete) {
+#if defined(FASTPLY_HAS_IO_URING)
+    if (ring_) {
+      ring_->reap(1, complete);
+      continue;
+    }
+#endif
+    pool_->reap(1, complete);
+  }
+  return done_.size() - before;
+}
+
+template <typename... Args>
+std::size_t FastPlyAsync<Args...>::wait(std::vector<AsyncCompletion>& out,
+                                        std::size_t min_complete) {
+  min_complete = std::min(min_complete, in_flight_ + done_.size());
+  if (done_.size() < min_complete)
+    reap(min_complete - done_.size());
+  const std::size_t n = done_.size();
+  out.insert(out.end(), done_.begin(), done_.end());
+  done_.clear();
+  return n;
+}
+
+template <typename... Args>
+template <typename T, typename F>
+void FastPlyAsync<Args...>::forEachChunk(std::size_t first,
+                                         std::size_t count,
+                                         F&& fn) {
+  constexpr std::size_t element = detail::IndexOf<T, Args...>::value;
+  if (first > header_.counts[element] ||
+      count > header_.counts[element] - first)
+    throw std::out_of_range("Accessed range is out of range");
+  if (in_flight_ || !done_.empty() || free_.size() != slots_.size())
+    throw std::runtime_error("forEachChunk() requires all reads to be "
+                             "completed and released");
+
+  const std::size_t chunk = maxRecords<T>();
+  const std::size_t num_chunks = (count + chunk - 1) / chunk;
+  std::vector<AsyncCompletion> completions;
+  std::vector<AsyncCompletion> ready;  // out of order completions
+  std::size_t issued = 0;
+  try {
+    for (std::size_t next = 0; next < num_chunks;) {
+      while (issued < num_chunks) {
+        const std::size_t begin = first + issued * chunk;
+        if (!read<T>(begin, std::min(chunk, first + count - begin)))
+          break;
+        ++issued;
+      }
+      completions.clear();
+      wait(completions, 1);
+      ready.insert(ready.end(), completions.begin(), completions.end());
+      for (auto it = ready.begin(); it != ready.end();) {
+        if (it->error)
+          throw std::system_error(it->error, std::generic_category());
+        if (it->first != first + next * chunk) {
+          ++it;
+          continue;
+        }
+        fn(it->template records<T>(), it->count);
+        release(*it);
+        ready.erase(it);
+        ++next;
+        it = ready.begin();
+      }
+    }
+  } catch (...) {
+    completions.clear();
+    wait(completions, in_flight_);
+    for (const auto& completion : ready)
+      release(completion);
+    for (const auto& completion : completions)
+      release(completion);
+    throw;
+  }
+}
+
+}  // namespace fastply
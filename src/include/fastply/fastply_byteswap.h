@@ -0,0 +1,252 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "fastply/fastply_simd.h"
+
+namespace fastply {
+namespace detail {
+
+constexpr bool isHostBigEndian() noexcept {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+  return true;
+#else
+  return false;
+#endif
+}
+
+inline void swapBytesInPlace(unsigned char* p, std::size_t size) noexcept {
+  switch (size) {
+    case 0:
+    case 1:
+      break;
+    case 2: {
+      std::uint16_t v;
+      std::memcpy(&v, p, 2);
+      v = __builtin_bswap16(v);
+      std::memcpy(p, &v, 2);
+      break;
+    }
+    case 4: {
+      std::uint32_t v;
+      std::memcpy(&v, p, 4);
+      v = __builtin_bswap32(v);
+      std::memcpy(p, &v, 4);
+      break;
+    }
+    case 8: {
+      std::uint64_t v;
+      std::memcpy(&v, p, 8);
+      v = __builtin_bswap64(v);
+      std::memcpy(p, &v, 8);
+      break;
+    }
+    default:
+      std::reverse(p, p + size);
+  }
+}
+
+template <typename V>
+inline V byteSwap(V v) noexcept {
+  swapBytesInPlace(reinterpret_cast<unsigned char*>(&v), sizeof(V));
+  return v;
+}
+
+/**
+ * @brief Converts packed records between little and big endian, given the
+ * (offset, size) of every field of the record.
+ *
+ * The vector path splits a group of records into 16 byte windows which start
+ * at a field boundary and only cover whole fields, so a single pshufb per
+ * window reverses all fields inside of it. Windows are written in ascending
+ * order; bytes a window copies verbatim beyond its last field are overwritten
+ * by the next window. Records not covered by full groups are swapped in
+ * scalar code. Source and destination may be identical.
+ */
+class ByteSwapKernel {
+ public:
+  using Field = std::pair<std::size_t, std::size_t>;  //!< (offset, size)
+
+  ByteSwapKernel(std::size_t record_size, const std::vector<Field>& fields)
+      : record_size_(record_size) {
+    for (const auto& f : fields)
+      if (f.second > 1)
+        swaps_.push_back(f);
+    if (!swaps_.empty())
+      planWindows(fields);
+  }
+
+  std::size_t recordSize() const noexcept { return record_size_; }
+
+  /// Swaps a single record from src into dst
+  void swapRecord(const unsigned char* src, unsigned char* dst) const noexcept {
+    if (src != dst)
+      std::memcpy(dst, src, record_size_);
+    for (const auto& f : swaps_)
+      swapBytesInPlace(dst + f.first, f.second);
+  }
+
+  /// Swaps count consecutive records from src into dst
+  void operator()(const unsigned char* src,
+                  unsigned char* dst,
+                  std::size_t count) const noexcept {
+    if (swaps_.empty()) {
+      if (src != dst)
+        std::memmove(dst, src, count * record_size_);
+      return;
+    }
+
+    std::size_t done = 0;
+#if FASTPLY_X86_DISPATCH
+    if (!window_offsets_.empty()) {
+      if (cpuHasAvx2())
+        done = swapAvx2(src, dst, count);
+      else if (cpuHasSsse3())
+        done = swapSsse3(src, dst, count);
+    }
+#endif
+    swapScalar(src + done * record_size_, dst + done * record_size_,
+               count - done);
+  }
+
+ private:
+  static constexpr std::size_t kWindow = 16;
+  static constexpr std::size_t kGroupRecords = 16;
+
+  void planWindows(const std::vector<Field>& fields) {
+    for (const auto& f : fields)
+      if (f.second > kWindow)
+        return;  // vector path not applicable
+
+    // All fields of one group of records
+    std::vector<Field> group;
+    for (std::size_t r = 0; r < kGroupRecords; ++r)
+      for (const auto& f : fields)
+        group.emplace_back(r * record_size_ + f.first, f.second);
+
+    std::size_t i = 0;
+    while (i < group.size()) {
+      const std::size_t start = group[i].first;
+      unsigned char mask[kWindow];
+      for (std::size_t j = 0; j < kWindow; ++j)
+        mask[j] = static_cast<unsigned char>(j);
+      while (i < group.size() &&
+             group[i].first + group[i].second - start <= kWindow) {
+        const std::size_t rel = group[i].first - start;
+        const std::size_t size = group[i].second;
+        for (std::size_t k = 0; k < size; ++k)
+          mask[rel + k] = static_cast<unsigned char>(rel + size - 1 - k);
+        ++i;
+      }
+      window_offsets_.push_back(static_cast<std::uint32_t>(start));
+      masks_.insert(masks_.end(), mask, mask + kWindow);
+      group_reach_ = std::max(group_reach_, start + kWindow);
+    }
+    masks_.resize(masks_.size() + kWindow);  // padding for paired loads
+  }
+
+  void swapScalar(const unsigned char* src,
+                  unsigned char* dst,
+                  std::size_t count) const noexcept {
+    for (std::size_t r = 0; r < count; ++r)
+      swapRecord(src + r * record_size_, dst + r * record_size_);
+  }
+
+#if FASTPLY_X86_DISPATCH
+  /// @return Number of records processed
+  FASTPLY_TARGET_SSSE3 std::size_t swapSsse3(const unsigned char* src,
+                                             unsigned char* dst,
+                                             std::size_t count) const
+      noexcept {
+    const std::size_t group_bytes = kGroupRecords * record_size_;
+    const std::size_t total = count * record_size_;
+    const std::size_t windows = window_offsets_.size();
+    std::size_t base = 0;
+    for (; base + group_reach_ <= total; base += group_bytes) {
+      for (std::size_t w = 0; w < windows; ++w) {
+        const std::size_t off = base + window_offsets_[w];
+        const __m128i mask = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(masks_.data() + w * kWindow));
+        const __m128i v =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + off));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + off),
+                         _mm_shuffle_epi8(v, mask));
+      }
+    }
+    return base / record_size_;
+  }
+
+  /// @return Number of records processed
+  FASTPLY_TARGET_AVX2 std::size_t swapAvx2(const unsigned char* src,
+                                           unsigned char* dst,
+                                           std::size_t count) const noexcept {
+    const std::size_t group_bytes = kGroupRecords * record_size_;
+    const std::size_t total = count * record_size_;
+    const std::size_t windows = window_offsets_.size();
+    std::size_t base = 0;
+    for (; base + group_reach_ <= total; base += group_bytes) {
+      std::size_t w = 0;
+      // Two windows per 256 bit shuffle (pshufb operates per 128 bit lane)
+      for (; w + 1 < windows; w += 2) {
+        const std::size_t off0 = base + window_offsets_[w];
+        const std::size_t off1 = base + window_offsets_[w + 1];
+        const __m256i mask = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(masks_.data() + w * kWindow));
+        const __m128i lo =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + off0));
+        const __m128i hi =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + off1));
+        const __m256i v = _mm256_shuffle_epi8(
+            _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1), mask);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + off0),
+                         _mm256_castsi256_si128(v));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + off1),
+                         _mm256_extracti128_si256(v, 1));
+      }
+      if (w < windows) {
+        const std::size_t off = base + window_offsets_[w];
+        const __m128i mask = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(masks_.data() + w * kWindow));
+        const __m128i v =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + off));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + off),
+                         _mm_shuffle_epi8(v, mask));
+      }
+    }
+    return base / record_size_;
+  }
+#endif
+
+  std::size_t record_size_;
+  std::vector<Field> swaps_;  //!< Fields wider than one byte
+  std::vector<std::uint32_t> window_offsets_;  //!< Window starts in a group
+  std::vector<unsigned char> masks_;           //!< pshufb mask per window
+  std::size_t group_reach_ = 0;  //!< Bytes touched by the windows of a group
+};
+
+}  // namespace detail
+}  // namespace fastply
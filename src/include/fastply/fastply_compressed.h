@@ -0,0 +1,936 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "fastply/fastply.h"
+#include "fastply/fastply_header.h"
+#include "fastply/fastply_parallel.h"
+
+// Block compressed PLY files (requires zlib, link with -lz).
+//
+// Layout: the PLY header (binary encoding, marked by a "comment
+// fastply_blocks" line), followed by the block table and the zlib compressed
+// blocks. Uncompressed, the blocks concatenate to the body of the binary PLY
+// file, split into blocks of a fixed size. The table holds the start of each
+// element inside the body, checkpoints (body offsets of every
+// 2^kListCheckpointShift()-th record) for list elements and the file offsets
+// of the blocks. Table fields are stored in the byte order of the writer.
+
+namespace fastply {
+
+/// Options for compressPly()
+struct CompressOptions {
+  std::size_t block_size = 1 << 20;  //!< Uncompressed bytes per block
+  int level = Z_DEFAULT_COMPRESSION;  //!< zlib compression level (0-9)
+  unsigned threads = 0;  //!< Number of threads (0: global pool)
+};
+
+/// Options for FastPlyCompressed::open()
+struct CompressedOpenOptions {
+  std::size_t cache_blocks = 16;  //!< Decompressed blocks kept in memory
+};
+
+namespace detail {
+
+/// Fixed part of the block table
+struct BlockTableHeader {
+  char magic[8];              //!< "FPLYBLK" followed by '\0'
+  std::uint32_t version;      //!< Format version
+  std::uint32_t byte_order;   //!< 0x01020304 as written by the writer
+  std::uint64_t block_size;   //!< Uncompressed bytes per block
+  std::uint64_t body_size;    //!< Uncompressed size of the body
+  std::uint64_t num_blocks;   //!< Number of blocks
+  std::uint64_t num_elements;  //!< Number of element start offsets - 1
+};
+
+constexpr std::uint32_t kBlockTableVersion() noexcept { return 1; }
+
+constexpr std::uint32_t kBlockTableByteOrder() noexcept { return 0x01020304u; }
+
+constexpr std::size_t kListCheckpointShift() noexcept { return 8; }
+
+inline std::size_t numCheckpoints(std::size_t count) noexcept {
+  return (count + (std::size_t(1) << kListCheckpointShift()) - 1) >>
+         kListCheckpointShift();
+}
+
+/**
+ * @brief Thread-safe LRU cache of decompressed blocks.
+ *
+ * Blocks are handed out as shared pointers, so evicting a block does not
+ * invalidate it for readers still holding it. Blocks are decompressed
+ * outside of the lock.
+ */
+class BlockCache {
+ public:
+  using Block = std::shared_ptr<const std::vector<unsigned char>>;
+
+  explicit BlockCache(std::size_t capacity = 16)
+      : capacity_(std::max<std::size_t>(capacity, 1)) {}
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+  }
+
+  /// Block key, loaded by load(key) if not cached
+  template <typename Load>
+  Block get(std::size_t key, Load&& load) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (Entry* entry = find(key)) {
+        entry->used = ++tick_;
+        return entry->block;
+      }
+    }
+    Block block = load(key);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (Entry* entry = find(key))  // loaded concurrently
+      return entry->block;
+    if (entries_.size() < capacity_) {
+      entries_.push_back({key, block, ++tick_});
+    } else {
+      auto lru = std::min_element(
+          entries_.begin(), entries_.end(),
+          [](const Entry& a, const Entry& b) { return a.used < b.used; });
+      *lru = {key, block, ++tick_};
+    }
+    return block;
+  }
+
+ private:
+  struct Entry {
+    std::size_t key;
+    Block block;
+    std::uint64_t used;  //!< Tick of the last access
+  };
+
+  // Caches are small (a few MB to a few hundred MB), a scan is fine
+  Entry* find(std::size_t key) noexcept {
+    for (auto& entry : entries_)
+      if (entry.key == key)
+        return &entry;
+    return nullptr;
+  }
+
+  std::mutex mutex_;
+  std::vector<Entry> entries_;
+  std::size_t capacity_;     //!< Maximum number of entries
+  std::uint64_t tick_ = 0;   //!< Access counter
+};
+
+/// Random access to the uncompressed body of a mapped block compressed file
+class BlockReader {
+ public:
+  using Block = BlockCache::Block;
+
+  /**
+   * @brief Reads num_blocks blocks whose num_blocks + 1 offsets are stored at
+   * offsets, inside the mapped file of file_length bytes.
+   *
+   * @throws std::runtime_error if the offsets are not ascending or point
+   * outside of the file, which block() relies on
+   */
+  void reset(const unsigned char* offsets,
+             const unsigned char* file,
+             std::size_t file_length,
+             std::size_t block_size,
+             std::size_t body_size,
+             std::size_t num_blocks,
+             std::size_t cache_blocks) {
+    offsets_ = offsets;
+    file_ = file;
+    block_size_ = block_size;
+    body_size_ = body_size;
+    num_blocks_ = num_blocks;
+
+    // Blocks follow the table and end with the file
+    std::size_t previous = static_cast<std::size_t>(offsets - file) +
+                           (num_blocks + 1) * sizeof(std::uint64_t);
+    for (std::size_t k = 0; k <= num_blocks; ++k) {
+      const std::size_t offset = blockOffset(k);
+      if (offset < previous || offset > file_length)
+        throw std::runtime_error("Invalid block offsets");
+      previous = offset;
+    }
+    cache_.reset(new BlockCache(cache_blocks));
+  }
+
+  std::size_t blockSize() const noexcept { return block_size_; }
+
+  std::size_t bodySize() const noexcept { return body_size_; }
+
+  std::size_t numBlocks() const noexcept { return num_blocks_; }
+
+  /// Uncompressed block k
+  Block block(std::size_t k) const {
+    return cache_->get(k, [this](std::size_t key) {
+      const std::size_t first = blockOffset(key);
+      const std::size_t size = std::min(block_size_,
+                                        body_size_ - key * block_size_);
+      auto data = std::make_shared<std::vector<unsigned char>>(size);
+      uLongf length = static_cast<uLongf>(size);
+      if (uncompress(data->data(), &length, file_ + first,
+                     static_cast<uLong>(blockOffset(key + 1) - first)) !=
+              Z_OK ||
+          length != size)
+        throw std::runtime_error("Corrupt compressed PLY block");
+      return Block(std::move(data));
+    });
+  }
+
+ private:
+  std::size_t blockOffset(std::size_t k) const noexcept {
+    return static_cast<std::size_t>(
+        loadUnaligned<std::uint64_t>(offsets_ + k * sizeof(std::uint64_t)));
+  }
+
+  const unsigned char* offsets_ = nullptr;  //!< File offsets of the blocks
+  const unsigned char* file_ = nullptr;     //!< Start of the mapped file
+  std::size_t block_size_ = 0;  //!< Uncompressed bytes per block
+  std::size_t body_size_ = 0;   //!< Uncompressed size of the body
+  std::size_t num_blocks_ = 0;  //!< Number of blocks
+  std::unique_ptr<BlockCache> cache_;  //!< Decompressed blocks
+};
+
+/**
+ * @brief Reads byte ranges of the body, holding on to the last block used.
+ *
+ * Also remembers where the last list record read ended (see
+ * PlyCompressedListContainer), so sequential reads need no lookups.
+ */
+class BlockCursor {
+ public:
+  BlockCursor() = default;
+
+  explicit BlockCursor(const BlockReader* reader) noexcept
+      : reader_(reader) {}
+
+  /// Copies size bytes of the body at offset into out
+  void read(std::size_t offset, std::size_t size, void* out) {
+    unsigned char* dst = static_cast<unsigned char*>(out);
+    while (size) {
+      const std::size_t k = offset / reader_->blockSize();
+      if (k != index_) {
+        block_ = reader_->block(k);
+        index_ = k;
+      }
+      const std::size_t within = offset - k * reader_->blockSize();
+      const std::size_t n = std::min(size, block_->size() - within);
+      std::memcpy(dst, block_->data() + within, n);
+      dst += n;
+      offset += n;
+      size -= n;
+    }
+  }
+
+  std::size_t next_record = std::numeric_limits<std::size_t>::max();
+  std::size_t next_offset = 0;  //!< Body offset of next_record
+
+ private:
+  const BlockReader* reader_ = nullptr;
+  BlockReader::Block block_;  //!< Last block used
+  std::size_t index_ = std::numeric_limits<std::size_t>::max();
+};
+
+/**
+ * @brief Random access iterator over a compressed container; keeps the
+ * current block, so sequential iteration decompresses every block once.
+ */
+template <typename C>
+class CompressedIterator {
+ public:
+  using iterator_category = std::random_access_iterator_tag;
+  using value_type = typename C::value_type;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const value_type*;
+  using reference = value_type;
+
+  CompressedIterator() = default;
+
+  CompressedIterator(const C* container, std::size_t idx) noexcept
+      : container_(container), idx_(idx), cursor_(container->reader_) {}
+
+  reference operator*() const { return container_->load(idx_, cursor_); }
+
+  reference operator[](difference_type n) const {
+    return container_->load(idx_ + n, cursor_);
+  }
+
+  CompressedIterator& operator++() noexcept {
+    ++idx_;
+    return *this;
+  }
+
+  CompressedIterator operator++(int) noexcept {
+    auto tmp = *this;
+    ++idx_;
+    return tmp;
+  }
+
+  CompressedIterator& operator--() noexcept {
+    --idx_;
+    return *this;
+  }
+
+  CompressedIterator operator--(int) noexcept {
+    auto tmp = *this;
+    --idx_;
+    return tmp;
+  }
+
+  CompressedIterator& operator+=(difference_type n) noexcept {
+    idx_ += n;
+    return *this;
+  }
+
+  CompressedIterator& operator-=(difference_type n) noexcept {
+    idx_ -= n;
+    return *this;
+  }
+
+  CompressedIterator operator+(difference_type n) const noexcept {
+    auto tmp = *this;
+    return tmp += n;
+  }
+
+  friend CompressedIterator operator+(difference_type n,
+                                      const CompressedIterator& it) noexcept {
+    return it + n;
+  }
+
+  CompressedIterator operator-(difference_type n) const noexcept {
+    auto tmp = *this;
+    return tmp -= n;
+  }
+
+  difference_type operator-(const CompressedIterator& rhs) const noexcept {
+    return static_cast<difference_type>(idx_) -
+           static_cast<difference_type>(rhs.idx_);
+  }
+
+  bool operator==(const CompressedIterator& rhs) const noexcept {
+    return idx_ == rhs.idx_;
+  }
+
+  bool operator!=(const CompressedIterator& rhs) const noexcept {
+    return idx_ != rhs.idx_;
+  }
+
+  bool operator<(const CompressedIterator& rhs) const noexcept {
+    return idx_ < rhs.idx_;
+  }
+
+  bool operator>(const CompressedIterator& rhs) const noexcept {
+    return idx_ > rhs.idx_;
+  }
+
+  bool operator<=(const CompressedIterator& rhs) const noexcept {
+    return idx_ <= rhs.idx_;
+  }
+
+  bool operator>=(const CompressedIterator& rhs) const noexcept {
+    return idx_ >= rhs.idx_;
+  }
+
+ private:
+  const C* container_ = nullptr;
+  std::size_t idx_ = 0;
+  mutable BlockCursor cursor_;  //!< Current block
+};
+
+}  // namespace detail
+
+/**
+ * @brief Elements of type T of a block compressed file. Elements are
+ * returned by value (in the byte order of the file, see needsByteSwap()),
+ * since blocks are only cached temporarily.
+ */
+template <typename T>
+class PlyCompressedElementContainer {
+ public:
+  using value_type = T;
+  using reference = T;
+  using const_reference = T;
+  using difference_type = std::ptrdiff_t;
+  using const_iterator =
+      detail::CompressedIterator<PlyCompressedElementContainer>;
+  using iterator = const_iterator;
+
+  value_type operator[](std::size_t i) const {
+    detail::BlockCursor cursor(reader_);
+    return load(i, cursor);
+  }
+
+  value_type at(std::size_t i) const {
+    if (i >= size_)
+      throw std::out_of_range("Accessed position is out of range");
+    return (*this)[i];
+  }
+
+  value_type front() const { return (*this)[0]; }
+
+  value_type back() const { return (*this)[size_ - 1]; }
+
+  /// Copies elements [first, first + count) into out
+  void copyTo(std::size_t first, std::size_t count, T* out) const {
+    if (first > size_ || count > size_ - first)
+      throw std::out_of_range("Accessed range is out of range");
+    detail::BlockCursor cursor(reader_);
+    cursor.read(begin_ + first * sizeof(T), count * sizeof(T), out);
+  }
+
+  const_iterator begin() const noexcept { return const_iterator(this, 0); }
+
+  const_iterator end() const noexcept { return const_iterator(this, size_); }
+
+  const_iterator cbegin() const noexcept { return begin(); }
+
+  const_iterator cend() const noexcept { return end(); }
+
+  std::size_t size() const noexcept { return size_; }
+
+  bool empty() const noexcept { return size_ == 0; }
+
+  bool needsByteSwap() const noexcept { return swap_; }
+
+ private:
+  value_type load(std::size_t i, detail::BlockCursor& cursor) const {
+    unsigned char record[sizeof(T)];
+    cursor.read(begin_ + i * sizeof(T), sizeof(T), record);
+    return detail::loadRecord<T>(record);
+  }
+
+  void setup(const detail::BlockReader* reader,
+             std::size_t begin,
+             std::size_t count,
+             bool byte_swap,
+             const unsigned char* /* checkpoints */) noexcept {
+    reader_ = reader;
+    begin_ = begin;
+    size_ = count;
+    swap_ = byte_swap;
+  }
+
+  const detail::BlockReader* reader_ = nullptr;  //!< Block access
+  std::size_t begin_ = 0;  //!< Body offset of the first element
+  std::size_t size_ = 0;
+  bool swap_ = false;  //!< Elements are stored in non-native byte order
+
+  friend class detail::CompressedIterator<PlyCompressedElementContainer>;
+  template <typename... Args>
+  friend class FastPlyCompressed;
+};
+
+/**
+ * @brief List element T of a block compressed file. Lists are returned as
+ * vectors of their values, converted to native byte order.
+ *
+ * Records are located from checkpoints stored every
+ * 2^kListCheckpointShift() records; iterators walk sequentially.
+ */
+template <typename T>
+class PlyCompressedListContainer {
+ public:
+  using count_type = typename T::fastply_count_type;
+  using list_value_type = typename T::fastply_value_type;
+  using value_type = std::vector<list_value_type>;
+  using reference = value_type;
+  using const_reference = value_type;
+  using difference_type = std::ptrdiff_t;
+  using const_iterator =
+      detail::CompressedIterator<PlyCompressedListContainer>;
+  using iterator = const_iterator;
+
+  value_type operator[](std::size_t i) const {
+    detail::BlockCursor cursor(reader_);
+    return load(i, cursor);
+  }
+
+  value_type at(std::size_t i) const {
+    if (i >= size_)
+      throw std::out_of_range("Accessed position is out of range");
+    return (*this)[i];
+  }
+
+  value_type front() const { return (*this)[0]; }
+
+  value_type back() const { return (*this)[size_ - 1]; }
+
+  const_iterator begin() const noexcept { return const_iterator(this, 0); }
+
+  const_iterator end() const noexcept { return const_iterator(this, size_); }
+
+  const_iterator cbegin() const noexcept { return begin(); }
+
+  const_iterator cend() const noexcept { return end(); }
+
+  std::size_t size() const noexcept { return size_; }
+
+  bool empty() const noexcept { return size_ == 0; }
+
+  bool needsByteSwap() const noexcept { return swap_; }
+
+ private:
+  std::size_t readCount(std::size_t offset, detail::BlockCursor& cursor) const {
+    unsigned char raw[sizeof(count_type)];
+    cursor.read(offset, sizeof(count_type), raw);
+    const count_type count = detail::loadUnaligned<count_type>(raw, swap_);
+    if (static_cast<long long>(count) < 0)
+      throw std::runtime_error("Negative list length found");
+    return static_cast<std::size_t>(count);
+  }
+
+  value_type load(std::size_t i, detail::BlockCursor& cursor) const {
+    std::size_t record = cursor.next_record;
+    std::size_t offset = cursor.next_offset;
+    const std::size_t checkpoint = i >> detail::kListCheckpointShift();
+    if (record > i || (record >> detail::kListCheckpointShift()) < checkpoint) {
+      record = checkpoint << detail::kListCheckpointShift();
+      offset = static_cast<std::size_t>(detail::loadUnaligned<std::uint64_t>(
+          checkpoints_ + checkpoint * sizeof(std::uint64_t)));
+    }
+    for (; record < i; ++record)
+      offset += sizeof(count_type) +
+                readCount(offset, cursor) * sizeof(list_value_type);
+
+    const std::size_t count = readCount(offset, cursor);
+    value_type values(count);
+    cursor.read(offset + sizeof(count_type), count * sizeof(list_value_type),
+                values.data());
+    if (swap_)
+      for (auto& value : values)
+        value = detail::byteSwap(value);
+    cursor.next_record = i + 1;
+    cursor.next_offset =
+        offset + sizeof(count_type) + count * sizeof(list_value_type);
+    return values;
+  }
+
+  void setup(const detail::BlockReader* reader,
+             std::size_t begin,
+             std::size_t count,
+             bool byte_swap,
+             const unsigned char* checkpoints) noexcept {
+    reader_ = reader;
+    begin_ = begin;
+    size_ = count;
+    swap_ = byte_swap;
+    checkpoints_ = checkpoints;
+  }
+
+  const detail::BlockReader* reader_ = nullptr;  //!< Block access
+  std::size_t begin_ = 0;  //!< Body offset of the first list
+  std::size_t size_ = 0;
+  bool swap_ = false;  //!< Lists are stored in non-native byte order
+  const unsigned char* checkpoints_ = nullptr;  //!< Offsets (in the table)
+
+  friend class detail::CompressedIterator<PlyCompressedListContainer>;
+  template <typename... Args>
+  friend class FastPlyCompressed;
+};
+
+template <typename T>
+using compressed_container_t =
+    typename std::conditional<is_list_element<T>::value,
+                              PlyCompressedListContainer<T>,
+                              PlyCompressedElementContainer<T>>::type;
+
+/**
+ * @brief Reader for block compressed PLY files (see compressPly()).
+ *
+ * The compressed file is memory mapped; blocks are decompressed on demand
+ * into a small LRU cache shared by all containers. Containers can be read
+ * from several threads. Records are read as stored: open() throws if an
+ * element is not stored like its struct.
+ */
+template <typename... Args>
+class FastPlyCompressed {
+  static_assert(sizeof...(Args),
+                "FastPlyCompressed expects at least one element definition "
+                "as template parameter.");
+
+ public:
+  FastPlyCompressed() = default;
+
+  ~FastPlyCompressed() { close(); }
+
+  FastPlyCompressed(const FastPlyCompressed&) = delete;
+  FastPlyCompressed& operator=(const FastPlyCompressed&) = delete;
+
+  bool open(const std::string& path,
+            const CompressedOpenOptions& options = CompressedOpenOptions());
+
+  void close();
+
+  bool isBigEndian() const noexcept { return header_.is_big_endian; }
+
+  bool needsByteSwap() const noexcept {
+    return header_.is_big_endian != detail::isHostBigEndian();
+  }
+
+  std::size_t numBlocks() const noexcept { return reader_.numBlocks(); }
+
+  std::size_t blockSize() const noexcept { return reader_.blockSize(); }
+
+  /// Uncompressed size of the element data
+  std::size_t bodySize() const noexcept { return reader_.bodySize(); }
+
+  template <typename T>
+  const auto& get() const noexcept {
+    return std::get<compressed_container_t<T>>(elements_);
+  }
+
+  template <std::size_t I>
+  const auto& get() const noexcept {
+    return std::get<I>(elements_);
+  }
+
+ private:
+  template <std::size_t... I>
+  void setupElements(const unsigned char* table, std::index_sequence<I...>);
+
+  detail::PlyHeader<sizeof...(Args)> header_;  //!< Parsed ply header
+  detail::BlockReader reader_;                 //!< Block access
+  std::tuple<compressed_container_t<Args>...> elements_;
+  std::size_t file_length_ = 0;       //!< Length of mapped file in bytes
+  void* ptr_mapped_file_ = nullptr;  //!< Ptr to start of mmap'ed file
+};
+
+template <typename... Args>
+bool FastPlyCompressed<Args...>::open(const std::string& path,
+                                      const CompressedOpenOptions& options) {
+  if (ptr_mapped_file_ != nullptr)  // already opened
+    return true;
+
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    throw std::system_error(errno, std::generic_category());
+  struct ::stat st;
+  if (fstat(fd, &st) == -1 || st.st_size <= 0) {
+    ::close(fd);
+    throw std::system_error(EFAULT, std::generic_category());
+  }
+  file_length_ = static_cast<std::size_t>(st.st_size);
+  ptr_mapped_file_ = mmap(0, file_length_, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);  // can be closed
+  if (ptr_mapped_file_ == MAP_FAILED) {
+    ptr_mapped_file_ = nullptr;
+    throw std::runtime_error("Failed to memory map " + path);
+  }
+
+  const unsigned char* file = static_cast<unsigned char*>(ptr_mapped_file_);
+  try {
+    const detail::HeaderStatus status = header_.parse(
+        reinterpret_cast<const char*>(file), file_length_);
+    if (status == detail::HeaderStatus::Invalid || header_.is_ascii ||
+        !header_.is_block_compressed) {
+      close();
+      return false;
+    }
+    if (status == detail::HeaderStatus::Incomplete)
+      throw std::runtime_error("PLY header is not terminated by end_header");
+    detail::requireInPlace<Args...>("FastPlyCompressed", header_);
+
+    // Validate the table before trusting any offset in it
+    detail::BlockTableHeader table;
+    const std::size_t table_start = header_.length;
+    const std::size_t offsets_start = table_start + sizeof(table);
+    if (file_length_ < offsets_start)
+      throw std::runtime_error("Truncated block table");
+    std::memcpy(&table, file + table_start, sizeof(table));
+    if (std::memcmp(table.magic, "FPLYBLK", 8) ||
+        table.version != detail::kBlockTableVersion() ||
+        table.byte_order != detail::kBlockTableByteOrder() ||
+        table.num_elements != sizeof...(Args) || table.block_size == 0 ||
+        table.num_blocks != (table.body_size + table.block_size - 1) /
+                                table.block_size)
+      throw std::runtime_error("Invalid or foreign block table");
+
+    const bool lists[] = {is_list_element<Args>::value...};
+    std::size_t checkpoints = 0;
+    for (std::size_t i = 0; i < sizeof...(Args); ++i)
+      if (lists[i]) {
+        checkpoints += detail::numCheckpoints(header_.counts[i]);
+        if (checkpoints > file_length_ / 8)
+          throw std::runtime_error("Truncated block compressed file");
+      }
+    const std::size_t blocks_start =
+        offsets_start + (sizeof...(Args) + 1 + checkpoints) * 8;
+    const std::size_t table_end =
+        blocks_start + (static_cast<std::size_t>(table.num_blocks) + 1) * 8;
+    if (file_length_ < table_end ||
+        detail::loadUnaligned<std::uint64_t>(file + table_end - 8) !=
+            file_length_)
+      throw std::runtime_error("Truncated block compressed file");
+
+    // Elements lie inside the body in order, fixed size records inside
+    // their element, list checkpoints inside their element
+    const std::size_t record_sizes[] = {
+        (is_list_element<Args>::value ? 0 : sizeof(Args))...};
+    const unsigned char* checkpoint = file + offsets_start +
+                                      (sizeof...(Args) + 1) * 8;
+    for (std::size_t i = 0; i < sizeof...(Args); ++i) {
+      const std::uint64_t begin =
+          detail::loadUnaligned<std::uint64_t>(file + offsets_start + i * 8);
+      const std::uint64_t end = detail::loadUnaligned<std::uint64_t>(
+          file + offsets_start + (i + 1) * 8);
+      if (begin > end || end > table.body_size ||
+          (!lists[i] && header_.counts[i] > (end - begin) / record_sizes[i]))
+        throw std::runtime_error("Invalid element offsets in block table");
+      const std::size_t num_checkpoints =
+          lists[i] ? detail::numCheckpoints(header_.counts[i]) : 0;
+      for (std::size_t k = 0; k < num_checkpoints; ++k, checkpoint += 8) {
+        const std::uint64_t offset =
+            detail::loadUnaligned<std::uint64_t>(checkpoint);
+        if (offset < begin || offset >= end)
+          throw std::runtime_error("Invalid list checkpoint in block table");
+      }
+    }
+
+    reader_.reset(file + blocks_start, file, file_length_,
+                  static_cast<std::size_t>(table.block_size),
+                  static_cast<std::size_t>(table.body_size),
+                  static_cast<std::size_t>(table.num_blocks),
+                  options.cache_blocks);
+    setupElements(file + offsets_start, std::index_sequence_for<Args...>{});
+  } catch (...) {
+    close();
+    throw;
+  }
+  return true;
+}
+
+template <typename... Args>
+template <std::size_t... I>
+void FastPlyCompressed<Args...>::setupElements(const unsigned char* table,
+                                               std::index_sequence<I...>) {
+  const unsigned char* checkpoints = table + (sizeof...(Args) + 1) * 8;
+  const bool lists[] = {is_list_element<Args>::value...};
+  const int expand[] = {
+      (std::get<I>(elements_).setup(
+           &reader_,
+           static_cast<std::size_t>(
+               detail::loadUnaligned<std::uint64_t>(table + I * 8)),
+           header_.counts[I], needsByteSwap(), checkpoints),
+       checkpoints += lists[I] ? detail::numCheckpoints(header_.counts[I]) * 8
+                               : 0,
+       0)...};
+  (void)expand;
+}
+
+template <typename... Args>
+void FastPlyCompressed<Args...>::close() {
+  if (ptr_mapped_file_ != nullptr) {
+    if (munmap(ptr_mapped_file_, file_length_) == -1)
+      throw std::runtime_error("Failed to unmap memory!");
+    ptr_mapped_file_ = nullptr;
+  }
+  file_length_ = 0;
+  header_.clear();
+  elements_ = std::tuple<compressed_container_t<Args>...>();
+  reader_ = detail::BlockReader();
+}
+
+namespace detail {
+
+/// Header of src, with the encoding of body and the block marker
+inline std::string blockCompressedHeader(const std::string& src,
+                                         std::size_t length,
+                                         bool big_endian) {
+  std::string text(length, '\0');
+  std::ifstream is(src, std::ios::binary);
+  if (!is.read(&text[0], static_cast<std::streamsize>(length)))
+    throw std::runtime_error("Failed to read the header of " + src);
+
+  std::string header;
+  std::size_t pos = 0;
+  while (pos < text.size()) {
+    std::size_t eol = text.find('\n', pos);
+    eol = eol == std::string::npos ? text.size() : eol + 1;
+    HeaderLine line(text.data() + pos, text.data() + eol);
+    if (line.next().is("format")) {
+      header += big_endian ? "format binary_big_endian 1.0\n"
+                           : "format binary_little_endian 1.0\n";
+      header += std::string("comment ") + kBlockCompressedComment() + "\n";
+    } else {
+      header.append(text, pos, eol - pos);
+    }
+    pos = eol;
+  }
+  return header;
+}
+
+template <typename T>
+bool storedInPlace(const PlyElementContainer<T>& elements) noexcept {
+  return elements.inPlace();
+}
+
+template <typename T>
+bool storedInPlace(const PlyListElementContainer<T>&) noexcept {
+  return true;
+}
+
+template <typename T>
+void appendCheckpoints(const PlyListElementContainer<T>& lists,
+                       const unsigned char* body,
+                       std::vector<std::uint64_t>& table) {
+  using count_type = typename T::fastply_count_type;
+  for (std::size_t i = 0; i < lists.size();
+       i += std::size_t(1) << kListCheckpointShift())
+    table.push_back(static_cast<std::uint64_t>(
+        static_cast<const unsigned char*>(lists[i].data()) -
+        sizeof(count_type) - body));
+}
+
+template <typename T>
+void appendCheckpoints(const PlyElementContainer<T>&,
+                       const unsigned char*,
+                       std::vector<std::uint64_t>&) noexcept {}
+
+}  // namespace detail
+
+/**
+ * @brief Converts the PLY file src (binary or ASCII) with elements Args...
+ * into a block compressed file dst, compressing blocks in parallel.
+ *
+ * Blocks are compressed in batches, so memory use stays at a few blocks per
+ * thread regardless of the size of the file. Blocks hold the body as stored,
+ * hence all elements have to be stored like their structs.
+ *
+ * @throws std::runtime_error if an element would have to be shuffled
+ */
+template <typename... Args>
+void compressPly(const std::string& src,
+                 const std::string& dst,
+                 const CompressOptions& options = CompressOptions()) {
+  FastPly<Args...> in;
+  if (!in.open(src))
+    throw std::runtime_error("Unsupported PLY file " + src);
+  // Blocks hold the body as stored, shuffled fields would be lost
+  const bool in_place[] = {detail::storedInPlace(in.template get<Args>())...};
+  if (std::find(std::begin(in_place), std::end(in_place), false) !=
+      std::end(in_place))
+    throw std::runtime_error("compressPly requires all elements of " + src +
+                             " to be stored like their structs");
+
+  const std::size_t block_size =
+      std::max<std::size_t>(options.block_size, 4096);
+  const std::string header = detail::blockCompressedHeader(
+      src, static_cast<std::size_t>(in.getHeaderOffset()),
+      in.isAscii() ? detail::isHostBigEndian() : in.isBigEndian());
+  const unsigned char* body = in.body();
+  const auto offsets = in.elementOffsets();
+  const std::size_t body_size = offsets.back();
+  const std::size_t num_blocks = (body_size + block_size - 1) / block_size;
+
+  detail::BlockTableHeader table;
+  std::memset(&table, 0, sizeof(table));
+  std::memcpy(table.magic, "FPLYBLK", 8);
+  table.version = detail::kBlockTableVersion();
+  table.byte_order = detail::kBlockTableByteOrder();
+  table.block_size = block_size;
+  table.body_size = body_size;
+  table.num_blocks = num_blocks;
+  table.num_elements = sizeof...(Args);
+
+  // Element offsets and list checkpoints, then the block offsets
+  std::vector<std::uint64_t> entries(offsets.begin(), offsets.end());
+  const int expand[] = {
+      (detail::appendCheckpoints(in.template get<Args>(), body, entries),
+       0)...};
+  (void)expand;
+  const std::size_t first_block = entries.size();
+  entries.resize(first_block + num_blocks + 1);
+
+  const int fd = ::open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1)
+    throw std::system_error(errno, std::generic_category());
+  try {
+    std::size_t position =
+        header.size() + sizeof(table) + entries.size() * 8;
+    const std::size_t batch = 4 * std::max<std::size_t>(
+        1, options.threads ? options.threads : defaultConcurrency());
+    std::vector<std::vector<unsigned char>> compressed(batch);
+    for (std::size_t first = 0; first < num_blocks; first += batch) {
+      const std::size_t count = std::min(batch, num_blocks - first);
+      detail::runTasks(count, options.threads, [&](std::size_t t) {
+        const std::size_t k = first + t;
+        const std::size_t size =
+            std::min(block_size, body_size - k * block_size);
+        auto& out = compressed[t];
+        uLongf length = compressBound(static_cast<uLong>(size));
+        out.resize(length);
+        if (compress2(out.data(), &length, body + k * block_size,
+                      static_cast<uLong>(size), options.level) != Z_OK)
+          throw std::runtime_error("Failed to compress PLY block");
+        out.resize(length);
+      });
+      for (std::size_t t = 0; t < count; ++t) {
+        entries[first_block + first + t] = position;
+        detail::writeAll(fd, compressed[t].data(), compressed[t].size(),
+                         static_cast<off_t>(position));
+        position += compressed[t].size();
+      }
+    }
+    entries.back() = position;
+
+    detail::writeAll(fd, header.data(), header.size(), 0);
+    detail::writeAll(fd, &table, sizeof(table),
+                     static_cast<off_t>(header.size()));
+    detail::writeAll(fd, entries.data(), entries.size() * 8,
+                     static_cast<off_t>(header.size() + sizeof(table)));
+    if (::close(fd) == -1)
+      throw std::system_error(errno, std::generic_category());
+  } catch (...) {
+    ::close(fd);
+    ::unlink(dst.c_str());
+    throw;
+  }
+}
+
+}  // namespace fastply
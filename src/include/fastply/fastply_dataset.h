@@ -0,0 +1,503 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <glob.h>
+#include <unistd.h>
+
+#include "fastply/fastply.h"
+#include "fastply/fastply_header.h"
+#include "fastply/fastply_options.h"
+#include "fastply/fastply_parallel.h"
+
+namespace fastply {
+
+/// Options for FastPlyDataset::open()
+struct DatasetOptions {
+  OpenOptions open;          //!< Options for every shard
+  unsigned threads = 0;      //!< Threads opening the shards (0: global pool)
+  std::size_t max_open = 0;  //!< Shards mapped at once (0: unlimited)
+};
+
+template <typename... Args>
+class FastPlyDataset;
+
+namespace detail {
+
+inline bool sameProperties(const std::vector<PlyProperty>& a,
+                           const std::vector<PlyProperty>& b) noexcept {
+  return a.size() == b.size() &&
+         std::equal(a.begin(), a.end(), b.begin(),
+                    [](const PlyProperty& x, const PlyProperty& y) {
+                      return x.type == y.type &&
+                             x.count_type == y.count_type &&
+                             x.is_list == y.is_list;
+                    });
+}
+
+/// Value returned by dataset containers: T, or the values of a list
+template <typename T, typename = void>
+struct DatasetValue {
+  using type = T;
+};
+
+template <typename T>
+struct DatasetValue<T, std::enable_if_t<is_list_element<T>::value>> {
+  using type = std::vector<typename T::fastply_value_type>;
+};
+
+/// Elements [first, last) of one shard
+struct ShardRange {
+  std::size_t shard;
+  std::size_t first;
+  std::size_t last;
+};
+
+}  // namespace detail
+
+/**
+ * @brief Elements T of all shards of a dataset, addressed by a global index
+ * (shard by shard, in the order the files were given).
+ *
+ * Elements are returned by value (lists as vectors of native values), since
+ * the shard holding them may be unmapped after the access. Each access looks
+ * up the shard in O(log shards); bulk access should go through the parallel
+ * algorithms below or FastPlyDataset::shard().
+ */
+template <typename T, typename... Args>
+class PlyDatasetContainer {
+ public:
+  using value_type = typename detail::DatasetValue<T>::type;
+  using difference_type = std::ptrdiff_t;
+  using reference = value_type;
+  using const_reference = value_type;
+  using const_iterator = detail::IndexIterator<PlyDatasetContainer, value_type>;
+  using iterator = const_iterator;
+
+  value_type operator[](std::size_t i) const {
+    const auto location = locate(i);
+    const auto ply = dataset_->shard(location.first);
+    return load(ply->template get<T>()[location.second], is_list_element<T>());
+  }
+
+  value_type at(std::size_t i) const {
+    if (i >= size())
+      throw std::out_of_range("Accessed position is out of range");
+    return (*this)[i];
+  }
+
+  value_type front() const { return (*this)[0]; }
+
+  value_type back() const { return (*this)[size() - 1]; }
+
+  const_iterator begin() const noexcept { return const_iterator(this, 0); }
+
+  const_iterator cbegin() const noexcept { return begin(); }
+
+  const_iterator end() const noexcept { return const_iterator(this, size()); }
+
+  const_iterator cend() const noexcept { return end(); }
+
+  std::size_t size() const noexcept { return offsets_.back(); }
+
+  bool empty() const noexcept { return size() == 0; }
+
+  /// Shard and index within the shard of element i
+  std::pair<std::size_t, std::size_t> locate(std::size_t i) const noexcept {
+    const std::size_t shard = static_cast<std::size_t>(
+        std::upper_bound(offsets_.begin(), offsets_.end(), i) -
+        offsets_.begin() - 1);
+    return {shard, i - offsets_[shard]};
+  }
+
+  /// Global index of the first element of shard s
+  std::size_t shardOffset(std::size_t s) const noexcept {
+    return offsets_[s];
+  }
+
+  /**
+   * @brief Splits all elements into ranges within shards of about
+   * size() / pieces elements (at least min_size), in global order.
+   */
+  std::vector<detail::ShardRange> split(std::size_t pieces,
+                                        std::size_t min_size = 4096) const {
+    const std::size_t piece =
+        std::max(min_size, size() / std::max<std::size_t>(pieces, 1));
+    std::vector<detail::ShardRange> ranges;
+    for (std::size_t s = 0; s + 1 < offsets_.size(); ++s)
+      for (std::size_t first = 0; first < offsets_[s + 1] - offsets_[s];
+           first += piece)
+        ranges.push_back(
+            {s, first, std::min(first + piece, offsets_[s + 1] - offsets_[s])});
+    return ranges;
+  }
+
+  const FastPlyDataset<Args...>& dataset() const noexcept { return *dataset_; }
+
+ private:
+  static value_type load(const T& element, std::false_type) {
+    return element;
+  }
+
+  template <typename View>
+  static value_type load(const View& list, std::true_type) {
+    return value_type(list.begin(), list.end());
+  }
+
+  const FastPlyDataset<Args...>* dataset_ = nullptr;
+  std::vector<std::size_t> offsets_{0};  //!< Prefix sums of shard sizes
+
+  friend class FastPlyDataset<Args...>;
+};
+
+/**
+ * @brief A set of PLY files (shards) with the same elements, read as one.
+ *
+ * Only the headers are read on open to build the global index space; the
+ * schema (properties and byte order of every element) must be the same in
+ * all shards. Shards are memory mapped on first access. With a limit on open
+ * shards, the least recently used shard is unmapped once it is no longer in
+ * use (shards handed out by shard() stay mapped while referenced).
+ *
+ * All members can be called from several threads.
+ */
+template <typename... Args>
+class FastPlyDataset {
+ public:
+  using shard_type = FastPly<Args...>;
+
+  FastPlyDataset() = default;
+
+  FastPlyDataset(const FastPlyDataset&) = delete;
+  FastPlyDataset& operator=(const FastPlyDataset&) = delete;
+
+  /**
+   * @brief Reads the headers of all files of paths (in parallel). No shard
+   * is mapped before it is accessed, so errors in the body of a shard
+   * (e.g. a truncated file) are only reported by shard().
+   *
+   * @return false if one of the files is not a (supported) PLY file
+   * @throws std::runtime_error if the schemas of the files differ
+   */
+  bool open(const std::vector<std::string>& paths,
+            const DatasetOptions& options = DatasetOptions());
+
+  /// Opens all files matching the glob pattern, in lexicographic order
+  bool openGlob(const std::string& pattern,
+                const DatasetOptions& options = DatasetOptions());
+
+  void close();
+
+  std::size_t numShards() const noexcept { return shards_.size(); }
+
+  const std::string& path(std::size_t s) const noexcept {
+    return shards_[s].path;
+  }
+
+  /// Number of currently mapped shards
+  std::size_t numOpen() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return num_open_;
+  }
+
+  bool needsByteSwap() const noexcept { return swap_; }
+
+  /// Shard s, mapped if needed; stays mapped while the pointer is held
+  std::shared_ptr<const shard_type> shard(std::size_t s) const;
+
+  template <typename T>
+  const PlyDatasetContainer<T, Args...>& get() const noexcept {
+    return std::get<PlyDatasetContainer<T, Args...>>(elements_);
+  }
+
+  template <std::size_t I>
+  const auto& get() const noexcept {
+    return std::get<I>(elements_);
+  }
+
+ private:
+  struct Shard {
+    std::string path;
+    std::shared_ptr<const shard_type> ply;  //!< nullptr while unmapped
+    std::uint64_t used = 0;                 //!< Tick of the last access
+  };
+
+  template <std::size_t... I>
+  void setupElements(const std::vector<std::array<std::size_t,
+                                                  sizeof...(Args)>>& counts,
+                     std::index_sequence<I...>);
+
+  /// Throws if the structs cannot be served from a shard with this header
+  template <std::size_t... I>
+  static void checkElements(const detail::PlyHeader<sizeof...(Args)>& header,
+                            std::index_sequence<I...>) {
+    const int expand[] = {(checkElement<Args>(header, I), 0)...};
+    (void)expand;
+  }
+
+  template <typename T>
+  static void checkElement(const detail::PlyHeader<sizeof...(Args)>& header,
+                           std::size_t i) {
+    if (!is_list_element<T>::value)
+      detail::planElement<T>(header.names[i], header.properties[i]);
+  }
+
+  /// Unmaps least recently used shards beyond the limit (mutex_ held)
+  void evict(std::size_t keep) const;
+
+  std::vector<Shard> shards_;
+  std::tuple<PlyDatasetContainer<Args, Args...>...> elements_;
+  OpenOptions open_options_;  //!< Options for mapping shards
+  std::size_t max_open_ = 0;  //!< Limit on mapped shards (0: unlimited)
+  bool swap_ = false;         //!< Shards are in non-native byte order
+  mutable std::mutex mutex_;  //!< Guards the mappings of shards_
+  mutable std::size_t num_open_ = 0;  //!< Mapped shards
+  mutable std::uint64_t tick_ = 0;    //!< Access counter
+};
+
+template <typename... Args>
+bool FastPlyDataset<Args...>::open(const std::vector<std::string>& paths,
+                                   const DatasetOptions& options) {
+  close();
+  open_options_ = options.open;
+  max_open_ = options.max_open;
+  shards_.resize(paths.size());
+
+  // Only the headers are read, shards are mapped on demand by shard()
+  using header_type = detail::PlyHeader<sizeof...(Args)>;
+  std::vector<header_type> headers(paths.size());
+  std::vector<char> valid(paths.size(), 0);
+  try {
+    detail::runTasks(paths.size(), options.threads, [&](std::size_t s) {
+      const int fd = ::open(paths[s].c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd == -1)
+        throw std::system_error(errno, std::generic_category());
+      detail::HeaderStatus status;
+      try {
+        detail::readHeader(fd, headers[s], status);
+      } catch (...) {
+        ::close(fd);
+        throw;
+      }
+      ::close(fd);
+      if (status != detail::HeaderStatus::Complete)
+        return;
+      if (headers[s].is_block_compressed)
+        throw std::runtime_error(
+            "Block compressed PLY files are read with FastPlyCompressed");
+      checkElements(headers[s], std::index_sequence_for<Args...>{});
+      valid[s] = 1;
+    });
+  } catch (...) {
+    close();
+    throw;
+  }
+
+  auto swap = [](const header_type& header) {
+    return !header.is_ascii &&
+           header.is_big_endian != detail::isHostBigEndian();
+  };
+  std::vector<std::array<std::size_t, sizeof...(Args)>> counts(paths.size());
+  for (std::size_t s = 0; s < paths.size(); ++s) {
+    if (!valid[s]) {
+      close();
+      return false;
+    }
+    for (std::size_t i = 0; i < sizeof...(Args); ++i) {
+      if (!detail::sameProperties(headers[s].properties[i],
+                                  headers[0].properties[i]) ||
+          swap(headers[s]) != swap(headers[0])) {
+        close();
+        throw std::runtime_error("Schema of " + paths[s] +
+                                 " differs from " + paths[0]);
+      }
+      counts[s][i] = headers[s].counts[i];
+    }
+  }
+  for (std::size_t s = 0; s < paths.size(); ++s) {
+    shards_[s].path = paths[s];
+    shards_[s].used = ++tick_;
+  }
+  swap_ = !paths.empty() && swap(headers[0]);
+  setupElements(counts, std::index_sequence_for<Args...>{});
+  return true;
+}
+
+template <typename... Args>
+bool FastPlyDataset<Args...>::openGlob(const std::string& pattern,
+                                       const DatasetOptions& options) {
+  glob_t matches;
+  const int result = glob(pattern.c_str(), 0, nullptr, &matches);
+  if (result != 0 && result != GLOB_NOMATCH) {
+    globfree(&matches);
+    throw std::runtime_error("Failed to expand " + pattern);
+  }
+  std::vector<std::string> paths(matches.gl_pathv,
+                                 matches.gl_pathv + matches.gl_pathc);
+  globfree(&matches);
+  return open(paths, options);
+}
+
+template <typename... Args>
+template <std::size_t... I>
+void FastPlyDataset<Args...>::setupElements(
+    const std::vector<std::array<std::size_t, sizeof...(Args)>>& counts,
+    std::index_sequence<I...>) {
+  const int expand[] = {(std::get<I>(elements_).dataset_ = this, 0)...};
+  (void)expand;
+  for (const auto& shard : counts) {
+    const int append[] = {(std::get<I>(elements_).offsets_.push_back(
+                               std::get<I>(elements_).offsets_.back() +
+                               shard[I]),
+                           0)...};
+    (void)append;
+  }
+}
+
+template <typename... Args>
+void FastPlyDataset<Args...>::close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  shards_.clear();
+  elements_ = std::tuple<PlyDatasetContainer<Args, Args...>...>();
+  num_open_ = 0;
+  swap_ = false;
+}
+
+template <typename... Args>
+std::shared_ptr<const typename FastPlyDataset<Args...>::shard_type>
+FastPlyDataset<Args...>::shard(std::size_t s) const {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Shard& shard = const_cast<Shard&>(shards_.at(s));
+    shard.used = ++tick_;
+    if (shard.ply)
+      return shard.ply;
+  }
+
+  // Map outside the lock, other threads may use other shards meanwhile
+  auto ply = std::make_shared<shard_type>();
+  if (!ply->open(shards_[s].path, open_options_))
+    throw std::runtime_error("Failed to reopen " + shards_[s].path);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  Shard& shard = const_cast<Shard&>(shards_[s]);
+  if (!shard.ply) {  // not mapped concurrently
+    shard.ply = std::move(ply);
+    ++num_open_;
+    evict(s);
+  }
+  return shard.ply;
+}
+
+template <typename... Args>
+void FastPlyDataset<Args...>::evict(std::size_t keep) const {
+  while (max_open_ && num_open_ > max_open_) {
+    Shard* lru = nullptr;
+    for (std::size_t s = 0; s < shards_.size(); ++s) {
+      Shard& shard = const_cast<Shard&>(shards_[s]);
+      if (s != keep && shard.ply && (!lru || shard.used < lru->used))
+        lru = &shard;
+    }
+    if (!lru)
+      return;
+    lru->ply.reset();  // unmapped once the last user releases it
+    --num_open_;
+  }
+}
+
+/**
+ * @brief Calls fn(element) for all elements of all shards in parallel
+ * (threads: 0 uses the global pool); list elements are passed as
+ * PlyListView. Each participant works through neighbouring shards, which
+ * stay mapped while in use. The order of the calls is unspecified.
+ */
+template <typename T, typename... Args, typename F>
+void parallel_for_each(const PlyDatasetContainer<T, Args...>& container,
+                       F fn,
+                       unsigned threads = 0) {
+  const unsigned participants =
+      threads ? threads : WorkStealingPool::global().size();
+  const auto ranges = container.split(participants * 8);
+  detail::runTasks(ranges.size(), threads, [&](std::size_t k) {
+    const auto ply = container.dataset().shard(ranges[k].shard);
+    const auto& elements = ply->template get<T>();
+    for (std::size_t i = ranges[k].first; i < ranges[k].last; ++i)
+      fn(elements[i]);
+  });
+}
+
+/**
+ * @brief Reduces transform(element) over all elements of all shards with
+ * reduce, starting from init. Partial results are combined in global order
+ * (reduce must be associative).
+ */
+template <typename T, typename... Args, typename R, typename Reduce,
+          typename Transform>
+R parallel_transform_reduce(const PlyDatasetContainer<T, Args...>& container,
+                            R init,
+                            Reduce reduce,
+                            Transform transform,
+                            unsigned threads = 0) {
+  const unsigned participants =
+      threads ? threads : WorkStealingPool::global().size();
+  const auto ranges = container.split(participants * 8);
+  std::vector<R> partial(ranges.size(), init);
+  detail::runTasks(ranges.size(), threads, [&](std::size_t k) {
+    const auto ply = container.dataset().shard(ranges[k].shard);
+    const auto& elements = ply->template get<T>();
+    R value = transform(elements[ranges[k].first]);
+    for (std::size_t i = ranges[k].first + 1; i < ranges[k].last; ++i)
+      value = reduce(std::move(value), transform(elements[i]));
+    partial[k] = std::move(value);
+  });
+  for (auto& value : partial)
+    init = reduce(std::move(init), std::move(value));
+  return init;
+}
+
+/// Number of elements of all shards for which pred(element) is true
+template <typename T, typename... Args, typename Pred>
+std::size_t parallel_count_if(const PlyDatasetContainer<T, Args...>& container,
+                              Pred pred,
+                              unsigned threads = 0) {
+  return parallel_transform_reduce(
+      container, std::size_t(0), std::plus<std::size_t>(),
+      [&](const auto& element) -> std::size_t { return pred(element) ? 1 : 0; },
+      threads);
+}
+
+}  // namespace fastply
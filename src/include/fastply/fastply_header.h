@@ -0,0 +1,356 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "fastply/fastply_types.h"
+
+namespace fastply {
+namespace detail {
+
+/// Non-owning view of one whitespace separated token of a header line
+struct HeaderToken {
+  const char* data = nullptr;
+  std::size_t size = 0;
+
+  bool empty() const noexcept { return size == 0; }
+
+  /// Case insensitive comparison with a lower case keyword
+  bool is(const char* keyword) const noexcept {
+    for (std::size_t i = 0; i < size; ++i, ++keyword) {
+      const char c = data[i] >= 'A' && data[i] <= 'Z'
+                         ? static_cast<char>(data[i] - 'A' + 'a')
+                         : data[i];
+      if (*keyword == '\0' || c != *keyword)
+        return false;
+    }
+    return *keyword == '\0';
+  }
+
+  std::string str() const { return std::string(data, size); }
+};
+
+/// Splits one header line (without its line break) into tokens
+class HeaderLine {
+ public:
+  HeaderLine(const char* begin, const char* end) noexcept
+      : p_(begin), end_(end) {}
+
+  /// Next token, empty at the end of the line
+  HeaderToken next() noexcept {
+    while (p_ != end_ && isSpace(*p_))
+      ++p_;
+    HeaderToken token;
+    token.data = p_;
+    while (p_ != end_ && !isSpace(*p_))
+      ++p_;
+    token.size = static_cast<std::size_t>(p_ - token.data);
+    return token;
+  }
+
+ private:
+  static bool isSpace(char c) noexcept {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+  }
+
+  const char* p_;    //!< Current position
+  const char* end_;  //!< End of the line
+};
+
+/// Parses a non-negative decimal number, false if malformed or too large
+inline bool parseCount(const HeaderToken& token, std::size_t& count) noexcept {
+  if (token.empty())
+    return false;
+  std::size_t value = 0;
+  for (std::size_t i = 0; i < token.size; ++i) {
+    const unsigned digit = static_cast<unsigned char>(token.data[i]) - '0';
+    if (digit > 9 ||
+        value > (std::numeric_limits<std::size_t>::max() - digit) / 10)
+      return false;
+    value = value * 10 + digit;
+  }
+  count = value;
+  return true;
+}
+
+/// First word of the comment marking block compressed files
+constexpr const char* kBlockCompressedComment() noexcept {
+  return "fastply_blocks";
+}
+
+/// Initial value of 64 bit FNV-1a hashes (e.g. schema fingerprints)
+constexpr std::uint64_t kFnv1aSeed = 0xcbf29ce484222325ULL;
+
+/// Continues the 64 bit FNV-1a hash with size bytes of text
+constexpr std::uint64_t fnv1a(const char* text,
+                              std::size_t size,
+                              std::uint64_t hash = kFnv1aSeed) noexcept {
+  for (std::size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(text[i]);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+/// Continues the 64 bit FNV-1a hash with size bytes of an object
+inline std::uint64_t fnv1a(const void* data,
+                           std::size_t size,
+                           std::uint64_t hash = kFnv1aSeed) noexcept {
+  return fnv1a(static_cast<const char*>(data), size, hash);
+}
+
+/**
+ * @brief Fingerprint of a schema given as its element and property lines
+ * without counts and with the canonical type names, e.g.
+ * "element face\nproperty list uchar int vertex_indices\n" (see
+ * PlyHeader::schema_fingerprint).
+ */
+constexpr std::uint64_t schemaFingerprint(const char* schema) noexcept {
+  std::size_t size = 0;
+  while (schema[size] != '\0')
+    ++size;
+  return fnv1a(schema, size);
+}
+
+/// Result of scanning (a prefix of) a PLY header
+enum class HeaderStatus {
+  Complete,    //!< end_header found
+  Incomplete,  //!< More input needed
+  Invalid      //!< Unsupported format
+};
+
+/**
+ * @brief Encoding, element counts and property declarations of a PLY header
+ * declaring at most N elements.
+ *
+ * Lines are scanned in place; strings are only built for the names of
+ * elements and properties (element names reuse their capacity on reparse).
+ */
+template <std::size_t N>
+struct PlyHeader {
+  bool is_big_endian = false;  //!< Encoding of ply file
+  bool is_ascii = false;       //!< ASCII encoded ply file
+  bool is_block_compressed = false;  //!< Body in compressed blocks
+  std::size_t num_elements = 0;  //!< Elements parsed from ply header
+  std::size_t length = 0;  //!< Length of header (incl. end_header line)
+  std::size_t counts[N] = {};  //!< Num. elements per element definition
+  std::string names[N];  //!< Element names as declared
+  std::vector<PlyProperty> properties[N];  //!< Properties per element
+  std::uint64_t schema_fingerprint =
+      kFnv1aSeed;  //!< Of the element and property lines
+
+  /**
+   * @brief Scans text from the start of the file, replacing any previous
+   * result. Throws std::runtime_error on malformed headers.
+   *
+   * @param complete Text holds the whole file, i.e. a last line without
+   * line break is not cut off
+   */
+  HeaderStatus parse(const char* text, std::size_t size, bool complete = true);
+
+  /// Resets to the empty header (keeps the capacity of properties)
+  void clear() noexcept {
+    is_big_endian = false;
+    is_ascii = false;
+    is_block_compressed = false;
+    num_elements = 0;
+    length = 0;
+    schema_fingerprint = kFnv1aSeed;
+    for (std::size_t i = 0; i < N; ++i) {
+      counts[i] = 0;
+      names[i].clear();
+      properties[i].clear();
+    }
+  }
+
+ private:
+  bool readEncoding(HeaderLine& line) noexcept;
+
+  void readElementDefinition(HeaderLine& line);
+
+  void readPropertyDefinition(HeaderLine& line);
+
+  // Pieces of a line are hashed in place, without assembling the line
+  void addToFingerprint(const char* text, std::size_t size) noexcept {
+    schema_fingerprint = fnv1a(text, size, schema_fingerprint);
+  }
+
+  void addToFingerprint(const char* text) noexcept {
+    addToFingerprint(text, std::strlen(text));
+  }
+
+  void addToFingerprint(const HeaderToken& token) noexcept {
+    addToFingerprint(token.data, token.size);
+  }
+};
+
+template <std::size_t N>
+HeaderStatus PlyHeader<N>::parse(const char* text,
+                                 std::size_t size,
+                                 bool complete) {
+  clear();
+  const char* p = text;
+  const char* end = text + size;
+  while (p != end) {
+    const char* eol =
+        static_cast<const char*>(std::memchr(p, '\n', std::size_t(end - p)));
+    if (!eol && !complete)
+      return HeaderStatus::Incomplete;  // the last line may be cut off
+    HeaderLine line(p, eol ? eol : end);
+    p = eol ? eol + 1 : end;
+
+    // Keywords are compared case insensitively (ASCII only). This allows
+    // slightly non-standard formats to be successfully parsed,
+    // aka PlY plY cOmMent, will be fine.
+    const HeaderToken keyword = line.next();
+    if (keyword.empty() || keyword.is("ply") || keyword.is("obj_info"))
+      continue;
+    else if (keyword.is("comment")) {
+      // Marker written by compressPly() (see fastply_compressed.h)
+      if (line.next().is(kBlockCompressedComment()))
+        is_block_compressed = true;
+    } else if (keyword.is("format")) {
+      if (!readEncoding(line))
+        return HeaderStatus::Invalid;
+    } else if (keyword.is("element")) {
+      readElementDefinition(line);
+    } else if (keyword.is("property")) {
+      readPropertyDefinition(line);
+    } else if (keyword.is("end_header")) {
+      length = static_cast<std::size_t>(p - text);
+      return HeaderStatus::Complete;
+    } else {
+      throw std::runtime_error("Unknown keyword '" + keyword.str() +
+                               "' found");
+    }
+  }
+  return HeaderStatus::Incomplete;
+}
+
+template <std::size_t N>
+bool PlyHeader<N>::readEncoding(HeaderLine& line) noexcept {
+  const HeaderToken s = line.next();
+  if (s.is("binary_little_endian"))
+    is_big_endian = false;
+  else if (s.is("binary_big_endian"))
+    is_big_endian = true;
+  else if (s.is("ascii"))
+    is_ascii = true;
+  else
+    return false;  // No support for typos ;).
+  return true;
+}
+
+template <std::size_t N>
+void PlyHeader<N>::readElementDefinition(HeaderLine& line) {
+  // If we read more element definition keywords than defined
+  if (num_elements >= N) {
+    throw std::runtime_error(
+        "Definition of PLY file does not match the loaded file. More "
+        "element definitions found than number of template parameters!");
+  }
+
+  const HeaderToken name = line.next();
+  names[num_elements].assign(name.data, name.size);
+  addToFingerprint("element ");
+  addToFingerprint(name);
+  addToFingerprint("\n");
+
+  // Store number of instances of this element type
+  if (!parseCount(line.next(), counts[num_elements]))
+    throw std::runtime_error("Invalid element count in PLY header");
+
+  ++num_elements;  // update the count of read elements
+}
+
+template <std::size_t N>
+void PlyHeader<N>::readPropertyDefinition(HeaderLine& line) {
+  if (num_elements == 0)
+    throw std::runtime_error("Property declared before any element");
+
+  PlyProperty property;
+  HeaderToken s = line.next();
+  if (s.is("list")) {
+    property.is_list = true;
+    s = line.next();
+    property.count_type = parsePlyType(s.data, s.size);
+    s = line.next();
+  }
+  property.type = parsePlyType(s.data, s.size);
+  // Unknown types are kept (Invalid) and only rejected if they need to be
+  // interpreted, i.e. when converting ASCII files.
+  const HeaderToken name = line.next();
+  property.name.assign(name.data, name.size);
+
+  addToFingerprint("property ");
+  if (property.is_list) {
+    addToFingerprint("list ");
+    addToFingerprint(plyTypeName(property.count_type));
+    addToFingerprint(" ");
+  }
+  addToFingerprint(plyTypeName(property.type));
+  addToFingerprint(" ");
+  addToFingerprint(name);
+  addToFingerprint("\n");
+
+  properties[num_elements - 1].push_back(std::move(property));
+}
+
+/**
+ * @brief Reads the PLY header from fd through pread(), growing the buffer
+ * until end_header was seen.
+ */
+template <std::size_t N>
+void readHeader(int fd, PlyHeader<N>& header, HeaderStatus& status) {
+  std::vector<char> text(4096);
+  std::size_t size = 0;
+  bool eof = false;
+  while ((status = header.parse(text.data(), size, eof)) ==
+         HeaderStatus::Incomplete) {
+    if (eof)
+      throw std::runtime_error("PLY header is not terminated by end_header");
+    if (size == text.size())
+      text.resize(2 * text.size());
+    const ssize_t n =
+        ::pread(fd, text.data() + size, text.size() - size,
+                static_cast<off_t>(size));
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n == -1)
+      throw std::system_error(errno, std::generic_category());
+    eof = n == 0;
+    size += static_cast<std::size_t>(n);
+  }
+}
+
+}  // namespace detail
+}  // namespace fastply
@@ -0,0 +1,610 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "fastply/fastply.h"
+#include "fastply/fastply_parallel.h"
+#include "fastply/fastply_sidecar.h"
+
+namespace fastply {
+
+/// Contiguous run of indices stored in a SpatialIndex or MeshAdjacency
+class IndexSpan {
+ public:
+  using value_type = std::uint64_t;
+  using const_iterator = const std::uint64_t*;
+
+  IndexSpan() = default;
+
+  IndexSpan(const std::uint64_t* first, const std::uint64_t* last) noexcept
+      : first_(first), last_(last) {}
+
+  std::uint64_t operator[](std::size_t i) const noexcept { return first_[i]; }
+
+  const_iterator begin() const noexcept { return first_; }
+
+  const_iterator end() const noexcept { return last_; }
+
+  std::size_t size() const noexcept {
+    return static_cast<std::size_t>(last_ - first_);
+  }
+
+  bool empty() const noexcept { return first_ == last_; }
+
+ private:
+  const std::uint64_t* first_ = nullptr;  //!< First index of the run
+  const std::uint64_t* last_ = nullptr;   //!< One past the last index
+};
+
+/// Options for SpatialIndex::build()
+struct IndexOptions {
+  std::size_t leaf_size = 32;  //!< Maximum number of elements per leaf
+  unsigned threads = 0;        //!< Number of threads (0: global pool)
+};
+
+/// Default location of the index sidecar of a PLY file
+inline std::string sidecarPath(const std::string& ply_path) {
+  return ply_path + ".kdx";
+}
+
+namespace detail {
+
+/// Header of the sidecar file, stored in host byte order
+struct SpatialIndexHeader {
+  char magic[8];             //!< "FPLYKDX" followed by '\0'
+  std::uint32_t version;     //!< Format version
+  std::uint32_t byte_order;  //!< 0x01020304 as written by the host
+  std::uint64_t count;       //!< Number of indexed elements
+  std::uint64_t stride;      //!< Size of one element record
+  std::uint64_t offsets[3];  //!< Offsets of the coordinates in the record
+  std::uint64_t type;        //!< PlyType of the coordinates
+  std::uint64_t leaf_size;   //!< Maximum number of elements per leaf
+  std::uint64_t depth;       //!< Depth of the leaves (root: 0)
+  std::uint64_t fingerprint;  //!< Hash of layout and sampled coordinates
+  MappingKey source;          //!< PLY file the index was built from
+};
+
+/// Bounds of the elements below a node (empty nodes: min > max)
+struct SpatialIndexNode {
+  double min[3];
+  double max[3];
+};
+
+constexpr std::uint32_t kIndexVersion() noexcept { return 2; }
+
+constexpr std::uint32_t kIndexByteOrder() noexcept { return 0x01020304u; }
+
+/// Offset of the node array in the sidecar
+constexpr std::size_t kIndexNodeOffset() noexcept { return 128; }
+
+static_assert(sizeof(SpatialIndexHeader) <= kIndexNodeOffset(),
+              "Sidecar header does not fit in front of the nodes");
+
+/// Depth at which all leaves hold at most leaf_size elements
+inline std::size_t leafDepth(std::size_t count, std::size_t leaf_size) {
+  std::size_t depth = 0;
+  while (depth < 63) {
+    const std::size_t mask = (std::size_t(1) << depth) - 1;
+    const std::size_t largest = (count >> depth) + ((count & mask) != 0);
+    if (largest <= leaf_size)
+      break;
+    ++depth;
+  }
+  return depth;
+}
+
+/**
+ * @brief Element range [first, second) of node j of the given level.
+ *
+ * Every node splits its range at the middle, so ranges follow from the path
+ * from the root (the bits of j) alone and need not be stored.
+ */
+inline std::pair<std::size_t, std::size_t> nodeRange(std::size_t count,
+                                                     std::size_t depth,
+                                                     std::size_t j) noexcept {
+  std::size_t first = 0, last = count;
+  for (std::size_t bit = depth; bit-- > 0;) {
+    const std::size_t mid = first + (last - first) / 2;
+    if ((j >> bit) & 1)
+      first = mid;
+    else
+      last = mid;
+  }
+  return {first, last};
+}
+
+template <typename V>
+double loadAsDouble(const unsigned char* p, bool byte_swap) noexcept {
+  return static_cast<double>(detail::loadUnaligned<V>(p, byte_swap));
+}
+
+/// Query region given by an axis aligned box
+struct BoxRegion {
+  std::array<double, 3> lo;
+  std::array<double, 3> hi;
+
+  bool disjoint(const SpatialIndexNode& node) const noexcept {
+    for (int a = 0; a < 3; ++a)
+      if (node.max[a] < lo[a] || node.min[a] > hi[a])
+        return true;
+    return false;
+  }
+
+  bool contains(const SpatialIndexNode& node) const noexcept {
+    for (int a = 0; a < 3; ++a)
+      if (node.min[a] < lo[a] || node.max[a] > hi[a])
+        return false;
+    return true;
+  }
+
+  bool contains(const std::array<double, 3>& p) const noexcept {
+    return p[0] >= lo[0] && p[0] <= hi[0] && p[1] >= lo[1] &&
+           p[1] <= hi[1] && p[2] >= lo[2] && p[2] <= hi[2];
+  }
+};
+
+/// Query region given by a ball
+struct BallRegion {
+  std::array<double, 3> center;
+  double radius2;  //!< Squared radius
+
+  bool disjoint(const SpatialIndexNode& node) const noexcept {
+    if (node.min[0] > node.max[0])
+      return true;
+    double d = 0;
+    for (int a = 0; a < 3; ++a) {
+      const double v = std::max({node.min[a] - center[a], 0.0,
+                                 center[a] - node.max[a]});
+      d += v * v;
+    }
+    return d > radius2;
+  }
+
+  bool contains(const SpatialIndexNode& node) const noexcept {
+    double d = 0;
+    for (int a = 0; a < 3; ++a) {
+      const double v = std::max(std::abs(node.min[a] - center[a]),
+                                std::abs(node.max[a] - center[a]));
+      d += v * v;
+    }
+    return d <= radius2;
+  }
+
+  bool contains(const std::array<double, 3>& p) const noexcept {
+    double d = 0;
+    for (int a = 0; a < 3; ++a)
+      d += (p[a] - center[a]) * (p[a] - center[a]);
+    return d <= radius2;
+  }
+};
+
+}  // namespace detail
+
+/**
+ * @brief Balanced kd-tree over three coordinates of the elements of a
+ * container, stored in a memory mapped sidecar file.
+ *
+ * The sidecar holds a permutation of the element indices, grouped by leaf,
+ * and the bounds of every node; coordinates are always read from the mapped
+ * PLY file. It is built once with build() and reopened without any work with
+ * open() (openOrBuild() combines both), as long as the PLY file it was built
+ * from (see SidecarSource) is unchanged. Queries return runs of the
+ * permutation (IndexSpan) whose entries index straight into the container.
+ *
+ * The index refers to the container it was opened with, which must outlive
+ * it (like iterators into the container).
+ */
+template <typename T>
+class SpatialIndex {
+ public:
+  using Point = std::array<double, 3>;
+
+  SpatialIndex() = default;
+
+  ~SpatialIndex() { close(); }
+
+  SpatialIndex(const SpatialIndex&) = delete;
+  SpatialIndex& operator=(const SpatialIndex&) = delete;
+
+  /**
+   * @brief Maps the sidecar at path.
+   *
+   * @return False if it does not exist or was not built from this version
+   * of source, or for this layout and data (compared by a hash of the
+   * layout and of sampled coordinates)
+   */
+  template <typename M>
+  bool open(const std::string& path,
+            const SidecarSource& source,
+            const PlyElementContainer<T>& container,
+            M T::*x,
+            M T::*y,
+            M T::*z);
+
+  /**
+   * @brief Builds the index for the container and writes it to path.
+   *
+   * Works on the mapped sidecar, so the permutation need not fit into
+   * memory. The file is written to a unique temporary file next to path and
+   * renamed once complete.
+   */
+  template <typename M>
+  void build(const std::string& path,
+             const SidecarSource& source,
+             const PlyElementContainer<T>& container,
+             M T::*x,
+             M T::*y,
+             M T::*z,
+             const IndexOptions& options = IndexOptions());
+
+  /// Opens the sidecar at path, rebuilding it if missing or stale
+  template <typename M>
+  void openOrBuild(const std::string& path,
+                   const SidecarSource& source,
+                   const PlyElementContainer<T>& container,
+                   M T::*x,
+                   M T::*y,
+                   M T::*z,
+                   const IndexOptions& options = IndexOptions()) {
+    if (!open(path, source, container, x, y, z))
+      build(path, source, container, x, y, z, options);
+  }
+
+  void close();
+
+  bool isOpen() const noexcept { return ptr_mapped_file_ != nullptr; }
+
+  /// Number of indexed elements
+  std::size_t size() const noexcept { return count_; }
+
+  std::size_t numNodes() const noexcept {
+    return (std::size_t(2) << depth_) - 1;
+  }
+
+  /// All element indices in leaf order
+  IndexSpan indices() const noexcept {
+    return {indices_, indices_ + count_};
+  }
+
+  /// Indices of all elements with lo <= (x, y, z) <= hi
+  std::vector<IndexSpan> queryBox(const Point& lo, const Point& hi) const {
+    return query(detail::BoxRegion{lo, hi});
+  }
+
+  /// Indices of all elements within radius of center
+  std::vector<IndexSpan> queryRadius(const Point& center,
+                                     double radius) const {
+    return query(detail::BallRegion{center, radius * radius});
+  }
+
+  /// Coordinates of element i as double
+  Point point(std::size_t i) const noexcept {
+    const unsigned char* record =
+        reinterpret_cast<const unsigned char*>(container_->data()) +
+        i * sizeof(T);
+    const bool swap = container_->needsByteSwap();
+    return {{load_(record + offsets_[0], swap),
+             load_(record + offsets_[1], swap),
+             load_(record + offsets_[2], swap)}};
+  }
+
+ private:
+  template <typename M>
+  static detail::SpatialIndexHeader describe(
+      const SidecarSource& source,
+      const PlyElementContainer<T>& container,
+      M T::*x,
+      M T::*y,
+      M T::*z);
+
+  static std::size_t fileLength(std::size_t count, std::size_t depth) {
+    return detail::kIndexNodeOffset() +
+           ((std::size_t(2) << depth) - 1) * sizeof(detail::SpatialIndexNode) +
+           count * sizeof(std::uint64_t);
+  }
+
+  template <typename V>
+  static void buildLevel(const PlyElementContainer<T>& container,
+                         const std::size_t (&offsets)[3],
+                         detail::SpatialIndexNode* nodes,
+                         std::uint64_t* indices,
+                         std::size_t depth,
+                         std::size_t level,
+                         unsigned threads);
+
+  void map(void* ptr, std::size_t length, const PlyElementContainer<T>& c);
+
+  template <typename Region>
+  std::vector<IndexSpan> query(const Region& region) const;
+
+  const PlyElementContainer<T>* container_ = nullptr;  //!< Indexed elements
+  double (*load_)(const unsigned char*, bool) = nullptr;  //!< Coord. loader
+  std::size_t offsets_[3] = {};      //!< Offsets of the coordinates
+  std::size_t count_ = 0;            //!< Number of indexed elements
+  std::size_t depth_ = 0;            //!< Depth of the leaves
+  const detail::SpatialIndexNode* nodes_ = nullptr;  //!< Nodes (heap order)
+  const std::uint64_t* indices_ = nullptr;  //!< Element indices by leaf
+  std::size_t file_length_ = 0;      //!< Length of mapped sidecar in bytes
+  void* ptr_mapped_file_ = nullptr;  //!< Ptr to start of mmap'ed sidecar
+};
+
+template <typename T>
+template <typename M>
+detail::SpatialIndexHeader SpatialIndex<T>::describe(
+    const SidecarSource& source,
+    const PlyElementContainer<T>& container,
+    M T::*x,
+    M T::*y,
+    M T::*z) {
+  static_assert(std::is_arithmetic<M>::value,
+                "Coordinates must be arithmetic members");
+  detail::SpatialIndexHeader header = {};
+  std::memcpy(header.magic, "FPLYKDX", 8);
+  header.version = detail::kIndexVersion();
+  header.byte_order = detail::kIndexByteOrder();
+  header.count = container.size();
+  header.stride = sizeof(T);
+  header.offsets[0] = detail::memberOffset(x);
+  header.offsets[1] = detail::memberOffset(y);
+  header.offsets[2] = detail::memberOffset(z);
+  using V = typename std::remove_cv<M>::type;
+  header.type = static_cast<std::uint64_t>(plyTypeOf<V>());
+
+  // Layout plus the coordinates of 65 evenly spaced elements
+  std::uint64_t hash = detail::fnv1a(&header, sizeof(header));
+  const unsigned char* base =
+      reinterpret_cast<const unsigned char*>(container.data());
+  for (std::size_t k = 0; container.size() && k <= 64; ++k) {
+    const unsigned char* record =
+        base + k * (container.size() - 1) / 64 * sizeof(T);
+    for (auto offset : header.offsets)
+      hash = detail::fnv1a(record + offset, sizeof(M), hash);
+  }
+  header.fingerprint = hash;
+  header.source = source.key();
+  return header;
+}
+
+template <typename T>
+template <typename M>
+bool SpatialIndex<T>::open(const std::string& path,
+                           const SidecarSource& source,
+                           const PlyElementContainer<T>& container,
+                           M T::*x,
+                           M T::*y,
+                           M T::*z) {
+  close();
+  std::size_t length = 0;
+  void* ptr = detail::mapSidecar(path, detail::kIndexNodeOffset(), length);
+  if (ptr == nullptr)
+    return false;
+
+  detail::SpatialIndexHeader stored;
+  std::memcpy(&stored, ptr, sizeof(stored));
+  const detail::SpatialIndexHeader expected =
+      describe(source, container, x, y, z);
+  const std::size_t stored_depth = static_cast<std::size_t>(stored.depth);
+  if (std::memcmp(&stored, &expected,
+                  offsetof(detail::SpatialIndexHeader, leaf_size)) ||
+      stored.fingerprint != expected.fingerprint ||
+      !(stored.source == expected.source) || stored.leaf_size == 0 ||
+      stored_depth != detail::leafDepth(container.size(),
+                                        static_cast<std::size_t>(
+                                            stored.leaf_size)) ||
+      length != fileLength(container.size(), stored_depth)) {
+    munmap(ptr, length);
+    return false;
+  }
+
+  load_ = &detail::loadAsDouble<typename std::remove_cv<M>::type>;
+  for (int a = 0; a < 3; ++a)
+    offsets_[a] = static_cast<std::size_t>(stored.offsets[a]);
+  depth_ = stored_depth;
+  map(ptr, length, container);
+  return true;
+}
+
+template <typename T>
+void SpatialIndex<T>::map(void* ptr,
+                          std::size_t length,
+                          const PlyElementContainer<T>& container) {
+  ptr_mapped_file_ = ptr;
+  file_length_ = length;
+  container_ = &container;
+  count_ = container.size();
+  const unsigned char* bytes = static_cast<const unsigned char*>(ptr);
+  nodes_ = reinterpret_cast<const detail::SpatialIndexNode*>(
+      bytes + detail::kIndexNodeOffset());
+  indices_ = reinterpret_cast<const std::uint64_t*>(nodes_ + numNodes());
+}
+
+template <typename T>
+template <typename M>
+void SpatialIndex<T>::build(const std::string& path,
+                            const SidecarSource& source,
+                            const PlyElementContainer<T>& container,
+                            M T::*x,
+                            M T::*y,
+                            M T::*z,
+                            const IndexOptions& options) {
+  close();
+  detail::SpatialIndexHeader header = describe(source, container, x, y, z);
+  const std::size_t count = container.size();
+  const std::size_t leaf_size = std::max<std::size_t>(1, options.leaf_size);
+  const std::size_t depth = detail::leafDepth(count, leaf_size);
+  header.leaf_size = leaf_size;
+  header.depth = depth;
+
+  detail::SidecarWriter writer(path, fileLength(count, depth));
+  unsigned char* bytes = writer.data();
+  auto* nodes = reinterpret_cast<detail::SpatialIndexNode*>(
+      bytes + detail::kIndexNodeOffset());
+  auto* indices =
+      reinterpret_cast<std::uint64_t*>(nodes + ((std::size_t(2) << depth) - 1));
+
+  const std::size_t chunks = std::max<std::size_t>(1, count >> 16);
+  detail::runTasks(chunks, options.threads, [&](std::size_t t) {
+    for (std::size_t i = count * t / chunks; i < count * (t + 1) / chunks; ++i)
+      indices[i] = i;
+  });
+
+  // Top down, one level at a time: bounds of each node, then split its
+  // range at the median of the longest axis
+  const std::size_t offsets[3] = {header.offsets[0], header.offsets[1],
+                                  header.offsets[2]};
+  for (std::size_t level = 0; level <= depth; ++level)
+    buildLevel<typename std::remove_cv<M>::type>(
+        container, offsets, nodes, indices, depth, level, options.threads);
+
+  std::memcpy(bytes, &header, sizeof(header));
+  writer.commit();
+
+  if (!open(path, source, container, x, y, z))
+    throw std::runtime_error("Failed to open spatial index " + path);
+}
+
+template <typename T>
+template <typename V>
+void SpatialIndex<T>::buildLevel(const PlyElementContainer<T>& container,
+                                 const std::size_t (&offsets)[3],
+                                 detail::SpatialIndexNode* nodes,
+                                 std::uint64_t* indices,
+                                 std::size_t depth,
+                                 std::size_t level,
+                                 unsigned threads) {
+  const unsigned char* base =
+      reinterpret_cast<const unsigned char*>(container.data());
+  const bool swap = container.needsByteSwap();
+  const std::size_t count = container.size();
+  const std::size_t num_nodes = std::size_t(1) << level;
+  const std::size_t tasks = std::min<std::size_t>(num_nodes, 1024);
+
+  auto build_node = [&](std::size_t j) {
+    const auto range = detail::nodeRange(count, level, j);
+    detail::SpatialIndexNode& node = nodes[num_nodes - 1 + j];
+    for (int a = 0; a < 3; ++a) {
+      node.min[a] = std::numeric_limits<double>::infinity();
+      node.max[a] = -std::numeric_limits<double>::infinity();
+    }
+    for (std::size_t i = range.first; i < range.second; ++i) {
+      const unsigned char* record = base + indices[i] * sizeof(T);
+      for (int a = 0; a < 3; ++a) {
+        const double v = detail::loadUnaligned<V>(record + offsets[a], swap);
+        node.min[a] = std::min(node.min[a], v);
+        node.max[a] = std::max(node.max[a], v);
+      }
+    }
+    if (level == depth || range.second - range.first < 2)
+      return;
+
+    int axis = 0;
+    for (int a = 1; a < 3; ++a)
+      if (node.max[a] - node.min[a] > node.max[axis] - node.min[axis])
+        axis = a;
+    const std::size_t offset = offsets[axis];
+    auto key = [&](std::uint64_t i) {
+      return detail::loadUnaligned<V>(base + i * sizeof(T) + offset, swap);
+    };
+    std::nth_element(indices + range.first,
+                     indices + range.first + (range.second - range.first) / 2,
+                     indices + range.second,
+                     [&](std::uint64_t lhs, std::uint64_t rhs) {
+                       return key(lhs) < key(rhs);
+                     });
+  };
+
+  detail::runTasks(tasks, threads, [&](std::size_t t) {
+    for (std::size_t j = num_nodes * t / tasks; j < num_nodes * (t + 1) / tasks;
+         ++j)
+      build_node(j);
+  });
+}
+
+template <typename T>
+template <typename Region>
+std::vector<IndexSpan> SpatialIndex<T>::query(const Region& region) const {
+  std::vector<IndexSpan> spans;
+  if (!isOpen())
+    return spans;
+
+  // Adjacent nodes cover adjacent runs, so touching runs are merged
+  auto emit = [&](std::size_t first, std::size_t last) {
+    if (!spans.empty() && spans.back().end() == indices_ + first)
+      spans.back() = IndexSpan(spans.back().begin(), indices_ + last);
+    else
+      spans.emplace_back(indices_ + first, indices_ + last);
+  };
+
+  struct Entry {
+    std::size_t node, level, first, last;
+  };
+  std::vector<Entry> stack{{0, 0, 0, count_}};
+  while (!stack.empty()) {
+    const Entry e = stack.back();
+    stack.pop_back();
+    const detail::SpatialIndexNode& node = nodes_[e.node];
+    if (e.first == e.last || region.disjoint(node))
+      continue;
+    if (region.contains(node)) {
+      emit(e.first, e.last);
+    } else if (e.level == depth_) {
+      for (std::size_t i = e.first; i < e.last; ++i)
+        if (region.contains(point(static_cast<std::size_t>(indices_[i]))))
+          emit(i, i + 1);
+    } else {
+      const std::size_t mid = e.first + (e.last - e.first) / 2;
+      stack.push_back({2 * e.node + 2, e.level + 1, mid, e.last});
+      stack.push_back({2 * e.node + 1, e.level + 1, e.first, mid});
+    }
+  }
+  return spans;
+}
+
+template <typename T>
+void SpatialIndex<T>::close() {
+  if (ptr_mapped_file_ != nullptr) {
+    if (munmap(ptr_mapped_file_, file_length_) == -1)
+      throw std::runtime_error("Failed to unmap memory!");
+    ptr_mapped_file_ = nullptr;
+  }
+  container_ = nullptr;
+  nodes_ = nullptr;
+  indices_ = nullptr;
+  file_length_ = 0;
+  count_ = 0;
+  depth_ = 0;
+}
+
+}  // namespace fastply
@@ -0,0 +1,374 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+// Define FASTPLY_INSTRUMENTATION to time the phases of FastPly::open() and
+// to record the scopes marked with FASTPLY_PROFILE_SCOPE. Without it both
+// compile to nothing. Residency reports (mincore) and ProfileScope objects
+// created explicitly are available regardless and cost nothing unless used.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#include "fastply/fastply_options.h"
+
+namespace fastply {
+
+/**
+ * @brief Wall time of the phases of the last FastPly::open() in nanoseconds
+ * (zero unless FASTPLY_INSTRUMENTATION is defined).
+ */
+struct OpenTimings {
+  std::uint64_t open_ns = 0;            //!< Whole open() call
+  std::uint64_t parse_header_ns = 0;    //!< Header parsing
+  std::uint64_t convert_ascii_ns = 0;   //!< ASCII to binary conversion
+  std::uint64_t setup_elements_ns = 0;  //!< Setup of the element containers
+};
+
+/// Bytes of the pages overlapping a block, and how many of them are resident
+struct Residency {
+  std::size_t bytes = 0;           //!< Size of all pages of the block
+  std::size_t resident_bytes = 0;  //!< Size of the pages in memory
+
+  double fraction() const noexcept {
+    return bytes ? static_cast<double>(resident_bytes) / bytes : 1.0;
+  }
+};
+
+/// Element block of an opened file, see FastPly::report()
+struct ElementReport {
+  std::string name;  //!< Element name (empty if unknown)
+  std::size_t count = 0;
+  Residency residency;
+};
+
+/// Open timings and residency of the element blocks of an opened file
+struct FileReport {
+  std::string path;  //!< Input path (empty for descriptors and buffers)
+  OpenTimings timings;
+  std::vector<ElementReport> elements;
+};
+
+/**
+ * @brief Counters of the scopes with the same name, see ProfileScope. Page
+ * faults and TLB misses are counted for the thread running the scope.
+ */
+struct ScopeStats {
+  std::size_t calls = 0;
+  std::uint64_t wall_ns = 0;
+  std::uint64_t minor_faults = 0;  //!< Faults served from the page cache
+  std::uint64_t major_faults = 0;  //!< Faults that had to read from disk
+  std::int64_t dtlb_misses = -1;   //!< -1 if perf counters are unavailable
+
+  ScopeStats& operator+=(const ScopeStats& rhs) noexcept {
+    calls += rhs.calls;
+    wall_ns += rhs.wall_ns;
+    minor_faults += rhs.minor_faults;
+    major_faults += rhs.major_faults;
+    if (rhs.dtlb_misses >= 0)
+      dtlb_misses = std::max<std::int64_t>(dtlb_misses, 0) + rhs.dtlb_misses;
+    return *this;
+  }
+};
+
+namespace detail {
+
+inline std::uint64_t nowNs() noexcept {
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count());
+}
+
+/// Stores its lifetime in target (no-op without FASTPLY_INSTRUMENTATION)
+class ScopedTimer {
+ public:
+#ifdef FASTPLY_INSTRUMENTATION
+  explicit ScopedTimer(std::uint64_t& target) noexcept
+      : target_(target), start_(nowNs()) {}
+
+  ~ScopedTimer() { target_ = nowNs() - start_; }
+
+ private:
+  std::uint64_t& target_;
+  std::uint64_t start_;
+#else
+  explicit ScopedTimer(std::uint64_t&) noexcept {}
+#endif
+};
+
+/// Residency of the pages overlapping [begin, end), queried with mincore
+inline Residency residency(const void* begin, const void* end) {
+  Residency result;
+  const std::uintptr_t page = pageSize();
+  const std::uintptr_t first =
+      reinterpret_cast<std::uintptr_t>(begin) & ~(page - 1);
+  const std::uintptr_t last = reinterpret_cast<std::uintptr_t>(end);
+  if (begin == nullptr || first >= last)
+    return result;
+
+  // In steps of 64K pages, so the vector stays small for large files
+  std::vector<unsigned char> pages;
+  for (std::uintptr_t p = first; p < last;) {
+    const std::size_t n =
+        std::min<std::uintptr_t>((last - p + page - 1) / page, 65536);
+    pages.resize(n);
+    if (mincore(reinterpret_cast<void*>(p), n * page, pages.data()) != 0)
+      return Residency();
+    for (const unsigned char resident : pages)
+      result.resident_bytes += (resident & 1) ? page : 0;
+    result.bytes += n * page;
+    p += n * page;
+  }
+  return result;
+}
+
+/// Counters of the calling thread at one point in time
+struct ThreadCounters {
+  std::uint64_t wall_ns = 0;
+  std::uint64_t minor_faults = 0;
+  std::uint64_t major_faults = 0;
+  std::int64_t dtlb_misses = -1;
+};
+
+#if defined(__linux__)
+/// dTLB load miss counter of the thread creating it, closed with it
+class DtlbCounter {
+ public:
+  DtlbCounter() noexcept {
+    perf_event_attr attr = {};
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = static_cast<int>(
+        syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+  }
+
+  ~DtlbCounter() {
+    if (fd_ >= 0)
+      ::close(fd_);
+  }
+
+  DtlbCounter(const DtlbCounter&) = delete;
+  DtlbCounter& operator=(const DtlbCounter&) = delete;
+
+  int fd() const noexcept { return fd_; }
+
+ private:
+  int fd_ = -1;  //!< perf event, -1 if perf events are not permitted
+};
+
+/// Per thread dTLB load miss counter, -1 if perf events are not permitted
+inline int dtlbCounter() noexcept {
+  thread_local const DtlbCounter counter;
+  return counter.fd();
+}
+#endif
+
+inline ThreadCounters threadCounters() noexcept {
+  ThreadCounters counters;
+  counters.wall_ns = nowNs();
+  struct rusage usage;
+#if defined(RUSAGE_THREAD)
+  const int who = RUSAGE_THREAD;
+#else
+  const int who = RUSAGE_SELF;
+#endif
+  if (getrusage(who, &usage) == 0) {
+    counters.minor_faults = static_cast<std::uint64_t>(usage.ru_minflt);
+    counters.major_faults = static_cast<std::uint64_t>(usage.ru_majflt);
+  }
+#if defined(__linux__)
+  std::uint64_t misses = 0;
+  const int fd = dtlbCounter();
+  if (fd >= 0 && read(fd, &misses, sizeof(misses)) == sizeof(misses))
+    counters.dtlb_misses = static_cast<std::int64_t>(misses);
+#endif
+  return counters;
+}
+
+/// Process wide totals of the profiled scopes, by name
+class ScopeRegistry {
+ public:
+  static ScopeRegistry& global() {
+    static ScopeRegistry registry;
+    return registry;
+  }
+
+  void add(const std::string& name, const ScopeStats& stats) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    scopes_[name] += stats;
+  }
+
+  std::map<std::string, ScopeStats> snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return scopes_;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    scopes_.clear();
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::map<std::string, ScopeStats> scopes_;
+};
+
+inline void appendJsonString(std::string& out, const std::string& value) {
+  out += '"';
+  for (const char c : value) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out += escaped;
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+inline void appendJson(std::string& out, const ScopeStats& stats) {
+  out += "{\"calls\": " + std::to_string(stats.calls) +
+         ", \"wall_ns\": " + std::to_string(stats.wall_ns) +
+         ", \"minor_faults\": " + std::to_string(stats.minor_faults) +
+         ", \"major_faults\": " + std::to_string(stats.major_faults) +
+         ", \"dtlb_misses\": " +
+         (stats.dtlb_misses < 0 ? std::string("null")
+                                : std::to_string(stats.dtlb_misses)) +
+         "}";
+}
+
+}  // namespace detail
+
+/**
+ * @brief Measures wall time, page faults and dTLB misses of the calling
+ * thread from construction to destruction, and adds them to the totals of
+ * its name (see profileScopes()). Usually created through
+ * FASTPLY_PROFILE_SCOPE, which compiles to nothing unless
+ * FASTPLY_INSTRUMENTATION is defined.
+ */
+class ProfileScope {
+ public:
+  explicit ProfileScope(std::string name)
+      : name_(std::move(name)), start_(detail::threadCounters()) {}
+
+  ProfileScope(const ProfileScope&) = delete;
+  ProfileScope& operator=(const ProfileScope&) = delete;
+
+  ~ProfileScope() { detail::ScopeRegistry::global().add(name_, elapsed()); }
+
+  /// Counters since construction
+  ScopeStats elapsed() const noexcept {
+    const detail::ThreadCounters now = detail::threadCounters();
+    ScopeStats stats;
+    stats.calls = 1;
+    stats.wall_ns = now.wall_ns - start_.wall_ns;
+    stats.minor_faults = now.minor_faults - start_.minor_faults;
+    stats.major_faults = now.major_faults - start_.major_faults;
+    if (start_.dtlb_misses >= 0 && now.dtlb_misses >= 0)
+      stats.dtlb_misses = now.dtlb_misses - start_.dtlb_misses;
+    return stats;
+  }
+
+ private:
+  std::string name_;
+  detail::ThreadCounters start_;
+};
+
+/// Totals of all profiled scopes that ended so far, by name
+inline std::map<std::string, ScopeStats> profileScopes() {
+  return detail::ScopeRegistry::global().snapshot();
+}
+
+inline void resetProfileScopes() { detail::ScopeRegistry::global().clear(); }
+
+/// JSON object mapping the scope names to their counters
+inline std::string toJson(const std::map<std::string, ScopeStats>& scopes) {
+  std::string out = "{";
+  for (const auto& scope : scopes) {
+    if (out.size() > 1)
+      out += ", ";
+    detail::appendJsonString(out, scope.first);
+    out += ": ";
+    detail::appendJson(out, scope.second);
+  }
+  return out + "}";
+}
+
+inline std::string toJson(const FileReport& report) {
+  std::string out = "{\"path\": ";
+  detail::appendJsonString(out, report.path);
+  out += ", \"timings\": {\"open_ns\": " +
+         std::to_string(report.timings.open_ns) + ", \"parse_header_ns\": " +
+         std::to_string(report.timings.parse_header_ns) +
+         ", \"convert_ascii_ns\": " +
+         std::to_string(report.timings.convert_ascii_ns) +
+         ", \"setup_elements_ns\": " +
+         std::to_string(report.timings.setup_elements_ns) +
+         "}, \"elements\": [";
+  for (std::size_t i = 0; i < report.elements.size(); ++i) {
+    const ElementReport& element = report.elements[i];
+    out += i ? ", {\"name\": " : "{\"name\": ";
+    detail::appendJsonString(out, element.name);
+    out += ", \"count\": " + std::to_string(element.count) +
+           ", \"bytes\": " + std::to_string(element.residency.bytes) +
+           ", \"resident_bytes\": " +
+           std::to_string(element.residency.resident_bytes) + "}";
+  }
+  return out + "]}";
+}
+
+}  // namespace fastply
+
+#define FASTPLY_CONCAT_IMPL_(a, b) a##b
+#define FASTPLY_CONCAT_(a, b) FASTPLY_CONCAT_IMPL_(a, b)
+
+#ifdef FASTPLY_INSTRUMENTATION
+/// Profiles the rest of the enclosing block under the given name
+#define FASTPLY_PROFILE_SCOPE(name) \
+  ::fastply::ProfileScope FASTPLY_CONCAT_(fastply_scope_, __LINE__)(name)
+#else
+#define FASTPLY_PROFILE_SCOPE(name) static_cast<void>(0)
+#endif
@@ -19,34 +19,461 @@
 // SOFTWARE.
 #pragma once
 
+#include <cstddef>
 #include <tuple>
 
-#define FASTPLY_GENERATE_OPERATORS(name, args...)        \
-                                                         \
-  auto tie_internals_() const { return std::tie(args); } \
-                                                         \
-  bool operator<(const name& rhs) const {                \
-    return tie_internals_() < rhs.tie_internals_();      \
-  }                                                      \
-                                                         \
-  bool operator>(const name& rhs) const {                \
-    return tie_internals_() > rhs.tie_internals_();      \
-  }                                                      \
-                                                         \
-  bool operator<=(const name& rhs) const {               \
-    return tie_internals_() <= rhs.tie_internals_();     \
-  }                                                      \
-                                                         \
-  bool operator>=(const name& rhs) const {               \
-    return tie_internals_() >= rhs.tie_internals_();     \
-  }                                                      \
-                                                         \
-  bool operator==(const name& rhs) const {               \
-    return tie_internals_() == rhs.tie_internals_();     \
-  }                                                      \
-                                                         \
-  bool operator!=(const name& rhs) const {               \
-    return tie_internals_() != rhs.tie_internals_();     \
+// Offset of the idx-th member passed to FASTPLY_GENERATE_OPERATORS, counted
+// in the order they are listed (which need not be the order of declaration).
+// Expands without top-level commas, as FASTPLY_ELEMENT passes the struct
+// body through another macro. Supports up to 128 members.
+#define FASTPLY_OFFSETS_(name, idx, ...) \
+  FASTPLY_OFFSETS_CAT_(FASTPLY_OFFSETS_, FASTPLY_OFFSETS_COUNT_(__VA_ARGS__)) \
+  (name, idx, __VA_ARGS__)
+#define FASTPLY_OFFSETS_CAT_(a, b) FASTPLY_OFFSETS_CAT_I_(a, b)
+#define FASTPLY_OFFSETS_CAT_I_(a, b) a##b
+#define FASTPLY_OFFSETS_COUNT_(...) \
+  FASTPLY_OFFSETS_ARG_(__VA_ARGS__, FASTPLY_OFFSETS_SEQ_())
+#define FASTPLY_OFFSETS_ARG_(...) FASTPLY_OFFSETS_ARG_I_(__VA_ARGS__)
+#define FASTPLY_OFFSETS_ARG_I_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, \
+    _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, \
+    _26, _27, _28, _29, _30, _31, _32, _33, _34, _35, _36, _37, _38, _39, \
+    _40, _41, _42, _43, _44, _45, _46, _47, _48, _49, _50, _51, _52, _53, \
+    _54, _55, _56, _57, _58, _59, _60, _61, _62, _63, _64, _65, _66, _67, \
+    _68, _69, _70, _71, _72, _73, _74, _75, _76, _77, _78, _79, _80, _81, \
+    _82, _83, _84, _85, _86, _87, _88, _89, _90, _91, _92, _93, _94, _95, \
+    _96, _97, _98, _99, _100, _101, _102, _103, _104, _105, _106, _107, \
+    _108, _109, _110, _111, _112, _113, _114, _115, _116, _117, _118, _119, \
+    _120, _121, _122, _123, _124, _125, _126, _127, _128, n, ...) n
+#define FASTPLY_OFFSETS_SEQ_() 128, 127, 126, 125, 124, 123, 122, 121, 120, \
+    119, 118, 117, 116, 115, 114, 113, 112, 111, 110, 109, 108, 107, 106, \
+    105, 104, 103, 102, 101, 100, 99, 98, 97, 96, 95, 94, 93, 92, 91, 90, \
+    89, 88, 87, 86, 85, 84, 83, 82, 81, 80, 79, 78, 77, 76, 75, 74, 73, 72, \
+    71, 70, 69, 68, 67, 66, 65, 64, 63, 62, 61, 60, 59, 58, 57, 56, 55, 54, \
+    53, 52, 51, 50, 49, 48, 47, 46, 45, 44, 43, 42, 41, 40, 39, 38, 37, 36, \
+    35, 34, 33, 32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, \
+    17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1
+#define FASTPLY_OFFSETS_1(name, idx, m) ((void)(idx), offsetof(name, m))
+#define FASTPLY_OFFSETS_2(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_1(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_3(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_2(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_4(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_3(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_5(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_4(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_6(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_5(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_7(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_6(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_8(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_7(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_9(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_8(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_10(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_9(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_11(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_10(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_12(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_11(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_13(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_12(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_14(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_13(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_15(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_14(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_16(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_15(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_17(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_16(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_18(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_17(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_19(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_18(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_20(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_19(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_21(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_20(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_22(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_21(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_23(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_22(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_24(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_23(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_25(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_24(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_26(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_25(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_27(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_26(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_28(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_27(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_29(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_28(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_30(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_29(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_31(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_30(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_32(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_31(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_33(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_32(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_34(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_33(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_35(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_34(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_36(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_35(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_37(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_36(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_38(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_37(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_39(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_38(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_40(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_39(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_41(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_40(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_42(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_41(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_43(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_42(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_44(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_43(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_45(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_44(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_46(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_45(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_47(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_46(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_48(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_47(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_49(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_48(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_50(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_49(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_51(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_50(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_52(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_51(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_53(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_52(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_54(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_53(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_55(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_54(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_56(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_55(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_57(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_56(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_58(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_57(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_59(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_58(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_60(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_59(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_61(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_60(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_62(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_61(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_63(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_62(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_64(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_63(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_65(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_64(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_66(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_65(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_67(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_66(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_68(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_67(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_69(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_68(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_70(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_69(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_71(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_70(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_72(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_71(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_73(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_72(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_74(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_73(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_75(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_74(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_76(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_75(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_77(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_76(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_78(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_77(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_79(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_78(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_80(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_79(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_81(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_80(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_82(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_81(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_83(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_82(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_84(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_83(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_85(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_84(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_86(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_85(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_87(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_86(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_88(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_87(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_89(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_88(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_90(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_89(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_91(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_90(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_92(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_91(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_93(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_92(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_94(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_93(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_95(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_94(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_96(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_95(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_97(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_96(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_98(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_97(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_99(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_98(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_100(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_99(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_101(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_100(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_102(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_101(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_103(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_102(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_104(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_103(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_105(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_104(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_106(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_105(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_107(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_106(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_108(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_107(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_109(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_108(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_110(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_109(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_111(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_110(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_112(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_111(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_113(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_112(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_114(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_113(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_115(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_114(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_116(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_115(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_117(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_116(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_118(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_117(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_119(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_118(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_120(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_119(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_121(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_120(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_122(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_121(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_123(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_122(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_124(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_123(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_125(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_124(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_126(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_125(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_127(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_126(name, (idx)-1, __VA_ARGS__))
+#define FASTPLY_OFFSETS_128(name, idx, m, ...) \
+  ((idx) == 0 ? offsetof(name, m) \
+              : FASTPLY_OFFSETS_127(name, (idx)-1, __VA_ARGS__))
+
+// Members of packed structs cannot be bound to references (std::tie would
+// silently refer to temporaries), hence the members are copied.
+#define FASTPLY_GENERATE_OPERATORS(name, args...)                \
+                                                                 \
+  auto tie_internals_() const { return std::make_tuple(args); }  \
+                                                                 \
+  static constexpr const char* fastply_name_() { return #name; } \
+                                                                 \
+  static constexpr const char* fastply_field_names_() {          \
+    return #args;                                                \
+  }                                                              \
+                                                                 \
+  static constexpr std::size_t fastply_field_offset_(            \
+      std::size_t idx) {                                         \
+    return FASTPLY_OFFSETS_(name, idx, args);                    \
+  }                                                              \
+                                                                 \
+  bool operator<(const name& rhs) const {                        \
+    return tie_internals_() < rhs.tie_internals_();              \
+  }                                                              \
+                                                                 \
+  bool operator>(const name& rhs) const {                        \
+    return tie_internals_() > rhs.tie_internals_();              \
+  }                                                              \
+                                                                 \
+  bool operator<=(const name& rhs) const {                       \
+    return tie_internals_() <= rhs.tie_internals_();             \
+  }                                                              \
+                                                                 \
+  bool operator>=(const name& rhs) const {                       \
+    return tie_internals_() >= rhs.tie_internals_();             \
+  }                                                              \
+                                                                 \
+  bool operator==(const name& rhs) const {                       \
+    return tie_internals_() == rhs.tie_internals_();             \
+  }                                                              \
+                                                                 \
+  bool operator!=(const name& rhs) const {                       \
+    return tie_internals_() != rhs.tie_internals_();             \
   }
 
 #if defined(_MSC_VER)
@@ -57,4 +484,15 @@
   __FP_ELEMENT__ __attribute__((__packed__))
 #endif
 
-#define FASTPLY_ELEMENT(name, ...) FASTPLY_PACKED_(struct name{__VA_ARGS__});
\ No newline at end of file
+#define FASTPLY_ELEMENT(name, ...) FASTPLY_PACKED_(struct name{__VA_ARGS__});
+
+// Element made of a single variable-length list property, e.g.
+// "property list uchar int vertex_indices" ->
+// FASTPLY_LIST_ELEMENT(Face, uint8_t, int32_t)
+#define FASTPLY_LIST_ELEMENT(name, count_type, value_type)         \
+  struct name {                                                    \
+    using fastply_count_type = count_type;                         \
+    using fastply_value_type = value_type;                         \
+                                                                   \
+    static constexpr const char* fastply_name_() { return #name; } \
+  };
@@ -0,0 +1,316 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <typeindex>
+#include <typeinfo>
+#include <utility>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fastply/fastply_header.h"
+
+namespace fastply {
+
+/// Counters of a MappingCache
+struct MappingCacheStats {
+  std::size_t hits = 0;       //!< Opens served by a cached mapping
+  std::size_t misses = 0;     //!< Opens that mapped the file
+  std::size_t evictions = 0;  //!< Idle mappings unmapped to meet the limits
+  std::size_t entries = 0;    //!< Cached mappings (in use or idle)
+  std::size_t bytes = 0;      //!< Address space of the cached mappings
+};
+
+namespace detail {
+
+/// Identity of a file version: device, inode, size and modification time
+struct MappingKey {
+  std::uint64_t device = 0;
+  std::uint64_t inode = 0;
+  std::uint64_t size = 0;
+  std::int64_t mtime_sec = 0;
+  std::int64_t mtime_nsec = 0;
+
+  MappingKey() = default;
+
+  explicit MappingKey(const struct ::stat& st) noexcept
+      : device(static_cast<std::uint64_t>(st.st_dev)),
+        inode(static_cast<std::uint64_t>(st.st_ino)),
+        size(static_cast<std::uint64_t>(st.st_size)) {
+#if defined(__APPLE__)
+    mtime_sec = st.st_mtimespec.tv_sec;
+    mtime_nsec = st.st_mtimespec.tv_nsec;
+#else
+    mtime_sec = st.st_mtim.tv_sec;
+    mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+  }
+
+  bool sameFile(const MappingKey& rhs) const noexcept {
+    return device == rhs.device && inode == rhs.inode;
+  }
+
+  bool operator==(const MappingKey& rhs) const noexcept {
+    return sameFile(rhs) && size == rhs.size && mtime_sec == rhs.mtime_sec &&
+           mtime_nsec == rhs.mtime_nsec;
+  }
+
+  bool operator<(const MappingKey& rhs) const noexcept {
+    return std::tie(device, inode, size, mtime_sec, mtime_nsec) <
+           std::tie(rhs.device, rhs.inode, rhs.size, rhs.mtime_sec,
+                    rhs.mtime_nsec);
+  }
+};
+
+/**
+ * @brief Mapping of a PLY file shared by all FastPly objects that opened it
+ * with OpenOptions::shared, unmapped with the last reference.
+ */
+class SharedMapping {
+ public:
+  SharedMapping(void* mapping_,
+                std::size_t mapping_length_,
+                void* data_,
+                std::size_t length_,
+                std::size_t data_offset_,
+                std::string header) noexcept
+      : mapping(mapping_),
+        mapping_length(mapping_length_),
+        data(data_),
+        length(length_),
+        data_offset(data_offset_),
+        header_(std::move(header)) {}
+
+  SharedMapping(const SharedMapping&) = delete;
+  SharedMapping& operator=(const SharedMapping&) = delete;
+
+  ~SharedMapping() {
+    if (mapping != nullptr)
+      munmap(mapping, mapping_length);
+  }
+
+  /**
+   * @brief Header parsed for up to N elements, parsed once per N.
+   * @return nullptr if the format is not supported
+   */
+  template <std::size_t N>
+  std::shared_ptr<const PlyHeader<N>> header() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& parsed = parsed_[N];
+    if (!parsed) {
+      auto header = std::make_shared<PlyHeader<N>>();
+      if (header->parse(header_.data(), header_.size()) !=
+          HeaderStatus::Complete)
+        return nullptr;
+      parsed = std::move(header);
+    }
+    return std::static_pointer_cast<const PlyHeader<N>>(parsed);
+  }
+
+  /// Stores an already parsed header
+  template <std::size_t N>
+  void setHeader(const PlyHeader<N>& header) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    parsed_[N] = std::make_shared<const PlyHeader<N>>(header);
+  }
+
+  /**
+   * @brief Elements set up by setup() over this mapping, once per type of
+   * Elements (i.e. per element list of FastPly). Later calls return the
+   * elements of the first successful setup; exceptions are passed on and
+   * nothing is cached.
+   */
+  template <typename Elements, typename Setup>
+  std::shared_ptr<const Elements> elements(Setup&& setup) const {
+    const std::type_index type(typeid(Elements));
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const auto it = elements_.find(type);
+      if (it != elements_.end())
+        return std::static_pointer_cast<const Elements>(it->second);
+    }
+    std::shared_ptr<const void> result =
+        std::make_shared<const Elements>(setup());
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Another thread may have set up the same elements meanwhile
+    return std::static_pointer_cast<const Elements>(
+        elements_.emplace(type, std::move(result)).first->second);
+  }
+
+  void* const mapping;               //!< Owned mapping
+  const std::size_t mapping_length;  //!< Length of the mapping in bytes
+  void* const data;                  //!< Start of the (binary) PLY data
+  const std::size_t length;          //!< Length of the PLY data in bytes
+  const std::size_t data_offset;     //!< Offset of the first element
+
+ private:
+  std::string header_;  //!< Header text of the file (before conversion)
+  mutable std::mutex mutex_;
+  mutable std::map<std::size_t, std::shared_ptr<const void>> parsed_;
+  mutable std::map<std::type_index, std::shared_ptr<const void>> elements_;
+};
+
+}  // namespace detail
+
+/**
+ * @brief Process wide registry of the mappings of files opened with
+ * OpenOptions::shared, keyed by device, inode, size and modification time.
+ *
+ * Opening a cached file takes one stat() and copies its parsed header and
+ * element setup, without mmap(), header parsing and checking the elements. Mappings stay mapped after the last
+ * FastPly using them is closed, until they are the least recently used idle
+ * mapping while more than maxEntries() mappings or maxBytes() of address
+ * space are cached. Modified files are mapped again; idle mappings of their
+ * old versions are dropped. All members are thread-safe.
+ */
+class MappingCache {
+ public:
+  static MappingCache& global() {
+    static MappingCache cache;
+    return cache;
+  }
+
+  std::size_t maxBytes() const noexcept {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return max_bytes_;
+  }
+
+  std::size_t maxEntries() const noexcept {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return max_entries_;
+  }
+
+  /// Changes the limits, unmapping idle mappings beyond them
+  void setLimits(std::size_t max_bytes, std::size_t max_entries) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_bytes_ = max_bytes;
+    max_entries_ = max_entries;
+    trimLocked();
+  }
+
+  MappingCacheStats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    MappingCacheStats stats = stats_;
+    stats.entries = lru_.size();
+    stats.bytes = bytes_;
+    return stats;
+  }
+
+  /// Unmaps all idle mappings (mappings in use stay cached)
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = lru_.begin(); it != lru_.end();)
+      it = it->second.use_count() == 1 ? erase(it) : std::next(it);
+  }
+
+  /// Mapping of the file with the given status, nullptr if not cached
+  std::shared_ptr<const detail::SharedMapping> find(
+      const struct ::stat& st) {
+    const detail::MappingKey key(st);
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = entries_.find(key);
+    if (it == entries_.end()) {
+      ++stats_.misses;
+      return nullptr;
+    }
+    ++stats_.hits;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->second;
+  }
+
+  /**
+   * @brief Caches the mapping of the file with the given status and returns
+   * it. If another thread cached the same file version meanwhile, the
+   * mapping is returned without being cached.
+   */
+  std::shared_ptr<const detail::SharedMapping> insert(
+      const struct ::stat& st,
+      std::shared_ptr<const detail::SharedMapping> mapping) {
+    const detail::MappingKey key(st);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.count(key))
+      return mapping;
+
+    // Earlier versions of the file are not opened again
+    for (auto it = lru_.begin(); it != lru_.end();)
+      it = it->first.sameFile(key) && it->second.use_count() == 1
+               ? erase(it)
+               : std::next(it);
+
+    lru_.emplace_front(key, mapping);
+    entries_[key] = lru_.begin();
+    bytes_ += mapping->mapping_length;
+    trimLocked();
+    return mapping;
+  }
+
+  /// Enforces the limits (called when a FastPly releases a mapping)
+  void trim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    trimLocked();
+  }
+
+ private:
+  using Entry =
+      std::pair<detail::MappingKey,
+                std::shared_ptr<const detail::SharedMapping>>;
+  using Iterator = std::list<Entry>::iterator;
+
+  MappingCache() = default;
+
+  Iterator erase(Iterator it) {
+    bytes_ -= it->second->mapping_length;
+    entries_.erase(it->first);
+    return lru_.erase(it);
+  }
+
+  /// Unmaps idle mappings, least recently used first, until within limits
+  void trimLocked() {
+    for (auto it = lru_.end(); it != lru_.begin() &&
+                               (lru_.size() > max_entries_ ||
+                                bytes_ > max_bytes_);) {
+      --it;
+      // Only the cache refers to idle mappings, so the count is stable
+      if (it->second.use_count() == 1) {
+        it = erase(it);
+        ++stats_.evictions;
+      }
+    }
+  }
+
+  mutable std::mutex mutex_;
+  std::list<Entry> lru_;  //!< Most recently used first
+  std::map<detail::MappingKey, Iterator> entries_;
+  std::size_t bytes_ = 0;
+  std::size_t max_bytes_ = std::size_t(16) << 30;
+  std::size_t max_entries_ = 256;
+  MappingCacheStats stats_;
+};
+
+}  // namespace fastply
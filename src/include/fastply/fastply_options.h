@@ -0,0 +1,106 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace fastply {
+
+/// Expected access pattern of the mapped file, passed on to the kernel
+enum class AccessPattern {
+  Normal,      //!< Default readahead
+  Sequential,  //!< Aggressive readahead, pages may be freed after access
+  Random,      //!< No readahead
+  WillNeed     //!< Read the whole file into the page cache asynchronously
+};
+
+/**
+ * @brief Options for FastPly::open().
+ *
+ * All options are hints: if the kernel does not support them (or they do not
+ * apply, e.g. huge pages for file systems without THP support), the file is
+ * opened regardless.
+ */
+struct OpenOptions {
+  AccessPattern access = AccessPattern::Normal;  //!< madvise policy
+  bool populate = false;    //!< Prefault all pages on open (MAP_POPULATE)
+  bool huge_pages = false;  //!< Request transparent huge pages (MADV_HUGEPAGE)
+  /**
+   * @brief Share the mapping with other opens of the same path (see
+   * MappingCache). An open served by a cached mapping reuses it as mapped
+   * and advised by the open that cached it: access, populate and
+   * huge_pages only apply to that first open.
+   */
+  bool shared = false;
+};
+
+/// Options for PlyElementContainer::gather()
+struct GatherOptions {
+  unsigned threads = 1;  //!< Number of threads (0: global pool)
+  bool sort = true;      //!< Visit non-resident records in file order
+  bool advise = true;    //!< madvise(WILLNEED) the pages before copying
+  std::size_t prefetch_distance = 16;  //!< Records prefetched ahead
+};
+
+namespace detail {
+
+inline std::size_t pageSize() noexcept {
+  static const std::size_t size =
+      static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  return size;
+}
+
+inline int adviceFor(AccessPattern access) noexcept {
+  switch (access) {
+    case AccessPattern::Sequential:
+      return MADV_SEQUENTIAL;
+    case AccessPattern::Random:
+      return MADV_RANDOM;
+    case AccessPattern::WillNeed:
+      return MADV_WILLNEED;
+    default:
+      return MADV_NORMAL;
+  }
+}
+
+/**
+ * @brief madvise on all pages overlapping the byte range [begin, end).
+ *
+ * The start is rounded down to the page boundary, i.e. neighbouring data
+ * sharing the first page is affected as well. Failures are ignored, since
+ * advice never changes the content of read-only mappings.
+ */
+inline void adviseRange(const void* begin,
+                        const void* end,
+                        int advice) noexcept {
+  const std::uintptr_t first = reinterpret_cast<std::uintptr_t>(begin);
+  const std::uintptr_t last = reinterpret_cast<std::uintptr_t>(end);
+  if (first >= last)
+    return;
+  const std::uintptr_t aligned = first & ~(std::uintptr_t(pageSize()) - 1);
+  madvise(reinterpret_cast<void*>(aligned), last - aligned, advice);
+}
+
+}  // namespace detail
+}  // namespace fastply
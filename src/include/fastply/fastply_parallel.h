@@ -0,0 +1,331 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace fastply {
+
+/// Number of worker threads used when 0 is requested
+inline unsigned defaultConcurrency() noexcept {
+  const unsigned n = std::thread::hardware_concurrency();
+  return n ? n : 1;
+}
+
+namespace detail {
+
+/// Set while the current thread executes tasks of a pool
+inline bool& inPoolTask() noexcept {
+  static thread_local bool active = false;
+  return active;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Persistent pool of threads executing indexed tasks with work
+ * stealing.
+ *
+ * run() hands every participant (the workers plus the calling thread) a
+ * contiguous range of task indices. Participants take tasks from the front of
+ * their own range; once it is exhausted they steal the upper half of the
+ * largest remaining range of another participant. Ranges are a single atomic
+ * word (begin, end), so neither taking nor stealing requires a lock.
+ *
+ * Runs on the same pool are serialized. run() called from within a task
+ * executes sequentially on the calling thread.
+ */
+class WorkStealingPool {
+ public:
+  /// threads: total number of participants including the caller (0: per core)
+  explicit WorkStealingPool(unsigned threads = 0)
+      : size_(threads ? threads : defaultConcurrency()),
+        ranges_(new Range[size_]) {
+    workers_.reserve(size_ - 1);
+    for (unsigned id = 1; id < size_; ++id)
+      workers_.emplace_back([this, id]() { workerLoop(id); });
+  }
+
+  ~WorkStealingPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_)
+      worker.join();
+  }
+
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  /// Number of participants (workers plus the calling thread)
+  unsigned size() const noexcept { return size_; }
+
+  /// Pool shared by all parallel algorithms (one participant per core)
+  static WorkStealingPool& global() {
+    static WorkStealingPool pool;
+    return pool;
+  }
+
+  /**
+   * @brief Pool with the given number of participants, created on first use
+   * and shared by later requests of that size (0: global()). At most
+   * kMaxCachedPools sizes are kept; the least recently requested one is
+   * dropped from the cache and destroyed once its last user releases it.
+   */
+  static std::shared_ptr<WorkStealingPool> sized(unsigned threads) {
+    if (threads == 0)
+      return std::shared_ptr<WorkStealingPool>(
+          std::shared_ptr<WorkStealingPool>(), &global());
+    using Entry = std::pair<unsigned, std::shared_ptr<WorkStealingPool>>;
+    static std::mutex mutex;
+    static std::vector<Entry> pools;  // most recently requested last
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = std::find_if(pools.begin(), pools.end(),
+                           [&](const Entry& e) { return e.first == threads; });
+    Entry entry;
+    if (it != pools.end()) {
+      entry = std::move(*it);
+      pools.erase(it);
+    } else {
+      entry = Entry(threads, std::make_shared<WorkStealingPool>(threads));
+      if (pools.size() >= kMaxCachedPools)
+        pools.erase(pools.begin());
+    }
+    pools.push_back(entry);
+    return entry.second;
+  }
+
+  /// Number of pools of explicit size kept alive by sized()
+  static constexpr std::size_t kMaxCachedPools = 4;
+
+  /**
+   * @brief Runs fn(task) for task in [0, num_tasks) and blocks until all
+   * tasks are finished. The first exception thrown by any task is rethrown;
+   * remaining tasks are skipped.
+   */
+  template <typename F>
+  void run(std::size_t num_tasks, F&& fn) {
+    if (num_tasks == 0)
+      return;
+    if (size_ == 1 || num_tasks == 1 || detail::inPoolTask() ||
+        num_tasks > kMaxTasks) {
+      for (std::size_t t = 0; t < num_tasks; ++t)
+        fn(t);
+      return;
+    }
+
+    using Fn = typename std::remove_reference<F>::type;
+    std::lock_guard<std::mutex> run_lock(run_mutex_);
+    context_ = const_cast<void*>(static_cast<const void*>(&fn));
+    invoke_ = [](void* context, std::size_t task) {
+      (*static_cast<Fn*>(context))(task);
+    };
+    error_ = nullptr;
+    cancelled_ = false;
+    // Only as many participants as there are tasks take part in the run
+    const unsigned active =
+        static_cast<unsigned>(std::min<std::size_t>(size_, num_tasks));
+    for (unsigned id = 0; id < size_; ++id)
+      ranges_[id].bounds.store(
+          id < active ? pack(num_tasks * id / active,
+                             num_tasks * (id + 1) / active)
+                      : pack(0, 0),
+          std::memory_order_relaxed);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      active_ = active;
+      pending_ = size_ - 1;
+      ++generation_;
+    }
+    wake_.notify_all();
+
+    work(0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return pending_ == 0; });
+    if (error_)
+      std::rethrow_exception(error_);
+  }
+
+ private:
+  static constexpr std::size_t kMaxTasks = 0xFFFFFFFFu;
+
+  /// Task range of one participant, padded to its own cache line
+  struct Range {
+    std::atomic<std::uint64_t> bounds{0};
+    char padding[64 - sizeof(std::atomic<std::uint64_t>)];
+  };
+
+  static std::uint64_t pack(std::size_t begin, std::size_t end) noexcept {
+    return (static_cast<std::uint64_t>(begin) << 32) | end;
+  }
+
+  static std::size_t first(std::uint64_t bounds) noexcept {
+    return static_cast<std::size_t>(bounds >> 32);
+  }
+
+  static std::size_t last(std::uint64_t bounds) noexcept {
+    return static_cast<std::size_t>(bounds & 0xFFFFFFFFu);
+  }
+
+  /// Takes the first task of participant id's own range
+  bool take(unsigned id, std::size_t& task) noexcept {
+    auto& bounds = ranges_[id].bounds;
+    std::uint64_t b = bounds.load(std::memory_order_acquire);
+    while (first(b) < last(b)) {
+      if (bounds.compare_exchange_weak(b, pack(first(b) + 1, last(b)),
+                                       std::memory_order_acq_rel)) {
+        task = first(b);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// Moves the upper half of the fullest other range into id's own range
+  bool steal(unsigned id, std::size_t& task) noexcept {
+    for (;;) {
+      unsigned victim = id;
+      std::size_t most = 0;
+      for (unsigned i = 1; i < size_; ++i) {
+        const unsigned v = (id + i) % size_;
+        const std::uint64_t b =
+            ranges_[v].bounds.load(std::memory_order_relaxed);
+        if (last(b) > first(b) && last(b) - first(b) > most) {
+          most = last(b) - first(b);
+          victim = v;
+        }
+      }
+      if (victim == id)
+        return false;
+
+      auto& bounds = ranges_[victim].bounds;
+      std::uint64_t b = bounds.load(std::memory_order_acquire);
+      if (first(b) >= last(b))
+        continue;
+      const std::size_t mid = first(b) + (last(b) - first(b)) / 2;
+      if (!bounds.compare_exchange_strong(b, pack(first(b), mid),
+                                          std::memory_order_acq_rel))
+        continue;
+      // Own range is empty, hence nobody else modifies it concurrently
+      ranges_[id].bounds.store(pack(mid + 1, last(b)),
+                               std::memory_order_release);
+      task = mid;
+      return true;
+    }
+  }
+
+  void work(unsigned id) noexcept {
+    bool& in_task = detail::inPoolTask();
+    in_task = true;
+    std::size_t task;
+    while (!cancelled_.load(std::memory_order_relaxed) &&
+           (take(id, task) || steal(id, task))) {
+      try {
+        invoke_(context_, task);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error_)
+          error_ = std::current_exception();
+        cancelled_ = true;
+      }
+    }
+    in_task = false;
+  }
+
+  void workerLoop(unsigned id) {
+    std::size_t seen = 0;
+    for (;;) {
+      bool active;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [&]() { return stop_ || generation_ != seen; });
+        if (stop_)
+          return;
+        seen = generation_;
+        active = id < active_;
+      }
+      if (active)
+        work(id);
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pending_ == 0)
+          done_.notify_one();
+      }
+    }
+  }
+
+  const unsigned size_;                 //!< Participants including the caller
+  std::unique_ptr<Range[]> ranges_;     //!< Task range per participant
+  std::vector<std::thread> workers_;    //!< Participants 1..size_-1
+  std::mutex run_mutex_;                //!< Serializes calls to run()
+  std::mutex mutex_;                    //!< Guards the fields below
+  std::condition_variable wake_;        //!< Signals a new run (or stop)
+  std::condition_variable done_;        //!< Signals all workers finished
+  std::size_t generation_ = 0;          //!< Incremented per run
+  unsigned pending_ = 0;                //!< Workers still busy with the run
+  unsigned active_ = 0;                 //!< Participants of the current run
+  bool stop_ = false;                   //!< Terminates the workers
+  std::exception_ptr error_;            //!< First exception of the run
+  std::atomic<bool> cancelled_{false};  //!< Skip remaining tasks
+  void* context_ = nullptr;             //!< Task function of the run
+  void (*invoke_)(void*, std::size_t) = nullptr;
+};
+
+namespace detail {
+
+/**
+ * @brief Runs fn(task) for task in [0, num_tasks) on up to threads threads
+ * (0: the global pool, one per core; otherwise the pool of that size from
+ * WorkStealingPool::sized(), of which at most min(threads, num_tasks)
+ * participants take part). The calling thread participates. The
+ * first exception thrown by any task is rethrown after all threads have
+ * finished.
+ */
+template <typename F>
+void runTasks(std::size_t num_tasks, unsigned threads, F&& fn) {
+  if (threads == 0) {
+    WorkStealingPool::global().run(num_tasks, fn);
+    return;
+  }
+  if (threads == 1 || num_tasks <= 1 || inPoolTask()) {
+    for (std::size_t t = 0; t < num_tasks; ++t)
+      fn(t);
+    return;
+  }
+  WorkStealingPool::sized(threads)->run(num_tasks, fn);
+}
+
+}  // namespace detail
+}  // namespace fastply
@@ -0,0 +1,768 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "fastply/fastply.h"
+#include "fastply/fastply_options.h"
+#include "fastply/fastply_parallel.h"
+#include "fastply/fastply_simd.h"
+
+namespace fastply {
+namespace detail {
+
+/// Node of a query: a range test on one field, or a combination of nodes
+struct QueryNode {
+  enum Kind : std::uint8_t { Range, And, Or, Not };
+
+  Kind kind = Range;
+  PlyType type = PlyType::Invalid;  //!< Type of the field (Range)
+  std::size_t offset = 0;           //!< Offset of the field in the record
+  double lo = 1;      //!< Inclusive lower bound, a value of the field's type
+  double hi = 0;      //!< Inclusive upper bound (lo > hi: matches nothing)
+  std::size_t left = 0;   //!< Index of the first operand
+  std::size_t right = 0;  //!< Index of the second operand (And, Or)
+};
+
+/**
+ * @brief Smallest value of V that is >= bound (> bound if strict).
+ * @return false if there is none
+ */
+template <typename V>
+bool lowerBound(double bound, bool strict, V& out) noexcept {
+  using limits = std::numeric_limits<V>;
+  if (std::isnan(bound))
+    return false;
+  if (std::is_integral<V>::value) {
+    const double c = strict ? std::floor(bound) + 1 : std::ceil(bound);
+    if (c > static_cast<double>(limits::max()))
+      return false;
+    out = c < static_cast<double>(limits::lowest()) ? limits::lowest()
+                                                    : static_cast<V>(c);
+    return true;
+  }
+  V v = bound > static_cast<double>(limits::max())
+            ? limits::infinity()
+            : bound < static_cast<double>(limits::lowest())
+                  ? -limits::infinity()
+                  : static_cast<V>(bound);
+  if (v < bound || (strict && v == bound)) {
+    if (v == limits::infinity())
+      return false;
+    v = std::nextafter(v, limits::infinity());
+  }
+  out = v;
+  return true;
+}
+
+/// Largest value of V that is <= bound (< bound if strict), false if none
+template <typename V>
+bool upperBound(double bound, bool strict, V& out) noexcept {
+  using limits = std::numeric_limits<V>;
+  if (std::isnan(bound))
+    return false;
+  if (std::is_integral<V>::value) {
+    const double c = strict ? std::ceil(bound) - 1 : std::floor(bound);
+    if (c < static_cast<double>(limits::lowest()))
+      return false;
+    out = c > static_cast<double>(limits::max()) ? limits::max()
+                                                 : static_cast<V>(c);
+    return true;
+  }
+  V v = bound > static_cast<double>(limits::max())
+            ? limits::infinity()
+            : bound < static_cast<double>(limits::lowest())
+                  ? -limits::infinity()
+                  : static_cast<V>(bound);
+  if (v > bound || (strict && v == bound)) {
+    if (v == -limits::infinity())
+      return false;
+    v = std::nextafter(v, -limits::infinity());
+  }
+  out = v;
+  return true;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Filter on the elements of type T: range tests on members combined
+ * with &&, || and !, e.g.
+ *
+ *   where(&Vertex::z) > h && where(&Vertex::red).between(10, 200)
+ *
+ * Evaluated by filter(). NaN values never lie inside a range.
+ */
+template <typename T>
+class Query {
+ public:
+  /// Matches the records whose field (type, offset) lies in [lo, hi]
+  Query(PlyType type, std::size_t offset, double lo, double hi) {
+    detail::QueryNode node;
+    node.type = type;
+    node.offset = offset;
+    node.lo = lo;
+    node.hi = hi;
+    nodes_.push_back(node);
+  }
+
+  /// Nodes in evaluation order, the last one is the root
+  const std::vector<detail::QueryNode>& nodes() const noexcept {
+    return nodes_;
+  }
+
+  friend Query operator&&(Query lhs, const Query& rhs) {
+    return combine(std::move(lhs), rhs, detail::QueryNode::And);
+  }
+
+  friend Query operator||(Query lhs, const Query& rhs) {
+    return combine(std::move(lhs), rhs, detail::QueryNode::Or);
+  }
+
+  friend Query operator!(Query query) {
+    detail::QueryNode node;
+    node.kind = detail::QueryNode::Not;
+    node.left = query.nodes_.size() - 1;
+    query.nodes_.push_back(node);
+    return query;
+  }
+
+ private:
+  static Query combine(Query lhs,
+                       const Query& rhs,
+                       detail::QueryNode::Kind kind) {
+    const std::size_t shift = lhs.nodes_.size();
+    for (detail::QueryNode node : rhs.nodes_) {
+      node.left += shift;
+      node.right += shift;
+      lhs.nodes_.push_back(node);
+    }
+    detail::QueryNode node;
+    node.kind = kind;
+    node.left = shift - 1;
+    node.right = lhs.nodes_.size() - 1;
+    lhs.nodes_.push_back(node);
+    return lhs;
+  }
+
+  std::vector<detail::QueryNode> nodes_;
+};
+
+/**
+ * @brief Member of T of type V to build range tests on, see where().
+ *
+ * Bounds are given as double and converted exactly, e.g. red > 300 matches
+ * nothing for 8 bit colors and z >= 0.1 starts at the first float >= 0.1.
+ */
+template <typename T, typename V>
+class QueryField {
+  static_assert(plyTypeOf<V>() != PlyType::Invalid,
+                "Queries require scalar members of a PLY type");
+
+ public:
+  explicit QueryField(std::size_t offset) noexcept : offset_(offset) {}
+
+  /// lo <= member <= hi
+  Query<T> between(double lo, double hi) const {
+    return range(lo, false, hi, false);
+  }
+
+  Query<T> operator<(double bound) const {
+    return range(-infinity(), false, bound, true);
+  }
+
+  Query<T> operator<=(double bound) const {
+    return range(-infinity(), false, bound, false);
+  }
+
+  Query<T> operator>(double bound) const {
+    return range(bound, true, infinity(), false);
+  }
+
+  Query<T> operator>=(double bound) const {
+    return range(bound, false, infinity(), false);
+  }
+
+  Query<T> operator==(double value) const {
+    return range(value, false, value, false);
+  }
+
+ private:
+  static constexpr double infinity() noexcept {
+    return std::numeric_limits<double>::infinity();
+  }
+
+  Query<T> range(double lo, bool strict_lo, double hi, bool strict_hi) const {
+    V l, h;
+    if (!detail::lowerBound(lo, strict_lo, l) ||
+        !detail::upperBound(hi, strict_hi, h) || h < l)
+      return Query<T>(plyTypeOf<V>(), offset_, 1, 0);
+    return Query<T>(plyTypeOf<V>(), offset_, static_cast<double>(l),
+                    static_cast<double>(h));
+  }
+
+  std::size_t offset_;
+};
+
+/// Starts a range test on a member, e.g. where(&Vertex::z) > 0
+template <typename T, typename M>
+QueryField<T, typename std::remove_cv<M>::type> where(M T::*member) noexcept {
+  return QueryField<T, typename std::remove_cv<M>::type>(
+      detail::memberOffset(member));
+}
+
+/// Points (x, y, z) inside the box [min, max] (bounds inclusive)
+template <typename T, typename M>
+Query<T> inside(M T::*x,
+                M T::*y,
+                M T::*z,
+                const std::array<double, 3>& min,
+                const std::array<double, 3>& max) {
+  return where(x).between(min[0], max[0]) &&
+         where(y).between(min[1], max[1]) && where(z).between(min[2], max[2]);
+}
+
+/**
+ * @brief Set of record indices in [0, size()), as returned by filter().
+ *
+ * Stored in blocks of blockSize() records, each either empty, full, a sorted
+ * array of offsets (sparse blocks) or a bitmap, whichever is smallest. Sparse
+ * and dense selections of large elements thus take little memory.
+ */
+class Selection {
+ public:
+  static constexpr std::size_t blockSize() noexcept { return 65536; }
+
+  /// Largest number of entries stored as an array instead of a bitmap
+  static constexpr std::size_t maxArraySize() noexcept { return 4096; }
+
+  Selection() = default;
+
+  /// Empty selection over size records
+  explicit Selection(std::size_t size)
+      : blocks_((size + blockSize() - 1) / blockSize()), size_(size) {}
+
+  /// Number of records the selection refers to
+  std::size_t size() const noexcept { return size_; }
+
+  /// Number of selected records
+  std::size_t count() const noexcept {
+    std::size_t count = 0;
+    for (const auto& block : blocks_)
+      count += block.count;
+    return count;
+  }
+
+  bool contains(std::size_t i) const noexcept {
+    if (i >= size_)
+      return false;
+    const Block& block = blocks_[i / blockSize()];
+    const std::size_t offset = i % blockSize();
+    if (block.count == 0 || block.count == blockLength(i / blockSize()))
+      return block.count != 0;
+    if (!block.words.empty())
+      return (block.words[offset / 64] >> (offset % 64)) & 1;
+    return std::binary_search(block.values.begin(), block.values.end(),
+                              static_cast<std::uint16_t>(offset));
+  }
+
+  /// Calls fn(index) for all selected records in increasing order
+  template <typename F>
+  void forEach(F&& fn) const {
+    for (std::size_t b = 0; b < blocks_.size(); ++b) {
+      const Block& block = blocks_[b];
+      const std::size_t base = b * blockSize();
+      if (block.count == blockLength(b)) {
+        for (std::size_t i = 0; i < block.count; ++i)
+          fn(base + i);
+      } else if (!block.words.empty()) {
+        for (std::size_t w = 0; w < block.words.size(); ++w)
+          for (std::uint64_t bits = block.words[w]; bits; bits &= bits - 1)
+            fn(base + w * 64 + __builtin_ctzll(bits));
+      } else {
+        for (const std::uint16_t offset : block.values)
+          fn(base + offset);
+      }
+    }
+  }
+
+  /// Selected indices in increasing order
+  std::vector<std::size_t> indices() const {
+    std::vector<std::size_t> result;
+    result.reserve(count());
+    forEach([&](std::size_t i) { result.push_back(i); });
+    return result;
+  }
+
+  /// Bytes held by the blocks (excluding the fixed cost per block)
+  std::size_t bytes() const noexcept {
+    std::size_t bytes = 0;
+    for (const auto& block : blocks_)
+      bytes += block.values.size() * sizeof(std::uint16_t) +
+               block.words.size() * sizeof(std::uint64_t);
+    return bytes;
+  }
+
+  /**
+   * @brief Replaces block b by the bits of its records, bit i of words[w]
+   * standing for record b * blockSize() + 64 * w + i. Bits of records
+   * beyond size() must be zero.
+   *
+   * Different blocks may be set concurrently.
+   */
+  void setBlock(std::size_t b, const std::uint64_t* words) {
+    const std::size_t num_words = (blockLength(b) + 63) / 64;
+    Block& block = blocks_[b];
+    block = Block();
+    for (std::size_t w = 0; w < num_words; ++w)
+      block.count += static_cast<std::uint32_t>(__builtin_popcountll(words[w]));
+    if (block.count == 0 || block.count == blockLength(b))
+      return;
+    if (block.count > maxArraySize()) {
+      block.words.assign(words, words + num_words);
+      return;
+    }
+    block.values.reserve(block.count);
+    for (std::size_t w = 0; w < num_words; ++w)
+      for (std::uint64_t bits = words[w]; bits; bits &= bits - 1)
+        block.values.push_back(
+            static_cast<std::uint16_t>(w * 64 + __builtin_ctzll(bits)));
+  }
+
+ private:
+  struct Block {
+    std::uint32_t count = 0;             //!< Selected records
+    std::vector<std::uint16_t> values;   //!< Sorted offsets (sparse blocks)
+    std::vector<std::uint64_t> words;    //!< Bitmap (dense blocks)
+  };
+
+  std::size_t blockLength(std::size_t b) const noexcept {
+    return std::min(blockSize(), size_ - b * blockSize());
+  }
+
+  std::vector<Block> blocks_;
+  std::size_t size_ = 0;
+};
+
+namespace detail {
+
+/**
+ * @brief Range test of the field at p + i * stride for records [first,
+ * last), one bit per record in out (first word: record first).
+ */
+template <typename V>
+void rangeScalar(const unsigned char* p,
+                 std::size_t stride,
+                 std::size_t first,
+                 std::size_t last,
+                 bool swap,
+                 V lo,
+                 V hi,
+                 std::uint64_t* out) noexcept {
+  for (std::size_t i = first; i < last; i += 64) {
+    const std::size_t n = std::min<std::size_t>(64, last - i);
+    std::uint64_t bits = 0;
+    for (std::size_t j = 0; j < n; ++j) {
+      const V v = loadUnaligned<V>(p + (i + j) * stride, swap);
+      bits |= std::uint64_t((v >= lo) & (v <= hi)) << j;
+    }
+    *out++ = bits;
+  }
+}
+
+#if FASTPLY_X86_DISPATCH
+/**
+ * @brief Number of whole words (64 records from first) whose fields can be
+ * gathered with loads of L bytes without reading past limit bytes from p.
+ */
+inline std::size_t gatherWords(std::size_t stride,
+                               std::size_t first,
+                               std::size_t last,
+                               std::size_t limit,
+                               std::size_t L) noexcept {
+  if (stride * 8 >= (std::size_t(1) << 31))
+    return 0;
+  std::size_t words = (last - first) / 64;
+  while (words && (first + words * 64 - 1) * stride + L > limit)
+    --words;
+  return words;
+}
+
+/**
+ * @brief AVX2 range test of integer fields of up to 4 bytes, 8 records per
+ * gather. Fields are widened to 32 bits; unsigned 32 bit fields and bounds
+ * are biased into the signed range (lo and hi are already biased).
+ *
+ * @return Index of the first record not processed
+ */
+template <typename V>
+FASTPLY_TARGET_AVX2 std::size_t rangeIntAvx2(const unsigned char* p,
+                                             std::size_t stride,
+                                             std::size_t first,
+                                             std::size_t last,
+                                             std::size_t limit,
+                                             bool swap,
+                                             std::int32_t lo,
+                                             std::int32_t hi,
+                                             std::uint64_t* out) noexcept {
+  const std::size_t words = gatherWords(stride, first, last, limit, 4);
+  const int s = static_cast<int>(stride);
+  const __m256i idx =
+      _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+  const __m256i bswap =
+      sizeof(V) == 2
+          ? _mm256_setr_epi8(1, 0, 2, 3, 5, 4, 6, 7, 9, 8, 10, 11, 13, 12, 14,
+                             15, 1, 0, 2, 3, 5, 4, 6, 7, 9, 8, 10, 11, 13, 12,
+                             14, 15)
+          : _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14,
+                             13, 12, 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8,
+                             15, 14, 13, 12);
+  const bool shuffle = swap && sizeof(V) > 1;
+  const __m128i shift = _mm_cvtsi32_si128(32 - 8 * int(sizeof(V)));
+  const __m256i vlo = _mm256_set1_epi32(lo);
+  const __m256i vhi = _mm256_set1_epi32(hi);
+  const __m256i bias = _mm256_set1_epi32(
+      std::is_signed<V>::value ? 0 : std::numeric_limits<std::int32_t>::min());
+
+  for (std::size_t w = 0; w < words; ++w) {
+    std::uint64_t bits = 0;
+    for (unsigned k = 0; k < 8; ++k) {
+      const unsigned char* q = p + (first + w * 64 + k * 8) * stride;
+      __m256i v =
+          _mm256_i32gather_epi32(reinterpret_cast<const int*>(q), idx, 1);
+      if (shuffle)
+        v = _mm256_shuffle_epi8(v, bswap);
+      if (sizeof(V) < 4) {
+        // Low bytes to the top, then back with sign or zero extension
+        v = _mm256_sll_epi32(v, shift);
+        v = std::is_signed<V>::value ? _mm256_sra_epi32(v, shift)
+                                     : _mm256_srl_epi32(v, shift);
+      } else {
+        v = _mm256_xor_si256(v, bias);
+      }
+      const __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi32(vlo, v),
+                                              _mm256_cmpgt_epi32(v, vhi));
+      const unsigned mask =
+          ~_mm256_movemask_ps(_mm256_castsi256_ps(outside)) & 0xFFu;
+      bits |= std::uint64_t(mask) << (8 * k);
+    }
+    out[w] = bits;
+  }
+  return first + words * 64;
+}
+
+FASTPLY_TARGET_AVX2 inline std::size_t rangeAvx2(const unsigned char* p,
+                                                 std::size_t stride,
+                                                 std::size_t first,
+                                                 std::size_t last,
+                                                 std::size_t limit,
+                                                 bool swap,
+                                                 float lo,
+                                                 float hi,
+                                                 std::uint64_t* out) noexcept {
+  const std::size_t words = gatherWords(stride, first, last, limit, 4);
+  const int s = static_cast<int>(stride);
+  const __m256i idx =
+      _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+  const __m256i bswap = _mm256_setr_epi8(
+      3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7, 6,
+      5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  const __m256 vlo = _mm256_set1_ps(lo);
+  const __m256 vhi = _mm256_set1_ps(hi);
+
+  for (std::size_t w = 0; w < words; ++w) {
+    std::uint64_t bits = 0;
+    for (unsigned k = 0; k < 8; ++k) {
+      const unsigned char* q = p + (first + w * 64 + k * 8) * stride;
+      __m256i raw =
+          _mm256_i32gather_epi32(reinterpret_cast<const int*>(q), idx, 1);
+      if (swap)
+        raw = _mm256_shuffle_epi8(raw, bswap);
+      const __m256 v = _mm256_castsi256_ps(raw);
+      const __m256 inside = _mm256_and_ps(_mm256_cmp_ps(v, vlo, _CMP_GE_OQ),
+                                          _mm256_cmp_ps(v, vhi, _CMP_LE_OQ));
+      bits |= std::uint64_t(_mm256_movemask_ps(inside)) << (8 * k);
+    }
+    out[w] = bits;
+  }
+  return first + words * 64;
+}
+
+FASTPLY_TARGET_AVX2 inline std::size_t rangeAvx2(const unsigned char* p,
+                                                 std::size_t stride,
+                                                 std::size_t first,
+                                                 std::size_t last,
+                                                 std::size_t limit,
+                                                 bool swap,
+                                                 double lo,
+                                                 double hi,
+                                                 std::uint64_t* out) noexcept {
+  const std::size_t words = gatherWords(stride, first, last, limit, 8);
+  const int s = static_cast<int>(stride);
+  const __m128i idx = _mm_setr_epi32(0, s, 2 * s, 3 * s);
+  const __m256i bswap = _mm256_setr_epi8(
+      7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2,
+      1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+  const __m256d vlo = _mm256_set1_pd(lo);
+  const __m256d vhi = _mm256_set1_pd(hi);
+
+  for (std::size_t w = 0; w < words; ++w) {
+    std::uint64_t bits = 0;
+    for (unsigned k = 0; k < 16; ++k) {
+      const unsigned char* q = p + (first + w * 64 + k * 4) * stride;
+      __m256i raw = _mm256_i32gather_epi64(
+          reinterpret_cast<const long long*>(q), idx, 1);
+      if (swap)
+        raw = _mm256_shuffle_epi8(raw, bswap);
+      const __m256d v = _mm256_castsi256_pd(raw);
+      const __m256d inside =
+          _mm256_and_pd(_mm256_cmp_pd(v, vlo, _CMP_GE_OQ),
+                        _mm256_cmp_pd(v, vhi, _CMP_LE_OQ));
+      bits |= std::uint64_t(_mm256_movemask_pd(inside)) << (4 * k);
+    }
+    out[w] = bits;
+  }
+  return first + words * 64;
+}
+
+template <typename V>
+std::size_t rangeAvx2(const unsigned char* p,
+                      std::size_t stride,
+                      std::size_t first,
+                      std::size_t last,
+                      std::size_t limit,
+                      bool swap,
+                      V lo,
+                      V hi,
+                      std::uint64_t* out) noexcept {
+  static_assert(std::is_integral<V>::value && sizeof(V) <= 4,
+                "Unexpected field type");
+  const std::int32_t bias =
+      std::is_signed<V>::value || sizeof(V) < 4
+          ? 0
+          : std::numeric_limits<std::int32_t>::min();
+  return rangeIntAvx2<V>(
+      p, stride, first, last, limit, swap,
+      static_cast<std::int32_t>(static_cast<std::uint32_t>(lo) ^ bias),
+      static_cast<std::int32_t>(static_cast<std::uint32_t>(hi) ^ bias), out);
+}
+#endif
+
+/**
+ * @brief Range test [lo, hi] of the field at offset of records [first,
+ * last) of count records of size stride, vectorized where supported.
+ */
+template <typename V>
+void rangeKernel(const unsigned char* base,
+                 std::size_t stride,
+                 std::size_t count,
+                 const QueryNode& node,
+                 bool swap,
+                 std::size_t first,
+                 std::size_t last,
+                 std::uint64_t* out) noexcept {
+  const unsigned char* p = base + node.offset;
+  const V lo = static_cast<V>(node.lo);
+  const V hi = static_cast<V>(node.hi);
+  std::size_t i = first;
+#if FASTPLY_X86_DISPATCH
+  if (cpuHasAvx2())
+    i = rangeAvx2(p, stride, first, last, count * stride - node.offset, swap,
+                  lo, hi, out);
+#else
+  (void)count;
+#endif
+  rangeScalar<V>(p, stride, i, last, swap, lo, hi, out + (i - first) / 64);
+}
+
+/**
+ * @brief Evaluates the nodes of a query over the records of a block, tile by
+ * tile so the records stay in cache while all of their fields are tested.
+ */
+class QueryScan {
+ public:
+  /// Records per tile (a multiple of 64)
+  static constexpr std::size_t tileSize() noexcept { return 2048; }
+
+  QueryScan(const std::vector<QueryNode>& nodes,
+            const unsigned char* base,
+            std::size_t stride,
+            std::size_t count,
+            bool swap) noexcept
+      : nodes_(nodes), base_(base), stride_(stride), count_(count),
+        swap_(swap) {}
+
+  /**
+   * @brief Bits of records [first, last) into out (first word: record
+   * first); first must be a multiple of 64.
+   */
+  void run(std::size_t first, std::size_t last, std::uint64_t* out) const {
+    constexpr std::size_t W = tileSize() / 64;
+    std::vector<std::uint64_t> scratch(nodes_.size() * W);
+    for (std::size_t t = first; t < last; t += tileSize())
+      eval(nodes_.size() - 1, t, std::min(last, t + tileSize()),
+           out + (t - first) / 64, scratch.data());
+  }
+
+ private:
+  void eval(std::size_t n,
+            std::size_t first,
+            std::size_t last,
+            std::uint64_t* out,
+            std::uint64_t* scratch) const {
+    const QueryNode& node = nodes_[n];
+    const std::size_t words = (last - first + 63) / 64;
+    const std::uint64_t tail =
+        (last - first) % 64 ? (std::uint64_t(1) << ((last - first) % 64)) - 1
+                            : ~std::uint64_t(0);
+    switch (node.kind) {
+      case QueryNode::Range:
+        range(node, first, last, out);
+        return;
+      case QueryNode::Not:
+        eval(node.left, first, last, out, scratch);
+        for (std::size_t w = 0; w < words; ++w)
+          out[w] = ~out[w];
+        out[words - 1] &= tail;
+        return;
+      case QueryNode::And:
+      case QueryNode::Or: {
+        eval(node.left, first, last, out, scratch);
+        // Skip the second operand if the first one decides the tile
+        const bool all = node.kind == QueryNode::Or;
+        bool decided = true;
+        for (std::size_t w = 0; decided && w < words; ++w)
+          decided = out[w] == (all ? (w + 1 < words ? ~std::uint64_t(0) : tail)
+                                   : 0);
+        if (decided)
+          return;
+        std::uint64_t* rhs = scratch;
+        eval(node.right, first, last, rhs, scratch + tileSize() / 64);
+        for (std::size_t w = 0; w < words; ++w)
+          out[w] = all ? out[w] | rhs[w] : out[w] & rhs[w];
+        return;
+      }
+    }
+  }
+
+  void range(const QueryNode& node,
+             std::size_t first,
+             std::size_t last,
+             std::uint64_t* out) const noexcept {
+    switch (node.type) {
+      case PlyType::Int8:
+        return kernel<std::int8_t>(node, first, last, out);
+      case PlyType::UInt8:
+        return kernel<std::uint8_t>(node, first, last, out);
+      case PlyType::Int16:
+        return kernel<std::int16_t>(node, first, last, out);
+      case PlyType::UInt16:
+        return kernel<std::uint16_t>(node, first, last, out);
+      case PlyType::Int32:
+        return kernel<std::int32_t>(node, first, last, out);
+      case PlyType::UInt32:
+        return kernel<std::uint32_t>(node, first, last, out);
+      case PlyType::Float32:
+        return kernel<float>(node, first, last, out);
+      case PlyType::Float64:
+        return kernel<double>(node, first, last, out);
+      default:
+        std::fill(out, out + (last - first + 63) / 64, 0);
+    }
+  }
+
+  template <typename V>
+  void kernel(const QueryNode& node,
+              std::size_t first,
+              std::size_t last,
+              std::uint64_t* out) const noexcept {
+    if (node.lo > node.hi) {
+      std::fill(out, out + (last - first + 63) / 64, 0);
+      return;
+    }
+    rangeKernel<V>(base_, stride_, count_, node, swap_, first, last, out);
+  }
+
+  const std::vector<QueryNode>& nodes_;
+  const unsigned char* base_;
+  std::size_t stride_;
+  std::size_t count_;
+  bool swap_;
+};
+
+}  // namespace detail
+
+/**
+ * @brief Records of the container matching the query.
+ *
+ * Blocks of Selection::blockSize() records are scanned in parallel (threads:
+ * 0 uses the global pool). Within a block the range tests are evaluated on
+ * tiles of records that fit into L2, each as a vectorized kernel specialized
+ * for the type of its field (AVX2 gathers where supported), producing 64
+ * records per word; && and || combine the words and skip the second operand
+ * for tiles decided by the first one. Big endian files are tested in place.
+ */
+template <typename T>
+Selection filter(const PlyElementContainer<T>& container,
+                 const Query<T>& query,
+                 unsigned threads = 0) {
+  Selection selection(container.size());
+  const detail::QueryScan scan(
+      query.nodes(), reinterpret_cast<const unsigned char*>(container.data()),
+      sizeof(T), container.size(), container.needsByteSwap());
+  const std::size_t block = Selection::blockSize();
+  detail::runTasks((container.size() + block - 1) / block, threads,
+                   [&](std::size_t b) {
+                     std::vector<std::uint64_t> words(block / 64);
+                     scan.run(b * block,
+                              std::min(container.size(), (b + 1) * block),
+                              words.data());
+                     selection.setBlock(b, words.data());
+                   });
+  return selection;
+}
+
+/**
+ * @brief Copies the selected elements into out in index order, see
+ * PlyElementContainer::gather(). out may also be the block of an element
+ * of a FastPlyWriter sized to selection.count(), to export a subset.
+ */
+template <typename T>
+void gather(const PlyElementContainer<T>& container,
+            const Selection& selection,
+            T* out,
+            const GatherOptions& options = GatherOptions()) {
+  if (selection.size() != container.size())
+    throw std::invalid_argument("Selection does not match the container");
+  const std::vector<std::size_t> indices = selection.indices();
+  container.gather(indices.data(), indices.size(), out, options);
+}
+
+}  // namespace fastply
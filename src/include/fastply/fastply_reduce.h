@@ -0,0 +1,408 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "fastply/fastply.h"
+#include "fastply/fastply_algorithm.h"
+#include "fastply/fastply_simd.h"
+
+namespace fastply {
+
+/// Options shared by all reductions
+struct ReduceOptions {
+  unsigned threads = 0;  //!< Number of threads (0: global pool)
+  bool cache = false;    //!< Reuse/store results in the container's cache
+};
+
+/// Minimum, maximum and sum of a field (NaN values give unspecified results)
+template <typename V>
+struct FieldStats {
+  V min = std::numeric_limits<V>::max();
+  V max = std::numeric_limits<V>::lowest();
+  double sum = 0;         //!< Sum of all values
+  std::size_t count = 0;  //!< Number of values
+
+  double mean() const noexcept { return count ? sum / count : 0.0; }
+
+  FieldStats& operator+=(const FieldStats& rhs) noexcept {
+    min = std::min(min, rhs.min);
+    max = std::max(max, rhs.max);
+    sum += rhs.sum;
+    count += rhs.count;
+    return *this;
+  }
+};
+
+/// Axis aligned bounding box
+template <typename V>
+struct Aabb {
+  std::array<V, 3> min;
+  std::array<V, 3> max;
+};
+
+namespace detail {
+
+template <typename V, std::size_t N>
+using StatsArray = std::array<FieldStats<V>, N>;
+
+/// Scalar stats of the fields at offsets of records [first, last)
+template <typename V, std::size_t N>
+void fieldStatsScalar(const unsigned char* base,
+                      std::size_t stride,
+                      const std::array<std::size_t, N>& offsets,
+                      std::size_t first,
+                      std::size_t last,
+                      bool swap,
+                      StatsArray<V, N>& stats) noexcept {
+  for (std::size_t i = first; i < last; ++i) {
+    const unsigned char* record = base + i * stride;
+    for (std::size_t k = 0; k < N; ++k) {
+      const V v = loadUnaligned<V>(record + offsets[k], swap);
+      stats[k].min = std::min(stats[k].min, v);
+      stats[k].max = std::max(stats[k].max, v);
+      stats[k].sum += static_cast<double>(v);
+    }
+  }
+  for (auto& s : stats)
+    s.count += last - first;
+}
+
+#if FASTPLY_X86_DISPATCH
+/**
+ * @brief Stats of float fields, gathering 8 records per field and step. Sums
+ * are accumulated in double precision.
+ *
+ * @return Index of the first record not processed
+ */
+template <std::size_t N>
+FASTPLY_TARGET_AVX2 std::size_t fieldStatsAvx2(
+    const unsigned char* base,
+    std::size_t stride,
+    const std::array<std::size_t, N>& offsets,
+    std::size_t first,
+    std::size_t last,
+    bool swap,
+    StatsArray<float, N>& stats) noexcept {
+  if (stride * 8 >= (std::size_t(1) << 31) || last - first < 8)
+    return first;
+
+  const int s = static_cast<int>(stride);
+  const __m256i idx =
+      _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+  const __m256i bswap = _mm256_setr_epi8(
+      3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, 3, 2, 1, 0, 7, 6,
+      5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  __m256 vmin[N], vmax[N];
+  __m256d vsum[N];
+  for (std::size_t k = 0; k < N; ++k) {
+    vmin[k] = _mm256_set1_ps(stats[k].min);
+    vmax[k] = _mm256_set1_ps(stats[k].max);
+    vsum[k] = _mm256_setzero_pd();
+  }
+
+  std::size_t i = first;
+  for (; i + 8 <= last; i += 8) {
+    const unsigned char* record = base + i * stride;
+    for (std::size_t k = 0; k < N; ++k) {
+      __m256i raw = _mm256_i32gather_epi32(
+          reinterpret_cast<const int*>(record + offsets[k]), idx, 1);
+      if (swap)
+        raw = _mm256_shuffle_epi8(raw, bswap);
+      const __m256 v = _mm256_castsi256_ps(raw);
+      vmin[k] = _mm256_min_ps(vmin[k], v);
+      vmax[k] = _mm256_max_ps(vmax[k], v);
+      vsum[k] = _mm256_add_pd(
+          vsum[k],
+          _mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(v)),
+                        _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1))));
+    }
+  }
+
+  for (std::size_t k = 0; k < N; ++k) {
+    alignas(32) float lo[8], hi[8];
+    alignas(32) double sum[4];
+    _mm256_store_ps(lo, vmin[k]);
+    _mm256_store_ps(hi, vmax[k]);
+    _mm256_store_pd(sum, vsum[k]);
+    stats[k].min = *std::min_element(lo, lo + 8);
+    stats[k].max = *std::max_element(hi, hi + 8);
+    stats[k].sum += (sum[0] + sum[1]) + (sum[2] + sum[3]);
+    stats[k].count += i - first;
+  }
+  return i;
+}
+#endif
+
+template <typename V, std::size_t N>
+void fieldStatsKernel(const unsigned char* base,
+                      std::size_t stride,
+                      const std::array<std::size_t, N>& offsets,
+                      std::size_t first,
+                      std::size_t last,
+                      bool swap,
+                      StatsArray<V, N>& stats,
+                      std::false_type /* float */) noexcept {
+  fieldStatsScalar<V, N>(base, stride, offsets, first, last, swap, stats);
+}
+
+template <typename V, std::size_t N>
+void fieldStatsKernel(const unsigned char* base,
+                      std::size_t stride,
+                      const std::array<std::size_t, N>& offsets,
+                      std::size_t first,
+                      std::size_t last,
+                      bool swap,
+                      StatsArray<V, N>& stats,
+                      std::true_type /* float */) noexcept {
+#if FASTPLY_X86_DISPATCH
+  if (cpuHasAvx2())
+    first = fieldStatsAvx2<N>(base, stride, offsets, first, last, swap, stats);
+#endif
+  fieldStatsScalar<V, N>(base, stride, offsets, first, last, swap, stats);
+}
+
+template <typename V>
+std::string statsKey(std::size_t offset) {
+  return "stats/" + std::to_string(static_cast<int>(plyTypeOf<V>())) + "/" +
+         std::to_string(offset);
+}
+
+/// Stats of the fields of type V at the given offsets, in one pass
+template <typename V, typename T, std::size_t N>
+StatsArray<V, N> fieldStats(const PlyElementContainer<T>& container,
+                            const std::array<std::size_t, N>& offsets,
+                            const ReduceOptions& options) {
+  static_assert(std::is_arithmetic<V>::value,
+                "Reductions require scalar members");
+  ResultCache* cache = options.cache ? container.cache() : nullptr;
+  StatsArray<V, N> result;
+  bool cached = cache != nullptr;
+  for (std::size_t k = 0; cached && k < N; ++k) {
+    const auto hit = cache->find<FieldStats<V>>(statsKey<V>(offsets[k]));
+    if (hit)
+      result[k] = *hit;
+    cached = hit != nullptr;
+  }
+  if (cached)
+    return result;
+
+  const unsigned char* base =
+      reinterpret_cast<const unsigned char*>(container.data());
+  const bool swap = container.needsByteSwap();
+  result = reduceChunks(
+      container, options.threads, StatsArray<V, N>(),
+      [&](std::size_t first, std::size_t last) {
+        StatsArray<V, N> stats;
+        fieldStatsKernel<V, N>(base, sizeof(T), offsets, first, last, swap,
+                               stats, std::is_same<V, float>{});
+        return stats;
+      },
+      [](StatsArray<V, N> lhs, const StatsArray<V, N>& rhs) {
+        for (std::size_t k = 0; k < N; ++k)
+          lhs[k] += rhs[k];
+        return lhs;
+      });
+
+  if (cache)
+    for (std::size_t k = 0; k < N; ++k)
+      cache->insert(statsKey<V>(offsets[k]), result[k]);
+  return result;
+}
+
+/// Cache key of a double, exact to the bit (unlike std::to_string)
+inline std::string exactKey(double value) {
+  std::uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return std::to_string(bits);
+}
+
+}  // namespace detail
+
+/// Minimum, maximum, sum and mean of a member, e.g. stats(vertices, &Vertex::x)
+template <typename T, typename M>
+FieldStats<typename std::remove_cv<M>::type> stats(
+    const PlyElementContainer<T>& container,
+    M T::*member,
+    const ReduceOptions& options = ReduceOptions()) {
+  using V = typename std::remove_cv<M>::type;
+  const std::array<std::size_t, 1> offsets = {{detail::memberOffset(member)}};
+  return detail::fieldStats<V>(container, offsets, options)[0];
+}
+
+/// Bounding box of the points given by three members (single pass)
+template <typename T, typename M>
+Aabb<typename std::remove_cv<M>::type> bounds(
+    const PlyElementContainer<T>& container,
+    M T::*x,
+    M T::*y,
+    M T::*z,
+    const ReduceOptions& options = ReduceOptions()) {
+  using V = typename std::remove_cv<M>::type;
+  const std::array<std::size_t, 3> offsets = {
+      {detail::memberOffset(x), detail::memberOffset(y),
+       detail::memberOffset(z)}};
+  const auto s = detail::fieldStats<V>(container, offsets, options);
+  return {{{s[0].min, s[1].min, s[2].min}}, {{s[0].max, s[1].max, s[2].max}}};
+}
+
+/// Mean of the points given by three members (single pass)
+template <typename T, typename M>
+std::array<double, 3> centroid(const PlyElementContainer<T>& container,
+                               M T::*x,
+                               M T::*y,
+                               M T::*z,
+                               const ReduceOptions& options = ReduceOptions()) {
+  using V = typename std::remove_cv<M>::type;
+  const std::array<std::size_t, 3> offsets = {
+      {detail::memberOffset(x), detail::memberOffset(y),
+       detail::memberOffset(z)}};
+  const auto s = detail::fieldStats<V>(container, offsets, options);
+  return {{s[0].mean(), s[1].mean(), s[2].mean()}};
+}
+
+/**
+ * @brief Histogram of a member with bins equally sized bins over [lo, hi).
+ * Values outside of the range are not counted.
+ */
+template <typename T, typename M>
+std::vector<std::size_t> histogram(
+    const PlyElementContainer<T>& container,
+    M T::*member,
+    std::size_t bins,
+    double lo,
+    double hi,
+    const ReduceOptions& options = ReduceOptions()) {
+  using V = typename std::remove_cv<M>::type;
+  static_assert(std::is_arithmetic<V>::value,
+                "Reductions require scalar members");
+  if (bins == 0 || !(lo < hi))
+    throw std::invalid_argument("Histogram requires bins > 0 and lo < hi");
+
+  const std::size_t offset = detail::memberOffset(member);
+  const std::string key = "histogram/" +
+                          std::to_string(static_cast<int>(plyTypeOf<V>())) +
+                          "/" + std::to_string(offset) + "/" +
+                          std::to_string(bins) + "/" + detail::exactKey(lo) +
+                          "/" + detail::exactKey(hi);
+  detail::ResultCache* cache = options.cache ? container.cache() : nullptr;
+  if (cache)
+    if (auto hit = cache->find<std::vector<std::size_t>>(key))
+      return *hit;
+
+  const unsigned char* base =
+      reinterpret_cast<const unsigned char*>(container.data()) + offset;
+  const bool swap = container.needsByteSwap();
+  const double scale = static_cast<double>(bins) / (hi - lo);
+  auto result = detail::reduceChunks(
+      container, options.threads, std::vector<std::size_t>(bins, 0),
+      [&](std::size_t first, std::size_t last) {
+        std::vector<std::size_t> counts(bins, 0);
+        for (std::size_t i = first; i < last; ++i) {
+          const double v = static_cast<double>(
+              detail::loadUnaligned<V>(base + i * sizeof(T), swap));
+          if (v >= lo && v < hi)
+            ++counts[std::min(bins - 1,
+                              static_cast<std::size_t>((v - lo) * scale))];
+        }
+        return counts;
+      },
+      [](std::vector<std::size_t> lhs, const std::vector<std::size_t>& rhs) {
+        for (std::size_t b = 0; b < lhs.size(); ++b)
+          lhs[b] += rhs[b];
+        return lhs;
+      });
+
+  if (cache)
+    cache->insert(key, result);
+  return result;
+}
+
+/**
+ * @brief Histogram of an 8 bit member (e.g. a color channel) with one bin per
+ * value; bin 0 holds the smallest value of the type.
+ */
+template <typename T, typename M>
+std::vector<std::size_t> histogram(
+    const PlyElementContainer<T>& container,
+    M T::*member,
+    const ReduceOptions& options = ReduceOptions()) {
+  using V = typename std::remove_cv<M>::type;
+  static_assert(sizeof(V) == 1 && std::is_integral<V>::value,
+                "Value histograms require 8 bit integer members");
+
+  const std::size_t offset = detail::memberOffset(member);
+  const std::string key = "histogram8/" +
+                          std::to_string(static_cast<int>(plyTypeOf<V>())) +
+                          "/" + std::to_string(offset);
+  detail::ResultCache* cache = options.cache ? container.cache() : nullptr;
+  if (cache)
+    if (auto hit = cache->find<std::vector<std::size_t>>(key))
+      return *hit;
+
+  // Signed values are shifted by 128, which maps bit patterns x to x ^ 0x80
+  const unsigned bias = std::is_signed<V>::value ? 0x80 : 0;
+  const unsigned char* base =
+      reinterpret_cast<const unsigned char*>(container.data()) + offset;
+  auto result = detail::reduceChunks(
+      container, options.threads, std::vector<std::size_t>(256, 0),
+      [&](std::size_t first, std::size_t last) {
+        // Interleaved sub-histograms avoid stalls on repeated values
+        std::vector<std::uint32_t> counts(4 * 256, 0);
+        std::size_t i = first;
+        for (; i + 4 <= last; i += 4) {
+          const unsigned char* p = base + i * sizeof(T);
+          ++counts[p[0]];
+          ++counts[256 + p[sizeof(T)]];
+          ++counts[512 + p[2 * sizeof(T)]];
+          ++counts[768 + p[3 * sizeof(T)]];
+        }
+        for (; i < last; ++i)
+          ++counts[base[i * sizeof(T)]];
+
+        std::vector<std::size_t> merged(256, 0);
+        for (unsigned b = 0; b < 256; ++b)
+          merged[b ^ bias] =
+              std::size_t(counts[b]) + counts[256 + b] + counts[512 + b] +
+              counts[768 + b];
+        return merged;
+      },
+      [](std::vector<std::size_t> lhs, const std::vector<std::size_t>& rhs) {
+        for (std::size_t b = 0; b < lhs.size(); ++b)
+          lhs[b] += rhs[b];
+        return lhs;
+      });
+
+  if (cache)
+    cache->insert(key, result);
+  return result;
+}
+
+}  // namespace fastply
@@ -0,0 +1,293 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "fastply/fastply_parallel.h"
+#include "fastply/fastply_types.h"
+
+namespace fastply {
+
+/**
+ * @brief Fingerprint (see detail::schemaFingerprint()) of the files read
+ * with FastPly<Args...>, 0 if unknown.
+ *
+ * Specialized by the headers generated with fastply_generate_schema(): files
+ * with this fingerprint are opened without matching every element against
+ * the header.
+ */
+template <typename... Args>
+struct SchemaFingerprint : std::integral_constant<std::uint64_t, 0> {};
+
+namespace detail {
+
+/// Bytes copied from a file record into the element struct
+struct FieldCopy {
+  std::size_t src;   //!< Offset inside the file record
+  std::size_t dst;   //!< Offset inside the element struct
+  std::size_t size;  //!< Length in bytes
+};
+
+/**
+ * @brief How the records of an element declared in the header are served
+ * as element structs.
+ *
+ * Records laid out exactly like the struct are used in place. Otherwise
+ * (fields reordered, or properties the struct does not list) the fields are
+ * shuffled into packed structs by a list of copies.
+ */
+struct RecordPlan {
+  bool in_place = true;  //!< Records are used as stored in the file
+  std::size_t stride = 0;  //!< Bytes per record in the file
+  std::vector<FieldCopy> copies;  //!< Shuffle (in_place == false only)
+};
+
+/// Bytes per record of scalar properties, 0 for lists or unknown types
+inline std::size_t recordStride(const std::vector<PlyProperty>& properties) {
+  std::size_t stride = 0;
+  for (const auto& property : properties) {
+    if (property.is_list || plyTypeSize(property.type) == 0)
+      return 0;
+    stride += plyTypeSize(property.type);
+  }
+  return stride;
+}
+
+/**
+ * @brief Matches the properties declared for an element against the fields
+ * of its struct.
+ *
+ * Fields are looked up by name, so properties may be declared in any order
+ * and properties without field are skipped. If a field name is not
+ * declared (e.g. members named differently than the properties), the
+ * properties have to match the fields by position, type and size instead.
+ * Elements with list properties, and structs without complete layout
+ * (fields is null), are only checked for their size where possible.
+ *
+ * @param fields Fields of the struct, or null if its layout is incomplete
+ * @throws std::runtime_error if the struct cannot be served from the file
+ */
+inline RecordPlan planRecords(const std::string& element,
+                              const std::vector<PlyProperty>& properties,
+                              const PlyFieldInfo* fields,
+                              const std::vector<std::string>& names,
+                              std::size_t record_size) {
+  RecordPlan plan;
+  plan.stride = recordStride(properties);
+  if (plan.stride == 0)
+    return plan;  // lists are interpreted by the container
+
+  const std::string mismatch =
+      "Element '" + element + "' of the PLY header does not match its "
+      "struct: ";
+  if (fields == nullptr) {
+    if (plan.stride != record_size)
+      throw std::runtime_error(
+          mismatch + std::to_string(plan.stride) + " bytes per record, but " +
+          std::to_string(record_size) + " bytes per struct (list all "
+          "members in FASTPLY_GENERATE_OPERATORS to skip properties)");
+    return plan;
+  }
+
+  // Offsets of the properties inside the record
+  std::vector<std::size_t> offsets(properties.size(), 0);
+  for (std::size_t j = 1; j < properties.size(); ++j)
+    offsets[j] = offsets[j - 1] + plyTypeSize(properties[j - 1].type);
+
+  bool by_name = true;
+  for (std::size_t i = 0; i < names.size(); ++i) {
+    const auto match =
+        std::find_if(properties.begin(), properties.end(),
+                     [&](const PlyProperty& p) { return p.name == names[i]; });
+    if (match == properties.end()) {
+      by_name = false;
+      break;
+    }
+    if (match->type != fields[i].type)
+      throw std::runtime_error(
+          mismatch + "property '" + names[i] + "' is " +
+          plyTypeName(match->type) + ", but the member is " +
+          plyTypeName(fields[i].type));
+    const std::size_t j =
+        static_cast<std::size_t>(match - properties.begin());
+    plan.copies.push_back({offsets[j], fields[i].offset, fields[i].size});
+  }
+
+  if (!by_name) {
+    // Position refers to the order the members are stored in
+    std::vector<std::size_t> order(names.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+      return fields[a].offset < fields[b].offset;
+    });
+    bool positional = plan.stride == record_size &&
+                      properties.size() == names.size();
+    for (std::size_t i = 0; positional && i < names.size(); ++i)
+      positional = properties[i].type == fields[order[i]].type;
+    if (!positional)
+      throw std::runtime_error(
+          mismatch + "members are neither declared by name nor in order");
+    plan.copies.clear();
+    return plan;
+  }
+
+  // Adjacent fields copied from adjacent properties form one copy
+  std::vector<FieldCopy> merged;
+  for (const auto& copy : plan.copies) {
+    if (!merged.empty() && merged.back().src + merged.back().size == copy.src &&
+        merged.back().dst + merged.back().size == copy.dst)
+      merged.back().size += copy.size;
+    else
+      merged.push_back(copy);
+  }
+  plan.in_place = plan.stride == record_size && merged.size() == 1 &&
+                  merged.front().src == 0 && merged.front().dst == 0;
+  plan.copies = plan.in_place ? std::vector<FieldCopy>() : std::move(merged);
+  return plan;
+}
+
+/// Copies a field whose size is known at compile time
+template <std::size_t Size>
+inline void copyField(const unsigned char* src, unsigned char* dst) noexcept {
+  std::memcpy(dst, src, Size);
+}
+
+/// Copies the fields of one file record into an element struct
+inline void assembleRecord(const unsigned char* record,
+                           unsigned char* element,
+                           const std::vector<FieldCopy>& copies) noexcept {
+  for (const auto& copy : copies) {
+    switch (copy.size) {
+      case 1:
+        copyField<1>(record + copy.src, element + copy.dst);
+        break;
+      case 2:
+        copyField<2>(record + copy.src, element + copy.dst);
+        break;
+      case 4:
+        copyField<4>(record + copy.src, element + copy.dst);
+        break;
+      case 8:
+        copyField<8>(record + copy.src, element + copy.dst);
+        break;
+      default:
+        std::memcpy(element + copy.dst, record + copy.src, copy.size);
+    }
+  }
+}
+
+/**
+ * @brief Shuffles count records of the given plan into packed structs of
+ * record_size bytes (in parallel). Bytes are copied as stored, i.e. byte
+ * order is not changed.
+ */
+inline std::shared_ptr<unsigned char> shuffleRecords(
+    const unsigned char* src,
+    std::size_t count,
+    const RecordPlan& plan,
+    std::size_t record_size) {
+  std::shared_ptr<unsigned char> out(
+      new unsigned char[std::max<std::size_t>(count * record_size, 1)],
+      std::default_delete<unsigned char[]>());
+  unsigned char* dst = out.get();
+  const std::vector<FieldCopy>& copies = plan.copies;
+  const std::size_t stride = plan.stride;
+
+  constexpr std::size_t kRecordsPerTask = 1 << 16;
+  const std::size_t num_tasks = (count + kRecordsPerTask - 1) / kRecordsPerTask;
+  runTasks(num_tasks, 0, [&](std::size_t task) {
+    const std::size_t first = task * kRecordsPerTask;
+    const std::size_t last = std::min(count, first + kRecordsPerTask);
+    for (std::size_t i = first; i < last; ++i)
+      assembleRecord(src + i * stride, dst + i * record_size, copies);
+  });
+  return out;
+}
+
+/**
+ * @brief Records of an element not stored like its struct (see RecordPlan).
+ *
+ * The records stay in the file: single structs and fields are assembled
+ * from them on access. The packed structs of all records are only shuffled
+ * into memory by the first call of structs(), shared by all copies of the
+ * container.
+ */
+class PlannedRecords {
+ public:
+  PlannedRecords(const unsigned char* records,
+                 std::size_t count,
+                 RecordPlan plan,
+                 std::size_t record_size)
+      : records_(records),
+        count_(count),
+        record_size_(record_size),
+        plan_(std::move(plan)) {}
+
+  /// First record in the file
+  const unsigned char* records() const noexcept { return records_; }
+
+  /// Bytes per record in the file
+  std::size_t stride() const noexcept { return plan_.stride; }
+
+  const RecordPlan& plan() const noexcept { return plan_; }
+
+  /// Offset inside the file record of the struct byte at offset
+  std::size_t sourceOffset(std::size_t offset) const noexcept {
+    for (const auto& copy : plan_.copies)
+      if (offset >= copy.dst && offset < copy.dst + copy.size)
+        return copy.src + (offset - copy.dst);
+    return offset;
+  }
+
+  /// Copies record i into the struct at element
+  void assemble(std::size_t i, unsigned char* element) const noexcept {
+    assembleRecord(records_ + i * plan_.stride, element, plan_.copies);
+  }
+
+  /// Packed structs of all records, shuffled on the first call
+  const unsigned char* structs() const {
+    std::call_once(once_, [this]() {
+      structs_ = shuffleRecords(records_, count_, plan_, record_size_);
+    });
+    return structs_.get();
+  }
+
+ private:
+  const unsigned char* records_ = nullptr;  //!< First record in the file
+  std::size_t count_ = 0;                   //!< Number of records
+  std::size_t record_size_ = 0;             //!< Bytes per struct
+  RecordPlan plan_;                         //!< Copies per record
+  mutable std::once_flag once_;             //!< Guards structs_
+  mutable std::shared_ptr<unsigned char> structs_;  //!< Packed structs
+};
+
+}  // namespace detail
+}  // namespace fastply
@@ -0,0 +1,189 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fastply/fastply_mapping_cache.h"
+
+namespace fastply {
+
+/**
+ * @brief PLY file a sidecar (SpatialIndex, MeshAdjacency) is built from,
+ * given by its path or its status (e.g. fstat() of the descriptor passed to
+ * FastPly::open()).
+ *
+ * Sidecars store the device, inode, size and modification time of the file
+ * and are only reopened for the same version of it.
+ */
+class SidecarSource {
+ public:
+  // Implicit, so that paths and stat results can be passed as they are
+
+  /// @throws std::system_error if the file cannot be stat()ed
+  SidecarSource(const std::string& ply_path)
+      : key_(statFile(ply_path.c_str())) {}
+
+  SidecarSource(const char* ply_path) : key_(statFile(ply_path)) {}
+
+  SidecarSource(const struct ::stat& st) noexcept : key_(st) {}
+
+  const detail::MappingKey& key() const noexcept { return key_; }
+
+ private:
+  static struct ::stat statFile(const char* path) {
+    struct ::stat st;
+    if (::stat(path, &st) == -1)
+      throw std::system_error(errno, std::generic_category());
+    return st;
+  }
+
+  detail::MappingKey key_;  //!< Identity of the file version
+};
+
+namespace detail {
+
+/**
+ * @brief Maps the sidecar at path read-only.
+ *
+ * @param length Set to the length of the file
+ * @return nullptr if it does not exist, is shorter than min_length or cannot
+ * be mapped
+ */
+inline void* mapSidecar(const std::string& path,
+                        std::size_t min_length,
+                        std::size_t& length) noexcept {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return nullptr;
+  struct ::stat st;
+  if (fstat(fd, &st) == -1 ||
+      static_cast<std::size_t>(st.st_size) < min_length) {
+    ::close(fd);
+    return nullptr;
+  }
+  length = static_cast<std::size_t>(st.st_size);
+  void* ptr = mmap(0, length, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);  // can be closed
+  return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
+/**
+ * @brief Sidecar being written: a unique temporary file (mkstemp()) in the
+ * directory of the target path, mapped for writing and zero filled.
+ *
+ * commit() syncs it and renames it over the target, so readers and
+ * concurrent builders only ever see complete sidecars. Unless committed, the
+ * destructor removes the temporary file.
+ */
+class SidecarWriter {
+ public:
+  /// @throws std::system_error if the file cannot be created or mapped
+  SidecarWriter(const std::string& path, std::size_t length)
+      : path_(path), length_(length) {
+    std::vector<char> name(path.begin(), path.end());
+    const char suffix[] = ".XXXXXX";
+    name.insert(name.end(), suffix, suffix + sizeof(suffix));
+    const int fd = ::mkstemp(name.data());
+    if (fd == -1)
+      throw std::system_error(errno, std::generic_category());
+    tmp_path_ = name.data();
+
+    int error = 0;
+    // mkstemp() creates the file for the owner only
+    if (::fchmod(fd, 0644) == -1 ||
+        ::ftruncate(fd, static_cast<off_t>(length)) == -1)
+      error = errno;
+#if defined(__linux__)
+    // Avoid SIGBUS when the disk runs full while writing through the mapping
+    if (!error && ::fallocate(fd, 0, 0, static_cast<off_t>(length)) == -1 &&
+        errno != EOPNOTSUPP && errno != ENOSYS)
+      error = errno;
+#endif
+    if (!error) {
+      ptr_ = mmap(0, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (ptr_ == MAP_FAILED) {
+        error = errno;
+        ptr_ = nullptr;
+      }
+    }
+    ::close(fd);
+    if (error) {
+      ::unlink(tmp_path_.c_str());
+      throw std::system_error(error, std::generic_category());
+    }
+  }
+
+  ~SidecarWriter() {
+    if (ptr_ != nullptr)
+      munmap(ptr_, length_);
+    if (!committed_)
+      ::unlink(tmp_path_.c_str());
+  }
+
+  SidecarWriter(const SidecarWriter&) = delete;
+  SidecarWriter& operator=(const SidecarWriter&) = delete;
+
+  unsigned char* data() const noexcept {
+    return static_cast<unsigned char*>(ptr_);
+  }
+
+  /**
+   * @brief Writes the sidecar to disk, cuts it to length bytes (at most the
+   * length it was created with) and renames it to the target path.
+   *
+   * @throws std::system_error on failure (the temporary file is removed)
+   */
+  void commit(std::size_t length) {
+    if (msync(ptr_, length_, MS_SYNC) == -1)
+      throw std::system_error(errno, std::generic_category());
+    munmap(ptr_, length_);
+    ptr_ = nullptr;
+    if (length != length_ &&
+        ::truncate(tmp_path_.c_str(), static_cast<off_t>(length)) == -1)
+      throw std::system_error(errno, std::generic_category());
+    if (std::rename(tmp_path_.c_str(), path_.c_str()) == -1)
+      throw std::system_error(errno, std::generic_category());
+    committed_ = true;
+  }
+
+  void commit() { commit(length_); }
+
+ private:
+  std::string path_;        //!< Target path
+  std::string tmp_path_;    //!< Temporary file, renamed by commit()
+  std::size_t length_ = 0;  //!< Length of the mapping in bytes
+  void* ptr_ = nullptr;     //!< Writable mapping of the temporary file
+  bool committed_ = false;  //!< Renamed to the target path
+};
+
+}  // namespace detail
+}  // namespace fastply
@@ -0,0 +1,57 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+// Vector kernels are compiled for their instruction set via function target
+// attributes and selected at runtime, so no -m flags are required by users.
+// Define FASTPLY_NO_SIMD to force the scalar fallbacks.
+#if !defined(FASTPLY_NO_SIMD) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define FASTPLY_X86_DISPATCH 1
+#include <immintrin.h>
+#define FASTPLY_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define FASTPLY_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define FASTPLY_X86_DISPATCH 0
+#endif
+
+namespace fastply {
+namespace detail {
+
+inline bool cpuHasSsse3() noexcept {
+#if FASTPLY_X86_DISPATCH
+  static const bool supported = __builtin_cpu_supports("ssse3");
+  return supported;
+#else
+  return false;
+#endif
+}
+
+inline bool cpuHasAvx2() noexcept {
+#if FASTPLY_X86_DISPATCH
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+#else
+  return false;
+#endif
+}
+
+}  // namespace detail
+}  // namespace fastply
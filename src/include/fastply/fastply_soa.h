@@ -0,0 +1,277 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <utility>
+
+#include "fastply/fastply.h"
+#include "fastply/fastply_algorithm.h"
+#include "fastply/fastply_parallel.h"
+#include "fastply/fastply_simd.h"
+
+namespace fastply {
+
+/**
+ * @brief Owning, 64 byte aligned array of size values, as returned by
+ * to_soa(). The values are not initialized.
+ */
+template <typename V>
+class AlignedColumn {
+ public:
+  using value_type = V;
+  using iterator = V*;
+  using const_iterator = const V*;
+
+  static constexpr std::size_t alignment() noexcept { return 64; }
+
+  AlignedColumn() = default;
+
+  explicit AlignedColumn(std::size_t size) : size_(size) {
+    void* ptr = nullptr;
+    if (size &&
+        posix_memalign(&ptr, alignment(), size * sizeof(V)) != 0)
+      throw std::bad_alloc();
+    data_.reset(static_cast<V*>(ptr));
+  }
+
+  V& operator[](std::size_t i) noexcept { return data_.get()[i]; }
+
+  const V& operator[](std::size_t i) const noexcept { return data_.get()[i]; }
+
+  V* data() noexcept { return data_.get(); }
+
+  const V* data() const noexcept { return data_.get(); }
+
+  iterator begin() noexcept { return data(); }
+
+  iterator end() noexcept { return data() + size_; }
+
+  const_iterator begin() const noexcept { return data(); }
+
+  const_iterator end() const noexcept { return data() + size_; }
+
+  std::size_t size() const noexcept { return size_; }
+
+  bool empty() const noexcept { return size_ == 0; }
+
+ private:
+  struct Free {
+    void operator()(V* ptr) const noexcept { std::free(ptr); }
+  };
+
+  std::unique_ptr<V, Free> data_;
+  std::size_t size_ = 0;
+};
+
+namespace detail {
+
+template <typename T, std::size_t I>
+using field_t = typename ElementLayout<T>::template field_type<I>;
+
+#if FASTPLY_X86_DISPATCH
+/**
+ * @brief Copies field (offset O, type V) of records [first, last) of stride
+ * S into out, 8 records (4 for 8 byte fields) per gather.
+ *
+ * Gathers load at least 4 bytes per record, so narrow fields near the end of
+ * the record read into the next one; the loop stops before reading past the
+ * last of the count records of the block.
+ *
+ * @return Index of the first record not processed
+ */
+template <std::size_t S, std::size_t O, typename V>
+FASTPLY_TARGET_AVX2 std::size_t gatherColumnAvx2(const unsigned char* base,
+                                                 std::size_t first,
+                                                 std::size_t last,
+                                                 std::size_t count,
+                                                 V* out,
+                                                 bool swap) noexcept {
+  static_assert(S * 8 < (std::size_t(1) << 31), "Record too large");
+  constexpr std::size_t L = sizeof(V) < 4 ? 4 : sizeof(V);  // bytes loaded
+  constexpr std::size_t K = sizeof(V) == 8 ? 4 : 8;  // records per gather
+  unsigned char* dst = reinterpret_cast<unsigned char*>(out);
+  const int s = static_cast<int>(S);
+
+  std::size_t i = first;
+  for (; i + K <= last && (i + K - 1) * S + O + L <= count * S; i += K) {
+    const unsigned char* p = base + i * S + O;
+    if (sizeof(V) == 8) {
+      const __m128i idx = _mm_setr_epi32(0, s, 2 * s, 3 * s);
+      __m256i v = _mm256_i32gather_epi64(
+          reinterpret_cast<const long long*>(p), idx, 1);
+      if (swap)
+        v = _mm256_shuffle_epi8(
+            v, _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11,
+                                10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13,
+                                12, 11, 10, 9, 8));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 8), v);
+      continue;
+    }
+
+    const __m256i idx =
+        _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+    __m256i v =
+        _mm256_i32gather_epi32(reinterpret_cast<const int*>(p), idx, 1);
+    if (sizeof(V) == 4) {
+      if (swap)
+        v = _mm256_shuffle_epi8(
+            v, _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14,
+                                13, 12, 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8,
+                                15, 14, 13, 12));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), v);
+    } else if (sizeof(V) == 2) {
+      // Low 2 bytes of every lane into the low 8 bytes of each half
+      const __m256i pick =
+          swap ? _mm256_setr_epi8(1, 0, 5, 4, 9, 8, 13, 12, -1, -1, -1, -1,
+                                  -1, -1, -1, -1, 1, 0, 5, 4, 9, 8, 13, 12,
+                                  -1, -1, -1, -1, -1, -1, -1, -1)
+               : _mm256_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, -1, -1, -1, -1,
+                                  -1, -1, -1, -1, 0, 1, 4, 5, 8, 9, 12, 13,
+                                  -1, -1, -1, -1, -1, -1, -1, -1);
+      v = _mm256_shuffle_epi8(v, pick);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 2),
+                       _mm_unpacklo_epi64(_mm256_castsi256_si128(v),
+                                          _mm256_extracti128_si256(v, 1)));
+    } else {
+      // Low byte of every lane into the low 4 bytes of each half
+      const __m256i pick = _mm256_setr_epi8(
+          0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 4,
+          8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+      v = _mm256_shuffle_epi8(v, pick);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i),
+                       _mm_unpacklo_epi32(_mm256_castsi256_si128(v),
+                                          _mm256_extracti128_si256(v, 1)));
+    }
+  }
+  return i;
+}
+#endif
+
+/// Copies field I of records [first, last) of the container into out
+template <typename T, std::size_t I>
+void gatherField(const PlyElementContainer<T>& container,
+                 std::size_t first,
+                 std::size_t last,
+                 field_t<T, I>* out) noexcept {
+  using V = field_t<T, I>;
+  constexpr std::size_t S = sizeof(T);
+  constexpr std::size_t O = ElementLayout<T>::fieldOffset(I);
+  const unsigned char* base =
+      reinterpret_cast<const unsigned char*>(container.data());
+  const bool swap = container.needsByteSwap();
+
+  std::size_t i = first;
+#if FASTPLY_X86_DISPATCH
+  i = gatherColumnAvx2<S, O>(base, first, last, container.size(), out, swap);
+#endif
+  for (; i < last; ++i)
+    out[i] = loadUnaligned<V>(base + i * S + O, swap);
+}
+
+/// Copies fields I... of records [first, last) record by record
+template <typename T, std::size_t... I, std::size_t... K, typename Columns>
+void copyRecords(const PlyElementContainer<T>& container,
+                 std::size_t first,
+                 std::size_t last,
+                 const Columns& columns,
+                 std::index_sequence<K...>) noexcept {
+  const unsigned char* base =
+      reinterpret_cast<const unsigned char*>(container.data());
+  const bool swap = container.needsByteSwap();
+  for (std::size_t i = first; i < last; ++i) {
+    const unsigned char* record = base + i * sizeof(T);
+    const int expand[] = {
+        (std::get<K>(columns)[i] = loadUnaligned<field_t<T, I>>(
+             record + ElementLayout<T>::fieldOffset(I), swap),
+         0)...};
+    (void)expand;
+  }
+}
+
+template <typename T, std::size_t... I, std::size_t... K, typename Columns>
+void transposeFields(const PlyElementContainer<T>& container,
+                     const Columns& columns,
+                     unsigned threads,
+                     std::index_sequence<K...> seq) {
+  static_assert(ElementLayout<T>::isComplete(),
+                "to_soa requires all members of the element to be listed "
+                "in FASTPLY_GENERATE_OPERATORS");
+  // Records per pass over the selected fields, so the records stay in L2
+  const std::size_t block = std::max<std::size_t>(1, (64 << 10) / sizeof(T));
+  const bool vector = cpuHasAvx2();
+  forEachChunk(container, threads, [&](std::size_t first, std::size_t last) {
+    if (!vector) {
+      copyRecords<T, I...>(container, first, last, columns, seq);
+      return;
+    }
+    for (std::size_t b = first; b < last; b += block) {
+      const std::size_t e = std::min(last, b + block);
+      const int expand[] = {
+          (gatherField<T, I>(container, b, e, std::get<K>(columns)), 0)...};
+      (void)expand;
+    }
+  });
+}
+
+template <typename Columns, std::size_t... K>
+auto columnPointers(Columns& columns, std::index_sequence<K...>) noexcept {
+  return std::make_tuple(std::get<K>(columns).data()...);
+}
+
+}  // namespace detail
+
+/**
+ * @brief Transposes fields I... of all elements into the given columns
+ * (structure of arrays), each holding container.size() values.
+ *
+ * Runs in parallel over page aligned chunks (threads: 0 uses the global pool).
+ * On AVX2 capable CPUs each field is copied with gathers specialized for the
+ * layout of T, otherwise records are copied one by one. Values are converted
+ * to native byte order.
+ */
+template <std::size_t... I, typename T>
+void to_soa(const PlyElementContainer<T>& container,
+            const std::tuple<detail::field_t<T, I>*...>& columns,
+            unsigned threads = 0) {
+  detail::transposeFields<T, I...>(container, columns, threads,
+                                   std::index_sequence_for<
+                                       detail::field_t<T, I>...>{});
+}
+
+/// Transposes fields I... into newly allocated, 64 byte aligned columns
+template <std::size_t... I, typename T>
+std::tuple<AlignedColumn<detail::field_t<T, I>>...> to_soa(
+    const PlyElementContainer<T>& container,
+    unsigned threads = 0) {
+  std::tuple<AlignedColumn<detail::field_t<T, I>>...> columns(
+      AlignedColumn<detail::field_t<T, I>>(container.size())...);
+  to_soa<I...>(container,
+               detail::columnPointers(columns,
+                                      std::make_index_sequence<sizeof...(I)>{}),
+               threads);
+  return columns;
+}
+
+}  // namespace fastply
@@ -0,0 +1,621 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "fastply/fastply.h"
+#include "fastply/fastply_parallel.h"
+#include "fastply/fastply_reduce.h"
+#include "fastply/fastply_writer.h"
+
+// External (out-of-core) sorting and vertex welding of PLY files. Records are
+// sorted in runs that fit into the memory limit (in parallel), spilled to an
+// unlinked temporary file and merged k-way into the output file.
+
+namespace fastply {
+
+/// Options for sortElements() and weldVertices()
+struct SortOptions {
+  std::size_t memory_limit = std::size_t(256) << 20;  //!< Bytes for runs
+  unsigned threads = 0;   //!< Threads sorting runs (0: global pool)
+  std::string temp_dir;   //!< Directory of temporary files (empty: ".")
+  std::size_t max_fan_in = 128;  //!< Runs merged at once
+};
+
+/// Options for weldVertices()
+struct WeldOptions {
+  SortOptions sort;
+  std::string remap_path;  //!< Writes the old -> new index table (uint64)
+};
+
+/**
+ * @brief Morton (Z-order) code of three members of T, each quantized to 21
+ * bits within a bounding box. Sorting by it gives spatially coherent order.
+ */
+template <typename T, typename V>
+class MortonKey {
+ public:
+  template <typename M>
+  MortonKey(M T::*x, M T::*y, M T::*z, const Aabb<V>& box) noexcept
+      : offsets_{{detail::memberOffset(x), detail::memberOffset(y),
+                  detail::memberOffset(z)}} {
+    for (std::size_t d = 0; d < 3; ++d) {
+      min_[d] = static_cast<double>(box.min[d]);
+      const double extent = static_cast<double>(box.max[d]) - min_[d];
+      scale_[d] = extent > 0 ? kMaxCell() / extent : 0.0;
+    }
+  }
+
+  std::uint64_t operator()(const T& element) const noexcept {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(&element);
+    std::uint64_t code = 0;
+    for (std::size_t d = 0; d < 3; ++d) {
+      const double v = static_cast<double>(
+          detail::loadUnaligned<V>(p + offsets_[d]));
+      const double cell = std::min(std::max((v - min_[d]) * scale_[d], 0.0),
+                                   kMaxCell());
+      code |= spread(static_cast<std::uint64_t>(cell)) << d;
+    }
+    return code;
+  }
+
+ private:
+  static constexpr double kMaxCell() noexcept { return (1 << 21) - 1; }
+
+  /// Inserts two zero bits between each of the lower 21 bits
+  static std::uint64_t spread(std::uint64_t v) noexcept {
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffULL;
+    v = (v | v << 16) & 0x1f0000ff0000ffULL;
+    v = (v | v << 8) & 0x100f00f00f00f00fULL;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+    v = (v | v << 2) & 0x1249249249249249ULL;
+    return v;
+  }
+
+  std::array<std::size_t, 3> offsets_;  //!< Offsets of the members
+  std::array<double, 3> min_;           //!< Lower corner of the box
+  std::array<double, 3> scale_;         //!< Cells per unit
+};
+
+/// Morton key over the bounding box of all elements of the container
+template <typename T, typename M>
+MortonKey<T, typename std::remove_cv<M>::type> mortonKey(
+    const PlyElementContainer<T>& container,
+    M T::*x,
+    M T::*y,
+    M T::*z,
+    const ReduceOptions& options = ReduceOptions()) {
+  return {x, y, z, bounds(container, x, y, z, options)};
+}
+
+namespace detail {
+
+/// Anonymous temporary file (unlinked right away)
+class TempFile {
+ public:
+  explicit TempFile(const std::string& dir) {
+    std::string name = (dir.empty() ? std::string(".") : dir) +
+                       "/fastply_sort_XXXXXX";
+    fd_ = mkstemp(&name[0]);
+    if (fd_ == -1)
+      throw std::system_error(errno, std::generic_category());
+    ::unlink(name.c_str());
+  }
+
+  ~TempFile() { ::close(fd_); }
+
+  TempFile(const TempFile&) = delete;
+  TempFile& operator=(const TempFile&) = delete;
+
+  int fd() const noexcept { return fd_; }
+
+ private:
+  int fd_ = -1;
+};
+
+/// Buffered sequential writes starting at a file offset
+class RunWriter {
+ public:
+  RunWriter(int fd, std::uint64_t offset, std::size_t buffer_size)
+      : fd_(fd), offset_(offset) {
+    buffer_.reserve(buffer_size);
+  }
+
+  void push(const unsigned char* data, std::size_t size) {
+    if (buffer_.size() + size > buffer_.capacity())
+      flush();
+    buffer_.insert(buffer_.end(), data, data + size);
+  }
+
+  void flush() {
+    writeAll(fd_, buffer_.data(), buffer_.size(),
+             static_cast<off_t>(offset_));
+    offset_ += buffer_.size();
+    buffer_.clear();
+  }
+
+ private:
+  int fd_;
+  std::uint64_t offset_;  //!< File offset of buffer_
+  std::vector<unsigned char> buffer_;
+};
+
+/// Buffered sequential reads of the records of one run
+class RunReader {
+ public:
+  RunReader(int fd,
+            std::uint64_t begin,
+            std::uint64_t end,
+            std::size_t record_size,
+            std::size_t buffer_size)
+      : fd_(fd),
+        offset_(begin),
+        end_(end),
+        record_size_(record_size),
+        buffer_(std::max(buffer_size / record_size, std::size_t(1)) *
+                record_size) {
+    refill();
+  }
+
+  bool empty() const noexcept { return pos_ == filled_; }
+
+  const unsigned char* head() const noexcept { return buffer_.data() + pos_; }
+
+  void pop() {
+    pos_ += record_size_;
+    if (pos_ == filled_)
+      refill();
+  }
+
+ private:
+  void refill() {
+    filled_ = static_cast<std::size_t>(
+        std::min<std::uint64_t>(buffer_.size(), end_ - offset_));
+    readAll(fd_, buffer_.data(), filled_, static_cast<off_t>(offset_));
+    offset_ += filled_;
+    pos_ = 0;
+  }
+
+  int fd_;
+  std::uint64_t offset_;  //!< File offset of the next refill
+  std::uint64_t end_;     //!< End of the run
+  std::size_t record_size_;
+  std::vector<unsigned char> buffer_;
+  std::size_t pos_ = 0;     //!< Offset of the head in buffer_
+  std::size_t filled_ = 0;  //!< Valid bytes in buffer_
+};
+
+/**
+ * @brief Merges sorted runs, calling sink(record) in key order. Equal keys
+ * keep the order of the runs, so merging consecutive runs is stable.
+ */
+template <typename T, typename Key, typename Sink>
+void mergeRuns(std::vector<RunReader>& runs, const Key& key, Sink&& sink) {
+  auto before = [&](std::size_t a, std::size_t b) {
+    const auto ka = key(loadRecord<T>(runs[a].head()));
+    const auto kb = key(loadRecord<T>(runs[b].head()));
+    if (ka < kb)
+      return true;
+    if (kb < ka)
+      return false;
+    return a < b;
+  };
+  auto heap_order = [&](std::size_t a, std::size_t b) { return before(b, a); };
+
+  std::vector<std::size_t> heap;
+  for (std::size_t r = 0; r < runs.size(); ++r)
+    if (!runs[r].empty())
+      heap.push_back(r);
+  std::make_heap(heap.begin(), heap.end(), heap_order);
+  while (!heap.empty()) {
+    std::pop_heap(heap.begin(), heap.end(), heap_order);
+    RunReader& run = runs[heap.back()];
+    sink(run.head());
+    run.pop();
+    if (run.empty())
+      heap.pop_back();
+    else
+      std::push_heap(heap.begin(), heap.end(), heap_order);
+  }
+}
+
+/**
+ * @brief Calls sink(record) for all elements of in, ordered by key (stable).
+ *
+ * Records are the native (host byte order) elements, followed by their
+ * original index as std::uint64_t if with_index is set.
+ */
+template <typename T, typename Key, typename Sink>
+void externalSort(const PlyElementContainer<T>& in,
+                  const Key& key,
+                  bool with_index,
+                  const SortOptions& options,
+                  Sink&& sink) {
+  using K = typename std::decay<decltype(key(std::declval<const T&>()))>::type;
+  const std::size_t n = in.size();
+  if (n == 0)
+    return;
+  const auto native = in.native();
+  const std::size_t record = sizeof(T) + (with_index ? sizeof(std::uint64_t)
+                                                     : 0);
+  const unsigned participants =
+      options.threads ? options.threads : WorkStealingPool::global().size();
+  // Run memory: input copy, sorted records, keys and positions
+  const std::size_t per_record = sizeof(T) + record + sizeof(K) + 4;
+  const std::size_t run_records = std::min<std::size_t>(
+      std::max<std::size_t>(options.memory_limit / participants / per_record,
+                            64),
+      std::numeric_limits<std::uint32_t>::max());
+  const std::size_t num_runs = (n + run_records - 1) / run_records;
+  const std::size_t fan_in = std::max<std::size_t>(options.max_fan_in, 2);
+
+  // Sorts run r into records (in memory)
+  auto sortRun = [&](std::size_t r, std::vector<unsigned char>& records) {
+    const std::size_t first = r * run_records;
+    const std::size_t count = std::min(run_records, n - first);
+    std::vector<unsigned char> values(count * sizeof(T));
+    native.copyTo(first, count, reinterpret_cast<T*>(&values[0]));
+    std::vector<K> keys;
+    keys.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+      keys.emplace_back(key(loadRecord<T>(&values[i * sizeof(T)])));
+    std::vector<std::uint32_t> order(count);
+    for (std::size_t i = 0; i < count; ++i)
+      order[i] = static_cast<std::uint32_t>(i);
+    std::sort(order.begin(), order.end(),
+              [&keys](std::uint32_t a, std::uint32_t b) {
+                if (keys[a] < keys[b])
+                  return true;
+                if (keys[b] < keys[a])
+                  return false;
+                return a < b;
+              });
+
+    records.resize(count * record);
+    unsigned char* out = records.data();
+    for (std::uint32_t i : order) {
+      std::memcpy(out, &values[i * sizeof(T)], sizeof(T));
+      if (with_index) {
+        const std::uint64_t index = first + i;
+        std::memcpy(out + sizeof(T), &index, sizeof(index));
+      }
+      out += record;
+    }
+  };
+
+  if (num_runs == 1) {
+    std::vector<unsigned char> records;
+    sortRun(0, records);
+    for (std::size_t i = 0; i < n; ++i)
+      sink(&records[i * record]);
+    return;
+  }
+
+  // Runs are stored at the offsets of their records, so merged runs of
+  // later passes cover contiguous ranges as well
+  std::unique_ptr<TempFile> file(new TempFile(options.temp_dir));
+  runTasks(num_runs, options.threads, [&](std::size_t r) {
+    std::vector<unsigned char> records;
+    sortRun(r, records);
+    writeAll(file->fd(), records.data(), records.size(),
+             static_cast<off_t>(r * run_records * record));
+  });
+  std::vector<std::pair<std::size_t, std::size_t>> runs;  // record ranges
+  for (std::size_t r = 0; r < num_runs; ++r)
+    runs.emplace_back(r * run_records, std::min(n, (r + 1) * run_records));
+
+  const std::size_t read_buffer =
+      std::max<std::size_t>(options.memory_limit / (fan_in + 1), 1 << 16);
+  auto readers = [&](int fd, std::size_t first, std::size_t last,
+                     std::size_t buffer_size) {
+    std::vector<RunReader> group;
+    for (std::size_t r = first; r < last; ++r)
+      group.emplace_back(fd, runs[r].first * record, runs[r].second * record,
+                         record, buffer_size);
+    return group;
+  };
+
+  while (runs.size() > fan_in) {
+    std::unique_ptr<TempFile> merged(new TempFile(options.temp_dir));
+    const std::size_t num_groups = (runs.size() + fan_in - 1) / fan_in;
+    runTasks(num_groups, options.threads, [&](std::size_t g) {
+      const std::size_t first = g * fan_in;
+      const std::size_t last = std::min(runs.size(), first + fan_in);
+      auto group =
+          readers(file->fd(), first, last, read_buffer / participants);
+      RunWriter writer(merged->fd(), runs[first].first * record,
+                       read_buffer / participants);
+      mergeRuns<T>(group, key, [&](const unsigned char* data) {
+        writer.push(data, record);
+      });
+      writer.flush();
+    });
+    std::vector<std::pair<std::size_t, std::size_t>> next;
+    for (std::size_t g = 0; g < num_groups; ++g)
+      next.emplace_back(runs[g * fan_in].first,
+                        runs[std::min(runs.size(), (g + 1) * fan_in) - 1]
+                            .second);
+    runs.swap(next);
+    file = std::move(merged);
+  }
+
+  auto group = readers(file->fd(), 0, runs.size(), read_buffer);
+  mergeRuns<T>(group, key, sink);
+}
+
+template <typename U, typename... Args>
+void setCount(const FastPly<Args...>& in,
+              FastPlyWriter<Args...>& out,
+              std::false_type /* list */) {
+  out.template setCount<U>(in.template get<U>().size());
+}
+
+template <typename U, typename... Args>
+void setCount(const FastPly<Args...>& in,
+              FastPlyWriter<Args...>& out,
+              std::true_type /* list */) {
+  const auto& lists = in.template get<U>();
+  out.template setCount<U>(
+      lists.size(),
+      (lists.sizeBytes() -
+       lists.size() * sizeof(typename U::fastply_count_type)) /
+          sizeof(typename U::fastply_value_type));
+}
+
+/// Copies element U to out, converted to host byte order
+template <typename U, typename... Args>
+void copyElement(const FastPly<Args...>& in,
+                 FastPlyWriter<Args...>& out,
+                 std::false_type /* list */) {
+  const auto& src = in.template get<U>();
+  auto& dst = out.template get<U>();
+  if (src.needsByteSwap())
+    src.native().copyTo(0, src.size(), dst.data());
+  else
+    std::memcpy(static_cast<void*>(dst.data()), src.data(),
+                src.size() * sizeof(U));
+}
+
+template <typename U, typename... Args>
+void copyElement(const FastPly<Args...>& in,
+                 FastPlyWriter<Args...>& out,
+                 std::true_type /* list */) {
+  const auto& src = in.template get<U>();
+  auto& dst = out.template get<U>();
+  if (!src.needsByteSwap()) {
+    std::memcpy(dst.data(), src.data(), src.sizeBytes());
+    return;
+  }
+  for (const auto& list : src)
+    dst.append(list.begin(), list.size());
+}
+
+/// Sets the counts of all elements of out to those of in
+template <typename... Args, std::size_t... I>
+void setCounts(const FastPly<Args...>& in,
+               FastPlyWriter<Args...>& out,
+               std::index_sequence<I...>) {
+  const int expand[] = {
+      (setCount<Args>(in, out, is_list_element<Args>()), 0)...};
+  (void)expand;
+}
+
+/// Copies all elements but those of the indices in skip
+template <typename... Args, std::size_t... I>
+void copyElements(const FastPly<Args...>& in,
+                  FastPlyWriter<Args...>& out,
+                  std::initializer_list<std::size_t> skip,
+                  std::index_sequence<I...>) {
+  const int expand[] = {
+      (std::find(skip.begin(), skip.end(), I) == skip.end()
+           ? (copyElement<Args>(in, out, is_list_element<Args>()), 0)
+           : 0)...};
+  (void)expand;
+}
+
+/// Shared, writable mapping of a file of count integers
+class RemapTable {
+ public:
+  RemapTable(const std::string& path,
+             const std::string& temp_dir,
+             std::size_t count)
+      : size_(std::max<std::size_t>(count, 1) * sizeof(std::uint64_t)) {
+    if (path.empty()) {
+      temp_.reset(new TempFile(temp_dir));
+      fd_ = temp_->fd();
+    } else {
+      fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      if (fd_ == -1)
+        throw std::system_error(errno, std::generic_category());
+      owns_fd_ = true;
+    }
+    void* data = MAP_FAILED;
+    if (ftruncate(fd_, static_cast<off_t>(size_)) == 0)
+      data = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (data == MAP_FAILED) {
+      const int error = errno;
+      if (owns_fd_)
+        ::close(fd_);
+      throw std::system_error(error, std::generic_category());
+    }
+    data_ = static_cast<std::uint64_t*>(data);
+  }
+
+  ~RemapTable() {
+    munmap(data_, size_);
+    if (owns_fd_)
+      ::close(fd_);
+  }
+
+  RemapTable(const RemapTable&) = delete;
+  RemapTable& operator=(const RemapTable&) = delete;
+
+  std::uint64_t& operator[](std::size_t i) noexcept { return data_[i]; }
+
+ private:
+  std::size_t size_;
+  int fd_ = -1;
+  bool owns_fd_ = false;
+  std::unique_ptr<TempFile> temp_;
+  std::uint64_t* data_ = nullptr;
+};
+
+}  // namespace detail
+
+/**
+ * @brief Writes the elements of in to path, with element T sorted by
+ * key(element) (stable; e.g. a tuple of members or a MortonKey). All other
+ * elements are copied. The output is written in host byte order.
+ *
+ * Element T is sorted out-of-core: memory use is bounded by
+ * options.memory_limit plus the (mapped) input and output.
+ *
+ * @param out Writer for the output; element and property names may be set
+ * beforehand, counts are set from in
+ */
+template <typename T, typename Key, typename... Args>
+void sortElements(const FastPly<Args...>& in,
+                  FastPlyWriter<Args...>& out,
+                  const std::string& path,
+                  const Key& key,
+                  const SortOptions& options = SortOptions()) {
+  static_assert(!is_list_element<T>::value,
+                "Only fixed size elements can be sorted");
+  constexpr std::size_t index = detail::IndexOf<T, Args...>::value;
+  detail::setCounts(in, out, std::index_sequence_for<Args...>{});
+  if (!out.open(path))
+    throw std::runtime_error("Failed to open " + path);
+  detail::copyElements(in, out, {index}, std::index_sequence_for<Args...>{});
+
+  unsigned char* target =
+      reinterpret_cast<unsigned char*>(out.template get<T>().data());
+  detail::externalSort(in.template get<T>(), key, false, options,
+                       [&](const unsigned char* record) {
+                         std::memcpy(target, record, sizeof(T));
+                         target += sizeof(T);
+                       });
+  out.close();
+}
+
+/**
+ * @brief Writes the elements of in to path with duplicate vertices V merged
+ * and the indices of the list element F rewritten accordingly.
+ *
+ * Vertices are sorted by key (externally, see sortElements()); vertices with
+ * equivalent keys are merged into the first of them (in file order). The
+ * output vertices are in key order. Faces keep their order, faces which
+ * become degenerate are kept.
+ *
+ * @return Number of vertices written
+ * @throws std::out_of_range if a face refers to a vertex that does not exist
+ */
+template <typename V, typename F, typename Key, typename... Args>
+std::size_t weldVertices(const FastPly<Args...>& in,
+                         FastPlyWriter<Args...>& out,
+                         const std::string& path,
+                         const Key& key,
+                         const WeldOptions& options = WeldOptions()) {
+  static_assert(is_list_element<F>::value,
+                "Faces must be a list element (e.g. vertex indices)");
+  using value_type = typename F::fastply_value_type;
+  constexpr std::size_t v_index = detail::IndexOf<V, Args...>::value;
+  constexpr std::size_t f_index = detail::IndexOf<F, Args...>::value;
+  const std::size_t n = in.template get<V>().size();
+
+  // Unique vertices are spilled in key order, the remap table filled
+  detail::RemapTable remap(options.remap_path, options.sort.temp_dir, n);
+  detail::TempFile unique_file(options.sort.temp_dir);
+  detail::RunWriter unique_writer(unique_file.fd(), 0, 1 << 20);
+  std::vector<unsigned char> last(sizeof(V));
+  std::size_t unique = 0;
+  detail::externalSort(
+      in.template get<V>(), key, true, options.sort,
+      [&](const unsigned char* record) {
+        const auto record_key = key(detail::loadRecord<V>(record));
+        if (unique == 0 ||
+            record_key < key(detail::loadRecord<V>(last.data())) ||
+            key(detail::loadRecord<V>(last.data())) < record_key) {
+          std::memcpy(last.data(), record, sizeof(V));
+          unique_writer.push(record, sizeof(V));
+          ++unique;
+        }
+        remap[static_cast<std::size_t>(
+            detail::loadUnaligned<std::uint64_t>(record + sizeof(V)))] =
+            unique - 1;
+      });
+  unique_writer.flush();
+
+  detail::setCounts(in, out, std::index_sequence_for<Args...>{});
+  out.template setCount<V>(unique);
+  if (!out.open(path))
+    throw std::runtime_error("Failed to open " + path);
+  detail::copyElements(in, out, {v_index, f_index},
+                       std::index_sequence_for<Args...>{});
+  detail::readAll(unique_file.fd(), out.template get<V>().data(),
+                  unique * sizeof(V), 0);
+
+  auto& faces = out.template get<F>();
+  std::vector<value_type> indices;
+  for (const auto& face : in.template get<F>()) {
+    indices.resize(face.size());
+    for (std::size_t i = 0; i < face.size(); ++i) {
+      const value_type vertex = face[i];
+      if (static_cast<long long>(vertex) < 0 ||
+          static_cast<std::size_t>(vertex) >= n)
+        throw std::out_of_range("Face refers to a non-existing vertex");
+      indices[i] = static_cast<value_type>(
+          remap[static_cast<std::size_t>(vertex)]);
+    }
+    faces.append(indices.begin(), indices.size());
+  }
+  out.close();
+  return unique;
+}
+
+/// weldVertices() merging vertices which are equal (operator<)
+template <typename V, typename F, typename... Args>
+std::size_t weldVertices(const FastPly<Args...>& in,
+                         FastPlyWriter<Args...>& out,
+                         const std::string& path,
+                         const WeldOptions& options = WeldOptions()) {
+  return weldVertices<V, F>(
+      in, out, path, [](const V& vertex) -> V { return vertex; }, options);
+}
+
+}  // namespace fastply
@@ -0,0 +1,471 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "fastply/fastply.h"
+#include "fastply/fastply_header.h"
+
+namespace fastply {
+
+/// Options for FastPlyStream
+struct StreamOptions {
+  std::size_t buffer_size = 4 << 20;  //!< Capacity of the ring buffer in bytes
+};
+
+namespace detail {
+
+/// Fixed capacity ring of bytes read from a file descriptor
+class StreamRing {
+ public:
+  explicit StreamRing(std::size_t capacity)
+      : data_(new unsigned char[capacity]), capacity_(capacity) {}
+
+  void reset(int fd) noexcept {
+    fd_ = fd;
+    head_ = tail_ = 0;
+    eof_ = false;
+  }
+
+  std::size_t capacity() const noexcept { return capacity_; }
+
+  /// Bytes read but not consumed yet
+  std::size_t buffered() const noexcept {
+    return static_cast<std::size_t>(tail_ - head_);
+  }
+
+  /// Buffered bytes starting at front() without wrapping around
+  std::size_t contiguous() const noexcept {
+    return std::min(buffered(), capacity_ - head_ % capacity_);
+  }
+
+  const unsigned char* front() const noexcept {
+    return data_.get() + head_ % capacity_;
+  }
+
+  bool eof() const noexcept { return eof_; }
+
+  void consume(std::size_t n) noexcept { head_ += n; }
+
+  /**
+   * @brief Reads whatever is available into the free space (one read call,
+   * blocking only if nothing is available).
+   *
+   * @return False if the ring is full or the input is exhausted
+   */
+  bool readSome() {
+    const std::size_t free = capacity_ - buffered();
+    if (free == 0 || eof_)
+      return false;
+    const std::size_t pos = tail_ % capacity_;
+    const std::size_t n = std::min(free, capacity_ - pos);
+    ssize_t r;
+    do {
+      r = ::read(fd_, data_.get() + pos, n);
+    } while (r == -1 && errno == EINTR);
+    if (r == -1)
+      throw std::system_error(errno, std::generic_category());
+    eof_ = r == 0;
+    tail_ += static_cast<std::uint64_t>(r);
+    return r > 0;
+  }
+
+  /// Reads until at least size bytes are buffered or the input is exhausted
+  void fill(std::size_t size) {
+    while (buffered() < size && readSome()) {
+    }
+  }
+
+  /// Copies the next n bytes into out and consumes them
+  void read(unsigned char* out, std::size_t n) {
+    while (n) {
+      if (buffered() == 0 && !readSome())
+        throw std::runtime_error("Unexpected end of PLY stream");
+      const std::size_t k = std::min(n, contiguous());
+      std::memcpy(out, front(), k);
+      consume(k);
+      out += k;
+      n -= k;
+    }
+  }
+
+  /// Skips the next n bytes
+  void skip(std::size_t n) {
+    while (n) {
+      if (buffered() == 0 && !readSome())
+        throw std::runtime_error("Unexpected end of PLY stream");
+      const std::size_t k = std::min(n, buffered());
+      consume(k);
+      n -= k;
+    }
+  }
+
+ private:
+  std::unique_ptr<unsigned char[]> data_;  //!< Ring storage
+  std::size_t capacity_;                   //!< Size of data_ in bytes
+  std::uint64_t head_ = 0;  //!< Total bytes consumed
+  std::uint64_t tail_ = 0;  //!< Total bytes read
+  int fd_ = -1;             //!< Input
+  bool eof_ = false;        //!< Input exhausted
+};
+
+}  // namespace detail
+
+/**
+ * @brief Reads binary PLY files from non-seekable input (pipes, sockets,
+ * stdin) through a fixed-size ring buffer.
+ *
+ * Memory use is bounded by StreamOptions::buffer_size (plus a staging copy of
+ * single records straddling the end of the ring, or larger than it), and
+ * records are handed out as soon as they arrive. Elements can only be read in
+ * the order of Args..., which has to match the file; reading an element skips
+ * the unread records of all elements before it.
+ *
+ * Records are passed as stored in the stream, i.e. in the byte order of the
+ * file (see needsByteSwap()), hence open() throws if an element is not
+ * stored like its struct. Pointers and views passed to callbacks or
+ * returned by next() stay valid until the stream is read again.
+ */
+template <typename... Args>
+class FastPlyStream {
+  static_assert(
+      sizeof...(Args),
+      "FastPlyStream expects at least one element definition as template "
+      "parameter.");
+
+ public:
+  explicit FastPlyStream(const StreamOptions& options = StreamOptions())
+      : ring_(std::max<std::size_t>(options.buffer_size, 64)) {}
+
+  ~FastPlyStream() { close(); }
+
+  FastPlyStream(const FastPlyStream&) = delete;
+  FastPlyStream& operator=(const FastPlyStream&) = delete;
+
+  /// Reads the header from fd, which stays owned by the caller
+  bool open(int fd);
+
+  /// Opens path (e.g. a FIFO) for reading and reads the header
+  bool open(const std::string& path);
+
+  void close();
+
+  bool isHeaderParsed() const noexcept { return header_parsed_; }
+
+  bool isBigEndian() const noexcept { return header_.is_big_endian; }
+
+  /// True if the stream's byte order differs from the host's
+  bool needsByteSwap() const noexcept {
+    return header_.is_big_endian != detail::isHostBigEndian();
+  }
+
+  /// Number of records of T declared in the header
+  template <typename T>
+  std::size_t size() const noexcept {
+    return header_.counts[index<T>()];
+  }
+
+  /// Number of records of T not read yet
+  template <typename T>
+  std::size_t remaining() const noexcept {
+    return index<T>() < current_
+               ? 0
+               : index<T>() == current_ ? remaining_ : size<T>();
+  }
+
+  /**
+   * @brief Passes the unread records of fixed-size element T to
+   * fn(const T* records, std::size_t count), in runs as large as the
+   * buffered input allows.
+   *
+   * @return Number of records passed
+   */
+  template <typename T, typename F>
+  std::size_t forEachChunk(F&& fn);
+
+  /**
+   * @brief Passes the unread records of T to fn: fn(const T&) for fixed-size
+   * elements, fn(PlyListView<value type>) for list elements.
+   *
+   * @return Number of records passed
+   */
+  template <typename T, typename F>
+  std::size_t forEach(F&& fn);
+
+  /// Next record of T (pull interface); requires remaining<T>() > 0
+  template <typename T>
+  auto next() {
+    enter(index<T>());
+    if (remaining_ == 0)
+      throw std::out_of_range("No records left to read");
+    --remaining_;
+    return readRecord<T>(is_list_element<T>{});
+  }
+
+ private:
+  template <typename T>
+  static constexpr std::size_t index() noexcept {
+    return detail::IndexOf<T, Args...>::value;
+  }
+
+  /// Skips forward to the first unread record of element idx
+  void enter(std::size_t idx);
+
+  /// Pointer to the next size bytes, which are consumed
+  const unsigned char* fetch(std::size_t size);
+
+  template <typename T>
+  const T& readRecord(std::false_type /* list */) {
+    return *reinterpret_cast<const T*>(fetch(sizeof(T)));
+  }
+
+  template <typename T>
+  PlyListView<typename T::fastply_value_type> readRecord(
+      std::true_type /* list */);
+
+  template <typename T>
+  void skipRecords(std::size_t count) {
+    skipRecords<T>(count, is_list_element<T>{});
+  }
+
+  template <typename T>
+  void skipRecords(std::size_t count, std::false_type /* list */) {
+    ring_.skip(count * sizeof(T));
+  }
+
+  template <typename T>
+  void skipRecords(std::size_t count, std::true_type /* list */) {
+    for (std::size_t i = 0; i < count; ++i)
+      readRecord<T>(std::true_type{});
+  }
+
+  template <typename T, typename F>
+  std::size_t forEachImpl(F& fn, std::false_type /* list */);
+
+  template <typename T, typename F>
+  std::size_t forEachImpl(F& fn, std::true_type /* list */);
+
+  detail::StreamRing ring_;              //!< Buffered input
+  std::vector<unsigned char> staging_;   //!< Copy of straddling records
+  detail::PlyHeader<sizeof...(Args)> header_;  //!< Parsed ply header
+  bool header_parsed_ = false;           //!< Indicates valid header
+  int fd_ = -1;                          //!< Input
+  bool owns_fd_ = false;                 //!< fd_ opened by open(path)
+  std::size_t current_ = 0;    //!< Element being read
+  std::size_t remaining_ = 0;  //!< Unread records of the current element
+};
+
+template <typename... Args>
+bool FastPlyStream<Args...>::open(int fd) {
+  if (fd_ != -1)  // already opened
+    return true;
+
+  fd_ = fd;
+  ring_.reset(fd);
+
+  // The header starts at the beginning of the ring, hence is contiguous
+  detail::HeaderStatus status;
+  try {
+    while ((status = header_.parse(
+                reinterpret_cast<const char*>(ring_.front()),
+                ring_.buffered(), ring_.eof())) ==
+           detail::HeaderStatus::Incomplete) {
+      if (ring_.eof())
+        throw std::runtime_error("PLY header is not terminated by end_header");
+      if (!ring_.readSome() && !ring_.eof())
+        throw std::runtime_error("PLY header does not fit into the buffer");
+    }
+    if (status == detail::HeaderStatus::Complete &&
+        (header_.is_ascii || header_.is_block_compressed))
+      throw std::runtime_error("ASCII and block compressed PLY files cannot "
+                               "be streamed");
+    if (status == detail::HeaderStatus::Complete)
+      detail::requireInPlace<Args...>("FastPlyStream", header_);
+  } catch (...) {
+    close();
+    throw;
+  }
+  if (status == detail::HeaderStatus::Invalid) {
+    close();
+    return false;
+  }
+
+  ring_.consume(header_.length);
+  header_parsed_ = true;
+  current_ = 0;
+  remaining_ = header_.counts[0];
+  return true;
+}
+
+template <typename... Args>
+bool FastPlyStream<Args...>::open(const std::string& path) {
+  if (fd_ != -1)  // already opened
+    return true;
+
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    throw std::system_error(errno, std::generic_category());
+  try {
+    if (!open(fd)) {
+      ::close(fd);
+      return false;
+    }
+  } catch (...) {
+    ::close(fd);
+    throw;
+  }
+  owns_fd_ = true;
+  return true;
+}
+
+template <typename... Args>
+void FastPlyStream<Args...>::close() {
+  if (owns_fd_)
+    ::close(fd_);
+  fd_ = -1;
+  owns_fd_ = false;
+  ring_.reset(-1);
+  header_.clear();
+  header_parsed_ = false;
+  current_ = 0;
+  remaining_ = 0;
+}
+
+template <typename... Args>
+void FastPlyStream<Args...>::enter(std::size_t idx) {
+  if (!header_parsed_)
+    throw std::runtime_error("Stream is not open");
+  if (idx < current_)
+    throw std::runtime_error(
+        "Element was already read; elements are streamed in the order of "
+        "the template parameters");
+
+  using Skip = void (FastPlyStream::*)(std::size_t);
+  static constexpr Skip skip[] = {&FastPlyStream::skipRecords<Args>...};
+  while (current_ < idx) {
+    (this->*skip[current_])(remaining_);
+    remaining_ = header_.counts[++current_];
+  }
+}
+
+template <typename... Args>
+const unsigned char* FastPlyStream<Args...>::fetch(std::size_t size) {
+  if (size <= ring_.capacity()) {
+    ring_.fill(size);
+    if (ring_.buffered() < size)
+      throw std::runtime_error("Unexpected end of PLY stream");
+    if (ring_.contiguous() >= size) {
+      const unsigned char* p = ring_.front();
+      ring_.consume(size);
+      return p;
+    }
+  }
+  // Straddles the end of the ring (or does not fit at all)
+  if (staging_.size() < size)
+    staging_.resize(size);
+  ring_.read(staging_.data(), size);
+  return staging_.data();
+}
+
+template <typename... Args>
+template <typename T>
+PlyListView<typename T::fastply_value_type>
+FastPlyStream<Args...>::readRecord(std::true_type /* list */) {
+  using count_type = typename T::fastply_count_type;
+  using value_type = typename T::fastply_value_type;
+  const count_type count =
+      detail::loadUnaligned<count_type>(fetch(sizeof(count_type)),
+                                        needsByteSwap());
+  if (static_cast<long long>(count) < 0)
+    throw std::runtime_error("Negative list size in PLY stream");
+  const std::size_t n = static_cast<std::size_t>(count);
+  return {fetch(n * sizeof(value_type)), n, needsByteSwap()};
+}
+
+template <typename... Args>
+template <typename T, typename F>
+std::size_t FastPlyStream<Args...>::forEachChunk(F&& fn) {
+  static_assert(!is_list_element<T>::value,
+                "forEachChunk requires a fixed-size element");
+  enter(index<T>());
+  std::size_t passed = 0;
+  while (remaining_) {
+    ring_.fill(sizeof(T));
+    const std::size_t n =
+        std::min(remaining_, ring_.contiguous() / sizeof(T));
+    if (n == 0) {  // straddles the end of the ring
+      --remaining_;
+      fn(&readRecord<T>(std::false_type{}), std::size_t(1));
+      ++passed;
+      continue;
+    }
+    const T* records = reinterpret_cast<const T*>(ring_.front());
+    ring_.consume(n * sizeof(T));
+    remaining_ -= n;
+    fn(records, n);
+    passed += n;
+  }
+  return passed;
+}
+
+template <typename... Args>
+template <typename T, typename F>
+std::size_t FastPlyStream<Args...>::forEach(F&& fn) {
+  return forEachImpl<T>(fn, is_list_element<T>{});
+}
+
+template <typename... Args>
+template <typename T, typename F>
+std::size_t FastPlyStream<Args...>::forEachImpl(F& fn,
+                                                std::false_type /* list */) {
+  return forEachChunk<T>([&fn](const T* records, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i)
+      fn(records[i]);
+  });
+}
+
+template <typename... Args>
+template <typename T, typename F>
+std::size_t FastPlyStream<Args...>::forEachImpl(F& fn,
+                                                std::true_type /* list */) {
+  enter(index<T>());
+  std::size_t passed = 0;
+  for (; remaining_; ++passed) {
+    --remaining_;
+    fn(readRecord<T>(std::true_type{}));
+  }
+  return passed;
+}
+
+}  // namespace fastply
@@ -0,0 +1,138 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+namespace fastply {
+
+/// Scalar property types of the PLY format
+enum class PlyType : std::uint8_t {
+  Invalid = 0,
+  Int8,
+  UInt8,
+  Int16,
+  UInt16,
+  Int32,
+  UInt32,
+  Float32,
+  Float64
+};
+
+/// Maps a C++ arithmetic type onto the PLY type of the same representation
+template <typename V>
+constexpr PlyType plyTypeOf() noexcept {
+  return std::is_floating_point<V>::value
+             ? (sizeof(V) == 4 ? PlyType::Float32
+                               : sizeof(V) == 8 ? PlyType::Float64
+                                                : PlyType::Invalid)
+             : !std::is_integral<V>::value
+                   ? PlyType::Invalid
+                   : sizeof(V) == 1
+                         ? (std::is_signed<V>::value ? PlyType::Int8
+                                                     : PlyType::UInt8)
+                         : sizeof(V) == 2
+                               ? (std::is_signed<V>::value ? PlyType::Int16
+                                                           : PlyType::UInt16)
+                               : sizeof(V) == 4
+                                     ? (std::is_signed<V>::value
+                                            ? PlyType::Int32
+                                            : PlyType::UInt32)
+                                     : PlyType::Invalid;
+}
+
+/// Size in bytes of a PLY type, 0 if invalid
+constexpr std::size_t plyTypeSize(PlyType type) noexcept {
+  return type == PlyType::Int8 || type == PlyType::UInt8
+             ? 1
+             : type == PlyType::Int16 || type == PlyType::UInt16
+                   ? 2
+                   : type == PlyType::Int32 || type == PlyType::UInt32 ||
+                             type == PlyType::Float32
+                         ? 4
+                         : type == PlyType::Float64 ? 8 : 0;
+}
+
+/// Parses a PLY type name (e.g. "uchar" or "uint8"), Invalid if unknown
+inline PlyType parsePlyType(const char* name, std::size_t length) noexcept {
+  struct Entry {
+    const char* name;
+    PlyType type;
+  };
+  static const Entry entries[] = {
+      {"char", PlyType::Int8},      {"int8", PlyType::Int8},
+      {"uchar", PlyType::UInt8},    {"uint8", PlyType::UInt8},
+      {"short", PlyType::Int16},    {"int16", PlyType::Int16},
+      {"ushort", PlyType::UInt16},  {"uint16", PlyType::UInt16},
+      {"int", PlyType::Int32},      {"int32", PlyType::Int32},
+      {"uint", PlyType::UInt32},    {"uint32", PlyType::UInt32},
+      {"float", PlyType::Float32},  {"float32", PlyType::Float32},
+      {"double", PlyType::Float64}, {"float64", PlyType::Float64}};
+  for (const auto& e : entries)
+    if (std::strlen(e.name) == length &&
+        std::memcmp(e.name, name, length) == 0)
+      return e.type;
+  return PlyType::Invalid;
+}
+
+/// Canonical PLY name of a type (as used in headers), empty if invalid
+inline const char* plyTypeName(PlyType type) noexcept {
+  switch (type) {
+    case PlyType::Int8:
+      return "char";
+    case PlyType::UInt8:
+      return "uchar";
+    case PlyType::Int16:
+      return "short";
+    case PlyType::UInt16:
+      return "ushort";
+    case PlyType::Int32:
+      return "int";
+    case PlyType::UInt32:
+      return "uint";
+    case PlyType::Float32:
+      return "float";
+    case PlyType::Float64:
+      return "double";
+    default:
+      return "";
+  }
+}
+
+/// Property declaration of the PLY header
+struct PlyProperty {
+  PlyType type = PlyType::Invalid;        //!< Scalar type or type of values
+  PlyType count_type = PlyType::Invalid;  //!< Type of the count of a list
+  bool is_list = false;
+  std::string name;  //!< Name as declared in the header
+};
+
+/// Field of an element struct (see ElementLayout)
+struct PlyFieldInfo {
+  PlyType type;        //!< PLY type of the field
+  std::size_t offset;  //!< Byte offset inside the (packed) element
+  std::size_t size;    //!< Size in bytes
+};
+
+}  // namespace fastply
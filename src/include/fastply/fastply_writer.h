@@ -0,0 +1,517 @@
+// Copyright 2019 David B. Adrian
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "fastply/fastply.h"
+
+namespace fastply {
+
+/**
+ * @brief Writable view onto the block of a fixed-size element inside the
+ * mapped output file. Disjoint ranges may be written from several threads.
+ */
+template <typename T>
+class PlyWritableElementContainer {
+ public:
+  using value_type = T;
+  using difference_type = std::ptrdiff_t;
+  using pointer = T*;
+  using reference = T&;
+  using iterator = T*;
+
+  reference operator[](std::size_t i) noexcept { return begin_[i]; }
+
+  /// Stores value at position i (also for elements with const members)
+  void set(std::size_t i, const T& value) noexcept {
+    std::memcpy(static_cast<void*>(begin_ + i), &value, sizeof(T));
+  }
+
+  /// Stores count values at positions [first, first + count)
+  void copyFrom(std::size_t first, const T* values, std::size_t count) noexcept(
+      false) {
+    if (first > size_ || count > size_ - first)
+      throw std::out_of_range("Accessed range is out of range");
+    std::memcpy(static_cast<void*>(begin_ + first), values, count * sizeof(T));
+  }
+
+  pointer data() noexcept { return begin_; }
+
+  iterator begin() noexcept { return begin_; }
+
+  iterator end() noexcept { return begin_ + size_; }
+
+  std::size_t size() const noexcept { return size_; }
+
+  bool empty() const noexcept { return size_ == 0; }
+
+ private:
+  void setupBlock(unsigned char* start, std::size_t count, std::size_t) {
+    begin_ = reinterpret_cast<pointer>(start);
+    size_ = count;
+  }
+
+  void resetBlock() noexcept {
+    begin_ = nullptr;
+    size_ = 0;
+  }
+
+  pointer begin_ = nullptr;
+  std::size_t size_ = 0;
+
+  template <typename... Args>
+  friend class FastPlyWriter;
+};
+
+/**
+ * @brief Writable view onto the block of a list element inside the mapped
+ * output file.
+ *
+ * Lists are either appended one after another, or placed directly via set(),
+ * given the number of values of all preceding lists. The latter allows
+ * filling disjoint ranges from several threads.
+ */
+template <typename T>
+class PlyWritableListContainer {
+ public:
+  using count_type = typename T::fastply_count_type;
+  using list_value_type = typename T::fastply_value_type;
+
+  /**
+   * @brief Writes list index.
+   *
+   * @param value_offset Number of values of all lists preceding index
+   */
+  void set(std::size_t index,
+           std::size_t value_offset,
+           const list_value_type* values,
+           std::size_t length) noexcept(false) {
+    unsigned char* p = writeCount(index, value_offset, length);
+    std::memcpy(p, values, length * sizeof(list_value_type));
+  }
+
+  /// Writes list index from an iterator range of length values
+  template <typename InputIt>
+  void set(std::size_t index,
+           std::size_t value_offset,
+           InputIt first,
+           std::size_t length) noexcept(false) {
+    unsigned char* p = writeCount(index, value_offset, length);
+    for (std::size_t i = 0; i < length; ++i, ++first) {
+      const list_value_type value = *first;
+      std::memcpy(p + i * sizeof(list_value_type), &value,
+                  sizeof(list_value_type));
+    }
+  }
+
+  /// Writes the next list (not thread safe)
+  template <typename InputIt>
+  void append(InputIt first, std::size_t length) noexcept(false) {
+    set(next_index_, next_value_, first, length);
+    ++next_index_;
+    next_value_ += length;
+  }
+
+  unsigned char* data() noexcept { return begin_; }
+
+  std::size_t size() const noexcept { return size_; }
+
+  bool empty() const noexcept { return size_ == 0; }
+
+  std::size_t numValues() const noexcept { return num_values_; }
+
+ private:
+  /// Range checks and writes the count of a list
+  /// @return Pointer to the first value of the list
+  unsigned char* writeCount(std::size_t index,
+                            std::size_t value_offset,
+                            std::size_t length) noexcept(false) {
+    if (index >= size_ || value_offset > num_values_ ||
+        length > num_values_ - value_offset)
+      throw std::out_of_range("Accessed list is out of range");
+    if (length > static_cast<std::size_t>(
+                     std::numeric_limits<count_type>::max()))
+      throw std::out_of_range("List length exceeds count type");
+    unsigned char* p = begin_ + index * sizeof(count_type) +
+                       value_offset * sizeof(list_value_type);
+    const count_type count = static_cast<count_type>(length);
+    std::memcpy(p, &count, sizeof(count_type));
+    return p + sizeof(count_type);
+  }
+
+  void setupBlock(unsigned char* start,
+                  std::size_t count,
+                  std::size_t num_values) {
+    begin_ = start;
+    size_ = count;
+    num_values_ = num_values;
+    next_index_ = 0;
+    next_value_ = 0;
+  }
+
+  void resetBlock() noexcept { setupBlock(nullptr, 0, 0); }
+
+  unsigned char* begin_ = nullptr;
+  std::size_t size_ = 0;
+  std::size_t num_values_ = 0;
+  std::size_t next_index_ = 0;
+  std::size_t next_value_ = 0;
+
+  template <typename... Args>
+  friend class FastPlyWriter;
+};
+
+template <typename T>
+using writable_container_t =
+    typename std::conditional<is_list_element<T>::value,
+                              PlyWritableListContainer<T>,
+                              PlyWritableElementContainer<T>>::type;
+
+/**
+ * @brief Writes binary PLY files (host byte order) through a shared memory
+ * mapping of the output file.
+ *
+ * The number of instances of every element has to be set before open(), which
+ * generates the header from the element types, sizes the file and maps it.
+ * The element blocks are then filled through the containers returned by
+ * get<T>(), possibly from several threads on disjoint ranges. close() flushes
+ * the mapping with a single msync.
+ */
+template <typename... Args>
+class FastPlyWriter {
+  static_assert(sizeof...(Args),
+                "FastPlyWriter expects at least one element definition as "
+                "template parameter.");
+
+ public:
+  FastPlyWriter() = default;
+
+  /// Unmaps the file like close(), but drops flush errors instead of throwing
+  ~FastPlyWriter() {
+    try {
+      close();
+    } catch (...) {
+    }
+  }
+
+  FastPlyWriter(const FastPlyWriter&) = delete;
+  FastPlyWriter& operator=(const FastPlyWriter&) = delete;
+
+  /// Number of instances of fixed-size element T
+  template <typename T>
+  void setCount(std::size_t count) {
+    static_assert(!is_list_element<T>::value,
+                  "List elements require the total number of values");
+    count_[index<T>()] = count;
+  }
+
+  /// Number of lists and total number of values of all lists of element T
+  template <typename T>
+  void setCount(std::size_t count, std::size_t num_values) {
+    static_assert(is_list_element<T>::value,
+                  "Only list elements have a number of values");
+    count_[index<T>()] = count;
+    num_values_[index<T>()] = num_values;
+  }
+
+  /// Overrides the element name (default: lower case name of T)
+  template <typename T>
+  void setElementName(const std::string& name) {
+    names_[index<T>()] = name;
+  }
+
+  /// Overrides the property names (default: members of T, "vertex_indices")
+  template <typename T>
+  void setPropertyNames(const std::vector<std::string>& names) {
+    property_names_[index<T>()] = names;
+  }
+
+  void addComment(const std::string& comment) { comments_.push_back(comment); }
+
+  /// Header as written by open()
+  std::string header() const;
+
+  /// Creates (truncates) the file at path, writes the header and maps it
+  bool open(const std::string& path);
+
+  /// Flushes all changes to the file (blocking)
+  void sync();
+
+  /// Flushes and unmaps the file; the file is unmapped even if the flush
+  /// fails, the error is thrown afterwards
+  void close();
+
+  bool isOpen() const noexcept { return ptr_mapped_file_ != nullptr; }
+
+  std::string getOutputPath() const noexcept { return path_; }
+
+  template <typename T>
+  auto& get() noexcept {
+    return std::get<writable_container_t<T>>(elements_);
+  }
+
+  template <std::size_t I>
+  auto& get() noexcept {
+    return std::get<I>(elements_);
+  }
+
+ private:
+  static constexpr std::size_t N = sizeof...(Args);
+
+  template <typename T>
+  static constexpr std::size_t index() noexcept {
+    return detail::IndexOf<T, Args...>::value;
+  }
+
+  template <typename T>
+  void appendDefinition(std::string& header, std::size_t idx) const;
+
+  template <typename T>
+  void appendProperties(std::string& header,
+                        std::size_t idx,
+                        std::false_type /* list */) const;
+
+  template <typename T>
+  void appendProperties(std::string& header,
+                        std::size_t idx,
+                        std::true_type /* list */) const;
+
+  template <typename T>
+  std::size_t blockSize(std::false_type /* list */) const noexcept {
+    return count_[index<T>()] * sizeof(T);
+  }
+
+  template <typename T>
+  std::size_t blockSize(std::true_type /* list */) const noexcept {
+    return count_[index<T>()] *
+               sizeof(typename T::fastply_count_type) +
+           num_values_[index<T>()] * sizeof(typename T::fastply_value_type);
+  }
+
+  template <std::size_t... I>
+  void setupElements(unsigned char* start, std::index_sequence<I...>);
+
+  template <std::size_t... I>
+  void resetElements(std::index_sequence<I...>) noexcept;
+
+  std::string path_ = "";  //!< Path to output ply file
+  std::size_t count_[sizeof...(Args)] = {};       //!< Instances per element
+  std::size_t num_values_[sizeof...(Args)] = {};  //!< List values per element
+  std::string names_[sizeof...(Args)];            //!< Element name overrides
+  std::vector<std::string> property_names_[sizeof...(
+      Args)];                         //!< Property name overrides
+  std::vector<std::string> comments_;  //!< Comment lines of the header
+
+  std::tuple<writable_container_t<Args>...> elements_;
+
+  std::size_t file_length_ = 0;       //!< Length of mapped file in bytes
+  void* ptr_mapped_file_ = nullptr;  //!< Ptr to start of mmap'ed file
+};
+
+template <typename... Args>
+template <typename T>
+void FastPlyWriter<Args...>::appendDefinition(std::string& header,
+                                              std::size_t idx) const {
+  const std::string name =
+      names_[idx].empty() ? elementName<T>() : names_[idx];
+  if (name.empty())
+    throw std::runtime_error("No element name known for element " +
+                             std::to_string(idx) + ", see setElementName()");
+  header += "element " + name + " " + std::to_string(count_[idx]) + "\n";
+  appendProperties<T>(header, idx, is_list_element<T>{});
+}
+
+template <typename... Args>
+template <typename T>
+void FastPlyWriter<Args...>::appendProperties(std::string& header,
+                                              std::size_t idx,
+                                              std::false_type) const {
+  static_assert(ElementLayout<T>::isComplete(),
+                "Writing requires all members of the element to be listed "
+                "in FASTPLY_GENERATE_OPERATORS");
+  const auto names = property_names_[idx].empty()
+                         ? ElementLayout<T>::fieldNames()
+                         : property_names_[idx];
+  const auto fields = ElementLayout<T>::fields();
+  if (names.size() != fields.size())
+    throw std::runtime_error("Number of property names does not match element");
+  // Properties are declared in the order the members are stored
+  std::vector<std::size_t> order(fields.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+    return fields[a].offset < fields[b].offset;
+  });
+  for (const std::size_t i : order)
+    header += std::string("property ") + plyTypeName(fields[i].type) + " " +
+              names[i] + "\n";
+}
+
+template <typename... Args>
+template <typename T>
+void FastPlyWriter<Args...>::appendProperties(std::string& header,
+                                              std::size_t idx,
+                                              std::true_type) const {
+  using count_type = typename T::fastply_count_type;
+  using value_type = typename T::fastply_value_type;
+  static_assert(plyTypeOf<count_type>() != PlyType::Invalid &&
+                    plyTypeOf<value_type>() != PlyType::Invalid,
+                "List types must be PLY types");
+  const std::string name = property_names_[idx].empty()
+                               ? std::string("vertex_indices")
+                               : property_names_[idx].front();
+  header += std::string("property list ") +
+            plyTypeName(plyTypeOf<count_type>()) + " " +
+            plyTypeName(plyTypeOf<value_type>()) + " " + name + "\n";
+}
+
+template <typename... Args>
+std::string FastPlyWriter<Args...>::header() const {
+  std::string header = "ply\nformat ";
+  header += detail::isHostBigEndian() ? "binary_big_endian 1.0\n"
+                                      : "binary_little_endian 1.0\n";
+  for (const auto& comment : comments_)
+    header += "comment " + comment + "\n";
+
+  const int expand[] = {
+      (appendDefinition<Args>(header, index<Args>()), 0)...};
+  (void)expand;
+
+  header += "end_header\n";
+  return header;
+}
+
+template <typename... Args>
+bool FastPlyWriter<Args...>::open(const std::string& path) {
+  if (ptr_mapped_file_ != nullptr)  // already opened
+    return true;
+
+  const std::string text = header();
+  const std::size_t sizes[] = {blockSize<Args>(is_list_element<Args>{})...};
+  file_length_ = text.size();
+  for (auto size : sizes)
+    file_length_ += size;
+
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1)
+    throw std::system_error(errno, std::generic_category());
+
+  auto fail = [&](int error) {
+    ::close(fd);
+    file_length_ = 0;
+    throw std::system_error(error, std::generic_category());
+  };
+
+  if (::ftruncate(fd, static_cast<off_t>(file_length_)) == -1)
+    fail(errno);
+#if defined(__linux__)
+  // Reserve the blocks up front: running out of space while writing to a
+  // sparse mapping raises SIGBUS instead of an error.
+  if (::fallocate(fd, 0, 0, static_cast<off_t>(file_length_)) == -1 &&
+      errno != EOPNOTSUPP && errno != ENOSYS)
+    fail(errno);
+#endif
+
+  void* ptr = mmap(0, file_length_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (ptr == MAP_FAILED)
+    fail(errno);
+  ::close(fd);  // can be closed
+
+  ptr_mapped_file_ = ptr;
+  path_ = path;
+  std::memcpy(ptr_mapped_file_, text.data(), text.size());
+
+  setupElements(static_cast<unsigned char*>(ptr_mapped_file_) + text.size(),
+                std::index_sequence_for<Args...>{});
+  return true;
+}
+
+template <typename... Args>
+template <std::size_t... I>
+void FastPlyWriter<Args...>::setupElements(unsigned char* start,
+                                           std::index_sequence<I...>) {
+  const std::size_t sizes[] = {blockSize<Args>(is_list_element<Args>{})...};
+  std::size_t offset = 0;
+  const int expand[] = {(std::get<I>(elements_).setupBlock(
+                             start + offset, count_[I], num_values_[I]),
+                         offset += sizes[I], 0)...};
+  (void)expand;
+}
+
+template <typename... Args>
+template <std::size_t... I>
+void FastPlyWriter<Args...>::resetElements(std::index_sequence<I...>) noexcept {
+  const int expand[] = {(std::get<I>(elements_).resetBlock(), 0)...};
+  (void)expand;
+}
+
+template <typename... Args>
+void FastPlyWriter<Args...>::sync() {
+  if (ptr_mapped_file_ != nullptr &&
+      msync(ptr_mapped_file_, file_length_, MS_SYNC) == -1)
+    throw std::system_error(errno, std::generic_category());
+}
+
+template <typename... Args>
+void FastPlyWriter<Args...>::close() {
+  int sync_error = 0;
+  bool unmapped = true;
+  if (ptr_mapped_file_ != nullptr) {
+    if (msync(ptr_mapped_file_, file_length_, MS_SYNC) == -1)
+      sync_error = errno;
+    unmapped = munmap(ptr_mapped_file_, file_length_) == 0;
+    ptr_mapped_file_ = nullptr;
+  }
+
+  file_length_ = 0;
+  path_ = "";
+  std::fill(count_, count_ + N, 0);
+  std::fill(num_values_, num_values_ + N, 0);
+  for (auto& name : names_)
+    name.clear();
+  for (auto& names : property_names_)
+    names.clear();
+  comments_.clear();
+
+  resetElements(std::index_sequence_for<Args...>{});
+
+  if (sync_error != 0)
+    throw std::system_error(sync_error, std::generic_category());
+  if (!unmapped)
+    throw std::runtime_error("Failed to unmap memory!");
+}
+
+}  // namespace fastply
@@ -67,3 +67,30 @@ FASTPLY_ELEMENT(Face,
   FASTPLY_GENERATE_OPERATORS(Face, vertex_index[0], vertex_index[1], vertex_index[2], vertex_index[3])
 )
 
+FASTPLY_LIST_ELEMENT(PolyFace, uint8_t, int32_t)
+
+FASTPLY_LIST_ELEMENT(TriFace, uint8_t, int32_t)
+
+// Subset of the vertex properties, in another order
+FASTPLY_ELEMENT(Splat,
+  const uint8_t red;
+  const float z;
+  const float nx;
+  const float x;
+
+  FASTPLY_GENERATE_OPERATORS(Splat, red, z, nx, x)
+)
+
+FASTPLY_ELEMENT(Position,
+  const double x;
+
+  FASTPLY_GENERATE_OPERATORS(Position, x)
+)
+
+// Members listed in a different order than declared
+FASTPLY_ELEMENT(Reordered,
+  const uint8_t a;
+  const float b;
+
+  FASTPLY_GENERATE_OPERATORS(Reordered, b, a)
+)
@@ -1,7 +1,32 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <thread>
+#include <vector>
 #include "DataLayout.h"
 #include "fastply/fastply.h"
+#include "fastply/fastply_adjacency.h"
+#include "fastply/fastply_algorithm.h"
+#include "fastply/fastply_async.h"
+#include "fastply/fastply_dataset.h"
+#ifdef FASTPLY_HAS_ZLIB
+#include "fastply/fastply_compressed.h"
+#endif
+#include "fastply/fastply_index.h"
+#include "fastply/fastply_query.h"
+#include "fastply/fastply_reduce.h"
+#include "fastply/fastply_soa.h"
+#include "fastply/fastply_sort.h"
+#include "fastply/fastply_stream.h"
+#include "fastply/fastply_writer.h"
 #include "gtest/gtest.h"
+#include "test_list.h"  // generated by fastply_generate_schema()
 
 using namespace fastply;
 
@@ -55,6 +80,135 @@ TEST_F(FastPlyBasicFunctionality, Initialization) {
   ASSERT_NO_THROW(fp->close());
 }
 
+TEST_F(FastPlyBasicFunctionality, HeaderScanner) {
+  const char text[] = " \tElement  vertex 12\r";
+  detail::HeaderLine line(text, text + sizeof(text) - 1);
+  ASSERT_TRUE(line.next().is("element"));
+  ASSERT_FALSE(line.next().is("vert"));
+  std::size_t count = 0;
+  ASSERT_TRUE(detail::parseCount(line.next(), count));
+  ASSERT_EQ(count, 12);
+  ASSERT_TRUE(line.next().empty());
+  const char overflow[] = "99999999999999999999999";
+  ASSERT_FALSE(detail::parseCount({overflow, sizeof(overflow) - 1}, count));
+
+  // CRLF line breaks and mixed case keywords
+  const std::string path = "test_header_scanner.ply";
+  auto write = [&](const std::string& header, std::size_t vertices) {
+    std::ofstream os(path, std::ios::binary);
+    os << header;
+    const std::vector<char> data(vertices * sizeof(Vertex), 0);
+    os.write(data.data(), static_cast<std::streamsize>(data.size()));
+  };
+  write("PLY\r\nFormat binary_big_endian 1.0\r\nCOMMENT test\r\n"
+        "element vertex 2\r\nProperty float x\r\nproperty float y\r\n"
+        "property float z\r\nproperty float nx\r\nproperty float ny\r\n"
+        "property float nz\r\nproperty uchar red\r\nproperty uchar green\r\n"
+        "property uchar blue\r\nelement camera 0\r\n"
+        "element alltypes 0\r\nelement face 0\r\nEnd_Header\r\n",
+        2);
+  ASSERT_EQ(fp->open(path), true);
+  ASSERT_EQ(fp->isBigEndian(), true);
+  ASSERT_EQ(fp->getHeaderOffset(), 307);
+  ASSERT_EQ(fp->get<Vertex>().size(), 2);
+  fp->close();
+
+  write("ply\nformat binary_little_endian 1.0\nelement vertex 2\n", 2);
+  ASSERT_THROW(fp->open(path), std::runtime_error);
+  write("ply\nformat binary_little_endian 1.0\nelement vertex -2\n"
+        "end_header\n",
+        0);
+  ASSERT_THROW(fp->open(path), std::runtime_error);
+  write("ply\nformat binary_middle_endian 1.0\nend_header\n", 0);
+  ASSERT_EQ(fp->open(path), false);
+  std::remove(path.c_str());
+}
+
+// Structs may list a subset of the properties, in any order
+TEST_F(FastPlyBasicFunctionality, SchemaProjection) {
+  ASSERT_EQ(fp->open("test_many.ply"), true);
+  ASSERT_TRUE(fp->get<Vertex>().inPlace());
+  ASSERT_EQ(fp->properties(0)[3].name, "nx");
+  const auto& vertices = fp->get<Vertex>();
+
+  for (const char* path :
+       {"test_many.ply", "test_many_be.ply", "test_many_ascii.ply"}) {
+    FastPly<Splat, Camera, Alltypes, Face> splats;
+    ASSERT_EQ(splats.open(path), true);
+    ASSERT_FALSE(splats.get<Splat>().inPlace());
+    ASSERT_EQ(splats.elementOffsets(), fp->elementOffsets());
+    ASSERT_EQ(splats.get<Camera>().size(), fp->get<Camera>().size());
+    const auto native = splats.get<Splat>().native();
+    ASSERT_EQ(native.size(), vertices.size());
+    for (std::size_t i = 0; i < vertices.size(); ++i) {
+      ASSERT_EQ(native[i].red, vertices[i].red);
+      ASSERT_EQ(native[i].z, vertices[i].z);
+      ASSERT_EQ(native[i].nx, vertices[i].nx);
+      ASSERT_EQ(native[i].x, vertices[i].x);
+    }
+
+    // Columns and gathers read the records in the file, references are
+    // served from the elements shuffled into memory on first use
+    const auto& shuffled = splats.get<Splat>();
+    const auto z = shuffled.column(&Splat::z);
+    const auto xz = shuffled.project(&Splat::x, &Splat::z);
+    std::vector<unsigned char> buffer(native.size() * sizeof(Splat));
+    auto copies = reinterpret_cast<Splat*>(buffer.data());
+    native.copyTo(0, native.size(), copies);
+    const std::vector<std::uint32_t> indices = {5, 0, 5, 2};
+    std::vector<unsigned char> out(indices.size() * sizeof(Splat));
+    auto gathered = reinterpret_cast<Splat*>(out.data());
+    shuffled.gather(indices.data(), indices.size(), gathered);
+    for (std::size_t i = 0; i < vertices.size(); ++i) {
+      ASSERT_EQ(z[i], vertices[i].z);
+      ASSERT_EQ(std::get<0>(xz[i]), vertices[i].x);
+      ASSERT_EQ(copies[i].nx, vertices[i].nx);
+    }
+    shuffled.materialize();
+    for (std::size_t k = 0; k < indices.size(); ++k) {
+      ASSERT_EQ(std::memcmp(&gathered[k].z, &shuffled[indices[k]].z,
+                            sizeof(float)),
+                0);
+      ASSERT_EQ(gathered[k].red, shuffled.data()[indices[k]].red);
+    }
+    ASSERT_EQ(static_cast<std::size_t>(shuffled.end() - shuffled.begin()),
+              vertices.size());
+  }
+
+  // Types have to match
+  FastPly<Position, Camera, Alltypes, Face> positions;
+  ASSERT_THROW(positions.open("test_many.ply"), std::runtime_error);
+  ASSERT_EQ(positions.isHeaderParsed(), false);
+}
+
+// Elements generated from the header of test_list.ply at build time
+TEST_F(FastPlyBasicFunctionality, GeneratedSchema) {
+  static_assert(SchemaFingerprint<test_list::Vertex, test_list::Face,
+                                  test_list::Triangle,
+                                  test_list::Camera>::value ==
+                    test_list::kFingerprint,
+                "Generated schemas specialize SchemaFingerprint");
+  test_list::Ply generated;
+  ASSERT_EQ(generated.open("test_list.ply"), true);
+  ASSERT_EQ(generated.schemaFingerprint(), test_list::kFingerprint);
+  ASSERT_EQ(fp->open("test_many.ply"), true);
+  ASSERT_NE(fp->schemaFingerprint(), test_list::kFingerprint);
+
+  FastPly<Vertex, PolyFace, TriFace, Camera> written;
+  ASSERT_EQ(written.open("test_list.ply"), true);
+  ASSERT_EQ(written.schemaFingerprint(), test_list::kFingerprint);
+  const auto& vertices = generated.get<test_list::Vertex>();
+  ASSERT_TRUE(vertices.inPlace());
+  ASSERT_EQ(vertices.size(), written.get<Vertex>().size());
+  ASSERT_EQ(std::memcmp(vertices.data(), written.get<Vertex>().data(),
+                        vertices.size() * sizeof(Vertex)),
+            0);
+  ASSERT_EQ(generated.get<test_list::Triangle>().sizeBytes(),
+            written.get<TriFace>().sizeBytes());
+  ASSERT_EQ(generated.get<test_list::Camera>()[0].k2,
+            written.get<Camera>()[0].k2);
+}
+
 TEST_F(FastPlyBasicFunctionality, RandomAccessMethods) {
   auto path = std::string("test_many.ply");
   ASSERT_EQ(fp->open(path), true);
@@ -88,6 +242,50 @@ TEST_F(FastPlyBasicFunctionality, PointerDifferences) {
   ASSERT_EQ(fp->get<Vertex>().end() - fp->get<Vertex>().data(), 1232);
 }
 
+TEST_F(FastPlyBasicFunctionality, Columns) {
+  ASSERT_EQ(fp->open("test_many.ply"), true);
+  const auto& vertices = fp->get<Vertex>();
+  const auto x = vertices.column(&Vertex::x);
+  const auto blue = vertices.column<8>();
+  ASSERT_EQ(x.size(), vertices.size());
+  ASSERT_EQ(x.stride(), sizeof(Vertex));
+  for (std::size_t i = 0; i < vertices.size(); ++i) {
+    ASSERT_EQ(x[i], vertices[i].x);
+    ASSERT_EQ(blue[i], vertices[i].blue);
+  }
+  ASSERT_EQ(vertices.column<0>().back(), vertices.back().x);
+  ASSERT_EQ(*std::max_element(x.begin(), x.end()), 127.f);
+  ASSERT_EQ(std::count(blue.begin(), blue.end(), vertices[0].blue),
+            std::count_if(vertices.begin(), vertices.end(),
+                          [&](const Vertex& v) {
+                            return v.blue == vertices[0].blue;
+                          }));
+  ASSERT_THROW(x.at(vertices.size()), std::out_of_range);
+
+  // Members not covered by the operators (incomplete layout)
+  const auto& cameras = fp->get<Camera>();
+  ASSERT_EQ(cameras.column(&Camera::k2)[0], cameras[0].k2);
+  ASSERT_EQ(cameras.column(&Camera::viewporty).front(), cameras[0].viewporty);
+}
+
+TEST_F(FastPlyBasicFunctionality, Projections) {
+  ASSERT_EQ(fp->open("test_many.ply"), true);
+  const auto& vertices = fp->get<Vertex>();
+  const auto xyz = vertices.project<0, 1, 2>();
+  const auto zr = vertices.project(&Vertex::z, &Vertex::red);
+  ASSERT_EQ(xyz.size(), vertices.size());
+  std::size_t i = 0;
+  for (const auto& p : xyz) {
+    ASSERT_EQ(std::get<0>(p), vertices[i].x);
+    ASSERT_EQ(std::get<1>(p), vertices[i].y);
+    ASSERT_EQ(std::get<2>(p), vertices[i].z);
+    ++i;
+  }
+  ASSERT_EQ(std::get<1>(zr.at(7)), vertices[7].red);
+  ASSERT_EQ(zr.column<0>()[7], vertices[7].z);
+  ASSERT_EQ(xyz.end() - xyz.begin(), vertices.size());
+}
+
 /********************************************************************
  * Edge case: Element definition, but not instances present in      *
  * binary section.                                                  *
@@ -160,6 +358,1802 @@ TEST_F(FastPlyMultiInstance, PointerState) {
   ASSERT_EQ(el1.front(), el2.front());
 }
 
+/********************************************************************
+ * Elements made of a single variable-length list property, e.g.    *
+ * mixed triangle/quad/pentagon faces, followed by fixed-size       *
+ * elements.                                                        *
+ *******************************************************************/
+class FastPlyListElements : public testing::Test {
+  using FastPlyC = FastPly<Vertex, PolyFace, TriFace, Camera>;
+
+  void SetUp() override { fp = std::make_unique<FastPlyC>(); }
+
+ public:
+  std::unique_ptr<FastPlyC> fp;
+  const std::size_t lengths[6] = {3, 4, 4, 3, 5, 3};
+};
+
+TEST_F(FastPlyListElements, Initialization) {
+  auto path = std::string("test_list.ply");
+  ASSERT_EQ(fp->open(path), true);
+  ASSERT_EQ(fp->get<Vertex>().size(), 40);
+  ASSERT_EQ(fp->get<PolyFace>().size(), 150);
+  ASSERT_EQ(fp->get<TriFace>().size(), 70);
+  ASSERT_EQ(fp->get<Camera>().size(), 1);
+  ASSERT_EQ(fp->get<PolyFace>().isUniform(), false);
+  ASSERT_EQ(fp->get<TriFace>().isUniform(), true);
+  ASSERT_NO_THROW(fp->close());
+  ASSERT_EQ(fp->get<PolyFace>().size(), 0);
+}
+
+TEST_F(FastPlyListElements, RandomAccess) {
+  auto path = std::string("test_list.ply");
+  ASSERT_EQ(fp->open(path), true);
+  auto& faces = fp->get<PolyFace>();
+
+  std::size_t count = 40 * 9;  // values written for the vertices
+  for (std::size_t i = 0; i < faces.size(); ++i) {
+    ASSERT_EQ(faces[i].size(), lengths[i % 6]);
+    for (std::size_t j = 0; j < faces[i].size(); ++j)
+      ASSERT_EQ(faces[i][j], static_cast<int32_t>(count++ % 128));
+  }
+  ASSERT_EQ(faces.at(149).back(), faces[149][2]);
+  ASSERT_THROW(faces.at(150), std::out_of_range);
+  ASSERT_THROW(faces[0].at(3), std::out_of_range);
+
+  auto& triangles = fp->get<TriFace>();
+  for (const auto& triangle : triangles) {
+    ASSERT_EQ(triangle.size(), 3);
+    for (auto index : triangle)
+      ASSERT_EQ(index, static_cast<int32_t>(count++ % 128));
+  }
+
+  // Elements following the lists start where the last list ends
+  ASSERT_EQ(fp->get<Camera>().front().view_px, count % 128);
+  ASSERT_EQ(reinterpret_cast<const unsigned char*>(fp->get<Camera>().begin()),
+            triangles.data() + triangles.sizeBytes());
+}
+
+TEST_F(FastPlyListElements, Iterators) {
+  auto path = std::string("test_list.ply");
+  ASSERT_EQ(fp->open(path), true);
+  auto& faces = fp->get<PolyFace>();
+  ASSERT_EQ(std::distance(faces.begin(), faces.end()), 150);
+  ASSERT_EQ((*(faces.end() - 1)).size(), faces.back().size());
+
+  auto face = faces[4];
+  ASSERT_EQ(face.end() - face.begin(), 5);
+  ASSERT_EQ(*std::max_element(face.begin(), face.end()), face.back());
+}
+
+// Counts beyond the end of the body must throw, not read past the mapping
+TEST_F(FastPlyListElements, TruncatedFile) {
+  const std::string path = "test_list_truncated.ply";
+  {
+    std::ofstream os(path, std::ios::binary);
+    os << "ply\nformat binary_little_endian 1.0\n"
+          "element vertex 100000000\nproperty float x\nproperty float y\n"
+          "property float z\nproperty float nx\nproperty float ny\n"
+          "property float nz\nproperty uchar red\nproperty uchar green\n"
+          "property uchar blue\nelement polyface 1\n"
+          "property list uchar int vertex_index\nend_header\n";
+    os.write("\3\0\0\0\1\0\0\0\2\0\0\0", 12);
+  }
+  ASSERT_THROW(fp->open(path), std::runtime_error);
+  ASSERT_EQ(fp->isHeaderParsed(), false);
+  std::remove(path.c_str());
+}
+
+/********************************************************************
+ * Big endian files are accessed through byte swapping views, which *
+ * must yield the same elements as the little endian file.          *
+ *******************************************************************/
+class FastPlyBigEndian : public testing::Test {
+  using FastPlyC = FastPly<Vertex, Camera, Alltypes, Face>;
+
+  void SetUp() override {
+    le = std::make_unique<FastPlyC>();
+    be = std::make_unique<FastPlyC>();
+  }
+
+ public:
+  using FastPlyL = FastPly<Vertex, PolyFace, TriFace, Camera>;
+
+  std::unique_ptr<FastPlyC> le;
+  std::unique_ptr<FastPlyC> be;
+};
+
+TEST_F(FastPlyBigEndian, LayoutDescriptor) {
+  ASSERT_EQ(ElementLayout<Vertex>::numFields(), 9);
+  ASSERT_TRUE(ElementLayout<Vertex>::isComplete());
+  ASSERT_TRUE(ElementLayout<Alltypes>::isComplete());
+  ASSERT_FALSE(ElementLayout<Camera>::isComplete());
+  ASSERT_FALSE(ElementLayout<Face>::isComplete());
+  ASSERT_EQ(ElementLayout<Alltypes>::fields()[7].type, PlyType::Float64);
+  ASSERT_EQ(ElementLayout<Alltypes>::fields()[7].offset, 18);
+
+  // Offsets are those of the members, not of the listed order
+  ASSERT_TRUE(ElementLayout<Reordered>::isComplete());
+  ASSERT_EQ(ElementLayout<Reordered>::fields()[0].type, PlyType::Float32);
+  ASSERT_EQ(ElementLayout<Reordered>::fieldOffset(0), 1);
+  ASSERT_EQ(ElementLayout<Reordered>::fieldOffset(1), 0);
+}
+
+TEST_F(FastPlyBigEndian, LazySwap) {
+  ASSERT_EQ(le->open("test_many.ply"), true);
+  ASSERT_EQ(be->open("test_many_be.ply"), true);
+  ASSERT_EQ(be->isBigEndian(), true);
+  ASSERT_EQ(be->needsByteSwap(), true);
+  ASSERT_EQ(be->get<Vertex>().needsByteSwap(), true);
+
+  auto expected = le->get<Vertex>().native();
+  auto swapped = be->get<Vertex>().native();
+  ASSERT_EQ(expected.needsByteSwap(), false);
+  ASSERT_EQ(swapped.size(), expected.size());
+  ASSERT_NE(be->get<Vertex>()[1], le->get<Vertex>()[1]);
+  for (std::size_t i = 0; i < swapped.size(); ++i)
+    ASSERT_EQ(swapped[i], le->get<Vertex>()[i]);
+  ASSERT_TRUE(std::equal(swapped.begin(), swapped.end(), expected.begin()));
+  ASSERT_THROW(swapped.at(swapped.size()), std::out_of_range);
+
+  // Members not covered by FASTPLY_GENERATE_OPERATORS cannot be swapped
+  ASSERT_THROW(be->get<Camera>().native(), std::runtime_error);
+  ASSERT_NO_THROW(le->get<Camera>().native());
+}
+
+TEST_F(FastPlyBigEndian, BulkSwap) {
+  ASSERT_EQ(le->open("test_many.ply"), true);
+  ASSERT_EQ(be->open("test_many_be.ply"), true);
+  auto& vertices = le->get<Vertex>();
+  auto swapped = be->get<Vertex>().native();
+
+  // Uneven ranges exercise both the vectorized and the scalar tail path
+  const std::size_t first = 3;
+  const std::size_t count = swapped.size() - 10;
+  std::vector<unsigned char> buffer(count * sizeof(Vertex));
+  auto out = reinterpret_cast<Vertex*>(buffer.data());
+  swapped.copyTo(first, count, out);
+  ASSERT_EQ(std::memcmp(out, vertices.data() + first, buffer.size()), 0);
+
+  swapped.copyTo(0, 1, out);
+  ASSERT_EQ(out[0], vertices[0]);
+  ASSERT_THROW(swapped.copyTo(1, swapped.size(), out), std::out_of_range);
+}
+
+TEST_F(FastPlyBigEndian, Columns) {
+  ASSERT_EQ(le->open("test_many.ply"), true);
+  ASSERT_EQ(be->open("test_many_be.ply"), true);
+  const auto& expected = le->get<Vertex>();
+  const auto x = be->get<Vertex>().column(&Vertex::x);
+  const auto nz_green = be->get<Vertex>().project<5, 7>();
+  for (std::size_t i = 0; i < expected.size(); ++i) {
+    ASSERT_EQ(x[i], expected[i].x);
+    ASSERT_EQ(std::get<0>(nz_green[i]), expected[i].nz);
+    ASSERT_EQ(std::get<1>(nz_green[i]), expected[i].green);
+  }
+  ASSERT_EQ(be->get<Camera>().column(&Camera::viewportx)[0],
+            le->get<Camera>()[0].viewportx);
+}
+
+TEST_F(FastPlyBigEndian, Lists) {
+  FastPlyL fl_le, fl_be;
+  ASSERT_EQ(fl_le.open("test_list.ply"), true);
+  ASSERT_EQ(fl_be.open("test_list_be.ply"), true);
+  auto& faces_le = fl_le.get<PolyFace>();
+  auto& faces_be = fl_be.get<PolyFace>();
+  ASSERT_EQ(faces_be.size(), faces_le.size());
+  ASSERT_EQ(faces_be.needsByteSwap(), true);
+  for (std::size_t i = 0; i < faces_le.size(); ++i)
+    ASSERT_TRUE(std::equal(faces_le[i].begin(), faces_le[i].end(),
+                           faces_be[i].begin(), faces_be[i].end()));
+  ASSERT_EQ(fl_be.get<Camera>().size(), 1);
+  ASSERT_EQ(fl_be.get<TriFace>().back()[2], fl_le.get<TriFace>().back()[2]);
+}
+
+/********************************************************************
+ * ASCII files are converted to their binary representation and     *
+ * must be identical to the equivalent binary file.                 *
+ *******************************************************************/
+class FastPlyAscii : public testing::Test {
+  using FastPlyC = FastPly<Vertex, Camera, Alltypes, Face>;
+
+  void SetUp() override {
+    binary = std::make_unique<FastPlyC>();
+    ascii = std::make_unique<FastPlyC>();
+  }
+
+ public:
+  using FastPlyL = FastPly<Vertex, PolyFace, TriFace, Camera>;
+
+  std::unique_ptr<FastPlyC> binary;
+  std::unique_ptr<FastPlyC> ascii;
+};
+
+TEST_F(FastPlyAscii, Initialization) {
+  ASSERT_EQ(ascii->open("test_many_ascii.ply"), true);
+  ASSERT_EQ(ascii->isAscii(), true);
+  ASSERT_EQ(ascii->needsByteSwap(), false);
+  ASSERT_EQ(ascii->get<Vertex>().size(), 1232);
+  ASSERT_EQ(ascii->get<Camera>().size(), 1);
+  ASSERT_EQ(ascii->get<Alltypes>().size(), 0);
+  ASSERT_EQ(ascii->get<Face>().size(), 15);
+  ASSERT_NO_THROW(ascii->close());
+  ASSERT_EQ(ascii->isAscii(), false);
+}
+
+TEST_F(FastPlyAscii, MatchesBinary) {
+  ASSERT_EQ(binary->open("test_many.ply"), true);
+  ASSERT_EQ(ascii->open("test_many_ascii.ply"), true);
+  auto& v1 = binary->get<Vertex>();
+  auto& v2 = ascii->get<Vertex>();
+  ASSERT_EQ(std::memcmp(v1.data(), v2.data(), v1.size() * sizeof(Vertex)), 0);
+  ASSERT_EQ(std::memcmp(binary->get<Camera>().data(),
+                        ascii->get<Camera>().data(), sizeof(Camera)),
+            0);
+  ASSERT_EQ(std::memcmp(binary->get<Face>().data(), ascii->get<Face>().data(),
+                        15 * sizeof(Face)),
+            0);
+}
+
+TEST_F(FastPlyAscii, Lists) {
+  FastPlyL fl_binary, fl_ascii;
+  ASSERT_EQ(fl_binary.open("test_list.ply"), true);
+  ASSERT_EQ(fl_ascii.open("test_list_ascii.ply"), true);
+  auto& faces = fl_ascii.get<PolyFace>();
+  ASSERT_EQ(faces.size(), 150);
+  ASSERT_EQ(faces.sizeBytes(), fl_binary.get<PolyFace>().sizeBytes());
+  ASSERT_EQ(std::memcmp(faces.data(), fl_binary.get<PolyFace>().data(),
+                        faces.sizeBytes()),
+            0);
+  ASSERT_EQ(fl_ascii.get<Camera>().front(), fl_binary.get<Camera>().front());
+}
+
+TEST_F(FastPlyAscii, ParallelChunks) {
+  ASSERT_EQ(binary->open("test_many.ply"), true);
+
+  // Read the ASCII body and convert it in many small chunks
+  std::ifstream is("test_many_ascii.ply", std::ios::binary);
+  std::string text((std::istreambuf_iterator<char>(is)),
+                   std::istreambuf_iterator<char>());
+  const auto body = text.find("end_header\n") + 11;
+
+  PlyProperty f, uc, i32, list;
+  f.type = PlyType::Float32;
+  uc.type = PlyType::UInt8;
+  i32.type = PlyType::Int32;
+  list.is_list = true;
+  list.count_type = PlyType::UInt8;
+  list.type = PlyType::Int32;
+  std::vector<PlyProperty> vertex{f, f, f, f, f, f, uc, uc, uc};
+  std::vector<PlyProperty> camera(21, f);
+  camera[17] = camera[18] = i32;
+  std::vector<PlyProperty> face{list};
+
+  detail::AsciiElement elements[4];
+  elements[0] = {1232, vertex.data(), vertex.size()};
+  elements[1] = {1, camera.data(), camera.size()};
+  elements[2] = {0, nullptr, 0};
+  elements[3] = {15, face.data(), face.size()};
+
+  auto mapping = detail::convertAscii(text.data() + body,
+                                      text.data() + text.size(), elements, 4,
+                                      4, 1000);
+  const std::size_t expected = 1232 * sizeof(Vertex) + sizeof(Camera) +
+                               15 * sizeof(Face);
+  ASSERT_EQ(mapping.length, expected);
+  ASSERT_EQ(std::memcmp(mapping.data, binary->get<Vertex>().data(), expected),
+            0);
+  munmap(mapping.data, mapping.length);
+
+  // Records missing in the body are detected
+  elements[3].count = 16;
+  ASSERT_THROW(detail::convertAscii(text.data() + body,
+                                    text.data() + text.size(), elements, 4, 4,
+                                    1000),
+               std::runtime_error);
+}
+
+TEST_F(FastPlyAscii, NumberParsing) {
+  const char* floats[] = {"0.1",        "-1.5e3",   "3.4028235e38", "1e-45",
+                          "123.456789", "16777217", "0.30000001",   "-0.0",
+                          "1.17549435e-38", "7.038531e-26"};
+  for (const char* str : floats) {
+    float value;
+    ASSERT_TRUE(detail::parseFloat(str, str + std::strlen(str), value)) << str;
+    ASSERT_EQ(value, std::strtof(str, nullptr)) << str;
+  }
+  const char* doubles[] = {"0.1", "2.2250738585072014e-308", "9007199254740993",
+                           "1.7976931348623157e308", "-123456.789e-3"};
+  for (const char* str : doubles) {
+    double value;
+    ASSERT_TRUE(detail::parseFloat(str, str + std::strlen(str), value)) << str;
+    ASSERT_EQ(value, std::strtod(str, nullptr)) << str;
+  }
+
+  std::uint8_t u8;
+  std::int16_t i16;
+  ASSERT_TRUE(detail::parseInteger("255", "255" + 3, u8));
+  ASSERT_EQ(u8, 255);
+  ASSERT_FALSE(detail::parseInteger("256", "256" + 3, u8));
+  ASSERT_FALSE(detail::parseInteger("-1", "-1" + 2, u8));
+  ASSERT_TRUE(detail::parseInteger("-32768", "-32768" + 6, i16));
+  ASSERT_EQ(i16, -32768);
+  ASSERT_FALSE(detail::parseInteger("1.0", "1.0" + 3, i16));
+}
+
+/********************************************************************
+ * Access pattern hints and page cache control must never change    *
+ * the content seen through the containers.                         *
+ *******************************************************************/
+class FastPlyOpenOptions : public testing::Test {
+  using FastPlyC = FastPly<Vertex, Camera, Alltypes, Face>;
+
+  void SetUp() override { ASSERT_EQ(reference.open("test_many.ply"), true); }
+
+ public:
+  FastPlyC reference;
+};
+
+TEST_F(FastPlyOpenOptions, Policies) {
+  const auto& expected = reference.get<Vertex>();
+  const AccessPattern patterns[] = {
+      AccessPattern::Normal, AccessPattern::Sequential, AccessPattern::Random,
+      AccessPattern::WillNeed};
+  for (auto access : patterns) {
+    OpenOptions options;
+    options.access = access;
+    options.populate = access == AccessPattern::Sequential;
+    options.huge_pages = true;
+    FastPly<Vertex, Camera, Alltypes, Face> fp;
+    ASSERT_EQ(fp.open("test_many.ply", options), true);
+    ASSERT_TRUE(std::equal(expected.begin(), expected.end(),
+                           fp.get<Vertex>().begin(), fp.get<Vertex>().end()));
+    fp.advise(AccessPattern::Normal);
+  }
+}
+
+TEST_F(FastPlyOpenOptions, BufferAndDescriptor) {
+  const auto& expected = reference.get<Vertex>();
+  auto read = [](const char* path) {
+    std::ifstream is(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(is),
+                             std::istreambuf_iterator<char>());
+  };
+
+  // Caller buffers are used in place and never written to
+  std::vector<char> buffer = read("test_many.ply");
+  FastPly<Vertex, Camera, Alltypes, Face> fp;
+  ASSERT_EQ(fp.open(buffer.data(), buffer.size()), true);
+  ASSERT_EQ(static_cast<const void*>(fp.get<Vertex>().data()),
+            buffer.data() + fp.getHeaderOffset());
+  ASSERT_TRUE(std::equal(expected.begin(), expected.end(),
+                         fp.get<Vertex>().begin(), fp.get<Vertex>().end()));
+  ASSERT_NO_THROW(fp.get<Vertex>().evict());
+  fp.close();
+  ASSERT_THROW(fp.open(buffer.data(), 0), std::invalid_argument);
+
+  const std::vector<char> ascii = read("test_many_ascii.ply");
+  buffer = ascii;
+  ASSERT_EQ(fp.open(buffer.data(), buffer.size()), true);
+  ASSERT_TRUE(std::equal(expected.begin(), expected.end(),
+                         fp.get<Vertex>().begin(), fp.get<Vertex>().end()));
+  fp.close();
+  ASSERT_EQ(buffer, ascii);
+
+  // PLY data at an unaligned offset of a larger file
+  const std::string path = "test_open_fd.bin";
+  const std::vector<char> data = read("test_many.ply");
+  {
+    std::ofstream os(path, std::ios::binary);
+    const std::vector<char> prefix(5000, 'x');
+    os.write(prefix.data(), static_cast<std::streamsize>(prefix.size()));
+    os.write(data.data(), static_cast<std::streamsize>(data.size()));
+    os.write(prefix.data(), 100);
+  }
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  ASSERT_NE(fd, -1);
+  OpenOptions options;
+  options.populate = true;
+  // Ranges past the end of the file are rejected instead of mapped
+  ASSERT_THROW(fp.open(fd, 5000, data.size() + 101), std::system_error);
+  ASSERT_EQ(fp.isHeaderParsed(), false);
+  ASSERT_EQ(fp.open(fd, 5000, data.size(), options), true);
+  ::close(fd);
+  ASSERT_EQ(fp.getInputPath(), "");
+  ASSERT_TRUE(std::equal(expected.begin(), expected.end(),
+                         fp.get<Vertex>().begin(), fp.get<Vertex>().end()));
+  fp.advise(AccessPattern::Sequential);
+  ASSERT_EQ(fp.get<Face>().size(), reference.get<Face>().size());
+  fp.close();
+  std::remove(path.c_str());
+}
+
+TEST_F(FastPlyOpenOptions, PrefetchEvict) {
+  const auto& vertices = reference.get<Vertex>();
+  const Vertex first = vertices.front();
+  ASSERT_NO_THROW(vertices.prefetch());
+  ASSERT_NO_THROW(vertices.prefetch(100, 200));
+  ASSERT_NO_THROW(vertices.evict(0, 10));
+  ASSERT_NO_THROW(vertices.evict());
+  ASSERT_EQ(vertices.front(), first);
+  ASSERT_NO_THROW(vertices.prefetch(vertices.size(), 1));
+  ASSERT_THROW(vertices.evict(vertices.size() + 1), std::out_of_range);
+
+  FastPly<Vertex, PolyFace, TriFace, Camera> fl;
+  ASSERT_EQ(fl.open("test_list.ply"), true);
+  const auto& faces = fl.get<PolyFace>();
+  const auto last = faces.back().back();
+  ASSERT_NO_THROW(faces.prefetch(7, 50));
+  ASSERT_NO_THROW(faces.evict(140));
+  ASSERT_EQ(faces.back().back(), last);
+  ASSERT_THROW(faces.prefetch(151), std::out_of_range);
+
+  // Converted ASCII files live in anonymous memory and must survive evict
+  FastPly<Vertex, Camera, Alltypes, Face> fa;
+  ASSERT_EQ(fa.open("test_many_ascii.ply"), true);
+  fa.get<Vertex>().evict();
+  ASSERT_TRUE(std::equal(vertices.begin(), vertices.end(),
+                         fa.get<Vertex>().begin(), fa.get<Vertex>().end()));
+}
+
+TEST_F(FastPlyOpenOptions, Instrumentation) {
+  const FileReport report = reference.report();
+  ASSERT_EQ(report.path, "test_many.ply");
+  ASSERT_EQ(report.elements.size(), 4);
+  ASSERT_EQ(report.elements[0].name, "vertex");
+  ASSERT_EQ(report.elements[0].count, 1232);
+  for (const auto& element : report.elements) {
+    ASSERT_GT(element.residency.bytes, 0);
+    ASSERT_LE(element.residency.resident_bytes, element.residency.bytes);
+  }
+#ifdef FASTPLY_INSTRUMENTATION
+  ASSERT_GT(report.timings.open_ns, 0);
+  ASSERT_GE(report.timings.open_ns, report.timings.parse_header_ns);
+#else
+  ASSERT_EQ(report.timings.open_ns, 0);
+#endif
+  const std::string json = toJson(report);
+  ASSERT_NE(json.find("\"name\": \"vertex\", \"count\": 1232"),
+            std::string::npos);
+
+  // Touching fresh memory takes minor faults
+  resetProfileScopes();
+  {
+    ProfileScope scope("touch");
+    std::vector<char> memory(64 * detail::pageSize());
+    for (std::size_t i = 0; i < memory.size(); i += detail::pageSize())
+      memory[i] = 1;
+    ASSERT_GT(scope.elapsed().minor_faults, 0);
+  }
+  {
+    FASTPLY_PROFILE_SCOPE("macro");
+  }
+  const auto scopes = profileScopes();
+  ASSERT_EQ(scopes.at("touch").calls, 1);
+#ifdef FASTPLY_INSTRUMENTATION
+  ASSERT_EQ(scopes.count("macro"), 1);
+#else
+  ASSERT_EQ(scopes.count("macro"), 0);
+#endif
+  ASSERT_NE(toJson(scopes).find("\"touch\": {\"calls\": 1"), std::string::npos);
+}
+
+TEST_F(FastPlyOpenOptions, SharedMappings) {
+  MappingCache& cache = MappingCache::global();
+  cache.clear();
+  const std::size_t max_bytes = cache.maxBytes();
+  const std::size_t max_entries = cache.maxEntries();
+  const MappingCacheStats before = cache.stats();
+  const auto& expected = reference.get<Vertex>();
+
+  OpenOptions options;
+  options.shared = true;
+  {
+    FastPly<Vertex, Camera, Alltypes, Face> first, second;
+    ASSERT_EQ(first.open("test_many.ply", options), true);
+    ASSERT_EQ(second.open("test_many.ply", options), true);
+    ASSERT_EQ(first.get<Vertex>().data(), second.get<Vertex>().data());
+    ASSERT_TRUE(std::equal(expected.begin(), expected.end(),
+                           second.get<Vertex>().begin(),
+                           second.get<Vertex>().end()));
+    first.close();
+    ASSERT_EQ(second.get<Face>().size(), reference.get<Face>().size());
+
+    // Elements are set up once per element list, e.g. shuffled fields
+    FastPly<Splat, Camera, Alltypes, Face> splats, more_splats;
+    ASSERT_EQ(splats.open("test_many.ply", options), true);
+    ASSERT_EQ(more_splats.open("test_many.ply", options), true);
+    ASSERT_EQ(splats.get<Splat>().data(), more_splats.get<Splat>().data());
+    ASSERT_EQ(more_splats.get<Splat>()[7].x, expected[7].x);
+
+    // Converted ASCII data and headers parsed for other element lists
+    FastPly<Vertex, Camera, Alltypes, Face> ascii;
+    FastPly<Vertex, Camera, Alltypes, Face, PolyFace> wider;
+    ASSERT_EQ(ascii.open("test_many_ascii.ply", options), true);
+    ASSERT_EQ(wider.open("test_many_ascii.ply", options), true);
+    ASSERT_TRUE(wider.isAscii());
+    ASSERT_TRUE(std::equal(expected.begin(), expected.end(),
+                           wider.get<Vertex>().begin(),
+                           wider.get<Vertex>().end()));
+  }
+  MappingCacheStats stats = cache.stats();
+  ASSERT_EQ(stats.misses - before.misses, 2);
+  ASSERT_EQ(stats.hits - before.hits, 4);
+  ASSERT_EQ(stats.entries, 2);  // idle, but still mapped
+
+  // Least recently used idle mappings are dropped first
+  cache.setLimits(max_bytes, 1);
+  stats = cache.stats();
+  ASSERT_EQ(stats.entries, 1);
+  ASSERT_EQ(stats.evictions - before.evictions, 1);
+  FastPly<Vertex, Camera, Alltypes, Face> fp;
+  ASSERT_EQ(fp.open("test_many_ascii.ply", options), true);
+  ASSERT_EQ(cache.stats().hits, stats.hits + 1);
+
+  // Modified files are mapped again, replacing the idle old version
+  cache.setLimits(max_bytes, max_entries);
+  const std::string copy = "test_shared_copy.ply";
+  {
+    std::ifstream in("test_many.ply", std::ios::binary);
+    std::ofstream out(copy, std::ios::binary);
+    out << in.rdbuf();
+  }
+  fp.close();
+  ASSERT_EQ(fp.open(copy, options), true);
+  fp.close();
+  std::ofstream(copy, std::ios::binary | std::ios::app) << '\n';
+  ASSERT_EQ(fp.open(copy, options), true);
+  ASSERT_EQ(cache.stats().misses, stats.misses + 2);
+  ASSERT_EQ(cache.stats().entries, 2);
+  fp.close();
+
+  cache.clear();
+  ASSERT_EQ(cache.stats().entries, 0);
+  std::remove(copy.c_str());
+}
+
+/********************************************************************
+ * Parallel algorithms must match their sequential std equivalents  *
+ * for any number of threads.                                       *
+ *******************************************************************/
+class FastPlyParallel : public testing::Test {
+  void SetUp() override { ASSERT_EQ(fp.open("test_many.ply"), true); }
+
+ public:
+  FastPly<Vertex, Camera, Alltypes, Face> fp;
+};
+
+TEST_F(FastPlyParallel, PageChunks) {
+  const auto& vertices = fp.get<Vertex>();
+  const detail::PageChunks chunks(vertices.data(), vertices.size(),
+                                  sizeof(Vertex), 4);
+  ASSERT_EQ(chunks.chunkBytes() % detail::pageSize(), 0);
+  std::size_t expected = 0;
+  for (std::size_t k = 0; k < chunks.size(); ++k) {
+    ASSERT_EQ(chunks[k].first, expected);
+    expected = chunks[k].second;
+    if (k > 0) {  // chunks start at the first record of a page
+      const auto address =
+          reinterpret_cast<std::uintptr_t>(vertices.data() + chunks[k].first);
+      ASSERT_LT(address % chunks.chunkBytes(), sizeof(Vertex));
+    }
+  }
+  ASSERT_EQ(expected, vertices.size());
+}
+
+TEST_F(FastPlyParallel, Algorithms) {
+  const auto& vertices = fp.get<Vertex>();
+  auto red = [](const Vertex& v) { return v.red > 60; };
+  const auto count = std::count_if(vertices.begin(), vertices.end(), red);
+  double sum = 0;
+  for (const auto& v : vertices)
+    sum += v.x;
+
+  for (unsigned threads : {0u, 1u, 3u, 8u}) {
+    ASSERT_EQ(parallel_count_if(vertices, red, threads), count);
+    ASSERT_EQ(parallel_transform_reduce(
+                  vertices, 0.0, std::plus<double>(),
+                  [](const Vertex& v) { return double(v.x); }, threads),
+              sum);
+
+    std::atomic<std::size_t> visited{0};
+    parallel_for_each(vertices, [&](const Vertex&) { ++visited; }, threads);
+    ASSERT_EQ(visited, vertices.size());
+  }
+  ASSERT_EQ(parallel_count_if(fp.get<Camera>(),
+                              [](const Camera&) { return true; }, 4),
+            fp.get<Camera>().size());
+}
+
+TEST_F(FastPlyParallel, WorkStealing) {
+  WorkStealingPool pool(4);
+  ASSERT_EQ(pool.size(), 4);
+
+  // Highly imbalanced tasks: all work ends up in the first range
+  std::vector<std::atomic<int>> executed(1000);
+  pool.run(executed.size(), [&](std::size_t t) {
+    if (t < 10)
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    ++executed[t];
+  });
+  for (const auto& e : executed)
+    ASSERT_EQ(e, 1);
+
+  // Nested runs execute inline, exceptions reach the caller
+  std::atomic<int> nested{0};
+  pool.run(8, [&](std::size_t) {
+    pool.run(4, [&](std::size_t) { ++nested; });
+  });
+  ASSERT_EQ(nested, 32);
+  ASSERT_THROW(pool.run(100,
+                        [](std::size_t t) {
+                          if (t == 42)
+                            throw std::runtime_error("task failed");
+                        }),
+               std::runtime_error);
+
+  // Runs with an explicit thread count share one pool per size
+  ASSERT_EQ(WorkStealingPool::sized(3), WorkStealingPool::sized(3));
+  ASSERT_EQ(WorkStealingPool::sized(3)->size(), 3);
+  ASSERT_EQ(WorkStealingPool::sized(0).get(), &WorkStealingPool::global());
+
+  // Fewer tasks than participants, cache bounded, evicted pools stay usable
+  const auto three = WorkStealingPool::sized(3);
+  std::atomic<int> few{0};
+  three->run(2, [&](std::size_t) { ++few; });
+  ASSERT_EQ(few, 2);
+  const unsigned sizes = 2 * WorkStealingPool::kMaxCachedPools;
+  for (unsigned threads = 4; threads < 4 + sizes; ++threads)
+    WorkStealingPool::sized(threads);
+  ASSERT_NE(WorkStealingPool::sized(3), three);
+  three->run(8, [&](std::size_t) { ++few; });
+  ASSERT_EQ(few, 10);
+}
+
+TEST_F(FastPlyParallel, StructureOfArrays) {
+  const auto& vertices = fp.get<Vertex>();
+  for (unsigned threads : {1u, 4u}) {
+    // All field widths: 4 byte floats, 1 byte colors (last field of record)
+    const auto columns = to_soa<0, 1, 2, 6, 8>(vertices, threads);
+    const auto& x = std::get<0>(columns);
+    const auto& blue = std::get<4>(columns);
+    ASSERT_EQ(x.size(), vertices.size());
+    ASSERT_EQ(reinterpret_cast<std::uintptr_t>(x.data()) % 64, 0);
+    for (std::size_t i = 0; i < vertices.size(); ++i) {
+      ASSERT_EQ(x[i], vertices[i].x);
+      ASSERT_EQ(std::get<1>(columns)[i], vertices[i].y);
+      ASSERT_EQ(std::get<2>(columns)[i], vertices[i].z);
+      ASSERT_EQ(std::get<3>(columns)[i], vertices[i].red);
+      ASSERT_EQ(blue[i], vertices[i].blue);
+    }
+  }
+
+  // 2 and 8 byte fields, big endian source, caller provided columns
+  FastPly<Alltypes> le, be;
+  ASSERT_EQ(le.open("test_alltypes.ply"), true);
+  ASSERT_EQ(be.open("test_alltypes_be.ply"), true);
+  const auto& expected = le.get<Alltypes>();
+  ASSERT_EQ(expected.size(), 257);
+  std::vector<int16_t> s(expected.size());
+  std::vector<uint16_t> us(expected.size());
+  std::vector<double> d(expected.size());
+  to_soa<2, 3, 7>(be.get<Alltypes>(),
+                  std::make_tuple(s.data(), us.data(), d.data()), 4);
+  for (std::size_t i = 0; i < expected.size(); ++i) {
+    ASSERT_EQ(s[i], expected[i].s);
+    ASSERT_EQ(us[i], expected[i].us);
+    ASSERT_EQ(d[i], expected[i].d);
+  }
+}
+
+TEST_F(FastPlyParallel, Reductions) {
+  const auto& vertices = fp.get<Vertex>();
+  float min_x = vertices[0].x, max_x = vertices[0].x, max_z = vertices[0].z;
+  double sum_x = 0, sum_y = 0;
+  std::vector<std::size_t> red(256, 0), nx(10, 0);
+  for (const auto& v : vertices) {
+    min_x = std::min(min_x, v.x);
+    max_x = std::max(max_x, v.x);
+    max_z = std::max(max_z, v.z);
+    sum_x += v.x;
+    sum_y += v.y;
+    ++red[v.red];
+    if (v.nx >= 0 && v.nx < 100)
+      ++nx[static_cast<std::size_t>(v.nx / 10)];
+  }
+
+  for (unsigned threads : {1u, 4u}) {
+    ReduceOptions options;
+    options.threads = threads;
+    const auto x = stats(vertices, &Vertex::x, options);
+    ASSERT_EQ(x.min, min_x);
+    ASSERT_EQ(x.max, max_x);
+    ASSERT_EQ(x.sum, sum_x);
+    ASSERT_EQ(x.count, vertices.size());
+    ASSERT_EQ(stats(vertices, &Vertex::blue, options).max, 127);
+
+    const auto box = bounds(vertices, &Vertex::x, &Vertex::y, &Vertex::z,
+                            options);
+    ASSERT_EQ(box.min[0], min_x);
+    ASSERT_EQ(box.max[2], max_z);
+    const auto center =
+        centroid(vertices, &Vertex::x, &Vertex::y, &Vertex::z, options);
+    ASSERT_DOUBLE_EQ(center[1], sum_y / vertices.size());
+
+    ASSERT_EQ(histogram(vertices, &Vertex::red, options), red);
+    ASSERT_EQ(histogram(vertices, &Vertex::nx, 10, 0, 100, options), nx);
+  }
+  ASSERT_THROW(histogram(vertices, &Vertex::nx, 0, 0, 1),
+               std::invalid_argument);
+
+  // Big endian input yields the same results
+  FastPly<Vertex, Camera, Alltypes, Face> be;
+  ASSERT_EQ(be.open("test_many_be.ply"), true);
+  ASSERT_EQ(stats(be.get<Vertex>(), &Vertex::x).sum, sum_x);
+  ASSERT_EQ(stats(be.get<Vertex>(), &Vertex::z).max, max_z);
+}
+
+TEST_F(FastPlyParallel, ReductionCache) {
+  const auto& vertices = fp.get<Vertex>();
+  ReduceOptions options;
+  options.cache = true;
+  ASSERT_NE(vertices.cache(), nullptr);
+  ASSERT_EQ(vertices.cache()->find<FieldStats<float>>(
+                detail::statsKey<float>(0)),
+            nullptr);
+
+  const auto box = bounds(vertices, &Vertex::x, &Vertex::y, &Vertex::z,
+                          options);
+  const auto cached =
+      vertices.cache()->find<FieldStats<float>>(detail::statsKey<float>(0));
+  ASSERT_NE(cached, nullptr);
+  ASSERT_EQ(cached->min, box.min[0]);
+  ASSERT_EQ(stats(vertices, &Vertex::x, options).max, box.max[0]);
+  ASSERT_EQ(histogram(vertices, &Vertex::green, options),
+            histogram(vertices, &Vertex::green, options));
+
+  // Bounds differing beyond the sixth decimal are cached separately
+  const double lo = stats(vertices, &Vertex::red).min;
+  const auto all = histogram(vertices, &Vertex::red, 1, lo, 256, options);
+  const auto above = histogram(vertices, &Vertex::red, 1, lo + 1e-7, 256,
+                               options);
+  ASSERT_LT(above[0], all[0]);
+  ASSERT_EQ(above, histogram(vertices, &Vertex::red, 1, lo + 1e-7, 256));
+
+  fp.close();
+  ASSERT_EQ(vertices.cache(), nullptr);
+}
+
+TEST_F(FastPlyParallel, SpatialIndex) {
+  const auto& vertices = fp.get<Vertex>();
+  const std::string path = sidecarPath("test_many.ply");
+  std::remove(path.c_str());
+
+  IndexOptions options;
+  options.leaf_size = 4;
+  SpatialIndex<Vertex> index;
+  ASSERT_FALSE(index.open(path, "test_many.ply", vertices, &Vertex::x, &Vertex::y, &Vertex::z));
+  index.build(path, "test_many.ply", vertices, &Vertex::x, &Vertex::y, &Vertex::z, options);
+  ASSERT_EQ(index.size(), vertices.size());
+  std::vector<std::uint64_t> all(index.indices().begin(),
+                                 index.indices().end());
+  std::sort(all.begin(), all.end());
+  for (std::size_t i = 0; i < all.size(); ++i)
+    ASSERT_EQ(all[i], i);
+
+  auto collect = [](const std::vector<IndexSpan>& spans) {
+    std::vector<std::uint64_t> result;
+    for (const auto& span : spans)
+      result.insert(result.end(), span.begin(), span.end());
+    std::sort(result.begin(), result.end());
+    return result;
+  };
+  std::vector<std::uint64_t> in_box, in_ball;
+  for (std::size_t i = 0; i < vertices.size(); ++i) {
+    const auto& v = vertices[i];
+    if (v.x >= 10 && v.x <= 60 && v.y >= 0 && v.y <= 40 && v.z >= 20 &&
+        v.z <= 100)
+      in_box.push_back(i);
+    const double dx = v.x - 64, dy = v.y - 64, dz = v.z - 64;
+    if (dx * dx + dy * dy + dz * dz <= 30 * 30)
+      in_ball.push_back(i);
+  }
+  ASSERT_FALSE(in_box.empty());
+  ASSERT_EQ(collect(index.queryBox({{10, 0, 20}}, {{60, 40, 100}})), in_box);
+  ASSERT_EQ(collect(index.queryRadius({{64, 64, 64}}, 30)), in_ball);
+  ASSERT_TRUE(index.queryBox({{200, 200, 200}}, {{300, 300, 300}}).empty());
+
+  // Reopened without rebuilding; other coordinates do not match the sidecar
+  SpatialIndex<Vertex> reopened;
+  ASSERT_TRUE(reopened.open(path, "test_many.ply", vertices, &Vertex::x,
+                            &Vertex::y, &Vertex::z));
+  ASSERT_EQ(reopened.numNodes(), index.numNodes());
+  ASSERT_EQ(collect(reopened.queryBox({{10, 0, 20}}, {{60, 40, 100}})),
+            in_box);
+  ASSERT_FALSE(reopened.open(path, "test_many.ply", vertices, &Vertex::nx,
+                             &Vertex::ny, &Vertex::nz));
+  reopened.openOrBuild(path, "test_many.ply", vertices, &Vertex::nx,
+                       &Vertex::ny, &Vertex::nz);
+  ASSERT_TRUE(reopened.isOpen());
+  ASSERT_EQ(collect(reopened.queryRadius({{64, 64, 64}}, 1000)), all);
+
+  // Sidecars of other files or of other versions of the file are stale
+  const std::string copy = "test_index_copy.ply";
+  {
+    std::ifstream in("test_many.ply", std::ios::binary);
+    std::ofstream out(copy, std::ios::binary);
+    out << in.rdbuf();
+  }
+  ASSERT_FALSE(reopened.open(path, copy, vertices, &Vertex::nx, &Vertex::ny,
+                             &Vertex::nz));
+  reopened.build(path, copy, vertices, &Vertex::x, &Vertex::y, &Vertex::z);
+  ASSERT_TRUE(reopened.isOpen());
+  std::ofstream(copy, std::ios::binary | std::ios::app) << '\n';
+  ASSERT_FALSE(reopened.open(path, copy, vertices, &Vertex::x, &Vertex::y,
+                             &Vertex::z));
+  std::remove(copy.c_str());
+
+  // Concurrent builders write their own temporary files
+  std::vector<std::thread> builders;
+  for (int t = 0; t < 4; ++t)
+    builders.emplace_back([&]() {
+      SpatialIndex<Vertex> built;
+      built.build(path, "test_many.ply", vertices, &Vertex::x, &Vertex::y,
+                  &Vertex::z, options);
+    });
+  for (auto& builder : builders)
+    builder.join();
+  ASSERT_TRUE(reopened.open(path, "test_many.ply", vertices, &Vertex::x,
+                            &Vertex::y, &Vertex::z));
+  std::remove(path.c_str());
+}
+
+TEST_F(FastPlyParallel, MeshAdjacency) {
+  FastPly<Vertex, PolyFace, TriFace, Camera> mesh;
+  ASSERT_EQ(mesh.open("test_list.ply"), true);
+  const auto& faces = mesh.get<PolyFace>();
+  const std::string path = adjacencyPath("test_list.ply");
+  std::remove(path.c_str());
+
+  // Synthetic indices cover [0, 128) rather than the 40 vertices
+  const std::size_t num_vertices = 128;
+  std::vector<std::vector<std::uint64_t>> expected(num_vertices);
+  std::vector<std::pair<std::uint64_t, std::uint64_t>> edges;
+  for (std::size_t f = 0; f < faces.size(); ++f) {
+    for (std::size_t k = 0; k < faces[f].size(); ++k) {
+      const std::uint64_t a = faces[f][k];
+      const std::uint64_t b = faces[f][(k + 1) % faces[f].size()];
+      expected[a].push_back(f);
+      edges.emplace_back(std::min(a, b), std::max(a, b));
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+  edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+  MeshAdjacency adjacency;
+  const std::string source = "test_list.ply";
+  ASSERT_FALSE(adjacency.open(path, source, faces, num_vertices));
+  ASSERT_THROW(adjacency.build(path, source, faces, 10), std::out_of_range);
+  AdjacencyOptions options;
+  options.edges = true;
+  options.threads = 4;
+  adjacency.build(path, source, faces, num_vertices, options);
+  ASSERT_EQ(adjacency.numFaces(), faces.size());
+  for (std::size_t v = 0; v < num_vertices; ++v)
+    ASSERT_EQ(std::vector<std::uint64_t>(adjacency.faces(v).begin(),
+                                         adjacency.faces(v).end()),
+              expected[v]);
+  ASSERT_EQ(adjacency.numEdges(), edges.size());
+  for (std::size_t e = 0; e < edges.size(); ++e) {
+    ASSERT_EQ(adjacency.edge(e)[0], edges[e].first);
+    ASSERT_EQ(adjacency.edge(e)[1], edges[e].second);
+    ASSERT_EQ(adjacency.findEdge(edges[e].second, edges[e].first), e);
+  }
+  ASSERT_EQ(adjacency.findEdge(127, 127), adjacency.numEdges());
+  for (std::size_t f = 0; f < faces.size(); ++f) {
+    ASSERT_EQ(adjacency.faceEdges(f).size(), faces[f].size());
+    const auto e = adjacency.edge(adjacency.faceEdges(f)[0]);
+    ASSERT_EQ(e[0], std::min<std::uint64_t>(faces[f][0], faces[f][1]));
+    ASSERT_EQ(e[1], std::max<std::uint64_t>(faces[f][0], faces[f][1]));
+  }
+
+  // Reopened without rebuilding, but not for other faces
+  MeshAdjacency reopened;
+  ASSERT_TRUE(reopened.open(path, source, faces, num_vertices));
+  ASSERT_TRUE(reopened.hasEdges());
+  ASSERT_EQ(reopened.faces(3).size(), expected[3].size());
+  ASSERT_FALSE(
+      reopened.open(path, source, mesh.get<TriFace>(), num_vertices));
+  reopened.openOrBuild(path, source, mesh.get<TriFace>(), num_vertices);
+  ASSERT_FALSE(reopened.hasEdges());
+  ASSERT_EQ(reopened.numFaces(), mesh.get<TriFace>().size());
+
+  // Nor for another version of the PLY file
+  const std::string copy = "test_adjacency_copy.ply";
+  {
+    std::ifstream in(source, std::ios::binary);
+    std::ofstream out(copy, std::ios::binary);
+    out << in.rdbuf();
+  }
+  reopened.build(path, copy, faces, num_vertices);
+  ASSERT_TRUE(reopened.open(path, copy, faces, num_vertices));
+  std::ofstream(copy, std::ios::binary | std::ios::app) << '\n';
+  ASSERT_FALSE(reopened.open(path, copy, faces, num_vertices));
+  std::remove(copy.c_str());
+
+  // Tables that do not span the faces are not trusted
+  reopened.build(path, source, faces, num_vertices);
+  reopened.close();
+  {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    const std::uint64_t corrupt = 1;
+    file.seekp(static_cast<std::streamoff>(detail::kAdjacencyDataOffset()));
+    file.write(reinterpret_cast<const char*>(&corrupt), 8);
+  }
+  ASSERT_FALSE(reopened.open(path, source, faces, num_vertices));
+  std::remove(path.c_str());
+}
+
+TEST_F(FastPlyParallel, Gather) {
+  const auto& vertices = fp.get<Vertex>();
+  std::vector<std::uint32_t> indices(5000);
+  for (std::size_t k = 0; k < indices.size(); ++k)
+    indices[k] = static_cast<std::uint32_t>((k * 7919) % vertices.size());
+  indices[1] = indices[0];  // duplicates are fine
+
+  GatherOptions options;
+  for (unsigned threads : {1u, 0u}) {
+    for (bool sort : {true, false}) {
+      options.threads = threads;
+      options.sort = sort;
+      std::vector<unsigned char> out(indices.size() * sizeof(Vertex));
+      Vertex* gathered = reinterpret_cast<Vertex*>(&out[0]);
+      vertices.gather(indices.data(), indices.size(), gathered, options);
+      for (std::size_t k = 0; k < indices.size(); ++k)
+        ASSERT_EQ(gathered[k], vertices[indices[k]]);
+    }
+  }
+
+  // Cached pages are gathered directly, check the file order separately
+  const auto order =
+      detail::pageOrder(indices.data(), indices.size(), sizeof(Vertex),
+                        vertices.size());
+  for (std::size_t k = 1; k < order.size(); ++k)
+    ASSERT_LE(indices[order[k - 1]] * sizeof(Vertex) / detail::pageSize(),
+              indices[order[k]] * sizeof(Vertex) / detail::pageSize());
+
+  // Signed indices, validated before anything is copied
+  const std::int64_t few[] = {1231, 0, 600, 1231};
+  std::vector<unsigned char> out(4 * sizeof(Vertex));
+  Vertex* gathered = reinterpret_cast<Vertex*>(&out[0]);
+  vertices.gather(few, 4, gathered);
+  for (std::size_t k = 0; k < 4; ++k)
+    ASSERT_EQ(gathered[k], vertices[few[k]]);
+
+  const std::int64_t invalid[] = {0, -1};
+  ASSERT_THROW(vertices.gather(invalid, 2, gathered), std::out_of_range);
+}
+
+TEST_F(FastPlyParallel, Queries) {
+  const auto& vertices = fp.get<Vertex>();
+  auto expect = [&](const Query<Vertex>& query,
+                    bool (*pred)(const Vertex&)) -> std::size_t {
+    std::vector<std::size_t> expected;
+    for (std::size_t i = 0; i < vertices.size(); ++i)
+      if (pred(vertices[i]))
+        expected.push_back(i);
+    for (unsigned threads : {1u, 0u}) {
+      const Selection selection = filter(vertices, query, threads);
+      EXPECT_EQ(selection.size(), vertices.size());
+      EXPECT_EQ(selection.count(), expected.size());
+      EXPECT_EQ(selection.indices(), expected);
+    }
+    return expected.size();
+  };
+
+  ASSERT_GT(expect(where(&Vertex::z) > 64,
+                   [](const Vertex& v) { return v.z > 64; }),
+            0);
+  expect(where(&Vertex::x) >= 0.1,
+         [](const Vertex& v) { return double(v.x) >= 0.1; });
+  expect(where(&Vertex::z) > 64 && where(&Vertex::red).between(10, 200),
+         [](const Vertex& v) {
+           return v.z > 64 && v.red >= 10 && v.red <= 200;
+         });
+  expect(!(where(&Vertex::y) < 20) || where(&Vertex::blue) == 3,
+         [](const Vertex& v) { return !(v.y < 20) || v.blue == 3; });
+  expect(inside(&Vertex::x, &Vertex::y, &Vertex::z, {{10, 0, 20}},
+                {{60, 40, 100}}),
+         [](const Vertex& v) {
+           return v.x >= 10 && v.x <= 60 && v.y >= 0 && v.y <= 40 &&
+                  v.z >= 20 && v.z <= 100;
+         });
+  ASSERT_EQ(expect(where(&Vertex::red) > 300,
+                   [](const Vertex&) { return false; }),
+            0);
+  ASSERT_EQ(expect(where(&Vertex::red) >= -5,
+                   [](const Vertex&) { return true; }),
+            vertices.size());
+
+  // Selected elements feed gather()
+  const Selection selection = filter(vertices, where(&Vertex::z) > 64);
+  std::vector<unsigned char> out(selection.count() * sizeof(Vertex));
+  Vertex* gathered = reinterpret_cast<Vertex*>(&out[0]);
+  gather(vertices, selection, gathered);
+  const auto indices = selection.indices();
+  for (std::size_t k = 0; k < indices.size(); ++k)
+    ASSERT_EQ(gathered[k], vertices[indices[k]]);
+
+  // All field types, in both byte orders
+  FastPly<Alltypes> le, be;
+  ASSERT_EQ(le.open("test_alltypes.ply"), true);
+  ASSERT_EQ(be.open("test_alltypes_be.ply"), true);
+  const auto& all = le.get<Alltypes>();
+  const std::vector<Query<Alltypes>> queries = {
+      where(&Alltypes::c) >= -10, where(&Alltypes::uc).between(20, 130),
+      where(&Alltypes::s) < 100,  where(&Alltypes::us) > 1000,
+      where(&Alltypes::i) <= -3,  where(&Alltypes::ui) > 2147483648.0,
+      where(&Alltypes::f) > 0.5,  where(&Alltypes::d).between(-1, 1e3)};
+  std::vector<std::size_t> counts(queries.size(), 0);
+  for (const auto& a : all) {
+    counts[0] += a.c >= -10;
+    counts[1] += a.uc >= 20 && a.uc <= 130;
+    counts[2] += a.s < 100;
+    counts[3] += a.us > 1000;
+    counts[4] += a.i <= -3;
+    counts[5] += a.ui > 2147483648u;
+    counts[6] += a.f > 0.5;
+    counts[7] += a.d >= -1 && a.d <= 1e3;
+  }
+  for (std::size_t q = 0; q < queries.size(); ++q) {
+    ASSERT_EQ(filter(all, queries[q]).count(), counts[q]);
+    ASSERT_EQ(filter(be.get<Alltypes>(), queries[q]).indices(),
+              filter(all, queries[q]).indices());
+  }
+
+  // Blocks are stored as full, dense or sparse
+  const std::size_t B = Selection::blockSize();
+  Selection blocks(2 * B + 1000);
+  std::vector<std::uint64_t> words(B / 64, ~std::uint64_t(0));
+  blocks.setBlock(0, words.data());
+  std::fill(words.begin(), words.end(), 0xAAAAAAAAAAAAAAAAull);
+  blocks.setBlock(1, words.data());
+  std::fill(words.begin(), words.end(), 0);
+  words[3] = 0x5;
+  blocks.setBlock(2, words.data());
+  ASSERT_EQ(blocks.count(), B + B / 2 + 2);
+  ASSERT_EQ(blocks.bytes(), B / 8 + 2 * sizeof(std::uint16_t));
+  ASSERT_TRUE(blocks.contains(B - 1));
+  ASSERT_TRUE(blocks.contains(B + 1));
+  ASSERT_FALSE(blocks.contains(B + 2));
+  ASSERT_TRUE(blocks.contains(2 * B + 194));
+  ASSERT_FALSE(blocks.contains(2 * B + 193));
+  ASSERT_FALSE(blocks.contains(blocks.size()));
+}
+
+/********************************************************************
+ * Files written through the mapped writer must read back to the    *
+ * same elements, independent of the order lists are emitted in.    *
+ *******************************************************************/
+class FastPlyWriterTest : public testing::Test {
+  void SetUp() override { ASSERT_EQ(in.open("test_list.ply"), true); }
+
+  void TearDown() override { std::remove(path.c_str()); }
+
+ public:
+  FastPly<Vertex, PolyFace, TriFace, Camera> in;
+  const std::string path = "test_writer_out.ply";
+};
+
+TEST_F(FastPlyWriterTest, Header) {
+  FastPlyWriter<Vertex, PolyFace, Alltypes> out;
+  out.setCount<Vertex>(2);
+  out.setCount<PolyFace>(3, 9);
+  out.setCount<Alltypes>(1);
+  out.setPropertyNames<PolyFace>({"vertex_index"});
+  out.addComment("written by fastply");
+  const std::string header =
+      "ply\n"
+      "format binary_little_endian 1.0\n"
+      "comment written by fastply\n"
+      "element vertex 2\n"
+      "property float x\nproperty float y\nproperty float z\n"
+      "property float nx\nproperty float ny\nproperty float nz\n"
+      "property uchar red\nproperty uchar green\nproperty uchar blue\n"
+      "element polyface 3\n"
+      "property list uchar int vertex_index\n"
+      "element alltypes 1\n"
+      "property char c\nproperty uchar uc\nproperty short s\n"
+      "property ushort us\nproperty int i\nproperty uint ui\n"
+      "property float f\nproperty double d\n"
+      "end_header\n";
+  ASSERT_EQ(out.header(), header);
+
+  out.setPropertyNames<Vertex>({"x"});
+  ASSERT_THROW(out.header(), std::runtime_error);
+}
+
+TEST_F(FastPlyWriterTest, HeaderMemberOrder) {
+  FastPlyWriter<Reordered> out;
+  out.setCount<Reordered>(1);
+  const std::string header =
+      "ply\n"
+      "format binary_little_endian 1.0\n"
+      "element reordered 1\n"
+      "property uchar a\nproperty float b\n"
+      "end_header\n";
+  ASSERT_EQ(out.header(), header);
+}
+
+TEST_F(FastPlyWriterTest, RoundTrip) {
+  const auto& vertices = in.get<Vertex>();
+  const auto& faces = in.get<PolyFace>();
+
+  {
+    FastPlyWriter<Vertex, PolyFace> out;
+    out.setElementName<PolyFace>("face");
+    out.setCount<Vertex>(vertices.size());
+    const std::size_t num_values =
+        (faces.sizeBytes() - faces.size()) / sizeof(int32_t);
+    out.setCount<PolyFace>(faces.size(), num_values);
+    ASSERT_EQ(out.open(path), true);
+    ASSERT_EQ(out.isOpen(), true);
+
+    // Disjoint ranges from several threads, lists placed by value offset
+    auto& out_vertices = out.get<Vertex>();
+    auto& out_faces = out.get<PolyFace>();
+    std::vector<std::size_t> offsets(faces.size() + 1, 0);
+    for (std::size_t i = 0; i < faces.size(); ++i)
+      offsets[i + 1] = offsets[i] + faces[i].size();
+    ASSERT_EQ(offsets.back(), out_faces.numValues());
+
+    detail::runTasks(4, 4, [&](std::size_t task) {
+      for (std::size_t i = task; i < vertices.size(); i += 4)
+        out_vertices.set(i, vertices[i]);
+      for (std::size_t i = task; i < faces.size(); i += 4)
+        out_faces.set(i, offsets[i], faces[i].begin(), faces[i].size());
+    });
+    ASSERT_THROW(out_faces.set(faces.size(), 0, faces[0].begin(), 0),
+                 std::out_of_range);
+    ASSERT_THROW(out_vertices.copyFrom(1, vertices.data(), vertices.size()),
+                 std::out_of_range);
+  }
+
+  FastPly<Vertex, PolyFace> back;
+  ASSERT_EQ(back.open(path), true);
+  ASSERT_EQ(back.get<Vertex>().size(), vertices.size());
+  ASSERT_TRUE(std::equal(vertices.begin(), vertices.end(),
+                         back.get<Vertex>().begin()));
+  ASSERT_EQ(back.get<PolyFace>().size(), faces.size());
+  ASSERT_EQ(back.get<PolyFace>().sizeBytes(), faces.sizeBytes());
+  ASSERT_EQ(std::memcmp(back.get<PolyFace>().data(), faces.data(),
+                        faces.sizeBytes()),
+            0);
+}
+
+TEST_F(FastPlyWriterTest, Append) {
+  const auto& triangles = in.get<TriFace>();
+  {
+    FastPlyWriter<TriFace> out;
+    out.setCount<TriFace>(triangles.size(), 3 * triangles.size());
+    ASSERT_EQ(out.open(path), true);
+    for (const auto& triangle : triangles)
+      out.get<TriFace>().append(triangle.begin(), triangle.size());
+    ASSERT_THROW(out.get<TriFace>().append(triangles[0].begin(), 3),
+                 std::out_of_range);
+    out.close();
+    ASSERT_EQ(out.isOpen(), false);
+    ASSERT_EQ(out.get<TriFace>().size(), 0);
+  }
+
+  FastPly<TriFace> back;
+  ASSERT_EQ(back.open(path), true);
+  ASSERT_EQ(back.get<TriFace>().isUniform(), true);
+  for (std::size_t i = 0; i < triangles.size(); ++i)
+    ASSERT_TRUE(std::equal(triangles[i].begin(), triangles[i].end(),
+                           back.get<TriFace>()[i].begin()));
+}
+
+/********************************************************************
+ * External sorting and welding with runs much smaller than the     *
+ * input (several merge passes).                                    *
+ *******************************************************************/
+class FastPlySortTest : public testing::Test {
+  void SetUp() override {
+    // 3000 vertices, every one of the 1000 distinct ones three times
+    FastPly<Vertex, PolyFace, TriFace, Camera> in;
+    ASSERT_EQ(in.open("test_list.ply"), true);
+    const auto& vertices = in.get<Vertex>();
+    FastPlyWriter<Vertex, TriFace> out;
+    out.setCount<Vertex>(3000);
+    out.setCount<TriFace>(1000, 3000);
+    ASSERT_EQ(out.open(input), true);
+    for (std::size_t i = 0; i < 3000; ++i) {
+      Vertex v = vertices[(i * 7) % vertices.size()];
+      const float shift = static_cast<float>((i * 37) % 1000) / 8;
+      unsigned char* record =
+          reinterpret_cast<unsigned char*>(&out.get<Vertex>()[i]);
+      std::memcpy(record, &v, sizeof(Vertex));
+      std::memcpy(record, &shift, sizeof(float));  // x is the first member
+    }
+    for (std::int32_t i = 0; i < 1000; ++i) {
+      const std::int32_t face[3] = {i, i + 1000, (i * 7 + 2) % 3000};
+      out.get<TriFace>().append(face, 3);
+    }
+    out.close();
+    ASSERT_EQ(ply.open(input), true);
+
+    options.memory_limit = 1;  // 64 records per run
+    options.max_fan_in = 4;
+    options.threads = 2;
+  }
+
+  void TearDown() override {
+    std::remove(input.c_str());
+    std::remove(output.c_str());
+    std::remove(remap.c_str());
+  }
+
+ public:
+  const std::string input = "test_sort_in.ply";
+  const std::string output = "test_sort_out.ply";
+  const std::string remap = "test_sort_out.remap";
+  FastPly<Vertex, TriFace> ply;
+  SortOptions options;
+};
+
+TEST_F(FastPlySortTest, Sort) {
+  const auto& vertices = ply.get<Vertex>();
+  const auto key = mortonKey(vertices, &Vertex::x, &Vertex::y, &Vertex::z);
+  FastPlyWriter<Vertex, TriFace> out;
+  sortElements<Vertex>(ply, out, output, key, options);
+
+  FastPly<Vertex, TriFace> sorted;
+  ASSERT_EQ(sorted.open(output), true);
+  const auto& result = sorted.get<Vertex>();
+  ASSERT_EQ(result.size(), vertices.size());
+  for (std::size_t i = 1; i < result.size(); ++i)
+    ASSERT_LE(key(result[i - 1]), key(result[i]));
+  // A permutation of the input, faces untouched
+  for (const auto& v : vertices)
+    ASSERT_EQ(std::count(result.begin(), result.end(), v),
+              std::count(vertices.begin(), vertices.end(), v));
+  ASSERT_EQ(std::memcmp(sorted.get<TriFace>().data(),
+                        ply.get<TriFace>().data(),
+                        ply.get<TriFace>().sizeBytes()),
+            0);
+}
+
+TEST_F(FastPlySortTest, Weld) {
+  const auto& vertices = ply.get<Vertex>();
+  FastPlyWriter<Vertex, TriFace> out;
+  WeldOptions weld;
+  weld.sort = options;
+  weld.remap_path = remap;
+  ASSERT_EQ((weldVertices<Vertex, TriFace>(ply, out, output, weld)), 1000);
+
+  FastPly<Vertex, TriFace> welded;
+  ASSERT_EQ(welded.open(output), true);
+  const auto& result = welded.get<Vertex>();
+  ASSERT_EQ(result.size(), 1000);
+  for (std::size_t i = 1; i < result.size(); ++i)
+    ASSERT_TRUE(result[i - 1] < result[i]);
+
+  // Faces refer to equal vertices through the remap table
+  const auto& faces = ply.get<TriFace>();
+  const auto& remapped = welded.get<TriFace>();
+  ASSERT_EQ(remapped.size(), faces.size());
+  for (std::size_t f = 0; f < faces.size(); ++f)
+    for (std::size_t k = 0; k < 3; ++k)
+      ASSERT_EQ(result[remapped[f][k]], vertices[faces[f][k]]);
+
+  std::ifstream table(remap, std::ios::binary);
+  std::vector<std::uint64_t> indices(vertices.size());
+  table.read(reinterpret_cast<char*>(indices.data()),
+             indices.size() * sizeof(std::uint64_t));
+  ASSERT_TRUE(table.good());
+  for (std::size_t i = 0; i < vertices.size(); ++i)
+    ASSERT_EQ(result[indices[i]], vertices[i]);
+}
+
+TEST_F(FastPlySortTest, ByteOrder) {
+  // Big endian input is sorted (and written) in host byte order
+  FastPly<Alltypes> in;
+  ASSERT_EQ(in.open("test_alltypes_be.ply"), true);
+  FastPlyWriter<Alltypes> out;
+  auto key = [](const Alltypes& a) { return std::make_tuple(a.uc, a.i); };
+  sortElements<Alltypes>(in, out, output, key, options);
+
+  FastPly<Alltypes> sorted;
+  ASSERT_EQ(sorted.open(output), true);
+  ASSERT_EQ(sorted.needsByteSwap(), false);
+  const auto native = in.get<Alltypes>().native();
+  const auto& result = sorted.get<Alltypes>();
+  ASSERT_EQ(result.size(), native.size());
+  for (std::size_t i = 1; i < result.size(); ++i)
+    ASSERT_FALSE(key(result[i]) < key(result[i - 1]));
+  for (std::size_t i = 0; i < native.size(); ++i)
+    ASSERT_EQ(std::count(result.begin(), result.end(), native[i]),
+              std::count(native.begin(), native.end(), native[i]));
+}
+
+/********************************************************************
+ * Streaming from pipes through a small ring buffer must yield the  *
+ * same records as the memory mapping.                              *
+ *******************************************************************/
+class FastPlyStreaming : public testing::Test {
+ public:
+  ~FastPlyStreaming() override {
+    if (writer.joinable())
+      writer.join();
+  }
+
+  // Feeds the file through a pipe in small writes from another thread
+  int feed(const std::string& path) {
+    std::ifstream is(path, std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(is),
+                std::istreambuf_iterator<char>());
+    int fds[2];
+    if (pipe(fds) != 0)
+      throw std::system_error(errno, std::generic_category());
+    const int out = fds[1];
+    writer = std::thread([this, out] {
+      for (std::size_t i = 0; i < data.size(); i += 97) {
+        const std::size_t n = std::min<std::size_t>(97, data.size() - i);
+        if (::write(out, data.data() + i, n) != ssize_t(n))
+          break;
+      }
+      ::close(out);
+    });
+    return fds[0];
+  }
+
+  std::vector<char> data;
+  std::thread writer;
+};
+
+TEST_F(FastPlyStreaming, Pipe) {
+  FastPly<Vertex, Camera, Alltypes, Face> reference;
+  ASSERT_EQ(reference.open("test_many.ply"), true);
+  const int fd = feed("test_many.ply");
+  StreamOptions options;
+  options.buffer_size = 2048;  // the vertex block wraps around many times
+  FastPlyStream<Vertex, Camera, Alltypes, Face> stream(options);
+  ASSERT_EQ(stream.open(fd), true);
+  ASSERT_EQ(stream.size<Vertex>(), reference.get<Vertex>().size());
+
+  const auto& vertices = reference.get<Vertex>();
+  std::size_t i = 0;
+  bool equal = true;
+  ASSERT_EQ(stream.forEach<Vertex>([&](const Vertex& v) {
+    equal = equal && v == vertices[i++];
+  }), vertices.size());
+  ASSERT_TRUE(equal);
+  ASSERT_EQ(stream.remaining<Vertex>(), 0);
+
+  ASSERT_EQ(stream.remaining<Camera>(), 1);
+  ASSERT_EQ(stream.next<Camera>(), reference.get<Camera>()[0]);
+  ASSERT_THROW(stream.next<Camera>(), std::out_of_range);
+
+  // Skips the (empty) alltypes block
+  const auto& faces = reference.get<Face>();
+  std::size_t chunks = 0;
+  i = 0;
+  ASSERT_EQ(stream.forEachChunk<Face>([&](const Face* f, std::size_t n) {
+    ++chunks;
+    equal = equal && std::equal(f, f + n, faces.begin() + i);
+    i += n;
+  }), faces.size());
+  ASSERT_TRUE(equal);
+  ASSERT_LT(chunks, faces.size());
+  ASSERT_THROW(stream.forEach<Vertex>([](const Vertex&) {}),
+               std::runtime_error);
+  stream.close();
+  ::close(fd);
+}
+
+TEST_F(FastPlyStreaming, Lists) {
+  for (const char* path : {"test_list.ply", "test_list_be.ply"}) {
+    FastPly<Vertex, PolyFace, TriFace, Camera> reference;
+    ASSERT_EQ(reference.open(path), true);
+    const int fd = feed(path);
+    StreamOptions options;
+    options.buffer_size = 1024;
+    FastPlyStream<Vertex, PolyFace, TriFace, Camera> stream(options);
+    ASSERT_EQ(stream.open(fd), true);
+    ASSERT_EQ(stream.needsByteSwap(), reference.needsByteSwap());
+
+    // Skips the vertices
+    const auto& poly = reference.get<PolyFace>();
+    for (std::size_t i = 0; i < poly.size(); ++i) {
+      const auto face = stream.next<PolyFace>();
+      ASSERT_TRUE(std::equal(face.begin(), face.end(), poly[i].begin(),
+                             poly[i].end()));
+    }
+    const auto& tri = reference.get<TriFace>();
+    std::size_t i = 0;
+    bool equal = true;
+    ASSERT_EQ(stream.forEach<TriFace>([&](PlyListView<int32_t> face) {
+      equal = equal && std::equal(face.begin(), face.end(), tri[i].begin(),
+                                  tri[i].end());
+      ++i;
+    }), tri.size());
+    ASSERT_TRUE(equal);
+    ASSERT_EQ(stream.next<Camera>(), reference.get<Camera>()[0]);
+    stream.close();
+    ::close(fd);
+    writer.join();
+  }
+
+  StreamOptions options;
+  options.buffer_size = 64;
+  FastPlyStream<Vertex, PolyFace, TriFace, Camera> stream(options);
+  const int fd = feed("test_list.ply");
+  ASSERT_THROW(stream.open(fd), std::runtime_error);
+  char drain[4096];
+  while (::read(fd, drain, sizeof(drain)) > 0) {
+  }
+  ::close(fd);
+}
+
+// Records are passed as stored, hence cannot be shuffled
+TEST_F(FastPlyStreaming, ShuffledElements) {
+  FastPlyStream<Splat, Camera, Alltypes, Face> stream;
+  ASSERT_THROW(stream.open("test_many.ply"), std::runtime_error);
+}
+
+#ifdef FASTPLY_HAS_ZLIB
+/********************************************************************
+ * Block compressed files must read back through random access and  *
+ * the block cache to the records of the source file.               *
+ *******************************************************************/
+class FastPlyCompressedTest : public testing::Test {
+ public:
+  ~FastPlyCompressedTest() override { std::remove(path.c_str()); }
+
+  CompressOptions options() const {
+    CompressOptions options;
+    options.block_size = 4096;  // many blocks, records straddle them
+    options.level = 1;
+    options.threads = 2;
+    return options;
+  }
+
+  std::string path = "test_compressed.plyz";
+};
+
+TEST_F(FastPlyCompressedTest, Elements) {
+  for (const char* src : {"test_many.ply", "test_many_be.ply",
+                          "test_many_ascii.ply"}) {
+    compressPly<Vertex, Camera, Alltypes, Face>(src, path, options());
+    FastPly<Vertex, Camera, Alltypes, Face> reference;
+    ASSERT_EQ(reference.open(src), true);
+
+    CompressedOpenOptions open_options;
+    open_options.cache_blocks = 2;
+    FastPlyCompressed<Vertex, Camera, Alltypes, Face> ply;
+    ASSERT_EQ(ply.open(path, open_options), true);
+    ASSERT_GT(ply.numBlocks(), 4);
+    ASSERT_EQ(ply.needsByteSwap(), !reference.isAscii() &&
+                                       reference.needsByteSwap());
+
+    const auto& vertices = ply.get<Vertex>();
+    const auto& expected = reference.get<Vertex>();
+    ASSERT_EQ(vertices.size(), expected.size());
+    ASSERT_TRUE(std::equal(vertices.begin(), vertices.end(),
+                           expected.begin(), expected.end()));
+    // Random access in both directions, beyond the cache capacity
+    for (std::size_t i = expected.size(); i-- > 0;) {
+      const std::size_t j = (i * 7919) % expected.size();
+      ASSERT_EQ(vertices[i], expected[i]);
+      ASSERT_EQ(vertices[j], expected[j]);
+    }
+    ASSERT_EQ(vertices.end() - vertices.begin(), expected.size());
+    ASSERT_EQ(*(vertices.begin() + 1000), expected[1000]);
+    ASSERT_THROW(vertices.at(expected.size()), std::out_of_range);
+
+    const std::size_t num_faces = ply.get<Face>().size();
+    std::vector<unsigned char> faces(num_faces * sizeof(Face));
+    ply.get<Face>().copyTo(0, num_faces, reinterpret_cast<Face*>(&faces[0]));
+    ASSERT_EQ(std::memcmp(faces.data(), &reference.get<Face>()[0],
+                          faces.size()), 0);
+    ASSERT_EQ(ply.get<Camera>()[0], reference.get<Camera>()[0]);
+    ASSERT_TRUE(ply.get<Alltypes>().empty());
+  }
+
+  // Plain readers refuse the compressed file
+  FastPly<Vertex, Camera, Alltypes, Face> plain;
+  ASSERT_THROW(plain.open(path), std::runtime_error);
+  FastPlyCompressed<Vertex, Camera, Alltypes, Face> ply;
+  ASSERT_EQ(ply.open("test_many.ply"), false);
+}
+
+TEST_F(FastPlyCompressedTest, Lists) {
+  for (const char* src : {"test_list.ply", "test_list_be.ply"}) {
+    CompressOptions small = options();
+    small.block_size = 256;  // raised to the minimum block size
+    compressPly<Vertex, PolyFace, TriFace, Camera>(src, path, small);
+    FastPly<Vertex, PolyFace, TriFace, Camera> reference;
+    ASSERT_EQ(reference.open(src), true);
+    FastPlyCompressed<Vertex, PolyFace, TriFace, Camera> ply;
+    ASSERT_EQ(ply.open(path), true);
+    ASSERT_EQ(ply.blockSize(), 4096);
+
+    const auto& poly = reference.get<PolyFace>();
+    const auto& lists = ply.get<PolyFace>();
+    ASSERT_EQ(lists.size(), poly.size());
+    std::size_t i = 0;
+    for (const auto& face : lists) {
+      ASSERT_TRUE(std::equal(face.begin(), face.end(), poly[i].begin(),
+                             poly[i].end()));
+      ++i;
+    }
+    for (std::size_t j = poly.size(); j-- > 0;) {
+      const auto face = lists[j];
+      ASSERT_TRUE(std::equal(face.begin(), face.end(), poly[j].begin(),
+                             poly[j].end()));
+    }
+    const auto last = ply.get<TriFace>().back();
+    const auto expected = reference.get<TriFace>().back();
+    ASSERT_TRUE(std::equal(last.begin(), last.end(), expected.begin(),
+                           expected.end()));
+    ASSERT_EQ(ply.get<Camera>()[0], reference.get<Camera>()[0]);
+  }
+}
+
+TEST_F(FastPlyCompressedTest, CorruptBlockOffsets) {
+  compressPly<Vertex, Camera, Alltypes, Face>("test_many.ply", path,
+                                              options());
+  std::size_t num_blocks = 0;
+  {
+    FastPlyCompressed<Vertex, Camera, Alltypes, Face> ply;
+    ASSERT_EQ(ply.open(path), true);
+    num_blocks = ply.numBlocks();
+  }
+  std::vector<char> file;
+  {
+    std::ifstream is(path, std::ios::binary);
+    file.assign(std::istreambuf_iterator<char>(is),
+                std::istreambuf_iterator<char>());
+  }
+
+  // The first block starts right after its offsets
+  std::size_t table = 0;
+  for (std::size_t p = 0; p + 8 <= file.size(); ++p) {
+    std::uint64_t offset;
+    std::memcpy(&offset, &file[p], 8);
+    if (offset == p + (num_blocks + 1) * 8) {
+      table = p;
+      break;
+    }
+  }
+  ASSERT_NE(table, 0);
+  std::uint64_t first;
+  std::memcpy(&first, &file[table], 8);
+  const std::uint64_t descending = first - 1;
+  std::memcpy(&file[table + 8], &descending, 8);
+  {
+    std::ofstream os(path, std::ios::binary | std::ios::trunc);
+    os.write(file.data(), static_cast<std::streamsize>(file.size()));
+  }
+  FastPlyCompressed<Vertex, Camera, Alltypes, Face> ply;
+  ASSERT_THROW(ply.open(path), std::runtime_error);
+}
+
+// Element offsets and list checkpoints are checked before use
+TEST_F(FastPlyCompressedTest, CorruptElementTable) {
+  // Overwrites entry k of the element offsets and checkpoints
+  auto corrupt = [this](std::size_t k, std::uint64_t value) {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    const std::string text((std::istreambuf_iterator<char>(file)),
+                           std::istreambuf_iterator<char>());
+    const std::size_t table = text.find("FPLYBLK");
+    ASSERT_NE(table, std::string::npos);
+    file.seekp(static_cast<std::streamoff>(
+        table + sizeof(detail::BlockTableHeader) + k * 8));
+    file.write(reinterpret_cast<const char*>(&value), 8);
+  };
+
+  // Vertices overlapping the camera
+  compressPly<Vertex, Camera, Alltypes, Face>("test_many.ply", path,
+                                              options());
+  corrupt(1, 8);
+  FastPlyCompressed<Vertex, Camera, Alltypes, Face> ply;
+  ASSERT_THROW(ply.open(path), std::runtime_error);
+  ASSERT_EQ(ply.get<Vertex>().size(), 0);
+
+  // Element beyond the body
+  compressPly<Vertex, Camera, Alltypes, Face>("test_many.ply", path,
+                                              options());
+  corrupt(4, std::uint64_t(1) << 40);
+  ASSERT_THROW(ply.open(path), std::runtime_error);
+
+  // Checkpoint of the first list element beyond its element
+  compressPly<Vertex, PolyFace, TriFace, Camera>("test_list.ply", path,
+                                                 options());
+  corrupt(5, std::uint64_t(1) << 40);
+  FastPlyCompressed<Vertex, PolyFace, TriFace, Camera> lists;
+  ASSERT_THROW(lists.open(path), std::runtime_error);
+}
+
+// Blocks hold records as stored, hence cannot serve shuffled elements
+TEST_F(FastPlyCompressedTest, ShuffledElements) {
+  ASSERT_THROW((compressPly<Splat, Camera, Alltypes, Face>("test_many.ply",
+                                                           path, options())),
+               std::runtime_error);
+  compressPly<Vertex, Camera, Alltypes, Face>("test_many.ply", path,
+                                              options());
+  FastPlyCompressed<Splat, Camera, Alltypes, Face> ply;
+  ASSERT_THROW(ply.open(path), std::runtime_error);
+}
+#endif
+
+/********************************************************************
+ * Asynchronous reads (io_uring or pread pool) must return the same *
+ * records as the memory mapping.                                   *
+ *******************************************************************/
+class FastPlyAsyncTest : public testing::Test {};
+
+TEST_F(FastPlyAsyncTest, Reads) {
+  for (AsyncBackend backend : {AsyncBackend::Pread, AsyncBackend::Auto}) {
+    for (const char* path : {"test_many.ply", "test_many_be.ply"}) {
+      FastPly<Vertex, Camera, Alltypes, Face> reference;
+      ASSERT_EQ(reference.open(path), true);
+      const auto& vertices = reference.get<Vertex>();
+
+      AsyncOptions options;
+      options.backend = backend;
+      options.queue_depth = 4;
+      options.buffer_size = 4096;  // 151 vertices per read
+      FastPlyAsync<Vertex, Camera, Alltypes, Face> ply;
+      ASSERT_EQ(ply.open(path, options), true);
+      ASSERT_EQ(ply.needsByteSwap(), reference.needsByteSwap());
+      ASSERT_EQ(ply.size<Vertex>(), vertices.size());
+      ASSERT_EQ(ply.maxRecords<Vertex>(), 151);
+
+      std::vector<std::uint64_t> ids;
+      for (std::size_t first : {0, 1000, 7, 1231})
+        ids.push_back(ply.read<Vertex>(first, std::min<std::size_t>(
+                                                  100, 1232 - first)));
+      ASSERT_EQ(ply.read<Face>(0, 1), 0);  // all buffers in use
+      ASSERT_THROW(ply.read<Vertex>(1200, 33), std::out_of_range);
+      ASSERT_THROW(ply.read<Vertex>(0, 152), std::out_of_range);
+
+      std::vector<AsyncCompletion> completions;
+      while (completions.size() < ids.size())
+        ply.wait(completions);
+      for (const auto& completion : completions) {
+        ASSERT_EQ(completion.error, 0);
+        ASSERT_NE(std::find(ids.begin(), ids.end(), completion.id),
+                  ids.end());
+        ASSERT_EQ(std::memcmp(completion.data, &vertices[completion.first],
+                              completion.count * sizeof(Vertex)),
+                  0);
+        ply.release(completion);
+      }
+      ASSERT_EQ(ply.inFlight(), 0);
+
+      std::size_t next = 0;
+      ply.forEachChunk<Vertex>(0, vertices.size(),
+                               [&](const Vertex* records, std::size_t n) {
+                                 ASSERT_EQ(std::memcmp(records, &vertices[next],
+                                                       n * sizeof(Vertex)),
+                                           0);
+                                 next += n;
+                               });
+      ASSERT_EQ(next, vertices.size());
+
+      const auto& faces = reference.get<Face>();
+      ASSERT_NE(ply.read<Face>(0, faces.size()), 0);
+      completions.clear();
+      ply.wait(completions);
+      ASSERT_EQ(std::memcmp(completions[0].data, &faces[0],
+                            faces.size() * sizeof(Face)),
+                0);
+      ply.release(completions[0]);
+    }
+  }
+
+  // Elements behind list elements are located by scanning the lists
+  FastPly<Vertex, PolyFace, TriFace, Camera> reference;
+  ASSERT_EQ(reference.open("test_list_be.ply"), true);
+  FastPlyAsync<Vertex, PolyFace, TriFace, Camera> ply;
+  ASSERT_EQ(ply.open("test_list_be.ply"), true);
+  ASSERT_NE(ply.read<Camera>(0, 1), 0);
+  std::vector<AsyncCompletion> completions;
+  ply.wait(completions);
+  ASSERT_EQ(std::memcmp(completions[0].data, &reference.get<Camera>()[0],
+                        sizeof(Camera)),
+            0);
+}
+
+TEST_F(FastPlyAsyncTest, ShuffledElements) {
+  FastPlyAsync<Splat, Camera, Alltypes, Face> ply;
+  ASSERT_THROW(ply.open("test_many.ply"), std::runtime_error);
+}
+
+/********************************************************************
+ * Datasets of several files behave like one file with all elements *
+ * concatenated.                                                    *
+ *******************************************************************/
+class FastPlyDatasetTest : public testing::Test {};
+
+TEST_F(FastPlyDatasetTest, GlobalIndex) {
+  FastPly<Vertex, Camera, Alltypes, Face> reference;
+  ASSERT_EQ(reference.open("test_many.ply"), true);
+  const auto& expected = reference.get<Vertex>();
+
+  DatasetOptions options;
+  options.max_open = 1;
+  FastPlyDataset<Vertex, Camera, Alltypes, Face> dataset;
+  ASSERT_EQ(dataset.open({"test_many.ply", "test_many_ascii.ply",
+                          "test_many.ply"},
+                         options),
+            true);
+  ASSERT_EQ(dataset.numShards(), 3);
+  ASSERT_EQ(dataset.numOpen(), 0);  // shards are mapped on first access
+
+  const auto& vertices = dataset.get<Vertex>();
+  ASSERT_EQ(vertices.size(), 3 * expected.size());
+  ASSERT_EQ(dataset.get<Camera>().size(), 3);
+  ASSERT_EQ(vertices.locate(expected.size() + 5),
+            std::make_pair(std::size_t(1), std::size_t(5)));
+  ASSERT_EQ(vertices.shardOffset(2), 2 * expected.size());
+  for (std::size_t i = 0; i < vertices.size(); i += 97)
+    ASSERT_EQ(vertices[i], expected[i % expected.size()]);
+  ASSERT_EQ(vertices.back(), expected.back());
+  ASSERT_THROW(vertices.at(vertices.size()), std::out_of_range);
+  ASSERT_EQ(dataset.numOpen(), 1);
+
+  // A pinned shard stays mapped beyond the limit
+  const auto first = dataset.shard(0);
+  ASSERT_EQ(dataset.shard(2)->get<Vertex>().size(), expected.size());
+  ASSERT_EQ(first->get<Vertex>()[7], expected[7]);
+
+  auto pred = [](const Vertex& v) { return v.x < 64; };
+  const std::size_t count =
+      std::count_if(expected.begin(), expected.end(), pred);
+  ASSERT_EQ(parallel_count_if(vertices, pred, 2), 3 * count);
+  const double sum = parallel_transform_reduce(
+      vertices, 0.0, std::plus<double>(),
+      [](const Vertex& v) { return double(v.z); }, 2);
+  double expected_sum = 0;
+  for (const auto& v : expected)
+    expected_sum += v.z;
+  ASSERT_DOUBLE_EQ(sum, 3 * expected_sum);
+  ASSERT_LE(dataset.numOpen(), 2);
+}
+
+TEST_F(FastPlyDatasetTest, Lists) {
+  FastPly<Vertex, PolyFace, TriFace, Camera> reference;
+  ASSERT_EQ(reference.open("test_list.ply"), true);
+  const auto& expected = reference.get<PolyFace>();
+
+  FastPlyDataset<Vertex, PolyFace, TriFace, Camera> dataset;
+  ASSERT_EQ(dataset.openGlob("test_list.ply"), true);
+  const auto& faces = dataset.get<PolyFace>();
+  ASSERT_EQ(faces.size(), expected.size());
+  for (std::size_t i = 0; i < faces.size(); ++i) {
+    const auto face = faces[i];
+    ASSERT_TRUE(std::equal(face.begin(), face.end(), expected[i].begin(),
+                           expected[i].end()));
+  }
+  std::atomic<std::size_t> indices{0};
+  parallel_for_each(faces, [&](PlyListView<int32_t> face) {
+    indices += face.size();
+  });
+  std::size_t expected_indices = 0;
+  for (const auto& face : expected)
+    expected_indices += face.size();
+  ASSERT_EQ(indices, expected_indices);
+
+  // Big endian shards do not match the schema of the others
+  ASSERT_THROW(dataset.openGlob("test_list*.ply"), std::runtime_error);
+  ASSERT_EQ(dataset.numShards(), 0);
+  ASSERT_EQ(dataset.openGlob("test_list_no_such_file*.ply"), true);
+  ASSERT_TRUE(dataset.get<PolyFace>().empty());
+}
+
 /********************************************************************
  * Test class when no template arguments are provided (ply file     *
  * without any element definitions.                                 *
@@ -187,4 +2181,4 @@ TEST_F(FastPlyMultiInstance, PointerState) {
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
-}
\ No newline at end of file
+}